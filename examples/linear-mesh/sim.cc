@@ -95,7 +95,8 @@ Ptr<OpenGymDataContainer> MyGetObservation(void)
 {
   uint32_t nodeNum = NodeList::GetNNodes ();
   std::vector<uint32_t> shape = {nodeNum,};
-  Ptr<OpenGymBoxContainer<uint32_t> > box = CreateObject<OpenGymBoxContainer<uint32_t> >(shape);
+  // recycled from the previous steps, see OpenGymContainerPool
+  Ptr<OpenGymBoxContainer<uint32_t> > box = OpenGymDataContainer::Acquire<OpenGymBoxContainer<uint32_t> >(shape);
 
   for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i) {
     Ptr<Node> node = *i;
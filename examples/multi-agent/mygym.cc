@@ -37,6 +37,8 @@ MyGymEnv::MyGymEnv ()
 {
   NS_LOG_FUNCTION (this);
   m_interval = Seconds(0.1);
+  m_boxSlot = 0;
+  m_discreteSlot = 0;
 
   Simulator::Schedule (Seconds(0.0), &MyGymEnv::ScheduleNextStateRead, this);
 }
@@ -46,6 +48,8 @@ MyGymEnv::MyGymEnv (uint32_t agentId, Time stepTime)
   NS_LOG_FUNCTION (this);
   m_agentId = agentId;
   m_interval = stepTime;
+  m_boxSlot = 0;
+  m_discreteSlot = 0;
 
   Simulator::Schedule (Seconds(0.0), &MyGymEnv::ScheduleNextStateRead, this);
 }
@@ -121,6 +125,8 @@ MyGymEnv::GetActionSpace()
   Ptr<OpenGymDictSpace> space = CreateObject<OpenGymDictSpace> ();
   space->Add("box", box);
   space->Add("discrete", discrete);
+  m_boxSlot = space->GetSlot("box");
+  m_discreteSlot = space->GetSlot("discrete");
 
   NS_LOG_UNCOND ("AgentID: " << m_agentId << " MyGetActionSpace: " << space);
   return space;
@@ -211,8 +217,8 @@ bool
 MyGymEnv::ExecuteActions(Ptr<OpenGymDataContainer> action)
 {
   Ptr<OpenGymDictContainer> dict = DynamicCast<OpenGymDictContainer>(action);
-  Ptr<OpenGymBoxContainer<uint32_t> > box = DynamicCast<OpenGymBoxContainer<uint32_t> >(dict->Get("box"));
-  Ptr<OpenGymDiscreteContainer> discrete = DynamicCast<OpenGymDiscreteContainer>(dict->Get("discrete"));
+  Ptr<OpenGymBoxContainer<uint32_t> > box = DynamicCast<OpenGymBoxContainer<uint32_t> >(dict->Get(m_boxSlot));
+  Ptr<OpenGymDiscreteContainer> discrete = DynamicCast<OpenGymDiscreteContainer>(dict->Get(m_discreteSlot));
 
   NS_LOG_UNCOND ("AgentID: " << m_agentId << " MyExecuteActions: " << action);
   NS_LOG_UNCOND ("---" << box);
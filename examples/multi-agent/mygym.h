@@ -49,6 +49,9 @@ private:
 
   uint32_t m_agentId;
   Time m_interval;
+  // slots of the action space keys
+  uint32_t m_boxSlot;
+  uint32_t m_discreteSlot;
 };
 
 }
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+import argparse
+import time
+from ns3gym import ns3_multiagent_env as ns3env
+
+__author__ = "ZhangminWang"
+__copyright__ = "Copyright (c) 2019"
+__version__ = "0.1.1"
+
+# Loopback benchmark: steps per second of the same multigym simulation
+# with the ZMQ (tcp://localhost) and the shared memory transport.
+
+parser = argparse.ArgumentParser(description='Compare ns3gym transports')
+parser.add_argument('--steps',
+                    type=int,
+                    default=2000,
+                    help='Number of steps per transport, Default: 2000')
+parser.add_argument('--transports',
+                    type=str,
+                    default='tcp,shm',
+                    help='Comma separated transports, Default: tcp,shm')
+args = parser.parse_args()
+
+stepTime = 0.001  # seconds
+simArgs = {"--simTime": args.steps * stepTime * 2,
+           "--stepTime": stepTime}
+
+
+def run(transport, steps):
+    env = ns3env.MultiEnv(port=0, stepTime=stepTime, startSim=True, simSeed=0,
+                          simArgs=simArgs, debug=False, transport=transport)
+    env.reset()
+    agent_num = len(env.action_space)
+    actions = [env.action_space[ag].sample() for ag in range(agent_num)]
+    try:
+        start = time.time()
+        for _ in range(steps):
+            env.step(actions)
+        elapsed = time.time() - start
+    finally:
+        env.close()
+    return steps / elapsed
+
+
+results = {}
+for transport in args.transports.split(','):
+    results[transport] = run(transport, args.steps)
+    print("%s: %.1f steps/s" % (transport, results[transport]))
+
+if 'tcp' in results and 'shm' in results:
+    print("shm speedup over tcp://localhost: %.2fx" % (results['shm'] / results['tcp']))
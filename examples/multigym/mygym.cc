@@ -138,13 +138,15 @@ MyGymEnv::GetObservation (uint32_t id)
   Ptr<UniformRandomVariable> rngInt = CreateObject<UniformRandomVariable> ();
 
   std::vector<uint32_t> shape = {1};
-  Ptr<OpenGymBoxContainer<uint32_t>> box = CreateObject<OpenGymBoxContainer<uint32_t>> (shape);
+  // recycled from the previous steps, see OpenGymContainerPool
+  Ptr<OpenGymBoxContainer<uint32_t>> box =
+      OpenGymDataContainer::Acquire<OpenGymBoxContainer<uint32_t>> (shape);
 
   // generate random data
   uint32_t value = rngInt->GetInteger (low, high);
   box->AddValue (value);
 
-  Ptr<OpenGymTupleContainer> data = CreateObject<OpenGymTupleContainer> ();
+  Ptr<OpenGymTupleContainer> data = OpenGymDataContainer::Acquire<OpenGymTupleContainer> ();
   data->Add (box);
 
   // Print data from tuple
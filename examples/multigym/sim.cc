@@ -35,7 +35,7 @@ main (int argc, char *argv[])
   double simulationTime = 1; //seconds
   double envStepTime = 0.1; //seconds, ns3gym env step time interval
   uint32_t testArg = 0;
-  uint32_t openGymPort;
+  uint32_t openGymPort = 5555;
 
   CommandLine cmd;
   // required parameters for OpenGym interface
@@ -58,6 +58,7 @@ main (int argc, char *argv[])
 
   // OpenGym MultiEnv
   Ptr<MyGymEnv> myGymEnv = CreateObject<MyGymEnv> (Seconds (envStepTime));
+  myGymEnv->SetOpenGymPort (openGymPort);
   for (uint32_t id = 1; id < 11; id++)
     {
       myGymEnv->AddAgentId (id);
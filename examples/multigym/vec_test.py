@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+import argparse
+from ns3gym import ns3_vec_multiagent_env as vecenv
+
+__author__ = "ZhangminWang"
+__copyright__ = "Copyright (c) 2019"
+__version__ = "0.1.1"
+
+# NOTE: This is only a test, not use algorithm
+# Step several multigym simulations from one process.
+
+parser = argparse.ArgumentParser(description='Vectorized multi-agent env')
+parser.add_argument('--envs',
+                    type=int,
+                    default=4,
+                    help='Number of simulations, Default: 4')
+parser.add_argument('--steps',
+                    type=int,
+                    default=100,
+                    help='Number of steps, Default: 100')
+args = parser.parse_args()
+
+simTime = 5 # seconds
+stepTime = 0.5  # seconds
+seed = 1
+simArgs = {"--simTime": simTime,
+           "--stepTime": stepTime,
+           "--testArg": 123}
+
+env = vecenv.VecMultiEnv(args.envs, stepTime=stepTime, startSim=True, simSeed=seed, simArgs=simArgs)
+obs = env.reset()
+ac_spaces = env.action_space
+print("Observation shape: ", obs.shape)
+
+try:
+    for stepIdx in range(args.steps):
+        actions = [[space.sample() for space in ac_spaces] for _ in range(args.envs)]
+        obs, reward, done, info = env.step(actions)
+        print("Step: ", stepIdx, " reward: ", reward.mean(axis=1))
+        for i in range(args.envs):
+            if 'terminal_observation' in info[i]:
+                print("---env ", i, " restarted")
+
+except KeyboardInterrupt:
+    print("Ctrl-C -> Exit")
+finally:
+    env.close()
+    print("Done")
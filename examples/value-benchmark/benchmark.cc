@@ -0,0 +1,161 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2018 Piotr Gawlowicz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Piotr Gawlowicz <gawlowicz.p@gmail.com>
+ *
+ */
+
+/*
+ * Agent-steps per second of the simulation side of a step without the
+ * transport: build the observation of every agent, fill its message and
+ * decode a Discrete action, once with OpenGymDataContainer objects (new
+ * ones per step and recycled by an OpenGymContainerPool) and once with the
+ * opengym value types.
+ *
+ *   ./waf --run "opengym-value-benchmark --agents=100 --steps=1000 --obsLen=8"
+ */
+
+#include <chrono>
+#include <iostream>
+#include "ns3/core-module.h"
+#include "ns3/opengym-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymValueBenchmark");
+
+namespace {
+
+struct Setup
+{
+  uint32_t agents;
+  uint32_t steps;
+  uint32_t obsLen;
+  uint32_t rawTensorVersion;
+  // one state message field and one action per agent, reused like the interface does
+  std::vector<ns3opengym::DataContainer> obsMsgs;
+  ns3opengym::DataContainer actMsg;
+};
+
+double
+ElapsedSeconds (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+// \return checksum of the executed actions, keeps the work from being optimized out
+uint64_t
+RunContainers (Setup &setup, bool pooled)
+{
+  Ptr<OpenGymContainerPool> pool = Create<OpenGymContainerPool> ();
+  if (pooled)
+    {
+      OpenGymContainerPool::SetCurrent (PeekPointer (pool));
+    }
+  std::vector<uint32_t> shape (1, setup.obsLen);
+  uint64_t checksum = 0;
+  for (uint32_t step = 0; step < setup.steps; step++)
+    {
+      pool->ReleaseStep ();
+      for (uint32_t agent = 0; agent < setup.agents; agent++)
+        {
+          Ptr<OpenGymBoxContainer<float> > obs =
+              OpenGymDataContainer::Acquire<OpenGymBoxContainer<float> > (shape);
+          for (uint32_t i = 0; i < setup.obsLen; i++)
+            {
+              obs->AddValue (agent + i + step);
+            }
+          obs->FillDataContainerPbMsg (setup.obsMsgs[agent], setup.rawTensorVersion);
+
+          Ptr<OpenGymDiscreteContainer> action = DynamicCast<OpenGymDiscreteContainer> (
+              OpenGymDataContainer::CreateFromDataContainerPbMsg (setup.actMsg));
+          checksum += action->GetValue ();
+        }
+    }
+  OpenGymContainerPool::SetCurrent (0);
+  return checksum;
+}
+
+uint64_t
+RunValues (Setup &setup)
+{
+  opengym::Box<float> box (std::vector<uint32_t> (1, setup.obsLen));
+  std::vector<opengym::Data> obs (setup.agents);
+  opengym::Data action;
+  uint64_t checksum = 0;
+  for (uint32_t step = 0; step < setup.steps; step++)
+    {
+      for (uint32_t agent = 0; agent < setup.agents; agent++)
+        {
+          for (uint32_t i = 0; i < setup.obsLen; i++)
+            {
+              box.data[i] = agent + i + step;
+            }
+          obs[agent].Set (box);
+          obs[agent].Fill (setup.obsMsgs[agent], setup.rawTensorVersion);
+
+          action.Update (setup.actMsg);
+          checksum += action.GetValue ();
+        }
+    }
+  return checksum;
+}
+
+} // namespace
+
+int
+main (int argc, char *argv[])
+{
+  Setup setup;
+  setup.agents = 100;
+  setup.steps = 1000;
+  setup.obsLen = 8;
+  setup.rawTensorVersion = OpenGymDataContainer::GetRawTensorVersion ();
+
+  CommandLine cmd;
+  cmd.AddValue ("agents", "Number of agents. Default: 100", setup.agents);
+  cmd.AddValue ("steps", "Number of steps per path. Default: 1000", setup.steps);
+  cmd.AddValue ("obsLen", "Box observation elements. Default: 8", setup.obsLen);
+  cmd.AddValue ("rawTensorVersion", "Raw tensor version of the agent, 0: BoxDataContainer",
+                setup.rawTensorVersion);
+  cmd.Parse (argc, argv);
+
+  setup.obsMsgs.resize (setup.agents);
+  Ptr<OpenGymDiscreteContainer> action = CreateObject<OpenGymDiscreteContainer> (5);
+  action->SetValue (3);
+  action->FillDataContainerPbMsg (setup.actMsg, setup.rawTensorVersion);
+
+  double agentSteps = double (setup.agents) * setup.steps;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  uint64_t checksum = RunContainers (setup, false);
+  double containers = agentSteps / ElapsedSeconds (start);
+
+  start = std::chrono::steady_clock::now ();
+  checksum += RunContainers (setup, true);
+  double pooled = agentSteps / ElapsedSeconds (start);
+
+  start = std::chrono::steady_clock::now ();
+  checksum += RunValues (setup);
+  double values = agentSteps / ElapsedSeconds (start);
+
+  std::cout << "containers:        " << containers << " agent-steps/s" << std::endl;
+  std::cout << "pooled containers: " << pooled << " agent-steps/s" << std::endl;
+  std::cout << "value types:       " << values << " agent-steps/s" << std::endl;
+  std::cout << "value speedup over containers: " << values / containers << "x" << std::endl;
+  NS_LOG_DEBUG ("checksum " << checksum);
+  return 0;
+}
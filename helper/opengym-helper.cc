@@ -1,11 +1,129 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 #include "opengym-helper.h"
+#include "ns3/node-list.h"
+#include "ns3/node.h"
+#include "ns3/net-device.h"
+#include "ns3/channel.h"
 
 namespace ns3 {
 
-/* ... */
+OpenGymGraphHelper::OpenGymGraphHelper ()
+  : m_nodeFeatures (0),
+    m_edgeFeatures (0),
+    m_nodes (0),
+    m_devices (0)
+{
+}
+
+void
+OpenGymGraphHelper::SetNodeFeatures (uint32_t count, NodeFeaturesCallback cb)
+{
+  m_nodeFeatures = count;
+  m_nodeFeaturesCb = cb;
+}
+
+void
+OpenGymGraphHelper::SetEdgeFeatures (uint32_t count, EdgeFeaturesCallback cb)
+{
+  m_edgeFeatures = count;
+  m_edgeFeaturesCb = cb;
+}
+
+Ptr<OpenGymGraphSpace>
+OpenGymGraphHelper::GetSpace (float low, float high) const
+{
+  return CreateObject<OpenGymGraphSpace> (m_nodeFeatures, m_edgeFeatures, low, high);
+}
 
+Ptr<OpenGymGraphContainer>
+OpenGymGraphHelper::Create ()
+{
+  Ptr<OpenGymGraphContainer> graph =
+      CreateObject<OpenGymGraphContainer> (m_nodeFeatures, m_edgeFeatures);
+  Update (graph);
+  return graph;
+}
+
+uint32_t
+OpenGymGraphHelper::CountDevices () const
+{
+  uint32_t devices = 0;
+  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
+    {
+      devices += (*it)->GetNDevices ();
+    }
+  return devices;
+}
+
+void
+OpenGymGraphHelper::Build (Ptr<OpenGymGraphContainer> graph)
+{
+  graph->Clear ();
+  m_edges.clear ();
+  m_nodes = NodeList::GetNNodes ();
+  m_devices = CountDevices ();
+  graph->AddNodes (m_nodes);
+  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
+    {
+      Ptr<Node> node = *it;
+      for (uint32_t i = 0; i < node->GetNDevices (); i++)
+        {
+          Ptr<NetDevice> device = node->GetDevice (i);
+          Ptr<Channel> channel = device->GetChannel ();
+          if (!channel)
+            {
+              continue;
+            }
+          for (std::size_t j = 0; j < channel->GetNDevices (); j++)
+            {
+              Ptr<NetDevice> peer = channel->GetDevice (j);
+              if (peer->GetNode () == node)
+                {
+                  continue;
+                }
+              graph->AddEdge (node->GetId (), peer->GetNode ()->GetId ());
+              m_edges.push_back (std::make_pair (device, peer));
+            }
+        }
+    }
+}
+
+void
+OpenGymGraphHelper::Update (Ptr<OpenGymGraphContainer> graph)
+{
+  if (graph->GetNodeCount () != NodeList::GetNNodes () || graph->GetEdgeCount () != m_edges.size ()
+      || m_nodes != NodeList::GetNNodes () || m_devices != CountDevices ())
+    {
+      Build (graph);
+    }
+
+  if (!m_nodeFeaturesCb.IsNull ())
+    {
+      for (uint32_t i = 0; i < m_nodes; i++)
+        {
+          m_features.assign (m_nodeFeatures, 0.0);
+          m_nodeFeaturesCb (NodeList::GetNode (i), m_features);
+          m_features.resize (m_nodeFeatures);
+          graph->SetNodeFeatures (i, m_features);
+        }
+    }
+  if (!m_edgeFeaturesCb.IsNull ())
+    {
+      for (uint32_t e = 0; e < m_edges.size (); e++)
+        {
+          m_features.assign (m_edgeFeatures, 0.0);
+          m_edgeFeaturesCb (m_edges[e].first, m_edges[e].second, m_features);
+          m_features.resize (m_edgeFeatures);
+          graph->SetEdgeFeatures (e, m_features);
+        }
+    }
+}
 
+std::pair<Ptr<NetDevice>, Ptr<NetDevice> >
+OpenGymGraphHelper::GetEdgeDevices (uint32_t edge) const
+{
+  return m_edges.at (edge);
 }
 
+} // namespace ns3
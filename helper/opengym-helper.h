@@ -2,11 +2,61 @@
 #ifndef OPENGYM_HELPER_H
 #define OPENGYM_HELPER_H
 
+#include "ns3/callback.h"
+#include "ns3/ptr.h"
+#include "ns3/container.h"
+#include "ns3/spaces.h"
+#include <utility>
+#include <vector>
+
 namespace ns3 {
 
-/* ... */
+class Node;
+class NetDevice;
 
-}
+/**
+ * Builds an OpenGymGraphContainer of the simulated network: graph node i
+ * is node i of NodeList, and every NetDevice has an edge to each device
+ * on other nodes attached to its Channel. Features come from callbacks
+ * filling a vector of the configured length, which starts at 0.
+ *
+ * Update reads the features again, so only rows that changed are sent.
+ * Nodes or devices added since are picked up by a rebuild (a keyframe).
+ */
+class OpenGymGraphHelper
+{
+public:
+  typedef Callback<void, Ptr<Node>, std::vector<float> &> NodeFeaturesCallback;
+  // features of the edge from the first device to the second
+  typedef Callback<void, Ptr<NetDevice>, Ptr<NetDevice>, std::vector<float> &> EdgeFeaturesCallback;
 
-#endif /* OPENGYM_HELPER_H */
+  OpenGymGraphHelper ();
+
+  void SetNodeFeatures (uint32_t count, NodeFeaturesCallback cb);
+  void SetEdgeFeatures (uint32_t count, EdgeFeaturesCallback cb);
+
+  Ptr<OpenGymGraphSpace> GetSpace (float low, float high) const;
+  Ptr<OpenGymGraphContainer> Create ();
+  void Update (Ptr<OpenGymGraphContainer> graph);
+
+  // devices of the edge with id \p edge of the last built graph
+  std::pair<Ptr<NetDevice>, Ptr<NetDevice> > GetEdgeDevices (uint32_t edge) const;
 
+private:
+  void Build (Ptr<OpenGymGraphContainer> graph);
+  uint32_t CountDevices () const;
+
+  uint32_t m_nodeFeatures;
+  uint32_t m_edgeFeatures;
+  NodeFeaturesCallback m_nodeFeaturesCb;
+  EdgeFeaturesCallback m_edgeFeaturesCb;
+  // topology of the last build
+  uint32_t m_nodes;
+  uint32_t m_devices;
+  std::vector<std::pair<Ptr<NetDevice>, Ptr<NetDevice> > > m_edges;
+  std::vector<float> m_features;
+};
+
+} // namespace ns3
+
+#endif /* OPENGYM_HELPER_H */
@@ -21,6 +21,7 @@
 
 #include "ns3/log.h"
 #include "container.h"
+#include "spaces.h"
 
 namespace ns3 {
 
@@ -28,6 +29,61 @@ NS_LOG_COMPONENT_DEFINE ("OpenGymDataContainer");
 
 NS_OBJECT_ENSURE_REGISTERED (OpenGymDataContainer);
 
+namespace {
+
+// pool of the interface that steps, see OpenGymContainerPool
+OpenGymContainerPool *g_currentPool = 0;
+
+template <typename T>
+Ptr<OpenGymDataContainer>
+CreateBoxFromBytes(const google::protobuf::RepeatedField<uint32_t> &shapePb, const std::string &bytes)
+{
+  typedef typename OpenGymDtype<T>::Wire W;
+  std::vector<uint32_t> shape(shapePb.begin(), shapePb.end());
+  Ptr<OpenGymBoxContainer<T> > box = OpenGymDataContainer::Acquire<OpenGymBoxContainer<T> >(shape);
+  std::vector<T> myData(bytes.size() / sizeof(W));
+  for (size_t i = 0; i < myData.size(); i++) {
+    W value;
+    std::memcpy(&value, bytes.data() + i * sizeof(W), sizeof(W));
+    myData[i] = static_cast<T>(value);
+  }
+  box->SetData(myData);
+  return box;
+}
+
+// raw tensor data or BoxDataContainer packedData of any dtype
+Ptr<OpenGymDataContainer>
+CreateBoxFromBytes(ns3opengym::Dtype dtype, const google::protobuf::RepeatedField<uint32_t> &shape,
+                   const std::string &bytes)
+{
+  switch (dtype) {
+    case ns3opengym::INT:
+      return CreateBoxFromBytes<int32_t>(shape, bytes);
+    case ns3opengym::UINT:
+      return CreateBoxFromBytes<uint32_t>(shape, bytes);
+    case ns3opengym::DOUBLE:
+      return CreateBoxFromBytes<double>(shape, bytes);
+    case ns3opengym::INT8:
+      return CreateBoxFromBytes<int8_t>(shape, bytes);
+    case ns3opengym::UINT8:
+      return CreateBoxFromBytes<uint8_t>(shape, bytes);
+    case ns3opengym::INT16:
+      return CreateBoxFromBytes<int16_t>(shape, bytes);
+    case ns3opengym::UINT16:
+      return CreateBoxFromBytes<uint16_t>(shape, bytes);
+    case ns3opengym::INT64:
+      return CreateBoxFromBytes<int64_t>(shape, bytes);
+    case ns3opengym::UINT64:
+      return CreateBoxFromBytes<uint64_t>(shape, bytes);
+    case ns3opengym::BOOL:
+      return CreateBoxFromBytes<bool>(shape, bytes);
+    default:
+      return CreateBoxFromBytes<float>(shape, bytes);
+  }
+}
+
+} // namespace
+
 
 TypeId
 OpenGymDataContainer::GetTypeId (void)
@@ -61,17 +117,155 @@ OpenGymDataContainer::DoInitialize (void)
   //NS_LOG_FUNCTION (this);
 }
 
+void
+OpenGymDataContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  dataContainerPbMsg = GetDataContainerPbMsg();
+}
+
+void
+OpenGymDataContainer::Recycle()
+{
+}
+
+bool
+OpenGymDataContainer::UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  return false;
+}
+
+void
+OpenGymDataContainer::ResetDataContainerPbMsg(ns3opengym::DataContainer *dataContainerPbMsg)
+{
+  dataContainerPbMsg->set_type(ns3opengym::NoSpaceType);
+  dataContainerPbMsg->mutable_name()->clear();
+  if (dataContainerPbMsg->has_data()) {
+    dataContainerPbMsg->mutable_data()->mutable_type_url()->clear();
+    dataContainerPbMsg->mutable_data()->mutable_value()->clear();
+  }
+  if (dataContainerPbMsg->has_tensor()) {
+    ns3opengym::RawTensor *tensor = dataContainerPbMsg->mutable_tensor();
+    tensor->set_dtype(ns3opengym::NoDType);
+    tensor->mutable_shape()->Clear();
+    tensor->mutable_data()->clear();
+  }
+}
+
+uint32_t
+OpenGymDataContainer::GetRawTensorVersion()
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return 8;
+#else
+  return 0;
+#endif
+}
+
+uint32_t
+OpenGymDataContainer::GetDtypeSize(ns3opengym::Dtype dtype)
+{
+  switch (dtype) {
+    case ns3opengym::INT8:
+    case ns3opengym::UINT8:
+    case ns3opengym::BOOL:
+      return 1;
+    case ns3opengym::INT16:
+    case ns3opengym::UINT16:
+      return 2;
+    case ns3opengym::DOUBLE:
+    case ns3opengym::INT64:
+    case ns3opengym::UINT64:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+OpenGymContainerPool::OpenGymContainerPool()
+  : m_hits(0), m_misses(0)
+{
+}
+
+OpenGymContainerPool *
+OpenGymContainerPool::GetCurrent()
+{
+  return g_currentPool;
+}
+
+void
+OpenGymContainerPool::SetCurrent(OpenGymContainerPool *pool)
+{
+  g_currentPool = pool;
+}
+
+void
+OpenGymContainerPool::ReleaseStep()
+{
+  // a released Tuple or Dict drops its elements, which may release them too
+  bool released = true;
+  while (released) {
+    released = false;
+    size_t i = 0;
+    while (i < m_inUse.size()) {
+      if (m_inUse[i]->GetReferenceCount() > 1) {
+        i++;
+        continue;
+      }
+      Ptr<OpenGymDataContainer> container = m_inUse[i];
+      m_inUse[i] = m_inUse.back();
+      m_inUse.pop_back();
+      container->Recycle();
+      m_free[std::type_index(typeid(*container))].push_back(container);
+      released = true;
+    }
+  }
+  // still referenced by the simulation, deleted by its last Ptr
+  m_inUse.clear();
+}
+
+uint64_t
+OpenGymContainerPool::GetHits() const
+{
+  return m_hits;
+}
+
+uint64_t
+OpenGymContainerPool::GetMisses() const
+{
+  return m_misses;
+}
+
 Ptr<OpenGymDataContainer>
-OpenGymDataContainer::CreateFromDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg)
+OpenGymDataContainer::CreateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
 {
   Ptr<OpenGymDataContainer> actDataContainer;
 
+  if (dataContainerPbMsg.type() == ns3opengym::Box && dataContainerPbMsg.has_tensor())
+  {
+    const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+    return CreateBoxFromBytes(tensor.dtype(), tensor.shape(), tensor.data());
+  }
+
+  if (dataContainerPbMsg.type() == ns3opengym::MultiDiscrete)
+  {
+    Ptr<OpenGymMultiDiscreteContainer> multiDiscrete = Acquire<OpenGymMultiDiscreteContainer>();
+    multiDiscrete->UpdateFromDataContainerPbMsg(dataContainerPbMsg);
+    return multiDiscrete;
+  }
+
+  if (dataContainerPbMsg.type() == ns3opengym::MultiBinary)
+  {
+    Ptr<OpenGymMultiBinaryContainer> multiBinary = Acquire<OpenGymMultiBinaryContainer>();
+    multiBinary->UpdateFromDataContainerPbMsg(dataContainerPbMsg);
+    return multiBinary;
+  }
+
   if (dataContainerPbMsg.type() == ns3opengym::Discrete)
   {
     ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
     dataContainerPbMsg.data().UnpackTo(&discreteContainerPbMsg);
 
-    Ptr<OpenGymDiscreteContainer> discrete = CreateObject<OpenGymDiscreteContainer>();
+    Ptr<OpenGymDiscreteContainer> discrete = Acquire<OpenGymDiscreteContainer>();
     discrete->SetValue(discreteContainerPbMsg.data());
     actDataContainer = discrete;
   }
@@ -80,36 +274,40 @@ OpenGymDataContainer::CreateFromDataContainerPbMsg(ns3opengym::DataContainer &da
     ns3opengym::BoxDataContainer boxContainerPbMsg;
     dataContainerPbMsg.data().UnpackTo(&boxContainerPbMsg);
 
-    if (boxContainerPbMsg.dtype() == ns3opengym::INT) {
-      Ptr<OpenGymBoxContainer<int32_t> > box = CreateObject<OpenGymBoxContainer<int32_t> >();
+    if (boxContainerPbMsg.dtype() >= ns3opengym::INT8) {
+      actDataContainer = CreateBoxFromBytes(boxContainerPbMsg.dtype(), boxContainerPbMsg.shape(),
+                                            boxContainerPbMsg.packeddata());
+
+    } else if (boxContainerPbMsg.dtype() == ns3opengym::INT) {
+      Ptr<OpenGymBoxContainer<int32_t> > box = Acquire<OpenGymBoxContainer<int32_t> >();
       std::vector<int32_t> myData;
       myData.assign(boxContainerPbMsg.intdata().begin(), boxContainerPbMsg.intdata().end());
       box->SetData(myData);
       actDataContainer = box;
 
     } else if (boxContainerPbMsg.dtype() == ns3opengym::UINT) {
-      Ptr<OpenGymBoxContainer<uint32_t> > box = CreateObject<OpenGymBoxContainer<uint32_t> >();
+      Ptr<OpenGymBoxContainer<uint32_t> > box = Acquire<OpenGymBoxContainer<uint32_t> >();
       std::vector<uint32_t> myData;
       myData.assign(boxContainerPbMsg.uintdata().begin(), boxContainerPbMsg.uintdata().end());
       box->SetData(myData);
       actDataContainer = box;
 
     } else if (boxContainerPbMsg.dtype() == ns3opengym::FLOAT) {
-      Ptr<OpenGymBoxContainer<float> > box = CreateObject<OpenGymBoxContainer<float> >();
+      Ptr<OpenGymBoxContainer<float> > box = Acquire<OpenGymBoxContainer<float> >();
       std::vector<float> myData;
       myData.assign(boxContainerPbMsg.floatdata().begin(), boxContainerPbMsg.floatdata().end());
       box->SetData(myData);
       actDataContainer = box;
 
     } else if (boxContainerPbMsg.dtype() == ns3opengym::DOUBLE) {
-      Ptr<OpenGymBoxContainer<double> > box = CreateObject<OpenGymBoxContainer<double> >();
+      Ptr<OpenGymBoxContainer<double> > box = Acquire<OpenGymBoxContainer<double> >();
       std::vector<double> myData;
       myData.assign(boxContainerPbMsg.doubledata().begin(), boxContainerPbMsg.doubledata().end());
       box->SetData(myData);
       actDataContainer = box;
 
     } else {
-      Ptr<OpenGymBoxContainer<float> > box = CreateObject<OpenGymBoxContainer<float> >();
+      Ptr<OpenGymBoxContainer<float> > box = Acquire<OpenGymBoxContainer<float> >();
       std::vector<float> myData;
       myData.assign(boxContainerPbMsg.floatdata().begin(), boxContainerPbMsg.floatdata().end());
       box->SetData(myData);
@@ -118,7 +316,7 @@ OpenGymDataContainer::CreateFromDataContainerPbMsg(ns3opengym::DataContainer &da
   }
   else if (dataContainerPbMsg.type() == ns3opengym::Tuple)
   {
-    Ptr<OpenGymTupleContainer> tupleData = CreateObject<OpenGymTupleContainer> ();
+    Ptr<OpenGymTupleContainer> tupleData = Acquire<OpenGymTupleContainer>();
 
     ns3opengym::TupleDataContainer tupleContainerPbMsg;
     dataContainerPbMsg.data().UnpackTo(&tupleContainerPbMsg);
@@ -137,7 +335,7 @@ OpenGymDataContainer::CreateFromDataContainerPbMsg(ns3opengym::DataContainer &da
   }
   else if (dataContainerPbMsg.type() == ns3opengym::Dict)
   {
-    Ptr<OpenGymDictContainer> dictData = CreateObject<OpenGymDictContainer> ();
+    Ptr<OpenGymDictContainer> dictData = Acquire<OpenGymDictContainer>();
 
     ns3opengym::DictDataContainer dictContainerPbMsg;
     dataContainerPbMsg.data().UnpackTo(&dictContainerPbMsg);
@@ -149,7 +347,11 @@ OpenGymDataContainer::CreateFromDataContainerPbMsg(ns3opengym::DataContainer &da
     for(it=elements.begin();it!=elements.end();++it)
     {
       Ptr<OpenGymDataContainer> subSpace = OpenGymDataContainer::CreateFromDataContainerPbMsg(*it);
-      dictData->Add((*it).name(), subSpace);
+      if ((*it).slot()) {
+        dictData->Set((*it).slot() - 1, subSpace);
+      } else {
+        dictData->Add((*it).name(), subSpace);
+      }
     }
 
     actDataContainer = dictData;
@@ -210,6 +412,36 @@ OpenGymDiscreteContainer::GetDataContainerPbMsg()
   return dataContainerPbMsg;
 }
 
+void
+OpenGymDiscreteContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  discreteContainerPbMsg.set_data(GetValue());
+
+  dataContainerPbMsg.set_type(ns3opengym::Discrete);
+  google::protobuf::Any *any = dataContainerPbMsg.mutable_data();
+  // PackFrom builds the type url string again, reuse it if it is already set
+  if (any->Is<ns3opengym::DiscreteDataContainer>()) {
+    discreteContainerPbMsg.SerializeToString(any->mutable_value());
+  } else {
+    any->PackFrom(discreteContainerPbMsg);
+  }
+}
+
+bool
+OpenGymDiscreteContainer::UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  if (dataContainerPbMsg.type() != ns3opengym::Discrete) {
+    return false;
+  }
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  if (!dataContainerPbMsg.data().UnpackTo(&discreteContainerPbMsg)) {
+    return false;
+  }
+  SetValue(discreteContainerPbMsg.data());
+  return true;
+}
+
 bool
 OpenGymDiscreteContainer::SetValue(uint32_t value)
 {
@@ -223,6 +455,19 @@ OpenGymDiscreteContainer::GetValue()
   return m_value;
 }
 
+void
+OpenGymDiscreteContainer::Reuse()
+{
+  Reuse(0);
+}
+
+void
+OpenGymDiscreteContainer::Reuse(uint32_t n)
+{
+  m_n = n;
+  m_value = 0;
+}
+
 void
 OpenGymDiscreteContainer::Print(std::ostream& where) const
 {
@@ -230,198 +475,1224 @@ OpenGymDiscreteContainer::Print(std::ostream& where) const
 }
 
 TypeId
-OpenGymTupleContainer::GetTypeId (void)
+OpenGymMultiDiscreteContainer::GetTypeId (void)
 {
-  static TypeId tid = TypeId ("ns3::OpenGymTupleContainer")
+  static TypeId tid = TypeId ("ns3::OpenGymMultiDiscreteContainer")
     .SetParent<OpenGymDataContainer> ()
     .SetGroupName ("OpenGym")
-    .AddConstructor<OpenGymTupleContainer> ()
+    .AddConstructor<OpenGymMultiDiscreteContainer> ()
     ;
   return tid;
 }
 
-OpenGymTupleContainer::OpenGymTupleContainer()
+OpenGymMultiDiscreteContainer::OpenGymMultiDiscreteContainer()
 {
   //NS_LOG_FUNCTION (this);
 }
 
-OpenGymTupleContainer::~OpenGymTupleContainer ()
+OpenGymMultiDiscreteContainer::OpenGymMultiDiscreteContainer(std::vector<uint32_t> nvec):
+  m_nvec(nvec),
+  m_values(m_nvec.size(), 0)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+OpenGymMultiDiscreteContainer::~OpenGymMultiDiscreteContainer ()
 {
   //NS_LOG_FUNCTION (this);
 }
 
 void
-OpenGymTupleContainer::DoDispose (void)
+OpenGymMultiDiscreteContainer::DoDispose (void)
 {
   //NS_LOG_FUNCTION (this);
 }
 
 void
-OpenGymTupleContainer::DoInitialize (void)
+OpenGymMultiDiscreteContainer::DoInitialize (void)
 {
   //NS_LOG_FUNCTION (this);
 }
 
+ns3opengym::Dtype
+OpenGymMultiDiscreteContainer::GetWireDtype() const
+{
+  // the space bounds the values, received containers only know the values
+  uint32_t max = 0;
+  if (m_nvec.empty()) {
+    for (size_t i = 0; i < m_values.size(); i++) {
+      max = std::max(max, m_values[i]);
+    }
+  } else {
+    for (size_t i = 0; i < m_nvec.size(); i++) {
+      max = std::max(max, m_nvec[i] ? m_nvec[i] - 1 : 0);
+    }
+  }
+  if (max <= 0xff) {
+    return ns3opengym::UINT8;
+  }
+  if (max <= 0xffff) {
+    return ns3opengym::UINT16;
+  }
+  return ns3opengym::UINT;
+}
+
+template <typename W>
+static void
+EncodeUnsigned(const std::vector<uint32_t> &values, std::string *bytes)
+{
+  bytes->resize(values.size() * sizeof(W));
+  for (size_t i = 0; i < values.size(); i++) {
+    W value = static_cast<W>(values[i]);
+    std::memcpy(&(*bytes)[i * sizeof(W)], &value, sizeof(W));
+  }
+}
+
+template <typename W>
+static void
+DecodeUnsigned(const std::string &bytes, std::vector<uint32_t> &values)
+{
+  values.resize(bytes.size() / sizeof(W));
+  for (size_t i = 0; i < values.size(); i++) {
+    W value;
+    std::memcpy(&value, &bytes[i * sizeof(W)], sizeof(W));
+    values[i] = value;
+  }
+}
+
 ns3opengym::DataContainer
-OpenGymTupleContainer::GetDataContainerPbMsg()
+OpenGymMultiDiscreteContainer::GetDataContainerPbMsg()
 {
   ns3opengym::DataContainer dataContainerPbMsg;
-  dataContainerPbMsg.set_type(ns3opengym::Tuple);
-
-  ns3opengym::TupleDataContainer tupleContainerPbMsg;
+  FillDataContainerPbMsg(dataContainerPbMsg, 0);
+  return dataContainerPbMsg;
+}
 
-  std::vector< Ptr<OpenGymDataContainer> >::iterator it;
-  for (it=m_tuple.begin(); it!=m_tuple.end(); ++it)
-  {
-    Ptr<OpenGymDataContainer> subSpace = *it;
-    ns3opengym::DataContainer subDataContainer = subSpace->GetDataContainerPbMsg();
+void
+OpenGymMultiDiscreteContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  if (rawTensorVersion < 8) {
+    std::vector<uint32_t> shape(1, m_values.size());
+    Ptr<OpenGymBoxContainer<uint32_t> > box = Acquire<OpenGymBoxContainer<uint32_t> >(shape, 0u);
+    std::copy(m_values.begin(), m_values.end(), box->GetMutableDataView().begin());
+    box->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+    return;
+  }
 
-    tupleContainerPbMsg.add_element()->CopyFrom(subDataContainer);
+  dataContainerPbMsg.set_type(ns3opengym::MultiDiscrete);
+  ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor();
+  ns3opengym::Dtype dtype = GetWireDtype();
+  tensor->set_dtype(dtype);
+  tensor->mutable_shape()->Clear();
+  tensor->add_shape(m_values.size());
+  if (dtype == ns3opengym::UINT8) {
+    EncodeUnsigned<uint8_t>(m_values, tensor->mutable_data());
+  } else if (dtype == ns3opengym::UINT16) {
+    EncodeUnsigned<uint16_t>(m_values, tensor->mutable_data());
+  } else {
+    EncodeUnsigned<uint32_t>(m_values, tensor->mutable_data());
   }
+}
 
-  dataContainerPbMsg.mutable_data()->PackFrom(tupleContainerPbMsg);
-  return dataContainerPbMsg;
+bool
+OpenGymMultiDiscreteContainer::UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  if (dataContainerPbMsg.type() != ns3opengym::MultiDiscrete) {
+    return false;
+  }
+  if (dataContainerPbMsg.has_tensor()) {
+    const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+    if (tensor.dtype() == ns3opengym::UINT8) {
+      DecodeUnsigned<uint8_t>(tensor.data(), m_values);
+    } else if (tensor.dtype() == ns3opengym::UINT16) {
+      DecodeUnsigned<uint16_t>(tensor.data(), m_values);
+    } else if (tensor.dtype() == ns3opengym::UINT) {
+      DecodeUnsigned<uint32_t>(tensor.data(), m_values);
+    } else {
+      return false;
+    }
+    return true;
+  }
+  ns3opengym::BoxDataContainer boxContainerPbMsg;
+  if (!dataContainerPbMsg.data().UnpackTo(&boxContainerPbMsg)) {
+    return false;
+  }
+  m_values.assign(boxContainerPbMsg.uintdata().begin(), boxContainerPbMsg.uintdata().end());
+  return true;
 }
 
 bool
-OpenGymTupleContainer::Add(Ptr<OpenGymDataContainer> space)
+OpenGymMultiDiscreteContainer::SetValue(uint32_t idx, uint32_t value)
 {
-  NS_LOG_FUNCTION (this);
-  m_tuple.push_back(space);
+  if (idx >= m_values.size() || (idx < m_nvec.size() && value >= m_nvec[idx])) {
+    return false;
+  }
+  m_values[idx] = value;
   return true;
 }
 
-Ptr<OpenGymDataContainer>
-OpenGymTupleContainer::Get(uint32_t idx)
+uint32_t
+OpenGymMultiDiscreteContainer::GetValue(uint32_t idx) const
 {
-  Ptr<OpenGymDataContainer> data;
+  return idx < m_values.size() ? m_values[idx] : 0;
+}
 
-  if (idx < m_tuple.size())
-  {
-    data = m_tuple.at(idx);
+bool
+OpenGymMultiDiscreteContainer::SetValues(const std::vector<uint32_t> &values)
+{
+  if (values.size() != m_values.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < m_nvec.size(); i++) {
+    if (values[i] >= m_nvec[i]) {
+      return false;
+    }
   }
+  m_values = values;
+  return true;
+}
 
-  return data;
+const std::vector<uint32_t> &
+OpenGymMultiDiscreteContainer::GetValues() const
+{
+  return m_values;
+}
+
+std::vector<uint32_t>
+OpenGymMultiDiscreteContainer::GetNvec() const
+{
+  return m_nvec;
+}
+
+uint32_t
+OpenGymMultiDiscreteContainer::GetSize() const
+{
+  return m_values.size();
 }
 
 void
-OpenGymTupleContainer::Print(std::ostream& where) const
+OpenGymMultiDiscreteContainer::Reuse()
 {
-  where << "Tuple(";
+  Reuse(std::vector<uint32_t>());
+}
 
-  std::vector< Ptr<OpenGymDataContainer> >::const_iterator it;
-  std::vector< Ptr<OpenGymDataContainer> >::const_iterator it2;
-  for (it=m_tuple.cbegin(); it!=m_tuple.cend(); ++it)
-  {
-    Ptr<OpenGymDataContainer> subSpace = *it;
-    subSpace->Print(where);
+void
+OpenGymMultiDiscreteContainer::Reuse(std::vector<uint32_t> nvec)
+{
+  m_nvec.swap(nvec);
+  m_values.assign(m_nvec.size(), 0);
+}
 
-    it2 = it;
-    it2++;
-    if (it2 != m_tuple.end())
+void
+OpenGymMultiDiscreteContainer::Print(std::ostream& where) const
+{
+  where << "MultiDiscrete[";
+  for (size_t i = 0; i < m_values.size(); i++) {
+    where << m_values[i];
+    if (i + 1 != m_values.size())
       where << ", ";
   }
-  where << ")";
+  where << "]";
 }
 
-
 TypeId
-OpenGymDictContainer::GetTypeId (void)
+OpenGymMultiBinaryContainer::GetTypeId (void)
 {
-  static TypeId tid = TypeId ("ns3::OpenGymDictContainer")
+  static TypeId tid = TypeId ("ns3::OpenGymMultiBinaryContainer")
     .SetParent<OpenGymDataContainer> ()
     .SetGroupName ("OpenGym")
-    .AddConstructor<OpenGymDictContainer> ()
+    .AddConstructor<OpenGymMultiBinaryContainer> ()
     ;
   return tid;
 }
 
-OpenGymDictContainer::OpenGymDictContainer()
+OpenGymMultiBinaryContainer::OpenGymMultiBinaryContainer()
 {
   //NS_LOG_FUNCTION (this);
+  Reuse(0);
 }
 
-OpenGymDictContainer::~OpenGymDictContainer ()
+OpenGymMultiBinaryContainer::OpenGymMultiBinaryContainer(uint32_t n)
+{
+  //NS_LOG_FUNCTION (this);
+  Reuse(n);
+}
+
+OpenGymMultiBinaryContainer::~OpenGymMultiBinaryContainer ()
 {
   //NS_LOG_FUNCTION (this);
 }
 
 void
-OpenGymDictContainer::DoDispose (void)
+OpenGymMultiBinaryContainer::DoDispose (void)
 {
   //NS_LOG_FUNCTION (this);
 }
 
 void
-OpenGymDictContainer::DoInitialize (void)
+OpenGymMultiBinaryContainer::DoInitialize (void)
 {
   //NS_LOG_FUNCTION (this);
 }
 
 ns3opengym::DataContainer
-OpenGymDictContainer::GetDataContainerPbMsg()
+OpenGymMultiBinaryContainer::GetDataContainerPbMsg()
 {
   ns3opengym::DataContainer dataContainerPbMsg;
-  dataContainerPbMsg.set_type(ns3opengym::Dict);
+  FillDataContainerPbMsg(dataContainerPbMsg, 0);
+  return dataContainerPbMsg;
+}
 
-  ns3opengym::DictDataContainer dictContainerPbMsg;
+void
+OpenGymMultiBinaryContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  if (rawTensorVersion < 8) {
+    std::vector<uint32_t> shape(1, m_n);
+    Ptr<OpenGymBoxContainer<bool> > box = Acquire<OpenGymBoxContainer<bool> >(shape, false);
+    OpenGymSpan<uint8_t> data = box->GetMutableDataView();
+    for (uint32_t i = 0; i < m_n; i++) {
+      data[i] = GetValue(i);
+    }
+    box->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+    return;
+  }
 
-  std::map< std::string, Ptr<OpenGymDataContainer> >::iterator it;
-  for (it=m_dict.begin(); it!=m_dict.end(); ++it)
-  {
-    std::string name = it->first;
-    Ptr<OpenGymDataContainer> subSpace = it->second;
+  dataContainerPbMsg.set_type(ns3opengym::MultiBinary);
+  ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor();
+  tensor->set_dtype(ns3opengym::BOOL);
+  tensor->mutable_shape()->Clear();
+  tensor->add_shape(m_n);
+  tensor->mutable_data()->assign(m_bits);
+}
 
-    ns3opengym::DataContainer subDataContainer = subSpace->GetDataContainerPbMsg();
-    subDataContainer.set_name(name);
+bool
+OpenGymMultiBinaryContainer::UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  if (dataContainerPbMsg.type() != ns3opengym::MultiBinary) {
+    return false;
+  }
+  if (dataContainerPbMsg.has_tensor()) {
+    const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+    uint32_t n = tensor.shape_size() ? tensor.shape(0) : 0;
+    if (tensor.data().size() != (n + 7) / 8) {
+      return false;
+    }
+    m_n = n;
+    m_bits.assign(tensor.data());
+    return true;
+  }
+  ns3opengym::BoxDataContainer boxContainerPbMsg;
+  if (!dataContainerPbMsg.data().UnpackTo(&boxContainerPbMsg)) {
+    return false;
+  }
+  Reuse(boxContainerPbMsg.uintdata_size());
+  for (uint32_t i = 0; i < m_n; i++) {
+    SetValue(i, boxContainerPbMsg.uintdata(i) != 0);
+  }
+  return true;
+}
 
-    dictContainerPbMsg.add_element()->CopyFrom(subDataContainer);
+bool
+OpenGymMultiBinaryContainer::SetValue(uint32_t idx, bool value)
+{
+  if (idx >= m_n) {
+    return false;
   }
+  uint8_t mask = 1 << (idx % 8);
+  if (value) {
+    m_bits[idx / 8] |= mask;
+  } else {
+    m_bits[idx / 8] &= ~mask;
+  }
+  return true;
+}
 
-  dataContainerPbMsg.mutable_data()->PackFrom(dictContainerPbMsg);
-  return dataContainerPbMsg;
+bool
+OpenGymMultiBinaryContainer::GetValue(uint32_t idx) const
+{
+  if (idx >= m_n) {
+    return false;
+  }
+  return (static_cast<uint8_t>(m_bits[idx / 8]) >> (idx % 8)) & 1;
 }
 
 bool
-OpenGymDictContainer::Add(std::string key, Ptr<OpenGymDataContainer> data)
+OpenGymMultiBinaryContainer::SetValues(const std::vector<bool> &values)
 {
-  NS_LOG_FUNCTION (this);
-  m_dict.insert(std::pair<std::string, Ptr<OpenGymDataContainer> > (key, data));
+  if (values.size() != m_n) {
+    return false;
+  }
+  for (uint32_t i = 0; i < m_n; i++) {
+    SetValue(i, values[i]);
+  }
   return true;
 }
 
-Ptr<OpenGymDataContainer>
-OpenGymDictContainer::Get(std::string key)
+std::vector<bool>
+OpenGymMultiBinaryContainer::GetValues() const
 {
-  Ptr<OpenGymDataContainer> data;
-  std::map< std::string, Ptr<OpenGymDataContainer> >::iterator it = m_dict.find(key);
-  if ( it != m_dict.end() ) {
-    data = it->second;
+  std::vector<bool> values(m_n);
+  for (uint32_t i = 0; i < m_n; i++) {
+    values[i] = GetValue(i);
   }
-  return data;
+  return values;
+}
+
+uint32_t
+OpenGymMultiBinaryContainer::GetSize() const
+{
+  return m_n;
 }
 
 void
-OpenGymDictContainer::Print(std::ostream& where) const
+OpenGymMultiBinaryContainer::Reuse()
 {
-  where << "Dict(";
+  Reuse(0);
+}
 
-  std::map< std::string, Ptr<OpenGymDataContainer> >::const_iterator it;
-  std::map< std::string, Ptr<OpenGymDataContainer> >::const_iterator it2;
-  for (it=m_dict.cbegin(); it!=m_dict.cend(); ++it)
-  {
-    std::string name = it->first;
-    Ptr<OpenGymDataContainer> subSpace = it->second;
+void
+OpenGymMultiBinaryContainer::Reuse(uint32_t n)
+{
+  m_n = n;
+  m_bits.assign((n + 7) / 8, '\0');
+}
+
+void
+OpenGymMultiBinaryContainer::Print(std::ostream& where) const
+{
+  where << "MultiBinary[";
+  for (uint32_t i = 0; i < m_n; i++) {
+    where << GetValue(i);
+    if (i + 1 != m_n)
+      where << ", ";
+  }
+  where << "]";
+}
+
+TypeId
+OpenGymTupleContainer::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::OpenGymTupleContainer")
+    .SetParent<OpenGymDataContainer> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymTupleContainer> ()
+    ;
+  return tid;
+}
+
+OpenGymTupleContainer::OpenGymTupleContainer()
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+OpenGymTupleContainer::~OpenGymTupleContainer ()
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymTupleContainer::DoDispose (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymTupleContainer::DoInitialize (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+ns3opengym::DataContainer
+OpenGymTupleContainer::GetDataContainerPbMsg()
+{
+  ns3opengym::DataContainer dataContainerPbMsg;
+  dataContainerPbMsg.set_type(ns3opengym::Tuple);
+
+  ns3opengym::TupleDataContainer tupleContainerPbMsg;
+
+  std::vector< Ptr<OpenGymDataContainer> >::iterator it;
+  for (it=m_tuple.begin(); it!=m_tuple.end(); ++it)
+  {
+    Ptr<OpenGymDataContainer> subSpace = *it;
+    ns3opengym::DataContainer subDataContainer = subSpace->GetDataContainerPbMsg();
+
+    tupleContainerPbMsg.add_element()->CopyFrom(subDataContainer);
+  }
+
+  dataContainerPbMsg.mutable_data()->PackFrom(tupleContainerPbMsg);
+  return dataContainerPbMsg;
+}
+
+void
+OpenGymTupleContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  dataContainerPbMsg.set_type(ns3opengym::Tuple);
+
+  ns3opengym::TupleDataContainer tupleContainerPbMsg;
+
+  std::vector< Ptr<OpenGymDataContainer> >::iterator it;
+  for (it=m_tuple.begin(); it!=m_tuple.end(); ++it)
+  {
+    (*it)->FillDataContainerPbMsg(*tupleContainerPbMsg.add_element(), rawTensorVersion);
+  }
+
+  dataContainerPbMsg.mutable_data()->PackFrom(tupleContainerPbMsg);
+}
 
-    where << name << "=";
+bool
+OpenGymTupleContainer::Add(Ptr<OpenGymDataContainer> space)
+{
+  NS_LOG_FUNCTION (this);
+  m_tuple.push_back(space);
+  return true;
+}
+
+Ptr<OpenGymDataContainer>
+OpenGymTupleContainer::Get(uint32_t idx)
+{
+  Ptr<OpenGymDataContainer> data;
+
+  if (idx < m_tuple.size())
+  {
+    data = m_tuple.at(idx);
+  }
+
+  return data;
+}
+
+void
+OpenGymTupleContainer::Recycle()
+{
+  m_tuple.clear();
+}
+
+void
+OpenGymTupleContainer::Reuse()
+{
+}
+
+void
+OpenGymTupleContainer::Print(std::ostream& where) const
+{
+  where << "Tuple(";
+
+  std::vector< Ptr<OpenGymDataContainer> >::const_iterator it;
+  std::vector< Ptr<OpenGymDataContainer> >::const_iterator it2;
+  for (it=m_tuple.cbegin(); it!=m_tuple.cend(); ++it)
+  {
+    Ptr<OpenGymDataContainer> subSpace = *it;
     subSpace->Print(where);
 
     it2 = it;
     it2++;
-    if (it2 != m_dict.end())
+    if (it2 != m_tuple.end())
       where << ", ";
   }
   where << ")";
 }
 
-}
\ No newline at end of file
+
+TypeId
+OpenGymDictContainer::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::OpenGymDictContainer")
+    .SetParent<OpenGymDataContainer> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymDictContainer> ()
+    ;
+  return tid;
+}
+
+OpenGymDictContainer::OpenGymDictContainer()
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+OpenGymDictContainer::OpenGymDictContainer(Ptr<OpenGymDictSpace> space)
+{
+  //NS_LOG_FUNCTION (this);
+  Bind(space);
+}
+
+OpenGymDictContainer::~OpenGymDictContainer ()
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymDictContainer::DoDispose (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymDictContainer::DoInitialize (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+ns3opengym::DataContainer
+OpenGymDictContainer::GetDataContainerPbMsg()
+{
+  ns3opengym::DataContainer dataContainerPbMsg;
+  dataContainerPbMsg.set_type(ns3opengym::Dict);
+
+  ns3opengym::DictDataContainer dictContainerPbMsg;
+
+  for (uint32_t i = 0; i < m_elements.size(); i++)
+  {
+    if (!m_elements[i]) {
+      continue;
+    }
+    ns3opengym::DataContainer subDataContainer = m_elements[i]->GetDataContainerPbMsg();
+    subDataContainer.set_name(m_space ? m_space->GetKey(i) : m_keys[i]);
+
+    dictContainerPbMsg.add_element()->CopyFrom(subDataContainer);
+  }
+
+  dataContainerPbMsg.mutable_data()->PackFrom(dictContainerPbMsg);
+  return dataContainerPbMsg;
+}
+
+void
+OpenGymDictContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  dataContainerPbMsg.set_type(ns3opengym::Dict);
+
+  ns3opengym::DictDataContainer dictContainerPbMsg;
+
+  for (uint32_t i = 0; i < m_elements.size(); i++)
+  {
+    if (!m_elements[i]) {
+      continue;
+    }
+    ns3opengym::DataContainer *subDataContainer = dictContainerPbMsg.add_element();
+    m_elements[i]->FillDataContainerPbMsg(*subDataContainer, rawTensorVersion);
+    // the key once in the space description instead of in every step
+    if (rawTensorVersion >= 5 && (m_space || m_keys[i].empty())) {
+      subDataContainer->set_slot(i + 1);
+    } else {
+      subDataContainer->set_name(m_space ? m_space->GetKey(i) : m_keys[i]);
+    }
+  }
+
+  dataContainerPbMsg.mutable_data()->PackFrom(dictContainerPbMsg);
+}
+
+bool
+OpenGymDictContainer::Add(std::string key, Ptr<OpenGymDataContainer> data)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_space) {
+    int32_t slot = m_space->GetSlot(key);
+    if (slot < 0) {
+      NS_LOG_WARN ("Dict space has no key " << key);
+      return false;
+    }
+    if (!m_elements[slot]) {
+      m_elements[slot] = data;
+    }
+    return true;
+  }
+  // like std::map::insert, an existing key keeps its element
+  std::vector<std::string>::iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+  if (it != m_keys.end() && *it == key) {
+    return true;
+  }
+  m_elements.insert(m_elements.begin() + (it - m_keys.begin()), data);
+  m_keys.insert(it, key);
+  return true;
+}
+
+Ptr<OpenGymDataContainer>
+OpenGymDictContainer::Get(std::string key)
+{
+  Ptr<OpenGymDataContainer> data;
+  if (m_space) {
+    int32_t slot = m_space->GetSlot(key);
+    if (slot >= 0) {
+      data = m_elements[slot];
+    }
+    return data;
+  }
+  std::vector<std::string>::iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+  if (it != m_keys.end() && *it == key) {
+    data = m_elements[it - m_keys.begin()];
+  }
+  return data;
+}
+
+bool
+OpenGymDictContainer::Set(uint32_t slot, Ptr<OpenGymDataContainer> data)
+{
+  if (m_space) {
+    if (slot >= m_elements.size()) {
+      NS_LOG_WARN ("Dict space has no slot " << slot);
+      return false;
+    }
+  } else if (slot >= m_elements.size()) {
+    m_keys.resize(slot + 1);
+    m_elements.resize(slot + 1);
+  }
+  m_elements[slot] = data;
+  return true;
+}
+
+Ptr<OpenGymDataContainer>
+OpenGymDictContainer::Get(uint32_t slot)
+{
+  Ptr<OpenGymDataContainer> data;
+  if (slot < m_elements.size()) {
+    data = m_elements[slot];
+  }
+  return data;
+}
+
+bool
+OpenGymDictContainer::Bind(Ptr<OpenGymDictSpace> space)
+{
+  NS_LOG_FUNCTION (this);
+  if (!space) {
+    return false;
+  }
+  if (space == m_space) {
+    return true;
+  }
+  std::vector< Ptr<OpenGymDataContainer> > elements(space->GetSlotCount());
+  for (uint32_t i = 0; i < m_elements.size(); i++) {
+    if (!m_elements[i]) {
+      continue;
+    }
+    // elements received by slot keep it
+    int32_t slot = i;
+    if (m_space) {
+      slot = space->GetSlot(m_space->GetKey(i));
+    } else if (!m_keys[i].empty()) {
+      slot = space->GetSlot(m_keys[i]);
+    }
+    if (slot < 0 || slot >= (int32_t) elements.size()) {
+      return false;
+    }
+    elements[slot] = m_elements[i];
+  }
+  m_space = space;
+  m_keys.clear();
+  m_elements.swap(elements);
+  return true;
+}
+
+Ptr<OpenGymDictSpace>
+OpenGymDictContainer::GetSpace() const
+{
+  return m_space;
+}
+
+void
+OpenGymDictContainer::Recycle()
+{
+  m_space = 0;
+  m_keys.clear();
+  m_elements.clear();
+}
+
+void
+OpenGymDictContainer::Reuse()
+{
+}
+
+void
+OpenGymDictContainer::Reuse(Ptr<OpenGymDictSpace> space)
+{
+  Bind(space);
+}
+
+void
+OpenGymDictContainer::Print(std::ostream& where) const
+{
+  where << "Dict(";
+
+  bool first = true;
+  for (uint32_t i = 0; i < m_elements.size(); i++)
+  {
+    if (!m_elements[i]) {
+      continue;
+    }
+    if (!first)
+      where << ", ";
+    first = false;
+
+    where << (m_space ? m_space->GetKey(i) : m_keys[i]) << "=";
+    m_elements[i]->Print(where);
+  }
+  where << ")";
+}
+
+
+uint64_t OpenGymGraphContainer::m_nextGraphId = 1;
+
+TypeId
+OpenGymGraphContainer::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::OpenGymGraphContainer")
+    .SetParent<OpenGymDataContainer> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymGraphContainer> ()
+    ;
+  return tid;
+}
+
+OpenGymGraphContainer::OpenGymGraphContainer()
+{
+  //NS_LOG_FUNCTION (this);
+  Reuse(0, 0);
+}
+
+OpenGymGraphContainer::OpenGymGraphContainer(uint32_t nodeFeatures, uint32_t edgeFeatures)
+{
+  //NS_LOG_FUNCTION (this);
+  Reuse(nodeFeatures, edgeFeatures);
+}
+
+OpenGymGraphContainer::~OpenGymGraphContainer ()
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymGraphContainer::DoDispose (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymGraphContainer::DoInitialize (void)
+{
+  //NS_LOG_FUNCTION (this);
+}
+
+uint32_t
+OpenGymGraphContainer::AddNodes(uint32_t count)
+{
+  uint32_t first = m_nodes;
+  m_nodes += count;
+  m_nodeData.resize(m_nodes * m_nodeFeatures, 0.0);
+  m_nodeChanged.resize(m_nodes, 0);
+  DropChanges();
+  return first;
+}
+
+uint32_t
+OpenGymGraphContainer::AddNode()
+{
+  return AddNodes(1);
+}
+
+int32_t
+OpenGymGraphContainer::AddEdge(uint32_t src, uint32_t dst)
+{
+  if (src >= m_nodes || dst >= m_nodes) {
+    return -1;
+  }
+  m_src.push_back(src);
+  m_dst.push_back(dst);
+  m_edgeData.resize(m_src.size() * m_edgeFeatures, 0.0);
+  m_edgeChanged.resize(m_src.size(), 0);
+  DropChanges();
+  return m_src.size() - 1;
+}
+
+bool
+OpenGymGraphContainer::RemoveEdge(uint32_t edge)
+{
+  if (edge >= m_src.size()) {
+    return false;
+  }
+  uint32_t last = m_src.size() - 1;
+  if (edge != last) {
+    m_src[edge] = m_src[last];
+    m_dst[edge] = m_dst[last];
+    std::copy(m_edgeData.begin() + last * m_edgeFeatures, m_edgeData.end(),
+              m_edgeData.begin() + edge * m_edgeFeatures);
+  }
+  m_src.pop_back();
+  m_dst.pop_back();
+  m_edgeData.resize(last * m_edgeFeatures);
+  // the flags of the moved edge are dropped with the others
+  DropChanges();
+  m_edgeChanged.resize(last);
+  return true;
+}
+
+void
+OpenGymGraphContainer::Clear()
+{
+  m_nodes = 0;
+  m_src.clear();
+  m_dst.clear();
+  m_nodeData.clear();
+  m_edgeData.clear();
+  m_nodeChanged.clear();
+  m_edgeChanged.clear();
+  m_changedNodes.clear();
+  m_changedEdges.clear();
+  m_keyframe = true;
+}
+
+void
+OpenGymGraphContainer::DropChanges()
+{
+  for (size_t i = 0; i < m_changedNodes.size(); i++) {
+    m_nodeChanged[m_changedNodes[i]] = 0;
+  }
+  for (size_t i = 0; i < m_changedEdges.size(); i++) {
+    m_edgeChanged[m_changedEdges[i]] = 0;
+  }
+  m_changedNodes.clear();
+  m_changedEdges.clear();
+  m_keyframe = true;
+}
+
+void
+OpenGymGraphContainer::MarkNode(uint32_t node)
+{
+  // a keyframe sends all rows anyway
+  if (!m_keyframe && !m_nodeChanged[node]) {
+    m_nodeChanged[node] = 1;
+    m_changedNodes.push_back(node);
+  }
+}
+
+void
+OpenGymGraphContainer::MarkEdge(uint32_t edge)
+{
+  if (!m_keyframe && !m_edgeChanged[edge]) {
+    m_edgeChanged[edge] = 1;
+    m_changedEdges.push_back(edge);
+  }
+}
+
+bool
+OpenGymGraphContainer::SetNodeFeatures(uint32_t node, const std::vector<float> &features)
+{
+  if (node >= m_nodes || features.size() > m_nodeFeatures) {
+    return false;
+  }
+  if (features.empty()) {
+    return true;
+  }
+  float *row = &m_nodeData[node * m_nodeFeatures];
+  if (!std::equal(features.begin(), features.end(), row)) {
+    std::copy(features.begin(), features.end(), row);
+    MarkNode(node);
+  }
+  return true;
+}
+
+bool
+OpenGymGraphContainer::SetNodeFeature(uint32_t node, uint32_t idx, float value)
+{
+  if (node >= m_nodes || idx >= m_nodeFeatures) {
+    return false;
+  }
+  float &feature = m_nodeData[node * m_nodeFeatures + idx];
+  if (feature != value) {
+    feature = value;
+    MarkNode(node);
+  }
+  return true;
+}
+
+bool
+OpenGymGraphContainer::SetEdgeFeatures(uint32_t edge, const std::vector<float> &features)
+{
+  if (edge >= m_src.size() || features.size() > m_edgeFeatures) {
+    return false;
+  }
+  if (features.empty()) {
+    return true;
+  }
+  float *row = &m_edgeData[edge * m_edgeFeatures];
+  if (!std::equal(features.begin(), features.end(), row)) {
+    std::copy(features.begin(), features.end(), row);
+    MarkEdge(edge);
+  }
+  return true;
+}
+
+bool
+OpenGymGraphContainer::SetEdgeFeature(uint32_t edge, uint32_t idx, float value)
+{
+  if (edge >= m_src.size() || idx >= m_edgeFeatures) {
+    return false;
+  }
+  float &feature = m_edgeData[edge * m_edgeFeatures + idx];
+  if (feature != value) {
+    feature = value;
+    MarkEdge(edge);
+  }
+  return true;
+}
+
+float
+OpenGymGraphContainer::GetNodeFeature(uint32_t node, uint32_t idx) const
+{
+  if (node >= m_nodes || idx >= m_nodeFeatures) {
+    return 0;
+  }
+  return m_nodeData[node * m_nodeFeatures + idx];
+}
+
+float
+OpenGymGraphContainer::GetEdgeFeature(uint32_t edge, uint32_t idx) const
+{
+  if (edge >= m_src.size() || idx >= m_edgeFeatures) {
+    return 0;
+  }
+  return m_edgeData[edge * m_edgeFeatures + idx];
+}
+
+uint32_t
+OpenGymGraphContainer::GetNodeCount() const
+{
+  return m_nodes;
+}
+
+uint32_t
+OpenGymGraphContainer::GetEdgeCount() const
+{
+  return m_src.size();
+}
+
+uint32_t
+OpenGymGraphContainer::GetEdgeSource(uint32_t edge) const
+{
+  return m_src.at(edge);
+}
+
+uint32_t
+OpenGymGraphContainer::GetEdgeTarget(uint32_t edge) const
+{
+  return m_dst.at(edge);
+}
+
+uint32_t
+OpenGymGraphContainer::GetNodeFeatureCount() const
+{
+  return m_nodeFeatures;
+}
+
+uint32_t
+OpenGymGraphContainer::GetEdgeFeatureCount() const
+{
+  return m_edgeFeatures;
+}
+
+uint64_t
+OpenGymGraphContainer::GetGraphId() const
+{
+  return m_graphId;
+}
+
+uint32_t
+OpenGymGraphContainer::GetSeq() const
+{
+  return m_seq;
+}
+
+void
+OpenGymGraphContainer::SetKeyframeInterval(uint32_t fills)
+{
+  m_keyframeInterval = fills;
+}
+
+void
+OpenGymGraphContainer::RequestKeyframe()
+{
+  m_keyframe = true;
+}
+
+void
+OpenGymGraphContainer::Reuse()
+{
+  Reuse(0, 0);
+}
+
+void
+OpenGymGraphContainer::Reuse(uint32_t nodeFeatures, uint32_t edgeFeatures)
+{
+  m_graphId = m_nextGraphId++;
+  m_nodeFeatures = nodeFeatures;
+  m_edgeFeatures = edgeFeatures;
+  Clear();
+  m_seq = 0;
+  m_keyframeInterval = 0;
+  m_fillsSinceKeyframe = 0;
+}
+
+static void
+SetFeatureRows(ns3opengym::RawTensor *tensor, uint32_t rows, uint32_t cols)
+{
+  tensor->set_dtype(ns3opengym::FLOAT);
+  tensor->mutable_shape()->Clear();
+  tensor->add_shape(rows);
+  tensor->add_shape(cols);
+  tensor->mutable_data()->resize(rows * cols * sizeof(float));
+}
+
+static void
+SetIndexBytes(std::string *bytes, const uint32_t *data, size_t n)
+{
+  bytes->resize(n * sizeof(uint32_t));
+  if (n) {
+    std::memcpy(&(*bytes)[0], data, bytes->size());
+  }
+}
+
+void
+OpenGymGraphContainer::FillKeyframe(ns3opengym::GraphDataContainer &graph)
+{
+  // counting sort of the edges by source, stable in edge id order
+  uint32_t edges = m_src.size();
+  std::vector<uint32_t> indptr(m_nodes + 1, 0);
+  for (uint32_t e = 0; e < edges; e++) {
+    indptr[m_src[e] + 1]++;
+  }
+  for (uint32_t n = 0; n < m_nodes; n++) {
+    indptr[n + 1] += indptr[n];
+  }
+  SetIndexBytes(graph.mutable_indptr(), indptr.data(), indptr.size());
+  m_csrPos.resize(edges);
+  std::vector<uint32_t> indices(edges);
+  for (uint32_t e = 0; e < edges; e++) {
+    m_csrPos[e] = indptr[m_src[e]]++;
+    indices[m_csrPos[e]] = m_dst[e];
+  }
+  SetIndexBytes(graph.mutable_indices(), indices.data(), indices.size());
+
+  ns3opengym::RawTensor *nodes = graph.mutable_nodefeatures();
+  SetFeatureRows(nodes, m_nodes, m_nodeFeatures);
+  if (!m_nodeData.empty()) {
+    std::memcpy(&(*nodes->mutable_data())[0], m_nodeData.data(), m_nodeData.size() * sizeof(float));
+  }
+  ns3opengym::RawTensor *edgeRows = graph.mutable_edgefeatures();
+  SetFeatureRows(edgeRows, edges, m_edgeFeatures);
+  size_t rowBytes = m_edgeFeatures * sizeof(float);
+  for (uint32_t e = 0; e < edges && rowBytes; e++) {
+    std::memcpy(&(*edgeRows->mutable_data())[m_csrPos[e] * rowBytes], &m_edgeData[e * m_edgeFeatures], rowBytes);
+  }
+  graph.mutable_noderows()->clear();
+  graph.mutable_edgerows()->clear();
+}
+
+void
+OpenGymGraphContainer::FillUpdate(ns3opengym::GraphDataContainer &graph)
+{
+  graph.mutable_indptr()->clear();
+  graph.mutable_indices()->clear();
+
+  ns3opengym::RawTensor *nodes = graph.mutable_nodefeatures();
+  SetFeatureRows(nodes, m_changedNodes.size(), m_nodeFeatures);
+  size_t rowBytes = m_nodeFeatures * sizeof(float);
+  for (size_t i = 0; i < m_changedNodes.size(); i++) {
+    std::memcpy(&(*nodes->mutable_data())[i * rowBytes], &m_nodeData[m_changedNodes[i] * m_nodeFeatures], rowBytes);
+  }
+  SetIndexBytes(graph.mutable_noderows(), m_changedNodes.data(), m_changedNodes.size());
+
+  ns3opengym::RawTensor *edges = graph.mutable_edgefeatures();
+  SetFeatureRows(edges, m_changedEdges.size(), m_edgeFeatures);
+  rowBytes = m_edgeFeatures * sizeof(float);
+  std::string *edgeRows = graph.mutable_edgerows();
+  edgeRows->resize(m_changedEdges.size() * sizeof(uint32_t));
+  for (size_t i = 0; i < m_changedEdges.size(); i++) {
+    uint32_t e = m_changedEdges[i];
+    std::memcpy(&(*edges->mutable_data())[i * rowBytes], &m_edgeData[e * m_edgeFeatures], rowBytes);
+    std::memcpy(&(*edgeRows)[i * sizeof(uint32_t)], &m_csrPos[e], sizeof(uint32_t));
+  }
+}
+
+void
+OpenGymGraphContainer::FillTuple(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  FillKeyframe(m_graphPbMsg);
+  Ptr<OpenGymTupleContainer> tuple = Acquire<OpenGymTupleContainer>();
+
+  std::vector<uint32_t> shape(1, m_nodes + 1);
+  Ptr<OpenGymBoxContainer<uint32_t> > indptr = Acquire<OpenGymBoxContainer<uint32_t> >(shape, 0u);
+  std::memcpy(indptr->GetMutableDataView().data(), m_graphPbMsg.indptr().data(), m_graphPbMsg.indptr().size());
+  tuple->Add(indptr);
+
+  shape[0] = m_src.size();
+  Ptr<OpenGymBoxContainer<uint32_t> > indices = Acquire<OpenGymBoxContainer<uint32_t> >(shape, 0u);
+  if (!m_src.empty()) {
+    std::memcpy(indices->GetMutableDataView().data(), m_graphPbMsg.indices().data(), m_graphPbMsg.indices().size());
+  }
+  tuple->Add(indices);
+
+  const ns3opengym::RawTensor *tensors[] = {&m_graphPbMsg.nodefeatures(), &m_graphPbMsg.edgefeatures()};
+  for (int i = 0; i < 2; i++) {
+    shape.assign(tensors[i]->shape().begin(), tensors[i]->shape().end());
+    Ptr<OpenGymBoxContainer<float> > features = Acquire<OpenGymBoxContainer<float> >(shape, 0.0f);
+    if (!tensors[i]->data().empty()) {
+      std::memcpy(features->GetMutableDataView().data(), tensors[i]->data().data(), tensors[i]->data().size());
+    }
+    tuple->Add(features);
+  }
+  tuple->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+}
+
+ns3opengym::DataContainer
+OpenGymGraphContainer::GetDataContainerPbMsg()
+{
+  ns3opengym::DataContainer dataContainerPbMsg;
+  FillTuple(dataContainerPbMsg, 0);
+  return dataContainerPbMsg;
+}
+
+void
+OpenGymGraphContainer::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  if (rawTensorVersion < 7) {
+    FillTuple(dataContainerPbMsg, rawTensorVersion);
+    return;
+  }
+
+  bool keyframe = m_keyframe || m_seq == 0 ||
+                  (m_keyframeInterval && m_fillsSinceKeyframe + 1 >= m_keyframeInterval);
+  m_seq++;
+  m_graphPbMsg.set_graphid(m_graphId);
+  m_graphPbMsg.set_seq(m_seq);
+  m_graphPbMsg.set_keyframe(keyframe);
+  m_graphPbMsg.set_numnodes(m_nodes);
+  if (keyframe) {
+    FillKeyframe(m_graphPbMsg);
+    m_fillsSinceKeyframe = 0;
+  } else {
+    FillUpdate(m_graphPbMsg);
+    m_fillsSinceKeyframe++;
+  }
+  for (size_t i = 0; i < m_changedNodes.size(); i++) {
+    m_nodeChanged[m_changedNodes[i]] = 0;
+  }
+  for (size_t i = 0; i < m_changedEdges.size(); i++) {
+    m_edgeChanged[m_changedEdges[i]] = 0;
+  }
+  m_changedNodes.clear();
+  m_changedEdges.clear();
+  m_keyframe = false;
+
+  dataContainerPbMsg.set_type(ns3opengym::Graph);
+  google::protobuf::Any *any = dataContainerPbMsg.mutable_data();
+  if (any->Is<ns3opengym::GraphDataContainer>()) {
+    m_graphPbMsg.SerializeToString(any->mutable_value());
+  } else {
+    any->PackFrom(m_graphPbMsg);
+  }
+}
+
+void
+OpenGymGraphContainer::Print(std::ostream& where) const
+{
+  where << "Graph(nodes: " << m_nodes << ", edges: " << m_src.size() << ")";
+}
+
+}
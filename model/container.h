@@ -23,11 +23,21 @@
 #define OPENGYM_CONTAINER_H
 
 #include "ns3/object.h"
+#include "ns3/simple-ref-count.h"
 #include "ns3/type-name.h"
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <type_traits>
+#include <typeindex>
+#include <vector>
 #include "messages.pb.h"
 
 namespace ns3 {
 
+class OpenGymDictSpace;
+
 class OpenGymDataContainer : public Object
 {
 public:
@@ -37,7 +47,52 @@ public:
   static TypeId GetTypeId ();
 
   virtual ns3opengym::DataContainer GetDataContainerPbMsg() = 0;
-  static Ptr<OpenGymDataContainer> CreateFromDataContainerPbMsg(ns3opengym::DataContainer &dataContainer);
+  /**
+   * Fill \p dataContainer in place, e.g. a field of the state message.
+   * With a \p rawTensorVersion negotiated with the agent (not 0) Box data
+   * is written as one RawTensor byte block instead of a BoxDataContainer
+   * packed into Any. Native 8/16/64-bit and bool dtypes need version 3.
+   */
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+  static Ptr<OpenGymDataContainer> CreateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
+  /**
+   * Overwrite this container with the content of \p dataContainer, used to
+   * recycle action containers between steps.
+   * \return false if \p dataContainer does not fit this container type,
+   * the caller then falls back to CreateFromDataContainerPbMsg
+   */
+  virtual bool UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
+  /**
+   * Reset all fields of \p dataContainer to their defaults. Unlike Clear()
+   * submessages and string buffers are kept, so merging the next message
+   * into it does not allocate.
+   */
+  static void ResetDataContainerPbMsg(ns3opengym::DataContainer *dataContainer);
+
+  /**
+   * \return raw tensor version supported by this build, 0 on big-endian hosts.
+   * Version 2 adds delta encoded observations (TensorDelta), version 3
+   * native 8/16/64-bit and bool dtypes, version 4 batched multi-agent
+   * states (BatchedStateMsg), version 5 Dict elements by slot, version 6
+   * sparse Box data (SparseTensor), version 7 graphs (GraphDataContainer),
+   * version 8 compact MultiDiscrete and MultiBinary data.
+   */
+  static uint32_t GetRawTensorVersion();
+  // \return bytes per element of \p dtype in RawTensor data
+  static uint32_t GetDtypeSize(ns3opengym::Dtype dtype);
+
+  /**
+   * Like CreateObject<C> (args), but hands out a recycled container of
+   * the current OpenGymContainerPool if it has one. \p args are those of
+   * a C constructor. Without a current pool this is CreateObject.
+   */
+  template <typename C, typename... Args>
+  static Ptr<C> Acquire(const Args &... args);
+  /**
+   * Drop references before the container goes back to a pool, Tuple and
+   * Dict release their elements.
+   */
+  virtual void Recycle();
 
   virtual void Print(std::ostream& where) const = 0;
   friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymDataContainer> container)
@@ -52,6 +107,69 @@ protected:
   virtual void DoDispose (void);
 };
 
+/**
+ * Free lists of containers for OpenGymDataContainer::Acquire, one pool
+ * per interface. The interface makes its pool current while it steps and
+ * calls ReleaseStep at the start of the next step: containers only the
+ * pool still references (the observation was serialized, the action was
+ * executed) go back to the free list of their type, containers kept by
+ * the simulation are left to their Ptrs. In steady state every Acquire
+ * is a hit and a step allocates no containers.
+ */
+class OpenGymContainerPool : public SimpleRefCount<OpenGymContainerPool>
+{
+public:
+  OpenGymContainerPool ();
+
+  static OpenGymContainerPool *GetCurrent();
+  // 0 makes Acquire fall back to CreateObject
+  static void SetCurrent(OpenGymContainerPool *pool);
+
+  template <typename C, typename... Args>
+  Ptr<C> Acquire(const Args &... args);
+  void ReleaseStep();
+
+  // containers handed out recycled / newly created
+  uint64_t GetHits() const;
+  uint64_t GetMisses() const;
+
+private:
+  std::map<std::type_index, std::vector<Ptr<OpenGymDataContainer> > > m_free;
+  std::vector<Ptr<OpenGymDataContainer> > m_inUse;
+  uint64_t m_hits;
+  uint64_t m_misses;
+};
+
+template <typename C, typename... Args>
+Ptr<C>
+OpenGymContainerPool::Acquire(const Args &... args)
+{
+  std::vector<Ptr<OpenGymDataContainer> > &freeList = m_free[std::type_index(typeid(C))];
+  Ptr<C> container;
+  if (freeList.empty()) {
+    m_misses++;
+    container = CreateObject<C>(args...);
+  } else {
+    m_hits++;
+    container = StaticCast<C>(freeList.back());
+    freeList.pop_back();
+    container->Reuse(args...);
+  }
+  m_inUse.push_back(container);
+  return container;
+}
+
+template <typename C, typename... Args>
+Ptr<C>
+OpenGymDataContainer::Acquire(const Args &... args)
+{
+  OpenGymContainerPool *pool = OpenGymContainerPool::GetCurrent();
+  if (pool) {
+    return pool->Acquire<C>(args...);
+  }
+  return CreateObject<C>(args...);
+}
+
 
 class OpenGymDiscreteContainer : public OpenGymDataContainer
 {
@@ -63,6 +181,8 @@ public:
   static TypeId GetTypeId ();
 
   virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+  virtual bool UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
 
   virtual void Print(std::ostream& where) const;
   friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymDiscreteContainer> container)
@@ -74,6 +194,10 @@ public:
   bool SetValue(uint32_t value);
   uint32_t GetValue();
 
+  // called by OpenGymContainerPool, like the constructor with the same arguments
+  void Reuse();
+  void Reuse(uint32_t n);
+
 protected:
   // Inherited
   virtual void DoInitialize (void);
@@ -83,17 +207,195 @@ protected:
   uint32_t m_value;
 };
 
+/**
+ * Vector of discrete values, element i in [0, nvec[i]), e.g. one choice
+ * per node. Agents with raw tensor version 8 get the values in the
+ * smallest of uint8, uint16 and uint32 that holds them, older agents a
+ * uint32 Box.
+ */
+class OpenGymMultiDiscreteContainer : public OpenGymDataContainer
+{
+public:
+  OpenGymMultiDiscreteContainer ();
+  OpenGymMultiDiscreteContainer (std::vector<uint32_t> nvec);
+  virtual ~OpenGymMultiDiscreteContainer ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+  // nvec is not sent, received containers keep the one they had
+  virtual bool UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
+
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymMultiDiscreteContainer> container)
+  {
+    container->Print(os);
+    return os;
+  }
+
+  // \return false if idx or value is out of range
+  bool SetValue(uint32_t idx, uint32_t value);
+  uint32_t GetValue(uint32_t idx) const;
+  bool SetValues(const std::vector<uint32_t> &values);
+  const std::vector<uint32_t> &GetValues() const;
+  std::vector<uint32_t> GetNvec() const;
+  uint32_t GetSize() const;
+
+  // called by OpenGymContainerPool, like the constructor with the same arguments
+  void Reuse();
+  void Reuse(std::vector<uint32_t> nvec);
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  // smallest unsigned dtype for the values
+  ns3opengym::Dtype GetWireDtype() const;
+
+  std::vector<uint32_t> m_nvec;
+  std::vector<uint32_t> m_values;
+};
+
+/**
+ * Vector of n binary values, e.g. a channel mask. Agents with raw tensor
+ * version 8 get them packed to bits, older agents a bool Box.
+ */
+class OpenGymMultiBinaryContainer : public OpenGymDataContainer
+{
+public:
+  OpenGymMultiBinaryContainer ();
+  OpenGymMultiBinaryContainer (uint32_t n);
+  virtual ~OpenGymMultiBinaryContainer ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+  virtual bool UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
+
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymMultiBinaryContainer> container)
+  {
+    container->Print(os);
+    return os;
+  }
+
+  // \return false if idx is out of range
+  bool SetValue(uint32_t idx, bool value);
+  bool GetValue(uint32_t idx) const;
+  bool SetValues(const std::vector<bool> &values);
+  std::vector<bool> GetValues() const;
+  uint32_t GetSize() const;
+
+  // called by OpenGymContainerPool, like the constructor with the same arguments
+  void Reuse();
+  void Reuse(uint32_t n);
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  uint32_t m_n;
+  // bit i is bit i % 8 of byte i / 8, the wire format
+  std::string m_bits;
+};
+
+/**
+ * Read-only view of contiguous elements owned by a container, valid until
+ * the container is resized or destroyed. Does not copy.
+ */
+template <typename T>
+class OpenGymSpan
+{
+public:
+  OpenGymSpan () : m_data(0), m_size(0) {}
+  OpenGymSpan (T *data, size_t size) : m_data(data), m_size(size) {}
+
+  T *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  T *begin() const { return m_data; }
+  T *end() const { return m_data + m_size; }
+  T &operator[](size_t idx) const { return m_data[idx]; }
+
+private:
+  T *m_data;
+  size_t m_size;
+};
+
+/**
+ * Dtype of a Box element type, chosen at compile time. Wire is the element
+ * type in RawTensor data, Legacy and LegacyWire are sent to agents with a
+ * raw tensor version below 3 (and in BoxDataContainer). Types without a
+ * specialization are sent as FLOAT.
+ */
+template <typename T>
+struct OpenGymDtype
+{
+  static constexpr ns3opengym::Dtype value = ns3opengym::FLOAT;
+  static constexpr ns3opengym::Dtype legacy = ns3opengym::FLOAT;
+  typedef float Wire;
+  typedef float LegacyWire;
+};
+
+#define OPENGYM_DTYPE_DEFINE(type, dtype, wire, legacyDtype, legacyWire) \
+  template <>                                                         \
+  struct OpenGymDtype<type>                                           \
+  {                                                                   \
+    static constexpr ns3opengym::Dtype value = ns3opengym::dtype;     \
+    static constexpr ns3opengym::Dtype legacy = ns3opengym::legacyDtype; \
+    typedef wire Wire;                                                \
+    typedef legacyWire LegacyWire;                                    \
+  }
+
+OPENGYM_DTYPE_DEFINE (int8_t, INT8, int8_t, INT, int32_t);
+OPENGYM_DTYPE_DEFINE (uint8_t, UINT8, uint8_t, UINT, uint32_t);
+OPENGYM_DTYPE_DEFINE (int16_t, INT16, int16_t, INT, int32_t);
+OPENGYM_DTYPE_DEFINE (uint16_t, UINT16, uint16_t, UINT, uint32_t);
+OPENGYM_DTYPE_DEFINE (int32_t, INT, int32_t, INT, int32_t);
+OPENGYM_DTYPE_DEFINE (uint32_t, UINT, uint32_t, UINT, uint32_t);
+OPENGYM_DTYPE_DEFINE (int64_t, INT64, int64_t, INT, int32_t);
+OPENGYM_DTYPE_DEFINE (uint64_t, UINT64, uint64_t, UINT, uint32_t);
+OPENGYM_DTYPE_DEFINE (bool, BOOL, uint8_t, UINT, uint32_t);
+OPENGYM_DTYPE_DEFINE (float, FLOAT, float, FLOAT, float);
+OPENGYM_DTYPE_DEFINE (double, DOUBLE, double, DOUBLE, double);
+
+#undef OPENGYM_DTYPE_DEFINE
+
+/**
+ * Box data in row-major order.
+ *
+ * Created from a shape only, the container grows with AddValue. Created
+ * with a fill value it is fixed-shape: the data is allocated once for the
+ * whole shape, Set writes single elements by flat or N-d index and Reset
+ * makes it reusable for the next step. AddValue then writes from the
+ * start of the buffer instead of growing it.
+ *
+ * bool elements are stored as uint8_t (0 or 1), the views of a bool
+ * container are uint8_t views.
+ */
 template <typename T = float>
 class OpenGymBoxContainer : public OpenGymDataContainer
 {
 public:
+  typedef typename std::conditional<std::is_same<T, bool>::value, uint8_t, T>::type StorageType;
+
   OpenGymBoxContainer ();
   OpenGymBoxContainer (std::vector<uint32_t> shape);
+  // fixed-shape container with all elements set to fill
+  OpenGymBoxContainer (std::vector<uint32_t> shape, T fill);
   virtual ~OpenGymBoxContainer ();
 
   static TypeId GetTypeId ();
 
   virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+  virtual bool UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainer);
 
   virtual void Print(std::ostream& where) const;
   friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymBoxContainer> container)
@@ -104,11 +406,33 @@ public:
 
   bool AddValue(T value);
   T GetValue(uint32_t idx);
-
+  // \return false if idx is out of range
+  bool Set(uint32_t idx, T value);
+  bool Set(std::initializer_list<uint32_t> index, T value);
+  T Get(std::initializer_list<uint32_t> index) const;
+  // row-major position of an N-d index, the element count if out of range
+  uint32_t GetFlatIndex(std::initializer_list<uint32_t> index) const;
+  /**
+   * Reuse the container: a fixed-shape one is filled with T () and AddValue
+   * starts over, otherwise the data is cleared keeping its capacity.
+   */
+  void Reset();
+  bool IsFixedShape() const;
+  // called by OpenGymContainerPool, like the constructor with the same arguments
+  void Reuse();
+  void Reuse(std::vector<uint32_t> shape);
+  void Reuse(std::vector<uint32_t> shape, T fill);
+
+  // a fixed-shape container copies into its buffer, data has to fit
   bool SetData(std::vector<T> data);
+  // copies, see GetDataView
   std::vector<T> GetData();
+  OpenGymSpan<const StorageType> GetDataView() const;
+  // write access to the elements in place, e.g. to fill a fixed-shape container
+  OpenGymSpan<StorageType> GetMutableDataView();
 
   std::vector<uint32_t> GetShape();
+  OpenGymSpan<const uint32_t> GetShapeView() const;
 
 protected:
   // Inherited
@@ -116,17 +440,27 @@ protected:
   virtual void DoDispose (void);
 
 private:
-  void SetDtype();
+  // swaps if T is the storage type, converts otherwise (bool)
+  void MoveData(std::vector<StorageType> &data);
+  template <typename U>
+  void MoveData(std::vector<U> &data);
+  template <typename W>
+  void EncodeRawTensor(std::string *bytes) const;
+  template <typename W>
+  void DecodeRawTensor(const std::string &bytes);
 	std::vector<uint32_t> m_shape;
-	ns3opengym::Dtype m_dtype;
-	std::vector<T> m_data;
+	std::vector<StorageType> m_data;
+	// fixed-shape mode: m_data keeps the size of the shape, next AddValue
+	bool m_fixed;
+	uint32_t m_cursor;
 };
 
 template <typename T>
 TypeId
 OpenGymBoxContainer<T>::GetTypeId (void)
 {
-  std::string name = TypeNameGet<T> ();
+  // TypeNameGet has no bool specialization
+  std::string name = std::is_same<T, bool>::value ? std::string ("bool") : TypeNameGet<T> ();
   static TypeId tid = TypeId (("ns3::OpenGymBoxContainer<" + name + ">").c_str ())
     .SetParent<Object> ()
     .SetGroupName ("OpenGym")
@@ -136,38 +470,36 @@ OpenGymBoxContainer<T>::GetTypeId (void)
 }
 
 template <typename T>
-OpenGymBoxContainer<T>::OpenGymBoxContainer()
+OpenGymBoxContainer<T>::OpenGymBoxContainer():
+	m_fixed(false),
+	m_cursor(0)
 {
- SetDtype();
 }
 
 template <typename T>
 OpenGymBoxContainer<T>::OpenGymBoxContainer(std::vector<uint32_t> shape):
-	m_shape(shape)
+	m_shape(shape),
+	m_fixed(false),
+	m_cursor(0)
 {
-  SetDtype();
 }
 
 template <typename T>
-OpenGymBoxContainer<T>::~OpenGymBoxContainer ()
+OpenGymBoxContainer<T>::OpenGymBoxContainer(std::vector<uint32_t> shape, T fill):
+	m_shape(shape),
+	m_fixed(true),
+	m_cursor(0)
 {
+  size_t size = 1;
+  for (size_t i = 0; i < m_shape.size(); i++) {
+    size *= m_shape[i];
+  }
+  m_data.assign(size, fill);
 }
 
 template <typename T>
-void
-OpenGymBoxContainer<T>::SetDtype ()
+OpenGymBoxContainer<T>::~OpenGymBoxContainer ()
 {
-  std::string name = TypeNameGet<T> ();
-  if (name == "int8_t" || name == "int16_t" || name == "int32_t" || name == "int64_t") 
-    m_dtype = ns3opengym::INT;
-  else if (name == "uint8_t" || name == "uint16_t" || name == "uint32_t" || name == "uint64_t") 
-    m_dtype = ns3opengym::UINT;
-  else if (name == "float")
-    m_dtype = ns3opengym::FLOAT;
-  else if (name == "double")
-    m_dtype = ns3opengym::DOUBLE;
-  else
-    m_dtype = ns3opengym::FLOAT;
 }
 
 template <typename T>
@@ -189,23 +521,23 @@ OpenGymBoxContainer<T>::GetDataContainerPbMsg()
   ns3opengym::DataContainer dataContainerPbMsg;
   ns3opengym::BoxDataContainer boxContainerPbMsg;
 
-  std::vector<uint32_t> shape = GetShape();
-  *boxContainerPbMsg.mutable_shape() = {shape.begin(), shape.end()};
-
+  *boxContainerPbMsg.mutable_shape() = {m_shape.begin(), m_shape.end()};
 
-  boxContainerPbMsg.set_dtype(m_dtype);
-  std::vector<T> data = GetData();
+  // the agent may not know the native dtypes
+  const ns3opengym::Dtype dtype = OpenGymDtype<T>::legacy;
+  boxContainerPbMsg.set_dtype(dtype);
+  const std::vector<StorageType> &data = m_data;
 
-  if (m_dtype == ns3opengym::INT) {
+  if (dtype == ns3opengym::INT) {
     *boxContainerPbMsg.mutable_intdata() = {data.begin(), data.end()};
 
-  } else if (m_dtype == ns3opengym::UINT) {
+  } else if (dtype == ns3opengym::UINT) {
     *boxContainerPbMsg.mutable_uintdata() = {data.begin(), data.end()};
 
-  } else if (m_dtype == ns3opengym::FLOAT) {
+  } else if (dtype == ns3opengym::FLOAT) {
     *boxContainerPbMsg.mutable_floatdata() = {data.begin(), data.end()};
 
-  } else if (m_dtype == ns3opengym::DOUBLE) {
+  } else if (dtype == ns3opengym::DOUBLE) {
     *boxContainerPbMsg.mutable_doubledata() = {data.begin(), data.end()};
 
   } else {
@@ -217,14 +549,205 @@ OpenGymBoxContainer<T>::GetDataContainerPbMsg()
   return dataContainerPbMsg;
 }
 
+template <typename T>
+void
+OpenGymBoxContainer<T>::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  if (!rawTensorVersion) {
+    dataContainerPbMsg = GetDataContainerPbMsg();
+    return;
+  }
+
+  dataContainerPbMsg.set_type(ns3opengym::Box);
+  ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor();
+  // Clear() keeps the capacity of the reused message
+  tensor->mutable_shape()->Clear();
+  tensor->mutable_shape()->Add(m_shape.begin(), m_shape.end());
+
+  if (rawTensorVersion >= 3) {
+    tensor->set_dtype(OpenGymDtype<T>::value);
+    EncodeRawTensor<typename OpenGymDtype<T>::Wire>(tensor->mutable_data());
+  } else {
+    tensor->set_dtype(OpenGymDtype<T>::legacy);
+    EncodeRawTensor<typename OpenGymDtype<T>::LegacyWire>(tensor->mutable_data());
+  }
+}
+
+template <typename T>
+template <typename W>
+void
+OpenGymBoxContainer<T>::EncodeRawTensor(std::string *bytes) const
+{
+  // W is the wire type of the sent dtype, the host is little-endian (see GetRawTensorVersion)
+  bytes->resize(m_data.size() * sizeof(W));
+  char *out = &(*bytes)[0];
+  if (std::is_same<StorageType, W>::value) {
+    std::memcpy(out, m_data.data(), bytes->size());
+    return;
+  }
+  for (size_t i = 0; i < m_data.size(); i++) {
+    W value = static_cast<W>(m_data[i]);
+    std::memcpy(out + i * sizeof(W), &value, sizeof(W));
+  }
+}
+
+template <typename T>
+bool
+OpenGymBoxContainer<T>::UpdateFromDataContainerPbMsg(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  // only raw tensors of the own dtype, BoxDataContainer messages allocate anyway
+  if (dataContainerPbMsg.type() != ns3opengym::Box || !dataContainerPbMsg.has_tensor()) {
+    return false;
+  }
+  const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+  if (tensor.dtype() != OpenGymDtype<T>::value) {
+    return false;
+  }
+  // a fixed-shape container keeps its shape and buffer
+  if (m_fixed && (tensor.shape_size() != (int) m_shape.size() ||
+                  !std::equal(m_shape.begin(), m_shape.end(), tensor.shape().begin()))) {
+    return false;
+  }
+
+  size_t size = 1;
+  for (int i = 0; i < tensor.shape_size(); i++) {
+    size *= tensor.shape(i);
+  }
+  if (tensor.data().size() != size * sizeof(typename OpenGymDtype<T>::Wire)) {
+    return false;
+  }
+
+  m_shape.assign(tensor.shape().begin(), tensor.shape().end());
+  DecodeRawTensor<typename OpenGymDtype<T>::Wire>(tensor.data());
+  m_cursor = 0;
+  return true;
+}
+
+template <typename T>
+template <typename W>
+void
+OpenGymBoxContainer<T>::DecodeRawTensor(const std::string &bytes)
+{
+  m_data.resize(bytes.size() / sizeof(W));
+  if (std::is_same<StorageType, W>::value) {
+    std::memcpy(m_data.data(), bytes.data(), m_data.size() * sizeof(W));
+    return;
+  }
+  for (size_t i = 0; i < m_data.size(); i++) {
+    W value;
+    std::memcpy(&value, bytes.data() + i * sizeof(W), sizeof(W));
+    m_data[i] = static_cast<T>(value);
+  }
+}
+
 template <typename T>
 bool
 OpenGymBoxContainer<T>::AddValue(T value)
 {
+  if (m_fixed) {
+    if (m_cursor >= m_data.size()) {
+      return false;
+    }
+    m_data[m_cursor++] = value;
+    return true;
+  }
   m_data.push_back(value);
   return true;
 }
 
+template <typename T>
+bool
+OpenGymBoxContainer<T>::Set(uint32_t idx, T value)
+{
+  if (idx >= m_data.size()) {
+    return false;
+  }
+  m_data[idx] = value;
+  return true;
+}
+
+template <typename T>
+bool
+OpenGymBoxContainer<T>::Set(std::initializer_list<uint32_t> index, T value)
+{
+  return Set(GetFlatIndex(index), value);
+}
+
+template <typename T>
+T
+OpenGymBoxContainer<T>::Get(std::initializer_list<uint32_t> index) const
+{
+  uint32_t idx = GetFlatIndex(index);
+  return idx < m_data.size() ? m_data[idx] : 0;
+}
+
+template <typename T>
+uint32_t
+OpenGymBoxContainer<T>::GetFlatIndex(std::initializer_list<uint32_t> index) const
+{
+  if (index.size() != m_shape.size()) {
+    return m_data.size();
+  }
+  uint32_t idx = 0;
+  std::vector<uint32_t>::const_iterator dim = m_shape.begin();
+  for (const uint32_t *i = index.begin(); i != index.end(); ++i, ++dim) {
+    if (*i >= *dim) {
+      return m_data.size();
+    }
+    idx = idx * (*dim) + *i;
+  }
+  return idx;
+}
+
+template <typename T>
+void
+OpenGymBoxContainer<T>::Reset()
+{
+  m_cursor = 0;
+  if (m_fixed) {
+    std::fill(m_data.begin(), m_data.end(), StorageType());
+    return;
+  }
+  m_data.clear();
+}
+
+template <typename T>
+bool
+OpenGymBoxContainer<T>::IsFixedShape() const
+{
+  return m_fixed;
+}
+
+template <typename T>
+void
+OpenGymBoxContainer<T>::Reuse()
+{
+  Reuse(std::vector<uint32_t>());
+}
+
+template <typename T>
+void
+OpenGymBoxContainer<T>::Reuse(std::vector<uint32_t> shape)
+{
+  m_shape.swap(shape);
+  m_fixed = false;
+  Reset();
+}
+
+template <typename T>
+void
+OpenGymBoxContainer<T>::Reuse(std::vector<uint32_t> shape, T fill)
+{
+  m_shape.swap(shape);
+  m_fixed = true;
+  m_cursor = 0;
+  size_t size = 1;
+  for (size_t i = 0; i < m_shape.size(); i++) {
+    size *= m_shape[i];
+  }
+  m_data.assign(size, fill);
+}
+
 template <typename T>
 T
 OpenGymBoxContainer<T>::GetValue(uint32_t idx)
@@ -241,10 +764,32 @@ template <typename T>
 bool
 OpenGymBoxContainer<T>::SetData(std::vector<T> data)
 {
-  m_data = data;
+  if (m_fixed) {
+    if (data.size() != m_data.size()) {
+      return false;
+    }
+    std::copy(data.begin(), data.end(), m_data.begin());
+    return true;
+  }
+  MoveData(data);
   return true;
 }
 
+template <typename T>
+void
+OpenGymBoxContainer<T>::MoveData(std::vector<StorageType> &data)
+{
+  m_data.swap(data);
+}
+
+template <typename T>
+template <typename U>
+void
+OpenGymBoxContainer<T>::MoveData(std::vector<U> &data)
+{
+  m_data.assign(data.begin(), data.end());
+}
+
 template <typename T>
 std::vector<uint32_t>
 OpenGymBoxContainer<T>::GetShape()
@@ -256,7 +801,28 @@ template <typename T>
 std::vector<T>
 OpenGymBoxContainer<T>::GetData()
 {
-  return m_data;
+  return std::vector<T>(m_data.begin(), m_data.end());
+}
+
+template <typename T>
+OpenGymSpan<const typename OpenGymBoxContainer<T>::StorageType>
+OpenGymBoxContainer<T>::GetDataView() const
+{
+  return OpenGymSpan<const StorageType>(m_data.data(), m_data.size());
+}
+
+template <typename T>
+OpenGymSpan<typename OpenGymBoxContainer<T>::StorageType>
+OpenGymBoxContainer<T>::GetMutableDataView()
+{
+  return OpenGymSpan<StorageType>(m_data.data(), m_data.size());
+}
+
+template <typename T>
+OpenGymSpan<const uint32_t>
+OpenGymBoxContainer<T>::GetShapeView() const
+{
+  return OpenGymSpan<const uint32_t>(m_shape.data(), m_shape.size());
 }
 
 template <typename T>
@@ -276,6 +842,338 @@ OpenGymBoxContainer<T>::Print(std::ostream& where) const
 }
 
 
+/**
+ * Box data of which most elements are zero, holding only the added
+ * elements. Add appends one element by flat or N-d index during the step,
+ * no dense buffer is built; an index added twice adds up. Agents with raw
+ * tensor version 6 get a SparseTensor in COO format, or CSR for 2-d
+ * shapes if asked for, older agents the dense Box.
+ */
+template <typename T = float>
+class OpenGymSparseBoxContainer : public OpenGymDataContainer
+{
+public:
+  typedef typename OpenGymBoxContainer<T>::StorageType StorageType;
+  enum Format {
+    COO = ns3opengym::SparseTensor::COO,
+    CSR = ns3opengym::SparseTensor::CSR
+  };
+
+  OpenGymSparseBoxContainer ();
+  OpenGymSparseBoxContainer (std::vector<uint32_t> shape, Format format = COO);
+  virtual ~OpenGymSparseBoxContainer ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymSparseBoxContainer> container)
+  {
+    container->Print(os);
+    return os;
+  }
+
+  // \return false if idx is out of range
+  bool Add(uint32_t idx, T value);
+  bool Add(std::initializer_list<uint32_t> index, T value);
+  // number of added elements
+  uint32_t GetNnz() const;
+  // row-major copy with the added elements summed up
+  std::vector<T> GetDense() const;
+  // drop the elements, keeping the capacity
+  void Reset();
+  // called by OpenGymContainerPool, like the constructor with the same arguments
+  void Reuse();
+  void Reuse(std::vector<uint32_t> shape);
+  void Reuse(std::vector<uint32_t> shape, Format format);
+
+  std::vector<uint32_t> GetShape();
+  // CSR needs a 2-d shape, other shapes are sent as COO
+  void SetFormat(Format format);
+  Format GetFormat() const;
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  uint32_t GetSize() const;
+  template <typename W>
+  void EncodeValues(std::string *bytes, const std::vector<uint32_t> *order) const;
+  // dense Box of the same elements, for agents without sparse tensors
+  Ptr<OpenGymBoxContainer<T> > ToBox() const;
+
+  std::vector<uint32_t> m_shape;
+  Format m_format;
+  // flat row-major index and value of every added element, in Add order
+  std::vector<uint32_t> m_indices;
+  std::vector<StorageType> m_values;
+  // CSR: element order sorted by row, reused between steps
+  std::vector<uint32_t> m_order;
+};
+
+template <typename T>
+TypeId
+OpenGymSparseBoxContainer<T>::GetTypeId (void)
+{
+  std::string name = std::is_same<T, bool>::value ? std::string ("bool") : TypeNameGet<T> ();
+  static TypeId tid = TypeId (("ns3::OpenGymSparseBoxContainer<" + name + ">").c_str ())
+    .SetParent<Object> ()
+    .SetGroupName ("OpenGym")
+    .template AddConstructor<OpenGymSparseBoxContainer<T> > ()
+    ;
+  return tid;
+}
+
+template <typename T>
+OpenGymSparseBoxContainer<T>::OpenGymSparseBoxContainer():
+	m_format(COO)
+{
+}
+
+template <typename T>
+OpenGymSparseBoxContainer<T>::OpenGymSparseBoxContainer(std::vector<uint32_t> shape, Format format):
+	m_shape(shape),
+	m_format(format)
+{
+}
+
+template <typename T>
+OpenGymSparseBoxContainer<T>::~OpenGymSparseBoxContainer ()
+{
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::DoDispose (void)
+{
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::DoInitialize (void)
+{
+}
+
+template <typename T>
+uint32_t
+OpenGymSparseBoxContainer<T>::GetSize() const
+{
+  uint32_t size = 1;
+  for (size_t i = 0; i < m_shape.size(); i++) {
+    size *= m_shape[i];
+  }
+  return size;
+}
+
+template <typename T>
+bool
+OpenGymSparseBoxContainer<T>::Add(uint32_t idx, T value)
+{
+  if (idx >= GetSize()) {
+    return false;
+  }
+  m_indices.push_back(idx);
+  m_values.push_back(value);
+  return true;
+}
+
+template <typename T>
+bool
+OpenGymSparseBoxContainer<T>::Add(std::initializer_list<uint32_t> index, T value)
+{
+  if (index.size() != m_shape.size()) {
+    return false;
+  }
+  uint32_t idx = 0;
+  const uint32_t *dim = m_shape.data();
+  for (std::initializer_list<uint32_t>::const_iterator it = index.begin(); it != index.end(); ++it, ++dim) {
+    if (*it >= *dim) {
+      return false;
+    }
+    idx = idx * *dim + *it;
+  }
+  return Add(idx, value);
+}
+
+template <typename T>
+uint32_t
+OpenGymSparseBoxContainer<T>::GetNnz() const
+{
+  return m_indices.size();
+}
+
+template <typename T>
+std::vector<T>
+OpenGymSparseBoxContainer<T>::GetDense() const
+{
+  std::vector<T> dense(GetSize(), T());
+  for (size_t i = 0; i < m_indices.size(); i++) {
+    dense[m_indices[i]] = static_cast<T>(dense[m_indices[i]] + m_values[i]);
+  }
+  return dense;
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::Reset()
+{
+  m_indices.clear();
+  m_values.clear();
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::Reuse()
+{
+  Reuse(std::vector<uint32_t>(), COO);
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::Reuse(std::vector<uint32_t> shape)
+{
+  Reuse(shape, COO);
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::Reuse(std::vector<uint32_t> shape, Format format)
+{
+  m_shape.swap(shape);
+  m_format = format;
+  Reset();
+}
+
+template <typename T>
+std::vector<uint32_t>
+OpenGymSparseBoxContainer<T>::GetShape()
+{
+  return m_shape;
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::SetFormat(Format format)
+{
+  m_format = format;
+}
+
+template <typename T>
+typename OpenGymSparseBoxContainer<T>::Format
+OpenGymSparseBoxContainer<T>::GetFormat() const
+{
+  return m_format;
+}
+
+template <typename T>
+Ptr<OpenGymBoxContainer<T> >
+OpenGymSparseBoxContainer<T>::ToBox() const
+{
+  Ptr<OpenGymBoxContainer<T> > box = Acquire<OpenGymBoxContainer<T> >(m_shape, T());
+  OpenGymSpan<StorageType> data = box->GetMutableDataView();
+  for (size_t i = 0; i < m_indices.size(); i++) {
+    data[m_indices[i]] = static_cast<T>(data[m_indices[i]] + m_values[i]);
+  }
+  return box;
+}
+
+template <typename T>
+ns3opengym::DataContainer
+OpenGymSparseBoxContainer<T>::GetDataContainerPbMsg()
+{
+  return ToBox()->GetDataContainerPbMsg();
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion)
+{
+  if (rawTensorVersion < 6) {
+    ToBox()->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+    return;
+  }
+
+  dataContainerPbMsg.set_type(ns3opengym::SparseBox);
+  ns3opengym::SparseTensor *sparse = dataContainerPbMsg.mutable_sparse();
+  sparse->set_dtype(OpenGymDtype<T>::value);
+  sparse->mutable_shape()->Clear();
+  sparse->mutable_shape()->Add(m_shape.begin(), m_shape.end());
+  size_t nnz = m_indices.size();
+  std::string *indices = sparse->mutable_indices();
+  std::string *indptr = sparse->mutable_indptr();
+
+  if (m_format == CSR && m_shape.size() == 2) {
+    // counting sort by row, stable so the elements of a row keep their order
+    uint32_t rows = m_shape[0];
+    uint32_t cols = m_shape[1];
+    std::vector<uint32_t> rowStart(rows + 1, 0);
+    for (size_t i = 0; i < nnz; i++) {
+      rowStart[m_indices[i] / cols + 1]++;
+    }
+    for (uint32_t r = 0; r < rows; r++) {
+      rowStart[r + 1] += rowStart[r];
+    }
+    indptr->resize((rows + 1) * sizeof(uint32_t));
+    std::memcpy(&(*indptr)[0], rowStart.data(), indptr->size());
+    m_order.resize(nnz);
+    for (size_t i = 0; i < nnz; i++) {
+      m_order[rowStart[m_indices[i] / cols]++] = i;
+    }
+    indices->resize(nnz * sizeof(uint32_t));
+    for (size_t i = 0; i < nnz; i++) {
+      uint32_t col = m_indices[m_order[i]] % cols;
+      std::memcpy(&(*indices)[i * sizeof(uint32_t)], &col, sizeof(uint32_t));
+    }
+    sparse->set_format(ns3opengym::SparseTensor::CSR);
+    EncodeValues<typename OpenGymDtype<T>::Wire>(sparse->mutable_values(), &m_order);
+    return;
+  }
+
+  // COO: coordinates [rank, nnz], one row per dimension
+  size_t rank = m_shape.size();
+  indptr->clear();
+  indices->resize(rank * nnz * sizeof(uint32_t));
+  for (size_t i = 0; i < nnz; i++) {
+    uint32_t idx = m_indices[i];
+    for (size_t d = rank; d-- > 0;) {
+      uint32_t coord = idx % m_shape[d];
+      idx /= m_shape[d];
+      std::memcpy(&(*indices)[(d * nnz + i) * sizeof(uint32_t)], &coord, sizeof(uint32_t));
+    }
+  }
+  sparse->set_format(ns3opengym::SparseTensor::COO);
+  EncodeValues<typename OpenGymDtype<T>::Wire>(sparse->mutable_values(), 0);
+}
+
+template <typename T>
+template <typename W>
+void
+OpenGymSparseBoxContainer<T>::EncodeValues(std::string *bytes, const std::vector<uint32_t> *order) const
+{
+  bytes->resize(m_values.size() * sizeof(W));
+  for (size_t i = 0; i < m_values.size(); i++) {
+    W value = static_cast<W>(m_values[order ? (*order)[i] : i]);
+    std::memcpy(&(*bytes)[i * sizeof(W)], &value, sizeof(W));
+  }
+}
+
+template <typename T>
+void
+OpenGymSparseBoxContainer<T>::Print(std::ostream& where) const
+{
+  where << "Sparse[";
+  for (size_t i = 0; i < m_indices.size(); i++) {
+    where << m_indices[i] << ": " << std::to_string(m_values[i]);
+    if (i + 1 != m_indices.size())
+      where << ", ";
+  }
+  where << "]";
+}
+
 class OpenGymTupleContainer : public OpenGymDataContainer
 {
 public:
@@ -285,6 +1183,7 @@ public:
   static TypeId GetTypeId ();
 
   virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
 
   virtual void Print(std::ostream& where) const;
   friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymTupleContainer> container)
@@ -296,6 +1195,10 @@ public:
   bool Add(Ptr<OpenGymDataContainer> space);
   Ptr<OpenGymDataContainer> Get(uint32_t idx);
 
+  virtual void Recycle();
+  // called by OpenGymContainerPool, like the constructor
+  void Reuse();
+
 protected:
   // Inherited
   virtual void DoInitialize (void);
@@ -305,15 +1208,23 @@ protected:
 };
 
 
+/**
+ * Elements by key. A container bound to an OpenGymDictSpace (constructor
+ * or Bind) has one slot per key of the space: Get and Set by slot are
+ * array lookups and from raw tensor version 5 elements are sent with their
+ * slot instead of their key, the agent knows the keys from the space.
+ */
 class OpenGymDictContainer : public OpenGymDataContainer
 {
 public:
   OpenGymDictContainer ();
+  OpenGymDictContainer (Ptr<OpenGymDictSpace> space);
   virtual ~OpenGymDictContainer ();
 
   static TypeId GetTypeId ();
 
   virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
 
   virtual void Print(std::ostream& where) const;
   friend std::ostream& operator<< ( std::ostream& os, const Ptr<OpenGymDictContainer> container)
@@ -322,15 +1233,148 @@ public:
     return os;
   }
 
+  // false if the container is bound and the space has no such key
   bool Add(std::string key, Ptr<OpenGymDataContainer> value);
   Ptr<OpenGymDataContainer> Get(std::string key);
+  ///\{ by slot of the bound space, unbound ones have the slots they received
+  bool Set(uint32_t slot, Ptr<OpenGymDataContainer> value);
+  Ptr<OpenGymDataContainer> Get(uint32_t slot);
+  ///\}
+
+  /**
+   * Move the elements added by key to their slots of \p space.
+   * \return false if an element has a key \p space does not have
+   */
+  bool Bind(Ptr<OpenGymDictSpace> space);
+  Ptr<OpenGymDictSpace> GetSpace() const;
+
+  virtual void Recycle();
+  // called by OpenGymContainerPool, like the constructors
+  void Reuse();
+  void Reuse(Ptr<OpenGymDictSpace> space);
 
 protected:
   // Inherited
   virtual void DoInitialize (void);
   virtual void DoDispose (void);
 
-  std::map< std::string, Ptr<OpenGymDataContainer> > m_dict;
+  Ptr<OpenGymDictSpace> m_space;
+  // unbound: sorted keys, empty for elements received by slot
+  std::vector<std::string> m_keys;
+  // bound: per slot of m_space, 0 if not set
+  std::vector< Ptr<OpenGymDataContainer> > m_elements;
+};
+
+/**
+ * Graph for GNN agents: CSR adjacency, node features [nodes, n] and edge
+ * features [edges, m], float. Nodes and edges are added during the step,
+ * features are set by node index and by the edge id AddEdge returned.
+ *
+ * Agents with raw tensor version 7 get a keyframe with the whole graph
+ * after a structural change (AddNode, AddEdge, RemoveEdge, Clear), every
+ * keyframe interval and on RequestKeyframe, otherwise only the feature
+ * rows set to a different value since the previous fill. Every fill is
+ * the next message of the graph, an update only applies to the previous
+ * one: the multi-agent interface fills a graph shared by several agents
+ * once per step and sends a keyframe to agents that missed a message.
+ * Older agents get a Tuple of Boxes (indptr, indices, node features, edge
+ * features).
+ */
+class OpenGymGraphContainer : public OpenGymDataContainer
+{
+public:
+  OpenGymGraphContainer ();
+  OpenGymGraphContainer (uint32_t nodeFeatures, uint32_t edgeFeatures);
+  virtual ~OpenGymGraphContainer ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::DataContainer GetDataContainerPbMsg();
+  virtual void FillDataContainerPbMsg(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymGraphContainer> container)
+  {
+    container->Print(os);
+    return os;
+  }
+
+  // \return index of the first new node, features are 0
+  uint32_t AddNodes(uint32_t count);
+  uint32_t AddNode();
+  // \return id of the new edge, -1 if a node is out of range
+  int32_t AddEdge(uint32_t src, uint32_t dst);
+  // the last edge takes the id of the removed one
+  bool RemoveEdge(uint32_t edge);
+  // remove all nodes and edges
+  void Clear();
+
+  // \return false if the node or edge is out of range or features too long
+  bool SetNodeFeatures(uint32_t node, const std::vector<float> &features);
+  bool SetNodeFeature(uint32_t node, uint32_t idx, float value);
+  bool SetEdgeFeatures(uint32_t edge, const std::vector<float> &features);
+  bool SetEdgeFeature(uint32_t edge, uint32_t idx, float value);
+  float GetNodeFeature(uint32_t node, uint32_t idx) const;
+  float GetEdgeFeature(uint32_t edge, uint32_t idx) const;
+
+  uint32_t GetNodeCount() const;
+  uint32_t GetEdgeCount() const;
+  uint32_t GetEdgeSource(uint32_t edge) const;
+  uint32_t GetEdgeTarget(uint32_t edge) const;
+  uint32_t GetNodeFeatureCount() const;
+  uint32_t GetEdgeFeatureCount() const;
+  uint64_t GetGraphId() const;
+  // sequence number of the last fill, 0 before the first one
+  uint32_t GetSeq() const;
+
+  // send a keyframe at least every \p fills fills, 0 only when needed
+  void SetKeyframeInterval(uint32_t fills);
+  void RequestKeyframe();
+
+  // called by OpenGymContainerPool, like the constructor with the same
+  // arguments, the graph gets a new id
+  void Reuse();
+  void Reuse(uint32_t nodeFeatures, uint32_t edgeFeatures);
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  void MarkNode(uint32_t node);
+  void MarkEdge(uint32_t edge);
+  // structural changes force a keyframe, pending row changes are void
+  void DropChanges();
+  void FillKeyframe(ns3opengym::GraphDataContainer &graph);
+  void FillUpdate(ns3opengym::GraphDataContainer &graph);
+  void FillTuple(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion);
+
+  static uint64_t m_nextGraphId;
+
+  uint64_t m_graphId;
+  uint32_t m_nodeFeatures;
+  uint32_t m_edgeFeatures;
+  uint32_t m_nodes;
+  // source and target node of every edge id
+  std::vector<uint32_t> m_src;
+  std::vector<uint32_t> m_dst;
+  // row-major, nodes in index order, edges in id order
+  std::vector<float> m_nodeData;
+  std::vector<float> m_edgeData;
+
+  // CSR position of every edge id, valid from the last keyframe on
+  std::vector<uint32_t> m_csrPos;
+  // rows changed since the last fill, flags avoid duplicates
+  std::vector<uint32_t> m_changedNodes;
+  std::vector<uint32_t> m_changedEdges;
+  std::vector<uint8_t> m_nodeChanged;
+  std::vector<uint8_t> m_edgeChanged;
+  bool m_keyframe;
+  uint32_t m_seq;
+  uint32_t m_keyframeInterval;
+  uint32_t m_fillsSinceKeyframe;
+  ns3opengym::GraphDataContainer m_graphPbMsg;
 };
 
 } // end of namespace ns3
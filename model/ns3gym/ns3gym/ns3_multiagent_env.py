@@ -34,66 +34,343 @@ https://github.com/openai/multiagent-particle-envs
 
 import os
 import sys
+import signal
+import itertools
 import zmq
 
 import numpy as np
+try:
+    import scipy.sparse as sp
+except ImportError:
+    sp = None
 import gym
 from gym import spaces
-from ns3gym.start_sim import  start_sim_script
+from ns3gym.start_sim import  start_sim_script, ForkServer, SimLauncher, SimPool
+from ns3gym.shm_channel import ShmChannel, DEFAULT_SHM_SIZE
 import ns3gym.messages_pb2 as pb
 from google.protobuf.any_pb2 import Any
 
+# raw tensor version understood by this agent, see RawTensor in messages.proto
+RAW_TENSOR_VERSION = 8
+RAW_TENSOR_DTYPES = {pb.INT: np.dtype('<i4'), pb.UINT: np.dtype('<u4'),
+                     pb.FLOAT: np.dtype('<f4'), pb.DOUBLE: np.dtype('<f8'),
+                     pb.INT8: np.dtype('i1'), pb.UINT8: np.dtype('u1'),
+                     pb.INT16: np.dtype('<i2'), pb.UINT16: np.dtype('<u2'),
+                     pb.INT64: np.dtype('<i8'), pb.UINT64: np.dtype('<u8'),
+                     pb.BOOL: np.dtype('?')}
+# dtypes of raw tensor version 3, simulations send INT / UINT to older agents.
+# Box spaces of these dtypes keep it in space.ns3Dtype, their actions are
+# sent natively, as raw tensor or as BoxDataContainer.packedData
+NATIVE_DTYPES = (pb.INT8, pb.UINT8, pb.INT16, pb.UINT16, pb.INT64, pb.UINT64, pb.BOOL)
+
+# gym spaces built from the interned spaces of MultiAgentInitMsg, keyed by
+# fingerprint and whether the native dtypes are used (raw tensor version
+# >= 3). Kept for the process, so reconnecting on reset() and every
+# simulation of a VecMultiEnv reuse them. Agents with equal spaces share
+# one space object.
+_SPACE_CACHE = {}
+
+def decode_sparse(sparse, densify=False):
+    """
+    SparseTensor (raw tensor version 6) as scipy.sparse csr_matrix or
+    coo_matrix. densify=True, other ranks than 2 or a missing scipy give a
+    numpy array, duplicate elements add up either way.
+    """
+    shape = tuple(sparse.shape)
+    values = np.frombuffer(sparse.values, dtype=RAW_TENSOR_DTYPES.get(sparse.dtype, np.float32))
+    indices = np.frombuffer(sparse.indices, dtype='<u4')
+    if sparse.format == pb.SparseTensor.CSR:
+        indptr = np.frombuffer(sparse.indptr, dtype='<u4')
+        if sp is not None and not densify:
+            return sp.csr_matrix((values, indices, indptr), shape=shape)
+        coords = (np.repeat(np.arange(shape[0]), np.diff(indptr)), indices)
+    else:
+        coords = tuple(indices.reshape(len(shape), -1))
+        if sp is not None and not densify and len(shape) == 2:
+            return sp.coo_matrix((values, coords), shape=shape)
+    data = np.zeros(shape, dtype=values.dtype)
+    np.add.at(data, coords, values)
+    return data
+
+def decode_graph(graph, graphs):
+    """
+    GraphDataContainer (raw tensor version 7) as dict of the CSR adjacency
+    'indptr' and 'indices' and the features 'nodes' [nodes, n] and 'edges'
+    [edges, m], edges in CSR order. graphs keeps the last graph of every
+    graph id: an update changes its feature rows in place and returns the
+    same dict. Agents sharing a graph get the same message.
+    """
+    last = graphs.get(graph.graphId)
+    if last is not None and last[0] == graph.seq:
+        return last[1]
+    if graph.keyframe:
+        data = {'indptr': np.frombuffer(graph.indptr, dtype='<u4'),
+                'indices': np.frombuffer(graph.indices, dtype='<u4'),
+                'nodes': _graph_rows(graph.nodeFeatures).copy(),
+                'edges': _graph_rows(graph.edgeFeatures).copy()}
+        graphs[graph.graphId] = [graph.seq, data]
+        return data
+    if last is None or last[0] != graph.seq - 1:
+        # the simulation sends keyframes to agents that missed a message
+        raise RuntimeError("Graph %d: update %d without the previous message" % (graph.graphId, graph.seq))
+    last[0] = graph.seq
+    data = last[1]
+    for key, rows, features in (('nodes', graph.nodeRows, graph.nodeFeatures),
+                                ('edges', graph.edgeRows, graph.edgeFeatures)):
+        rows = np.frombuffer(rows, dtype='<u4')
+        if len(rows):
+            data[key][rows] = _graph_rows(features)
+    return data
+
+def _graph_rows(tensor):
+    return np.frombuffer(tensor.data, dtype='<f4').reshape(tuple(tensor.shape))
+
+def decode_multi(dataContainerPb):
+    """
+    MultiDiscrete values as numpy array of the wire dtype (uint8, uint16 or
+    uint32), MultiBinary values as int8 array of 0 and 1.
+    """
+    if dataContainerPb.HasField('tensor'):
+        tensor = dataContainerPb.tensor
+        if dataContainerPb.type == pb.MultiBinary:
+            bits = np.frombuffer(tensor.data, dtype=np.uint8)
+            return np.unpackbits(bits, count=tensor.shape[0], bitorder='little').view(np.int8)
+        return np.frombuffer(tensor.data, dtype=RAW_TENSOR_DTYPES[tensor.dtype])
+    boxContainerPb = pb.BoxDataContainer()
+    dataContainerPb.data.Unpack(boxContainerPb)
+    return np.array(boxContainerPb.uintData, dtype=np.int8 if dataContainerPb.type == pb.MultiBinary else np.uint32)
+
+def pack_multi(dataContainer, actions, space, rawTensorVersion):
+    """
+    MultiDiscrete or MultiBinary actions into dataContainer, from raw tensor
+    version 8 compact: MultiDiscrete in the smallest unsigned dtype for
+    space.nvec, MultiBinary packed to bits.
+    """
+    data = np.asarray(actions).ravel()
+    if isinstance(space, spaces.MultiBinary):
+        dataContainer.type = pb.MultiBinary
+    else:
+        dataContainer.type = pb.MultiDiscrete
+    if rawTensorVersion < 8:
+        boxContainerPb = pb.BoxDataContainer()
+        boxContainerPb.dtype = pb.UINT
+        boxContainerPb.shape.append(len(data))
+        boxContainerPb.uintData.extend(data.astype(np.uint32).tolist())
+        dataContainer.data.Pack(boxContainerPb)
+        return
+    tensor = dataContainer.tensor
+    tensor.shape.append(len(data))
+    if dataContainer.type == pb.MultiBinary:
+        tensor.dtype = pb.BOOL
+        tensor.data = np.packbits(data.astype(bool), bitorder='little').tobytes()
+        return
+    maxValue = int(np.max(space.nvec)) - 1 if np.size(space.nvec) else 0
+    if maxValue <= 0xff:
+        tensor.dtype = pb.UINT8
+    elif maxValue <= 0xffff:
+        tensor.dtype = pb.UINT16
+    else:
+        tensor.dtype = pb.UINT
+    tensor.data = data.astype(RAW_TENSOR_DTYPES[tensor.dtype]).tobytes()
+
+ACTIVATIONS = {'linear': pb.DenseLayer.LINEAR, 'relu': pb.DenseLayer.RELU,
+               'tanh': pb.DenseLayer.TANH, 'sigmoid': pb.DenseLayer.SIGMOID}
+
+def _fill_policy(policy, inputScale, inputOffset, actionValues, agentIds, epsilon):
+    policy.inputScale.extend(np.atleast_1d(np.asarray(inputScale, dtype=np.float32)).tolist())
+    policy.inputOffset.extend(np.atleast_1d(np.asarray(inputOffset, dtype=np.float32)).tolist())
+    if actionValues is not None:
+        policy.actionValues.extend(np.asarray(actionValues, dtype=np.float32).ravel().tolist())
+    policy.agentIds.extend(int(agentId) for agentId in agentIds)
+    policy.epsilon = epsilon
+    return policy
+
+def table_policy(table, actionValues=None, inputScale=1.0, inputOffset=0.0, agentIds=(), epsilon=0.0):
+    """
+    Lookup table policy for MultiEnv.run_policy: table [bins..., actions]
+    of action values, one bin dimension per observation element. Element i
+    falls into bin floor(obs[i] * inputScale + inputOffset), clamped to the
+    table. The simulation takes the action with the largest value, or a
+    random one with probability epsilon, and sends actionValues[action]
+    (the action index without). agentIds: the agents of the policy, all
+    agents without another policy if empty.
+
+    The Q table of examples/linear-mesh/qlearn.py per agent n:
+    table_policy(Q[n], actionValues=np.arange(10) * 100 + 1, inputScale=0.1,
+    agentIds=[n])
+    """
+    table = np.asarray(table, dtype='<f4')
+    policy = pb.AgentPolicy()
+    policy.tableDims.extend(table.shape[:-1])
+    policy.table = table.tobytes()
+    return _fill_policy(policy, inputScale, inputOffset, actionValues, agentIds, epsilon)
+
+def mlp_policy(layers, actionValues=None, inputScale=1.0, inputOffset=0.0, agentIds=(), epsilon=0.0):
+    """
+    Multi-layer perceptron policy for MultiEnv.run_policy: layers lists
+    (weights [outputs, inputs], bias [outputs] or None, activation) with
+    activation 'linear', 'relu', 'tanh' or 'sigmoid'. The outputs of the
+    last layer are the Box action, or with actionValues (always for
+    Discrete actions) the values to choose from like table_policy.
+    """
+    policy = pb.AgentPolicy()
+    for weights, bias, activation in layers:
+        weights = np.asarray(weights, dtype='<f4')
+        layer = policy.layers.add()
+        layer.outputs, layer.inputs = weights.shape
+        layer.weights = weights.tobytes()
+        if bias is not None:
+            layer.bias = np.asarray(bias, dtype='<f4').tobytes()
+        layer.activation = ACTIVATIONS[activation]
+    return _fill_policy(policy, inputScale, inputOffset, actionValues, agentIds, epsilon)
+
 class MultiZmqBridge(object):
     """
     Multi-agent NS-3 ZMQ Bridge
+
+    transport='tcp' uses a ZMQ REP socket, transport='shm' uses the shared
+    memory rings of ShmChannel (simulation and agent on the same x86_64
+    host).
+
+    pipelined=True asks the simulation to run the next step interval while
+    the agent computes actions, see MultiEnv.step.
+
+    rawTensor=True exchanges Box data as flat little-endian byte blocks if
+    the simulation supports it. Box observations then arrive as read-only
+    numpy arrays of the Box shape instead of flat lists.
+
+    deltaObs=True (needs rawTensor) asks the simulation to send only the
+    changed elements of Box observations. The observation array of every
+    agent is then updated in place and returned again at every step, copy
+    it to keep an old observation.
+
+    If the simulation steps agents at their own intervals (agentSubsets,
+    see OpenGymMultiEnv::SetAgentStepInterval), every state only holds the
+    agents that are due: obs_n, reward_n, done_n and info_n['n'] are dicts
+    keyed by agent id, and so are the spaces and the actions to send.
+
+    workerId != None serves a part of the agents from one of several worker
+    processes (tcp only). The simulation binds a ZMQ ROUTER socket on port
+    (--OpenGymMultiInterface::Workers=numWorkers) and the worker connects
+    to simHost with a ZMQ REQ socket. agentIds lists the agents the worker
+    owns, None takes a share of the agents nobody claimed. The worker that
+    starts the simulation has to pass numWorkers, all workers the same port.
+
+    If all agents share one Box observation space, the simulation sends a
+    state as one batch (raw tensor version 4): obs_n is then a numpy array
+    [agents, ...] viewing the received bytes, reward_n a float32 array,
+    done_n a bool array and info_n['agentIds'] the agent id of every row.
+    batched=False keeps one message per agent.
+
+    Sparse Box observations (raw tensor version 6) arrive as scipy.sparse
+    matrices, densify=True turns them into numpy arrays, see decode_sparse.
+    Graph observations (version 7) arrive as dicts, see decode_graph.
+
+    With --OpenGymMultiInterface::StepDeadline in simArgs the simulation
+    does not wait longer than that for actions. It then executes fallback
+    actions and may send the next state before the reply to the last one
+    arrived, the late actions are dropped.
+
+    forkServer (a start_sim.ForkServer) forks the simulation from a parked
+    script instead of starting the script when startSim is set. launcher
+    (a start_sim.SimLauncher) starts the built binary without waf, simPool
+    (a start_sim.SimPool, tcp only) hands out a simulation started ahead
+    on its own port.
     """
-    def __init__(self, port=0, startSim=False, simSeed=0, simArgs={}, debug=False):
+    def __init__(self, port=0, startSim=False, simSeed=0, simArgs={}, debug=False,
+                 transport='tcp', shmSize=DEFAULT_SHM_SIZE, pipelined=False, rawTensor=True, deltaObs=False,
+                 workerId=None, agentIds=None, numWorkers=1, simHost='localhost', batched=True,
+                 densify=False, forkServer=None, launcher=None, simPool=None):
         super(MultiZmqBridge, self).__init__()
         port = int(port)
         self.port = port
         self.startSim = startSim
         self.simSeed = simSeed
-        self.simArgs = simArgs
+        self.simArgs = dict(simArgs)
+        self.transport = transport
         self.envStopped = False
         self.simPid = None
         self.wafPid = None
         self.ns3Process = None
+        self.forkServer = forkServer
         self.agents = None
-
-        context = zmq.Context()
-        self.socket = context.socket(zmq.REP)
-        try:
+        self.actionLag = 0
+        self.stepIdx = 0
+        self.envIndex = 0
+        self.simEnd = False
+        self.rawTensor = rawTensor
+        self.rawTensorVersion = 0
+        self.densify = densify
+        # last graph of every graph id, see decode_graph
+        self.graphs = {}
+        self.numWorkers = 0
+        self.agentSubsets = False
+        self.branching = False
+        self.softReset = False
+        self.policyOffload = False
+        # episodes the simulation reset in place
+        self.episode = 0
+        self.workerId = workerId
+        self.deltaObs = deltaObs and rawTensor
+        # Box observation of every agent, reference of the next delta, and
+        # its TensorDelta.seq
+        self.lastObs = {}
+        self.lastObsSeq = {}
+
+        if pipelined:
+            self.simArgs["--OpenGymMultiInterface::Pipelined"] = "true"
+        if self.deltaObs:
+            self.simArgs["--OpenGymMultiInterface::DeltaObservations"] = "true"
+        if not batched:
+            self.simArgs["--OpenGymMultiInterface::BatchedStates"] = "false"
+
+        if workerId is not None:
+            if transport != 'tcp' or port == 0:
+                print("Worker mode needs the tcp transport and the port of the simulation")
+                sys.exit()
+            self.simArgs["--OpenGymMultiInterface::Workers"] = int(numWorkers)
+            self._connect_worker(port, simHost, workerId, agentIds)
+        elif transport == 'shm':
             if port == 0 and self.startSim:
-                port = self.socket.bind_to_random_port('tcp://*', min_port=5001, max_port=10000, max_tries=100)
+                port = self._find_free_shm_port()
                 print("Got new port for ns3gm interface: ", port)
-
-            elif port == 0 and not self.startSim:
-                print("Cannot use port %s to bind" % str(port))
+            elif port == 0:
+                print("Cannot use port %s for shared memory" % str(port))
                 print("Please specify correct port")
                 sys.exit()
-
-            else:
-                self.socket.bind("tcp://*:%s" % str(port))
-
-        except Exception as e:
-            print("Cannot bind to tcp://*:%s as port is already in use" % str(port))
-            print("Please specify different port or use 0 to get free port")
-            sys.exit()
+            self.port = port
+            self.socket = ShmChannel(port, shmSize)
+            self.simArgs["--OpenGymMultiInterface::Transport"] = "shm"
+        else:
+            if startSim and simPool is not None and forkServer is None:
+                # the simulation already waits on its port
+                port, self.ns3Process, simSeed = simPool.acquire(self.simArgs)
+                self.simSeed = simSeed
+            self._bind_zmq(port)
+            port = self.port
 
         if (startSim == True and simSeed == 0):
             maxSeed = np.iinfo(np.uint32).max
             simSeed = np.random.randint(0, maxSeed)
             self.simSeed = simSeed
 
-        if self.startSim:
+        if self.startSim and forkServer is not None:
+            # fork the simulation from the parked script
+            self.simPid = forkServer.fork(port, simSeed, self.simArgs, debug)
+        elif self.ns3Process is not None:
+            print("Attached to simulation started ahead on port: {}".format(port))
+        elif self.startSim and launcher is not None:
+            self.ns3Process = launcher.launch(port, simSeed, self.simArgs, debug)
+        elif self.startSim:
             # run simulation script
-            self.ns3Process = start_sim_script(port, simSeed, simArgs, debug)
+            self.ns3Process = start_sim_script(port, simSeed, self.simArgs, debug)
         else:
-            print("Waiting for simulatison script to connect on port: tcp://localhost:{}".format(port))
+            print("Waiting for simulatison script to connect on port: {}://localhost:{}".format(transport, port))
             print('Please start proper ns-3 simulation script using ./waf --run "..."')
 
         # configure spaces
         self.agentIdVec = []
+        self.obsSpaces = {}
         self.observation_space = []
         self.action_space = []
 
@@ -102,24 +379,78 @@ class MultiZmqBridge(object):
         self.obs_n = []
         self.reward_n = []
         self.done_n = []
-        self.info_n = {'n': []}
+        self.info_n = {'n': [], 'stepIdx': 0, 'actionLag': 0}
         self.newEnvStateRx = None
 
+    @staticmethod
+    def _find_free_shm_port(min_port=5001, max_port=10000):
+        for _ in range(100):
+            port = np.random.randint(min_port, max_port)
+            if not os.path.exists("/dev/shm/ns3gym-%d" % port):
+                return port
+        raise RuntimeError("Could not find a free shared memory segment name")
+
+    def _bind_zmq(self, port):
+        context = zmq.Context()
+        self.socket = context.socket(zmq.REP)
+        try:
+            if port == 0 and self.startSim:
+                port = self.socket.bind_to_random_port('tcp://*', min_port=5001, max_port=10000, max_tries=100)
+                print("Got new port for ns3gm interface: ", port)
+
+            elif port == 0 and not self.startSim:
+                print("Cannot use port %s to bind" % str(port))
+                print("Please specify correct port")
+                sys.exit()
+
+            else:
+                self.socket.bind("tcp://*:%s" % str(port))
+
+        except Exception as e:
+            print("Cannot bind to tcp://*:%s as port is already in use" % str(port))
+            print("Please specify different port or use 0 to get free port")
+            sys.exit()
+        self.port = port
+
+    def _connect_worker(self, port, simHost, workerId, agentIds):
+        context = zmq.Context()
+        self.socket = context.socket(zmq.REQ)
+        # the simulation routes the states of the worker by this identity
+        self.socket.setsockopt(zmq.IDENTITY, ("worker-%d" % workerId).encode())
+        self.socket.connect("tcp://%s:%s" % (simHost, str(port)))
+        hello = pb.WorkerHelloMsg()
+        hello.workerId = workerId
+        if agentIds:
+            hello.agentIds.extend(agentIds)
+        self.socket.send(hello.SerializeToString())
+
     def close(self):
         try:
             if not self.envStopped:
                 self.envStopped = True
-                self.rx_env_state()
+                # a received state has to be answered before the next recv
+                if not self.newEnvStateRx:
+                    self.rx_env_state()
                 self.send_close_command()
-                self.ns3Process.kill()
-                if self.simPid:
-                    os.kill(self.simPid, signal.SIGTERM)
-                    self.simPid = None
-                if self.wafPid:
-                    os.kill(self.wafPid, signal.SIGTERM)
-                    self.wafPid = None
+                # only stop a simulation this bridge started or forked
+                if self.startSim:
+                    if self.ns3Process:
+                        self.ns3Process.kill()
+                    if self.simPid:
+                        os.kill(self.simPid, signal.SIGTERM)
+                        self.simPid = None
+                    if self.wafPid:
+                        os.kill(self.wafPid, signal.SIGTERM)
+                        self.wafPid = None
         except Exception as e:
             pass
+        if self.socket:
+            if self.transport == 'shm':
+                self.socket.close()
+            else:
+                # give the close command a moment, never block on a dead sim
+                self.socket.close(linger=100)
+            self.socket = None
 
     def _create_space(self, spaceDesc):
         space = None
@@ -135,8 +466,14 @@ class MultiZmqBridge(object):
             high = boxSpacePb.high
             shape = tuple(boxSpacePb.shape)
             mtype = boxSpacePb.dtype
-
-            if mtype == pb.INT:
+            # dtype is INT / UINT for native element types, as sent below raw tensor version 3
+            ns3Dtype = boxSpacePb.nativeDtype or mtype
+            if self.rawTensorVersion >= 3:
+                mtype = ns3Dtype
+
+            if mtype in NATIVE_DTYPES:
+                mtype = RAW_TENSOR_DTYPES[mtype]
+            elif mtype == pb.INT:
                 mtype = np.int
             elif mtype == pb.UINT:
                 mtype = np.uint
@@ -146,6 +483,8 @@ class MultiZmqBridge(object):
                 mtype = np.float
 
             space = spaces.Box(low=low, high=high, shape=shape, dtype=mtype)
+            # actions are sent natively whenever the simulation knows the dtype
+            space.ns3Dtype = ns3Dtype
 
         elif (spaceDesc.type == pb.Tuple):
             mySpaceList = []
@@ -169,22 +508,66 @@ class MultiZmqBridge(object):
                 mySpaceDict[pbSubSpaceDesc.name] = subSpace
 
             space = spaces.Dict(mySpaceDict)
+            # key of every slot, Dict elements may be sent by slot
+            space.ns3Keys = [pbSubSpaceDesc.name for pbSubSpaceDesc in dictSpacePb.element]
+
+        elif (spaceDesc.type == pb.MultiDiscrete):
+            multiDiscreteSpacePb = pb.MultiDiscreteSpace()
+            spaceDesc.space.Unpack(multiDiscreteSpacePb)
+            space = spaces.MultiDiscrete(list(multiDiscreteSpacePb.nvec))
+
+        elif (spaceDesc.type == pb.MultiBinary):
+            multiBinarySpacePb = pb.MultiBinarySpace()
+            spaceDesc.space.Unpack(multiBinarySpacePb)
+            space = spaces.MultiBinary(multiBinarySpacePb.n)
+
+        elif (spaceDesc.type == pb.Graph):
+            graphSpacePb = pb.GraphSpace()
+            spaceDesc.space.Unpack(graphSpacePb)
+            featureSpaces = []
+            for boxSpacePb in (graphSpacePb.nodeSpace, graphSpacePb.edgeSpace):
+                boxDesc = pb.SpaceDescription(type=pb.Box)
+                boxDesc.space.Pack(boxSpacePb)
+                featureSpaces.append(self._create_space(boxDesc))
+            nodeSpace, edgeSpace = featureSpaces
+            if hasattr(spaces, 'Graph'):
+                space = spaces.Graph(node_space=nodeSpace, edge_space=edgeSpace if edgeSpace.shape[0] else None)
+            else:
+                space = spaces.Dict({'nodes': nodeSpace, 'edges': edgeSpace})
 
         return space
 
-    def _create_data(self, dataContainerPb):
+    def _create_data(self, dataContainerPb, space=None):
         if (dataContainerPb.type == pb.Discrete):
             discreteContainerPb = pb.DiscreteDataContainer()
             dataContainerPb.data.Unpack(discreteContainerPb)
             data = discreteContainerPb.data
             return data
 
+        if (dataContainerPb.type == pb.Box) and dataContainerPb.HasField('tensor'):
+            tensor = dataContainerPb.tensor
+            data = np.frombuffer(tensor.data, dtype=RAW_TENSOR_DTYPES.get(tensor.dtype, np.float32))
+            return data.reshape(tuple(tensor.shape))
+
+        if (dataContainerPb.type == pb.SparseBox):
+            return decode_sparse(dataContainerPb.sparse, self.densify)
+
+        if (dataContainerPb.type in (pb.MultiDiscrete, pb.MultiBinary)):
+            return decode_multi(dataContainerPb)
+
+        if (dataContainerPb.type == pb.Graph):
+            graphContainerPb = pb.GraphDataContainer()
+            dataContainerPb.data.Unpack(graphContainerPb)
+            return decode_graph(graphContainerPb, self.graphs)
+
         if (dataContainerPb.type == pb.Box):
             boxContainerPb = pb.BoxDataContainer()
             dataContainerPb.data.Unpack(boxContainerPb)
             # print(boxContainerPb.shape, boxContainerPb.dtype, boxContainerPb.uintData)
 
-            if boxContainerPb.dtype == pb.INT:
+            if boxContainerPb.dtype in NATIVE_DTYPES:
+                data = np.frombuffer(boxContainerPb.packedData, dtype=RAW_TENSOR_DTYPES[boxContainerPb.dtype])
+            elif boxContainerPb.dtype == pb.INT:
                 data = boxContainerPb.intData
             elif boxContainerPb.dtype == pb.UINT:
                 data = boxContainerPb.uintData
@@ -201,8 +584,9 @@ class MultiZmqBridge(object):
             dataContainerPb.data.Unpack(tupleDataPb)
 
             myDataList = []
-            for pbSubData in tupleDataPb.element:
-                subData = self._create_data(pbSubData)
+            for i, pbSubData in enumerate(tupleDataPb.element):
+                subSpace = space.spaces[i] if isinstance(space, spaces.Tuple) else None
+                subData = self._create_data(pbSubData, subSpace)
                 myDataList.append(subData)
 
             data = tuple(myDataList)
@@ -213,9 +597,13 @@ class MultiZmqBridge(object):
             dataContainerPb.data.Unpack(dictDataPb)
 
             myDataDict = {}
+            keys = getattr(space, 'ns3Keys', [])
             for pbSubData in dictDataPb.element:
-                subData = self._create_data(pbSubData)
-                myDataDict[pbSubData.name] = subData
+                # elements of schema-bound dicts carry the slot of their key
+                name = keys[pbSubData.slot - 1] if pbSubData.slot else pbSubData.name
+                subSpace = space.spaces[name] if space is not None else None
+                subData = self._create_data(pbSubData, subSpace)
+                myDataDict[name] = subData
 
             data = myDataDict
             return data
@@ -231,13 +619,36 @@ class MultiZmqBridge(object):
             discreteContainerPb.data = actions
             dataContainer.data.Pack(discreteContainerPb)
 
+        elif spaceType in (spaces.MultiDiscrete, spaces.MultiBinary):
+            pack_multi(dataContainer, actions, spaceDesc, self.rawTensorVersion)
+
+        elif spaceType == spaces.Box and self.rawTensorVersion:
+            dataContainer.type = pb.Box
+            if getattr(spaceDesc, 'ns3Dtype', None) in NATIVE_DTYPES:
+                dtype = spaceDesc.ns3Dtype
+            elif np.issubdtype(spaceDesc.dtype, np.signedinteger):
+                dtype = pb.INT
+            elif np.issubdtype(spaceDesc.dtype, np.unsignedinteger):
+                dtype = pb.UINT
+            else:
+                dtype = pb.FLOAT
+            data = np.ascontiguousarray(actions, dtype=RAW_TENSOR_DTYPES[dtype])
+            dataContainer.tensor.dtype = dtype
+            dataContainer.tensor.shape.extend(data.shape)
+            dataContainer.tensor.data = data.tobytes()
+
         elif spaceType == spaces.Box:
             dataContainer.type = pb.Box
             boxContainerPb = pb.BoxDataContainer()
             shape = [len(actions)]
             boxContainerPb.shape.extend(shape)
 
-            if (spaceDesc.dtype in ['int', 'int8', 'int16', 'int32', 'int64']):
+            if getattr(spaceDesc, 'ns3Dtype', None) in NATIVE_DTYPES:
+                boxContainerPb.dtype = spaceDesc.ns3Dtype
+                data = np.ascontiguousarray(actions, dtype=RAW_TENSOR_DTYPES[spaceDesc.ns3Dtype])
+                boxContainerPb.packedData = data.tobytes()
+
+            elif (spaceDesc.dtype in ['int', 'int8', 'int16', 'int32', 'int64']):
                 boxContainerPb.dtype = pb.INT
                 boxContainerPb.intData.extend(actions)
 
@@ -288,24 +699,92 @@ class MultiZmqBridge(object):
 
         return dataContainer
 
+    def _create_obs(self, agentId, dataContainerPb):
+        # the simulation sets delta on every Box observation in delta mode
+        if not (dataContainerPb.HasField('tensor') and dataContainerPb.tensor.HasField('delta')):
+            return self._create_data(dataContainerPb, self.obsSpaces.get(agentId))
+
+        tensor = dataContainerPb.tensor
+        dtype = RAW_TENSOR_DTYPES.get(tensor.dtype, np.float32)
+        delta = tensor.delta
+        if delta.encoding == pb.TensorDelta.NONE:
+            # keyframe
+            shape = tuple(tensor.shape)
+            obs = self.lastObs.get(agentId)
+            if obs is None or obs.shape != shape or obs.dtype != dtype:
+                obs = np.empty(shape, dtype=dtype)
+                self.lastObs[agentId] = obs
+            obs.reshape(-1)[:] = np.frombuffer(tensor.data, dtype=dtype)
+            self.lastObsSeq[agentId] = delta.seq
+            return obs
+
+        if delta.seq and self.lastObsSeq.get(agentId) != delta.seq - 1:
+            raise RuntimeError("Agent %d: observation delta %d without the previous message" % (agentId, delta.seq))
+        self.lastObsSeq[agentId] = delta.seq
+        obs = self.lastObs[agentId]
+        flat = obs.reshape(-1)
+        values = np.frombuffer(delta.values, dtype=dtype)
+        if delta.encoding == pb.TensorDelta.SPARSE:
+            flat[np.asarray(delta.indices, dtype=np.intp)] = values
+        else:
+            # runs: unchanged count, changed count, ...
+            runs = np.asarray(delta.runs, dtype=np.intp)
+            unchanged = np.cumsum(runs[0::2])
+            flat[np.arange(len(values)) + np.repeat(unchanged, runs[1::2])] = values
+        return obs
+
+    def _get_space(self, spaces, spaceId, spaceDesc):
+        # id 0: the space is sent inline (older simulations)
+        if spaceId:
+            return spaces[spaceId - 1]
+        return self._create_space(spaceDesc)
+
     def initialize_env(self, stepInterval):
         request = self.socket.recv()
         multiAgentInitMsg = pb.MultiAgentInitMsg()
         multiAgentInitMsg.ParseFromString(request)
+        del request
         self.simPid = int(multiAgentInitMsg.simProcessId)
         self.wafPid = int(multiAgentInitMsg.wafShellProcessId)
+        if self.forkServer is not None or self.wafPid == os.getpid():
+            # no waf shell, the parent is the fork server or this process
+            self.wafPid = None
+        self.actionLag = int(multiAgentInitMsg.actionLag)
+        self.envIndex = int(multiAgentInitMsg.envIndex)
+        if self.rawTensor:
+            self.rawTensorVersion = min(int(multiAgentInitMsg.rawTensorVersion), RAW_TENSOR_VERSION)
+        self.agentSubsets = multiAgentInitMsg.agentSubsets
+        self.numWorkers = int(multiAgentInitMsg.numWorkers)
+        self.branching = multiAgentInitMsg.branching
+        self.softReset = multiAgentInitMsg.softReset
+        self.policyOffload = multiAgentInitMsg.policyOffload
+
+        spaces = []
+        for internedSpace in multiAgentInitMsg.spaces:
+            key = (internedSpace.fingerprint, self.rawTensorVersion >= 3)
+            space = _SPACE_CACHE.get(key)
+            if space is None:
+                space = self._create_space(internedSpace.space)
+                _SPACE_CACHE[key] = space
+            spaces.append(space)
 
         for agentInitMsg in multiAgentInitMsg.agentInitMsg:
             agent_id = agentInitMsg.agentId
             self.agentIdVec.append(agent_id)
-            ob_space = self._create_space(agentInitMsg.obsSpace)
+            ob_space = self._get_space(spaces, agentInitMsg.obsSpaceId, agentInitMsg.obsSpace)
             self.observation_space.append(ob_space)
-            ac_space = self._create_space(agentInitMsg.actSpace)
+            self.obsSpaces[agent_id] = ob_space
+            ac_space = self._get_space(spaces, agentInitMsg.actSpaceId, agentInitMsg.actSpace)
             self.action_space.append(ac_space)
 
+        if self.agentSubsets:
+            self.observation_space = dict(zip(self.agentIdVec, self.observation_space))
+            self.action_space = dict(zip(self.agentIdVec, self.action_space))
+
         reply = pb.SimInitAck()
         reply.done = True
         reply.stopSimReq = False
+        reply.rawTensorVersion = self.rawTensorVersion
         replyMsg = reply.SerializeToString()
         self.socket.send(replyMsg)
         return True
@@ -320,38 +799,103 @@ class MultiZmqBridge(object):
         request = self.socket.recv()
         multiAgentStateMsg = pb.MultiAgentStateMsg()
         multiAgentStateMsg.ParseFromString(request)
-
+        del request
+        self._rx_state(multiAgentStateMsg)
+
+    def _rx_state(self, multiAgentStateMsg):
+        self.stepIdx = int(multiAgentStateMsg.stepIdx)
+        self.simEnd = multiAgentStateMsg.ns3SimulationEnd
+        self.episode = int(multiAgentStateMsg.episode)
+        if multiAgentStateMsg.HasField('batch'):
+            self._rx_batch(multiAgentStateMsg.batch)
+            self.newEnvStateRx = True
+            return
+        if self.agentSubsets:
+            self.obs_n = {}
+            self.reward_n = {}
+            self.done_n = {}
+            self.info_n = {'n': {}, 'stepIdx': self.stepIdx, 'actionLag': self.actionLag}
+        else:
+            self.obs_n = []
+            self.reward_n = []
+            self.done_n = []
+            self.info_n = {'n': [], 'stepIdx': self.stepIdx, 'actionLag': self.actionLag}
         for agentStateMsg in multiAgentStateMsg.agentStateMsg:
-            # agent_id = agentStateMsg.agentId
-            obs = self._create_data(agentStateMsg.obsData)
-            self.obs_n.append(obs)
-            self.reward_n.append(agentStateMsg.reward)
-            self.done_n.append(agentStateMsg.done)
+            agent_id = agentStateMsg.agentId
+            obs = self._create_obs(agent_id, agentStateMsg.obsData)
             info = agentStateMsg.info
             if not info:
                 info = {}
-            self.info_n['n'].append(info)
-
-            self.newEnvStateRx = True
+            if self.agentSubsets:
+                self.obs_n[agent_id] = obs
+                self.reward_n[agent_id] = agentStateMsg.reward
+                self.done_n[agent_id] = agentStateMsg.done
+                self.info_n['n'][agent_id] = info
+            else:
+                self.obs_n.append(obs)
+                self.reward_n.append(agentStateMsg.reward)
+                self.done_n.append(agentStateMsg.done)
+                self.info_n['n'].append(info)
+
+        self.newEnvStateRx = True
+
+    def _rx_batch(self, batch):
+        agentIds = np.array(batch.agentIds, dtype=np.uint32)
+        count = len(agentIds)
+        tensor = batch.obs
+        dtype = RAW_TENSOR_DTYPES.get(tensor.dtype, np.float32)
+        obs = np.frombuffer(tensor.data, dtype=dtype).reshape(tuple(tensor.shape))
+        reward = np.frombuffer(batch.reward, dtype=np.dtype('<f4'))
+        done = np.unpackbits(np.frombuffer(batch.done, dtype=np.uint8), count=count,
+                             bitorder='little').astype(bool)
+        info = [i if i else {} for i in batch.info]
+        self.info_n = {'stepIdx': self.stepIdx, 'actionLag': self.actionLag, 'agentIds': agentIds}
+        if self.agentSubsets:
+            ids = agentIds.tolist()
+            self.obs_n = dict(zip(ids, obs))
+            self.reward_n = dict(zip(ids, reward.tolist()))
+            self.done_n = dict(zip(ids, done.tolist()))
+            self.info_n['n'] = dict(zip(ids, info))
+        else:
+            self.obs_n = obs
+            self.reward_n = reward
+            self.done_n = done
+            self.info_n['n'] = info
 
     def send_close_command(self):
         reply = pb.MultiAgentActMsg()
         reply.stopSimReq = True
+        reply.stepIdx = self.stepIdx
 
         replyMsg = reply.SerializeToString()
         self.socket.send(replyMsg)
         self.newEnvStateRx = False
         return True
 
+    def _fill_actions(self, multiAgentActMsg, action_n):
+        if isinstance(action_n, dict):
+            # agent id -> action, usually the agents of the last state
+            for agent_id, action in action_n.items():
+                if self.agentSubsets:
+                    space = self.action_space[agent_id]
+                else:
+                    space = self.action_space[self.agentIdVec.index(agent_id)]
+                agentAct = multiAgentActMsg.agentActMsg.add()
+                agentAct.agentId = agent_id
+                agentAct.actData.CopyFrom(self._pack_data(action, space))
+        else:
+            for i in range(len(action_n)):
+                agentAct = multiAgentActMsg.agentActMsg.add()
+                actionMsg = self._pack_data(action_n[i], self.action_space[i])
+                agentAct.agentId = self.agentIdVec[i]
+                agentAct.actData.CopyFrom(actionMsg)
+
     def send_action_n(self, action_n):
         multiAgentActMsg = pb.MultiAgentActMsg()
+        self._fill_actions(multiAgentActMsg, action_n)
 
-        for i in range(len(action_n)):
-            agentAct = multiAgentActMsg.agentActMsg.add()
-            actionMsg = self._pack_data(action_n[i], self.action_space[i])
-            agentAct.agentId = self.agentIdVec[i]
-            agentAct.actData.CopyFrom(actionMsg)
-
+        # the simulation drops actions that missed its StepDeadline by this
+        multiAgentActMsg.stepIdx = self.stepIdx
         multiAgentActMsg.stopSimReq = False
         if self.forceEnvStop:
             multiAgentActMsg.stopSimReq = True
@@ -366,6 +910,123 @@ class MultiZmqBridge(object):
         # get result of above mult-agent actions
         self.rx_env_state()
 
+    def reset_episode(self):
+        """
+        Soft reset: the simulation ends the episode and starts the next one
+        in place (OpenGymMultiEnv::ResetEpisode), keeping its process and
+        topology. \return True once the first state of the new episode is
+        received, False if the simulation cannot. The last state then stays
+        the current one and the simulation is not asked again.
+        """
+        if not self.softReset or self.simEnd or not self.newEnvStateRx:
+            return False
+        episode = self.episode
+        multiAgentActMsg = pb.MultiAgentActMsg()
+        multiAgentActMsg.stepIdx = self.stepIdx
+        multiAgentActMsg.resetReq = True
+        self.socket.send(multiAgentActMsg.SerializeToString())
+        reply = pb.MultiAgentStateMsg()
+        reply.ParseFromString(self.socket.recv())
+        if reply.resetFailed:
+            self.softReset = False
+            return False
+        self.newEnvStateRx = False
+        self._rx_state(reply)
+        if self.episode == episode:
+            # older simulations send the current state again
+            self.softReset = False
+            return False
+        return True
+
+    def branch(self, plans, horizon, maxParallel=0):
+        """
+        Evaluate plans from the current state in forked copies of the
+        simulation (needs self.branching). plans[k] lists the action_n of
+        every step, the last one is repeated up to horizon steps. The state
+        stays the current one, answer it with step() or branch() again.
+        \return one dict per plan: 'rewards' [steps, agents] after every
+        step, 'agentIds', 'dones' after the last step, 'steps', 'simEnd'
+        and 'failed'
+        """
+        if not self.branching:
+            raise RuntimeError("The simulation does not support branching (lockstep without workers "
+                               "and StepDeadline only)")
+        multiAgentActMsg = pb.MultiAgentActMsg()
+        multiAgentActMsg.stepIdx = self.stepIdx
+        request = multiAgentActMsg.branch
+        request.horizon = int(horizon)
+        request.maxParallel = int(maxParallel)
+        for plan in plans:
+            branchPlan = request.plans.add()
+            for action_n in plan:
+                self._fill_actions(branchPlan.steps.add(), action_n)
+        self.socket.send(multiAgentActMsg.SerializeToString())
+
+        reply = pb.MultiAgentStateMsg()
+        reply.ParseFromString(self.socket.recv())
+        results = []
+        for result in reply.branchResults:
+            agentIds = np.array(result.agentIds, dtype=np.uint32)
+            rewards = np.array(result.rewards, dtype=np.float32).reshape(result.steps, len(agentIds))
+            results.append({'rewards': rewards, 'agentIds': agentIds,
+                            'dones': np.array(result.dones, dtype=bool), 'steps': result.steps,
+                            'simEnd': result.simEnd, 'failed': result.failed})
+        return results
+
+    def run_policy(self, policies, maxStaleness=0):
+        """
+        Let the simulation act with policies (table_policy, mlp_policy; an
+        empty list keeps the previous ones) from the current state for up
+        to maxStaleness steps (0: until all agents are done or the end of
+        the simulation), needs self.policyOffload. The last row is the
+        current state, answer it with step(), reset_episode(), branch() or
+        run_policy() again.
+        \return dict 'agentIds', 'obs' [steps + 1, agents, obsSize] as
+        float32 with the start state first, 'actions' [steps, agents,
+        actionSize], 'rewards' and 'dones' [steps, agents] after each
+        action, 'simEnd'
+        """
+        if not self.policyOffload:
+            raise RuntimeError("The simulation does not support policy offload (lockstep without workers, "
+                               "StepDeadline and per-agent step intervals only)")
+        multiAgentActMsg = pb.MultiAgentActMsg()
+        multiAgentActMsg.stepIdx = self.stepIdx
+        request = multiAgentActMsg.policy
+        request.maxStaleness = int(maxStaleness)
+        for policy in policies:
+            request.policies.add().CopyFrom(policy)
+        self.socket.send(multiAgentActMsg.SerializeToString())
+
+        reply = pb.MultiAgentStateMsg()
+        reply.ParseFromString(self.socket.recv())
+        rollout = reply.rollout
+        if rollout.error:
+            raise RuntimeError("Policy refused: " + rollout.error)
+        self.stepIdx = int(reply.stepIdx)
+        self.simEnd = reply.ns3SimulationEnd
+        self.episode = int(reply.episode)
+        agentIds = np.array(rollout.agentIds, dtype=np.uint32)
+        count = len(agentIds)
+        rows = rollout.steps
+        obs = np.frombuffer(rollout.obs, dtype='<f4').reshape(rows, count, rollout.obsSize)
+        actions = np.frombuffer(rollout.actions, dtype='<f4').reshape(rows - 1, count, rollout.actionSize)
+        rewards = np.frombuffer(rollout.rewards, dtype='<f4').reshape(rows, count)
+        dones = np.frombuffer(rollout.dones, dtype=np.uint8).reshape(rows, count).astype(bool)
+
+        # the current state, observations in their spaces again
+        self.obs_n = []
+        for i, space in enumerate(self.observation_space):
+            if isinstance(space, spaces.Box):
+                self.obs_n.append(obs[-1, i, :int(np.prod(space.shape))].reshape(space.shape).astype(space.dtype))
+            else:
+                self.obs_n.append(int(obs[-1, i, 0]))
+        self.reward_n = rewards[-1].tolist()
+        self.done_n = dones[-1].tolist()
+        self.info_n = {'n': [{} for _ in range(count)], 'stepIdx': self.stepIdx, 'actionLag': self.actionLag}
+        self.newEnvStateRx = True
+        return {'agentIds': agentIds, 'obs': obs, 'actions': actions, 'rewards': rewards[1:],
+                'dones': dones[1:], 'simEnd': self.simEnd}
+
     # not use
     #
     # def reset(self):
@@ -429,8 +1090,37 @@ class MultiZmqBridge(object):
 class MultiEnv(gym.Env):
     """
     Multi Agent Environment
+
+    transport: 'tcp' (default) or 'shm', see MultiZmqBridge
+    pipelined: overlap simulation and inference with an action lag of one
+               step, see step()
+    rawTensor: flat binary Box data if the simulation supports it
+    deltaObs: send only changed Box elements, observations are updated in
+              place, see MultiZmqBridge
+    With per-agent step intervals in the simulation, spaces, observations,
+    rewards, dones and actions are dicts keyed by agent id, see step()
+    workerId, agentIds, numWorkers, simHost: serve only some agents from
+              this process, see MultiZmqBridge. reset() is not supported
+              in worker mode, the workers share one simulation.
+    batched: agents with a common Box observation space arrive as numpy
+             arrays [agents, ...], see MultiZmqBridge
+    densify: sparse Box observations as numpy arrays instead of scipy.sparse
+    forkServer: start the script once and fork a simulation from it at every
+                reset, simSeed is then the RNG run of the simulation. The
+                script has to call OpenGymMultiEnv::ServeForks, see ForkServer
+    directLaunch: start the built binary of the script without waf, see
+                  SimLauncher
+    simPool: number of simulations to start ahead (tcp only, implies
+             directLaunch), reset() attaches to one of them, see SimPool
+    softReset: reset() starts the next episode in the running simulation
+               if its env overrides OpenGymMultiEnv::ResetEpisode (lockstep
+               only), the other options above then only apply at the end of
+               the simulation. Seeds do not change between soft resets.
     """
-    def __init__(self, stepTime=0, port=0, startSim=True, simSeed=0, simArgs={}, debug=False):
+    def __init__(self, stepTime=0, port=0, startSim=True, simSeed=0, simArgs={}, debug=False,
+                 transport='tcp', shmSize=DEFAULT_SHM_SIZE, pipelined=False, rawTensor=True, deltaObs=False,
+                 workerId=None, agentIds=None, numWorkers=1, simHost='localhost', batched=True,
+                 densify=False, forkServer=False, directLaunch=False, simPool=0, softReset=True):
         # set required vectorized gym env property
         self.stepTime = stepTime
         self.port = port
@@ -438,6 +1128,29 @@ class MultiEnv(gym.Env):
         self.simSeed = simSeed
         self.simArgs = simArgs
         self.debug = debug
+        self.transport = transport
+        self.shmSize = shmSize
+        self.pipelined = pipelined
+        self.rawTensor = rawTensor
+        self.deltaObs = deltaObs
+        self.workerId = workerId
+        self.agentIds = agentIds
+        self.numWorkers = numWorkers
+        self.simHost = simHost
+        self.batched = batched
+        self.densify = densify
+        self.softReset = softReset
+        self.launcher = SimLauncher() if startSim and (directLaunch or simPool) else None
+        self.forkServer = ForkServer(launcher=self.launcher) if forkServer and startSim else None
+        self.simPool = None
+        if simPool and startSim and not forkServer:
+            if transport != 'tcp':
+                raise ValueError("A simulation pool needs the tcp transport")
+            seeds = itertools.repeat(simSeed) if simSeed else None
+            self.simPool = SimPool(simPool, seeds, self.launcher, debug)
+        # steps between an observation and the execution of its actions,
+        # reported by the simulation
+        self.actionLag = 0
 
         # Filled in reset function
         self.multiZmqBridge = None
@@ -446,14 +1159,31 @@ class MultiEnv(gym.Env):
         self.state = []
         self.step_beyond_done = None
 
-        self.multiZmqBridge = MultiZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug)
+        self._create_bridge()
+        self.envDirty = False
+        # self.seed()
+
+    def _create_bridge(self):
+        """
+        Connect to a new simulation and receive its first state.
+        """
+        self.multiZmqBridge = MultiZmqBridge(port=self.port, startSim=self.startSim, simSeed=self.simSeed,
+                                             simArgs=self.simArgs, debug=self.debug, transport=self.transport,
+                                             shmSize=self.shmSize, pipelined=self.pipelined,
+                                             rawTensor=self.rawTensor, deltaObs=self.deltaObs,
+                                             workerId=self.workerId, agentIds=self.agentIds,
+                                             numWorkers=self.numWorkers, simHost=self.simHost,
+                                             batched=self.batched, densify=self.densify,
+                                             forkServer=self.forkServer, launcher=self.launcher,
+                                             simPool=self.simPool)
         self.multiZmqBridge.initialize_env(self.stepTime)
+        self.actionLag = self.multiZmqBridge.actionLag
+        if self.pipelined and self.actionLag == 0:
+            print("Warning: pipelined mode requested but simulation runs in lockstep")
         self.action_space = self.multiZmqBridge.get_action_space()
         self.observation_space = self.multiZmqBridge.get_observation_space()
         # get first observations
         self.multiZmqBridge.rx_env_state()
-        self.envDirty = False
-        # self.seed()
 
     def get_state_n(self):
         obs_n = self.multiZmqBridge.get_obs_n()
@@ -464,26 +1194,79 @@ class MultiEnv(gym.Env):
 
 
     def step(self, action_n):
+        """
+        Send actions for the last observation and return the next state.
+
+        Lockstep (actionLag 0): action_n is executed for one step interval
+        and the returned state is its result.
+
+        Pipelined (actionLag 1): the simulation already runs the interval
+        after the last observation with the previous actions. action_n is
+        executed from the returned state on, so the returned reward belongs
+        to the previous actions. No action runs in the first interval.
+
+        info_n['actionLag'] and info_n['stepIdx'] tell both values.
+
+        With per-agent step intervals (multiZmqBridge.agentSubsets) action_n
+        is a dict {agent id: action} for the agents of the last state, and
+        the returned state holds the agents that are due next.
+        """
         self.multiZmqBridge.step(action_n)
         self.envDirty = True
         return self.get_state_n()
 
+    def branch(self, candidates, horizon, gamma=1.0, maxParallel=0, sequences=False):
+        """
+        Lookahead from the current state without advancing it: the
+        simulation forks a copy per candidate, runs it for horizon steps
+        (in parallel, at most maxParallel copies at once, 0 for all) and
+        returns its rewards. Continue with step(chosen action_n).
+
+        candidates[k] is an action_n repeated every step, or with
+        sequences=True a list of action_n per step whose last one repeats.
+        \return (returns, results): returns[k, i] the discounted reward sum
+        of agent i in candidate k, results the raw MultiZmqBridge.branch
+        results. A failed copy gets nan returns.
+        """
+        plans = candidates if sequences else [[action_n] for action_n in candidates]
+        results = self.multiZmqBridge.branch(plans, horizon, maxParallel)
+        column = {agentId: i for i, agentId in enumerate(self.multiZmqBridge.agentIdVec)}
+        returns = np.full((len(results), len(column)), np.nan, dtype=np.float64)
+        for k, result in enumerate(results):
+            if result['failed']:
+                continue
+            rewards = result['rewards']
+            discounts = np.power(gamma, np.arange(rewards.shape[0]))
+            returns[k, [column[agentId] for agentId in result['agentIds']]] = discounts @ rewards
+        return returns, results
+
+    def run_policy(self, policies, maxStaleness=0):
+        """
+        Policy offload: the simulation chooses the actions itself with
+        small policies (table_policy, mlp_policy) for up to maxStaleness
+        steps and returns the transitions in bulk, see
+        MultiZmqBridge.run_policy. Push new weights with the next call, or
+        [] to keep them. get_state_n() is the state after the last step.
+        """
+        rollout = self.multiZmqBridge.run_policy(policies, maxStaleness)
+        self.envDirty = True
+        return rollout
+
     def reset(self):
         if not self.envDirty:
             obs_n = self.multiZmqBridge.get_obs_n()
             return obs_n
 
+        if self.softReset and self.multiZmqBridge and self.multiZmqBridge.reset_episode():
+            self.envDirty = False
+            return self.multiZmqBridge.get_obs_n()
+
         if self.multiZmqBridge:
             self.multiZmqBridge.close()
             self.multiZmqBridge = None
 
         self.envDirty = False
-        self.multiZmqBridge = MultiZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug)
-        self.multiZmqBridge.initialize_env(self.stepTime)
-        self.action_space = self.multiZmqBridge.get_action_space()
-        self.observation_space = self.multiZmqBridge.get_observation_space()
-        # get first observations
-        self.multiZmqBridge.rx_env_state()
+        self._create_bridge()
         obs = self.multiZmqBridge.get_obs_n()
 
         return obs
@@ -495,3 +1278,9 @@ class MultiEnv(gym.Env):
         if self.multiZmqBridge:
             self.multiZmqBridge.close()
             self.multiZmqBridge = None
+        if self.forkServer:
+            self.forkServer.close()
+            self.forkServer = None
+        if self.simPool:
+            self.simPool.close()
+            self.simPool = None
@@ -0,0 +1,257 @@
+__author__ = "Zhangmin Wang"
+__copyright__ = "Copyright (c) 2019"
+__version__ = "0.1.1"
+__email__ = "zhangmwg@gmail.com"
+
+"""
+VecMultiEnv steps several ns-3 simulations of the same multi-agent
+scenario from one Python process, so a trainer does not wait on a single
+simulation. Every simulation is a MultiZmqBridge of its own, with its own
+port, seed and env index (--OpenGymMultiInterface::EnvIndex).
+
+NOTE: all simulations have to expose the same agents and spaces.
+"""
+
+import itertools
+import numpy as np
+import zmq
+
+import gym
+from ns3gym.ns3_multiagent_env import MultiZmqBridge
+from ns3gym.shm_channel import DEFAULT_SHM_SIZE
+from ns3gym.start_sim import ForkServer, SimLauncher, SimPool
+
+
+def _stack(items):
+    """Stack to one array, keep an object array for ragged items"""
+    try:
+        return np.stack([np.asarray(item) for item in items])
+    except ValueError:
+        data = np.empty(len(items), dtype=object)
+        data[:] = items
+        return data
+
+
+class VecMultiEnv(gym.Env):
+    """
+    Vectorized Multi Agent Environment
+
+    step() sends the actions to every simulation first and then collects
+    the states in arrival order (one zmq.Poller for the tcp transport),
+    so all simulations run concurrently.
+
+    obs_n, reward_n and done_n are stacked to [numEnvs, numAgents, ...],
+    info_n is a list with the info dict of every simulation.
+
+    With autoReset a simulation whose agents are all done, or which reached
+    its end, is restarted on its own. step() then returns the first
+    observation of the new episode and keeps the last one in
+    info_n[i]['terminal_observation'].
+
+    simSeed != 0 gives simulation i of episode k the seed
+    simSeed + i + k * numEnvs, simSeed = 0 draws random seeds.
+
+    With per-agent step intervals (agentSubsets) nothing is stacked:
+    obs_n, reward_n and done_n are lists with the dict of every simulation
+    and action_n[i] is a dict {agent id: action}, see MultiEnv.step.
+    ports: one port per simulation, needed with startSim=False.
+    Sparse Box observations can only be stacked with densify=True.
+    forkServer: fork all simulations from one parked script, see MultiEnv.
+    directLaunch, simPool: start the binary without waf and keep simPool
+    simulations per env started ahead, see MultiEnv. The seeds above hold.
+    softReset: reset in the running simulation where its env supports it,
+    see MultiEnv. A soft reset keeps the seed of the simulation.
+    """
+    def __init__(self, numEnvs, stepTime=0, ports=None, startSim=True, simSeed=0, simArgs={}, debug=False,
+                 transport='tcp', shmSize=DEFAULT_SHM_SIZE, pipelined=False, rawTensor=True, autoReset=True,
+                 deltaObs=False, batched=True, densify=False, forkServer=False, directLaunch=False, simPool=0,
+                 softReset=True):
+        self.numEnvs = int(numEnvs)
+        self.stepTime = stepTime
+        self.startSim = startSim
+        self.simSeed = simSeed
+        self.simArgs = simArgs
+        self.debug = debug
+        self.transport = transport
+        self.shmSize = shmSize
+        self.pipelined = pipelined
+        self.rawTensor = rawTensor
+        self.deltaObs = deltaObs
+        self.batched = batched
+        self.densify = densify
+        self.autoReset = autoReset
+        self.softReset = softReset
+        self.launcher = SimLauncher() if startSim and (directLaunch or simPool) else None
+        self.forkServer = ForkServer(launcher=self.launcher) if forkServer and startSim else None
+        # one pool per env, it starts the episodes of its env in order
+        self.simPools = [None] * self.numEnvs
+        if simPool and startSim and not forkServer:
+            if transport != 'tcp':
+                raise ValueError("A simulation pool needs the tcp transport")
+            for i in range(self.numEnvs):
+                self.simPools[i] = SimPool(simPool, self._seeds(i), self.launcher, debug)
+
+        if ports is None:
+            ports = [0] * self.numEnvs
+        if len(ports) != self.numEnvs:
+            raise ValueError("Need one port per simulation")
+        self.ports = list(ports)
+        self.episodes = [0] * self.numEnvs
+
+        self.bridges = [None] * self.numEnvs
+        self.poller = None
+        self.socketIdx = {}
+
+        # launch all simulations before waiting for the first one
+        for i in range(self.numEnvs):
+            self.bridges[i] = self._create_bridge(i)
+        for i in range(self.numEnvs):
+            self._initialize_bridge(i)
+
+        self.action_space = self.bridges[0].get_action_space()
+        self.observation_space = self.bridges[0].get_observation_space()
+        self.actionLag = self.bridges[0].actionLag
+        self.agentSubsets = self.bridges[0].agentSubsets
+        self.envDirty = False
+
+    def _seeds(self, i):
+        if not self.simSeed:
+            return None
+        return (self.simSeed + i + k * self.numEnvs for k in itertools.count())
+
+    def _create_bridge(self, i):
+        args = dict(self.simArgs)
+        args["--OpenGymMultiInterface::EnvIndex"] = i
+        seed = 0
+        if self.simSeed:
+            seed = self.simSeed + i + self.episodes[i] * self.numEnvs
+        return MultiZmqBridge(port=self.ports[i], startSim=self.startSim, simSeed=seed, simArgs=args,
+                              debug=self.debug, transport=self.transport, shmSize=self.shmSize,
+                              pipelined=self.pipelined, rawTensor=self.rawTensor, deltaObs=self.deltaObs,
+                              batched=self.batched, densify=self.densify, forkServer=self.forkServer,
+                              launcher=self.launcher, simPool=self.simPools[i])
+
+    def _initialize_bridge(self, i):
+        bridge = self.bridges[i]
+        bridge.initialize_env(self.stepTime)
+        if bridge.envIndex != i:
+            print("Warning: simulation on port {} reports env index {} instead of {}".format(
+                bridge.port, bridge.envIndex, i))
+        # get first observations
+        bridge.rx_env_state()
+        if self.transport == 'tcp':
+            if self.poller is None:
+                self.poller = zmq.Poller()
+            self.poller.register(bridge.socket, zmq.POLLIN)
+            self.socketIdx[bridge.socket] = i
+
+    def _close_bridge(self, i):
+        bridge = self.bridges[i]
+        if bridge is None:
+            return
+        if self.poller is not None and bridge.socket is not None:
+            self.poller.unregister(bridge.socket)
+            del self.socketIdx[bridge.socket]
+        bridge.close()
+        self.bridges[i] = None
+
+    def _soft_reset(self, i):
+        if self.softReset and self.bridges[i].reset_episode():
+            self.episodes[i] += 1
+            return True
+        return False
+
+    def _restart(self, i):
+        if self._soft_reset(i):
+            return
+        self._close_bridge(i)
+        self.episodes[i] += 1
+        self.bridges[i] = self._create_bridge(i)
+        self._initialize_bridge(i)
+
+    def _rx_env_states(self):
+        if self.poller is None:
+            for bridge in self.bridges:
+                bridge.rx_env_state()
+            return
+
+        pending = set(range(self.numEnvs))
+        while pending:
+            for socket, _ in self.poller.poll():
+                i = self.socketIdx[socket]
+                if i in pending:
+                    self.bridges[i].rx_env_state()
+                    pending.discard(i)
+
+    def _get_obs_n(self):
+        if self.agentSubsets:
+            return [bridge.get_obs_n() for bridge in self.bridges]
+        return _stack([_stack(bridge.get_obs_n()) for bridge in self.bridges])
+
+    def get_state_n(self):
+        obs_n = self._get_obs_n()
+        if self.agentSubsets:
+            reward_n = [bridge.get_reward_n() for bridge in self.bridges]
+            done_n = [bridge.get_done_n() for bridge in self.bridges]
+        else:
+            reward_n = np.array([bridge.get_reward_n() for bridge in self.bridges], dtype=np.float32)
+            done_n = np.array([bridge.get_done_n() for bridge in self.bridges], dtype=bool)
+        info_n = []
+        for i, bridge in enumerate(self.bridges):
+            info = dict(bridge.get_info_n())
+            info['envIndex'] = i
+            info_n.append(info)
+        return (obs_n, reward_n, done_n, info_n)
+
+    def step(self, action_n):
+        """
+        action_n[i] holds the actions of all agents of simulation i,
+        see MultiEnv.step for the meaning of info_n[i]['actionLag']
+        """
+        for i, bridge in enumerate(self.bridges):
+            bridge.send_action_n(action_n[i])
+        self._rx_env_states()
+        self.envDirty = True
+
+        obs_n, reward_n, done_n, info_n = self.get_state_n()
+        if not self.autoReset:
+            return (obs_n, reward_n, done_n, info_n)
+
+        restarted = False
+        for i, bridge in enumerate(self.bridges):
+            dones = bridge.get_done_n()
+            if isinstance(dones, dict):
+                dones = list(dones.values())
+            if bridge.simEnd or all(dones):
+                info_n[i]['terminal_observation'] = obs_n[i]
+                self._restart(i)
+                restarted = True
+        if restarted:
+            obs_n = self._get_obs_n()
+        return (obs_n, reward_n, done_n, info_n)
+
+    def reset(self):
+        if self.envDirty:
+            restarted = [i for i in range(self.numEnvs) if not self._soft_reset(i)]
+            for i in restarted:
+                self._close_bridge(i)
+                self.episodes[i] += 1
+                self.bridges[i] = self._create_bridge(i)
+            for i in restarted:
+                self._initialize_bridge(i)
+            self.envDirty = False
+        return self._get_obs_n()
+
+    def render(self, mode='human'):
+        return
+
+    def close(self):
+        for i in range(self.numEnvs):
+            self._close_bridge(i)
+        if self.forkServer:
+            self.forkServer.close()
+            self.forkServer = None
+        for i in range(self.numEnvs):
+            if self.simPools[i]:
+                self.simPools[i].close()
+                self.simPools[i] = None
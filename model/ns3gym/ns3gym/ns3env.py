@@ -11,6 +11,8 @@ from gym.utils import seeding
 from enum import IntEnum
 
 from ns3gym.start_sim import start_sim_script, build_ns3_project
+from ns3gym.ns3_multiagent_env import RAW_TENSOR_VERSION, RAW_TENSOR_DTYPES, NATIVE_DTYPES, decode_sparse, decode_graph, \
+    decode_multi, pack_multi
 
 import ns3gym.messages_pb2 as pb
 from google.protobuf.any_pb2 import Any
@@ -23,8 +25,16 @@ __email__ = "gawlowicz@tkn.tu-berlin.de"
 
 
 class Ns3ZmqBridge(object):
-    """docstring for Ns3ZmqBridge"""
-    def __init__(self, port=0, startSim=True, simSeed=0, simArgs={}, debug=False):
+    """
+    NS-3 ZMQ Bridge
+
+    rawTensor=True exchanges Box data as flat little-endian byte blocks if
+    the simulation supports it, see MultiZmqBridge. Sparse Box observations
+    arrive as scipy.sparse matrices, or numpy arrays with densify=True,
+    graphs as dicts, see decode_graph.
+    """
+    def __init__(self, port=0, startSim=True, simSeed=0, simArgs={}, debug=False, rawTensor=True,
+                 densify=False):
         super(Ns3ZmqBridge, self).__init__()
         port = int(port)
         self.port = port
@@ -32,6 +42,11 @@ class Ns3ZmqBridge(object):
         self.simSeed = simSeed
         self.simArgs = simArgs
         self.envStopped = False
+        self.rawTensor = rawTensor
+        self.rawTensorVersion = 0
+        self.densify = densify
+        # last graph of every graph id, see decode_graph
+        self.graphs = {}
         self.simPid = None
         self.wafPid = None
         self.ns3Process = None
@@ -110,8 +125,14 @@ class Ns3ZmqBridge(object):
             high = boxSpacePb.high
             shape = tuple(boxSpacePb.shape)
             mtype = boxSpacePb.dtype
-
-            if mtype == pb.INT:
+            # dtype is INT / UINT for native element types, as sent below raw tensor version 3
+            ns3Dtype = boxSpacePb.nativeDtype or mtype
+            if self.rawTensorVersion >= 3:
+                mtype = ns3Dtype
+
+            if mtype in NATIVE_DTYPES:
+                mtype = RAW_TENSOR_DTYPES[mtype]
+            elif mtype == pb.INT:
                 mtype = np.int
             elif mtype == pb.UINT:
                 mtype = np.uint
@@ -121,6 +142,8 @@ class Ns3ZmqBridge(object):
                 mtype = np.float
 
             space = spaces.Box(low=low, high=high, shape=shape, dtype=mtype)
+            # actions are sent natively whenever the simulation knows the dtype
+            space.ns3Dtype = ns3Dtype
 
         elif (spaceDesc.type == pb.Tuple):
             mySpaceList = []
@@ -144,6 +167,32 @@ class Ns3ZmqBridge(object):
                 mySpaceDict[pbSubSpaceDesc.name] = subSpace
 
             space = spaces.Dict(mySpaceDict)
+            # key of every slot, Dict elements may be sent by slot
+            space.ns3Keys = [pbSubSpaceDesc.name for pbSubSpaceDesc in dictSpacePb.element]
+
+        elif (spaceDesc.type == pb.MultiDiscrete):
+            multiDiscreteSpacePb = pb.MultiDiscreteSpace()
+            spaceDesc.space.Unpack(multiDiscreteSpacePb)
+            space = spaces.MultiDiscrete(list(multiDiscreteSpacePb.nvec))
+
+        elif (spaceDesc.type == pb.MultiBinary):
+            multiBinarySpacePb = pb.MultiBinarySpace()
+            spaceDesc.space.Unpack(multiBinarySpacePb)
+            space = spaces.MultiBinary(multiBinarySpacePb.n)
+
+        elif (spaceDesc.type == pb.Graph):
+            graphSpacePb = pb.GraphSpace()
+            spaceDesc.space.Unpack(graphSpacePb)
+            featureSpaces = []
+            for boxSpacePb in (graphSpacePb.nodeSpace, graphSpacePb.edgeSpace):
+                boxDesc = pb.SpaceDescription(type=pb.Box)
+                boxDesc.space.Pack(boxSpacePb)
+                featureSpaces.append(self._create_space(boxDesc))
+            nodeSpace, edgeSpace = featureSpaces
+            if hasattr(spaces, 'Graph'):
+                space = spaces.Graph(node_space=nodeSpace, edge_space=edgeSpace if edgeSpace.shape[0] else None)
+            else:
+                space = spaces.Dict({'nodes': nodeSpace, 'edges': edgeSpace})
 
         return space
 
@@ -154,12 +203,15 @@ class Ns3ZmqBridge(object):
 
         self.simPid = int(simInitMsg.simProcessId)
         self.wafPid = int(simInitMsg.wafShellProcessId)
+        if self.rawTensor:
+            self.rawTensorVersion = min(int(simInitMsg.rawTensorVersion), RAW_TENSOR_VERSION)
         self._action_space = self._create_space(simInitMsg.actSpace)
         self._observation_space = self._create_space(simInitMsg.obsSpace)
 
         reply = pb.SimInitAck()
         reply.done = True
         reply.stopSimReq = False
+        reply.rawTensorVersion = self.rawTensorVersion
         replyMsg = reply.SerializeToString()
         self.socket.send(replyMsg)
         return True
@@ -181,7 +233,7 @@ class Ns3ZmqBridge(object):
         envStateMsg = pb.EnvStateMsg()
         envStateMsg.ParseFromString(request)
 
-        self.obsData = self._create_data(envStateMsg.obsData)
+        self.obsData = self._create_data(envStateMsg.obsData, self._observation_space)
         self.reward = envStateMsg.reward
         self.gameOver = envStateMsg.isGameOver
         self.gameOverReason = envStateMsg.reason
@@ -233,19 +285,37 @@ class Ns3ZmqBridge(object):
     def is_game_over(self):
         return self.gameOver
 
-    def _create_data(self, dataContainerPb):
+    def _create_data(self, dataContainerPb, space=None):
         if (dataContainerPb.type == pb.Discrete):
             discreteContainerPb = pb.DiscreteDataContainer()
             dataContainerPb.data.Unpack(discreteContainerPb)
             data = discreteContainerPb.data
             return data
 
+        if (dataContainerPb.type == pb.Box) and dataContainerPb.HasField('tensor'):
+            tensor = dataContainerPb.tensor
+            data = np.frombuffer(tensor.data, dtype=RAW_TENSOR_DTYPES.get(tensor.dtype, np.float32))
+            return data.reshape(tuple(tensor.shape))
+
+        if (dataContainerPb.type == pb.SparseBox):
+            return decode_sparse(dataContainerPb.sparse, self.densify)
+
+        if (dataContainerPb.type in (pb.MultiDiscrete, pb.MultiBinary)):
+            return decode_multi(dataContainerPb)
+
+        if (dataContainerPb.type == pb.Graph):
+            graphContainerPb = pb.GraphDataContainer()
+            dataContainerPb.data.Unpack(graphContainerPb)
+            return decode_graph(graphContainerPb, self.graphs)
+
         if (dataContainerPb.type == pb.Box):
             boxContainerPb = pb.BoxDataContainer()
             dataContainerPb.data.Unpack(boxContainerPb)
             # print(boxContainerPb.shape, boxContainerPb.dtype, boxContainerPb.uintData)
 
-            if boxContainerPb.dtype == pb.INT:
+            if boxContainerPb.dtype in NATIVE_DTYPES:
+                data = np.frombuffer(boxContainerPb.packedData, dtype=RAW_TENSOR_DTYPES[boxContainerPb.dtype])
+            elif boxContainerPb.dtype == pb.INT:
                 data = boxContainerPb.intData
             elif boxContainerPb.dtype == pb.UINT:
                 data = boxContainerPb.uintData
@@ -262,8 +332,9 @@ class Ns3ZmqBridge(object):
             dataContainerPb.data.Unpack(tupleDataPb)
 
             myDataList = []
-            for pbSubData in tupleDataPb.element:
-                subData = self._create_data(pbSubData)
+            for i, pbSubData in enumerate(tupleDataPb.element):
+                subSpace = space.spaces[i] if isinstance(space, spaces.Tuple) else None
+                subData = self._create_data(pbSubData, subSpace)
                 myDataList.append(subData)
 
             data = tuple(myDataList)
@@ -274,9 +345,13 @@ class Ns3ZmqBridge(object):
             dataContainerPb.data.Unpack(dictDataPb)
 
             myDataDict = {}
+            keys = getattr(space, 'ns3Keys', [])
             for pbSubData in dictDataPb.element:
-                subData = self._create_data(pbSubData)
-                myDataDict[pbSubData.name] = subData
+                # elements of schema-bound dicts carry the slot of their key
+                name = keys[pbSubData.slot - 1] if pbSubData.slot else pbSubData.name
+                subSpace = space.spaces[name] if space is not None else None
+                subData = self._create_data(pbSubData, subSpace)
+                myDataDict[name] = subData
 
             data = myDataDict
             return data
@@ -301,13 +376,36 @@ class Ns3ZmqBridge(object):
             discreteContainerPb.data = actions
             dataContainer.data.Pack(discreteContainerPb)
 
+        elif spaceType in (spaces.MultiDiscrete, spaces.MultiBinary):
+            pack_multi(dataContainer, actions, spaceDesc, self.rawTensorVersion)
+
+        elif spaceType == spaces.Box and self.rawTensorVersion:
+            dataContainer.type = pb.Box
+            if getattr(spaceDesc, 'ns3Dtype', None) in NATIVE_DTYPES:
+                dtype = spaceDesc.ns3Dtype
+            elif np.issubdtype(spaceDesc.dtype, np.signedinteger):
+                dtype = pb.INT
+            elif np.issubdtype(spaceDesc.dtype, np.unsignedinteger):
+                dtype = pb.UINT
+            else:
+                dtype = pb.FLOAT
+            data = np.ascontiguousarray(actions, dtype=RAW_TENSOR_DTYPES[dtype])
+            dataContainer.tensor.dtype = dtype
+            dataContainer.tensor.shape.extend(data.shape)
+            dataContainer.tensor.data = data.tobytes()
+
         elif spaceType == spaces.Box:
             dataContainer.type = pb.Box
             boxContainerPb = pb.BoxDataContainer()
             shape = [len(actions)]
             boxContainerPb.shape.extend(shape)
 
-            if (spaceDesc.dtype in ['int', 'int8', 'int16', 'int32', 'int64']):
+            if getattr(spaceDesc, 'ns3Dtype', None) in NATIVE_DTYPES:
+                boxContainerPb.dtype = spaceDesc.ns3Dtype
+                data = np.ascontiguousarray(actions, dtype=RAW_TENSOR_DTYPES[spaceDesc.ns3Dtype])
+                boxContainerPb.packedData = data.tobytes()
+
+            elif (spaceDesc.dtype in ['int', 'int8', 'int16', 'int32', 'int64']):
                 boxContainerPb.dtype = pb.INT
                 boxContainerPb.intData.extend(actions)
 
@@ -360,13 +458,16 @@ class Ns3ZmqBridge(object):
 
 
 class Ns3Env(gym.Env):
-    def __init__(self, stepTime=0, port=0, startSim=True, simSeed=0, simArgs={}, debug=False):
+    def __init__(self, stepTime=0, port=0, startSim=True, simSeed=0, simArgs={}, debug=False, rawTensor=True,
+                 densify=False):
         self.stepTime = stepTime
         self.port = port
         self.startSim = startSim
         self.simSeed = simSeed
         self.simArgs = simArgs
         self.debug = debug
+        self.rawTensor = rawTensor
+        self.densify = densify
 
         # Filled in reset function
         self.ns3ZmqBridge = None
@@ -377,7 +478,8 @@ class Ns3Env(gym.Env):
         self.state = None
         self.steps_beyond_done = None
 
-        self.ns3ZmqBridge = Ns3ZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug)
+        self.ns3ZmqBridge = Ns3ZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug, self.rawTensor,
+                                         self.densify)
         self.ns3ZmqBridge.initialize_env(self.stepTime)
         self.action_space = self.ns3ZmqBridge.get_action_space()
         self.observation_space = self.ns3ZmqBridge.get_observation_space()
@@ -412,7 +514,8 @@ class Ns3Env(gym.Env):
             self.ns3ZmqBridge = None
 
         self.envDirty = False
-        self.ns3ZmqBridge = Ns3ZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug)
+        self.ns3ZmqBridge = Ns3ZmqBridge(self.port, self.startSim, self.simSeed, self.simArgs, self.debug, self.rawTensor,
+                                         self.densify)
         self.ns3ZmqBridge.initialize_env(self.stepTime)
         self.action_space = self.ns3ZmqBridge.get_action_space()
         self.observation_space = self.ns3ZmqBridge.get_observation_space()
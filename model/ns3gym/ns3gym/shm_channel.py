@@ -0,0 +1,216 @@
+__author__ = "Zhangmin Wang"
+__copyright__ = "Copyright (c) 2019"
+__version__ = "0.1.1"
+__email__ = "zhangmwg@gmail.com"
+
+"""
+Same-host transport for MultiZmqBridge, counterpart of the C++
+OpenGymShmChannel (model/opengym_shm_channel.h, see there for the segment
+layout). The agent creates the POSIX shared memory segment "/ns3gym-<port>"
+and the simulation attaches to it, like bind/connect with ZMQ.
+
+ShmChannel mimics the small part of the zmq socket API used by the bridge:
+recv() returns a memoryview into the ring (valid until the next recv/send)
+and send() copies the reply into the other ring. Like a REP socket, recv
+and send have to alternate.
+
+NOTE: ring indices and sequence counters are plain aligned ctypes
+loads/stores without fences, every shared word has a single writer. This is
+only ordered enough on x86_64 (stores are not reordered with stores, loads
+not with loads), so ShmChannel refuses other machines. A store may still
+pass a later load there, so a wake never relies on the waiter count: the
+FUTEX_WAKE is always made.
+"""
+
+import ctypes
+import os
+import platform
+import struct
+import time
+from multiprocessing import shared_memory
+
+SHM_MAGIC = 0x4733534e
+SHM_VERSION = 1
+SHM_RING0_HEADER = 64
+SHM_RING1_HEADER = 256
+SHM_DATA = 512
+SHM_SKIP = 0xFFFFFFFF
+SHM_SPIN = 2000
+DEFAULT_SHM_SIZE = 4 * 1024 * 1024
+
+_FUTEX_WAIT = 0
+_FUTEX_WAKE = 1
+_SYS_FUTEX = 202
+# machines whose memory order the unfenced ring protocol relies on
+SHM_MACHINES = ('x86_64', 'amd64')
+
+_libc = ctypes.CDLL(None, use_errno=True)
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+
+def _futex(addr, op, val, timeout=None):
+    ts = None
+    if timeout is not None:
+        ts = ctypes.byref(_Timespec(int(timeout), int((timeout % 1) * 1e9)))
+    _libc.syscall(_SYS_FUTEX, ctypes.c_void_p(addr), op, ctypes.c_uint32(val), ts, None, 0)
+
+
+def segment_name(port):
+    return "ns3gym-%d" % int(port)
+
+
+class _Ring(object):
+    def __init__(self, buf, headerOffset, dataOffset, capacity):
+        self.capacity = capacity
+        self.dataOffset = dataOffset
+        self.head = ctypes.c_uint64.from_buffer(buf, headerOffset)
+        self.tail = ctypes.c_uint64.from_buffer(buf, headerOffset + 64)
+        self.dataSeq = ctypes.c_uint32.from_buffer(buf, headerOffset + 128)
+        self.spaceSeq = ctypes.c_uint32.from_buffer(buf, headerOffset + 132)
+        self.dataWaiters = ctypes.c_uint32.from_buffer(buf, headerOffset + 136)
+        self.spaceWaiters = ctypes.c_uint32.from_buffer(buf, headerOffset + 140)
+
+    @staticmethod
+    def record_size(size):
+        return (4 + size + 7) & ~7
+
+    def wait(self, seq, waiters, expected, timeout=None):
+        # the simulation only wakes if it sees a waiter, the futex call
+        # orders the count before the kernel reads seq
+        waiters.value += 1
+        _futex(ctypes.addressof(seq), _FUTEX_WAIT, expected, timeout)
+        waiters.value -= 1
+
+    def wake(self, seq):
+        # always wake: the waiter count may be read before the seq store is
+        # visible, a waiter missed that way would sleep on the old seq
+        seq.value = (seq.value + 1) & 0xFFFFFFFF
+        _futex(ctypes.addressof(seq), _FUTEX_WAKE, 1)
+
+    def release(self):
+        """Hand the space behind the skipped or consumed record back to the producer"""
+        self.wake(self.spaceSeq)
+
+
+class ShmChannel(object):
+    """
+    Agent side of the shared memory transport
+    """
+    def __init__(self, port, size=DEFAULT_SHM_SIZE):
+        if platform.machine().lower() not in SHM_MACHINES:
+            raise RuntimeError("The shm transport needs x86_64, use transport='tcp' on %s"
+                               % platform.machine())
+        capacity = 1
+        while capacity < size:
+            capacity <<= 1
+        self.port = int(port)
+        self.capacity = capacity
+        self.name = segment_name(port)
+
+        try:
+            stale = shared_memory.SharedMemory(name=self.name)
+            stale.close()
+            stale.unlink()
+        except FileNotFoundError:
+            pass
+
+        self.shm = shared_memory.SharedMemory(name=self.name, create=True, size=SHM_DATA + 2 * capacity)
+        self.buf = self.shm.buf
+        # sim -> agent, agent -> sim
+        self.rx = _Ring(self.buf, SHM_RING0_HEADER, SHM_DATA, capacity)
+        self.tx = _Ring(self.buf, SHM_RING1_HEADER, SHM_DATA + capacity, capacity)
+        self.pendingRx = 0
+        self.replyPending = False
+        # magic is written last, the simulation waits for it
+        struct.pack_into('<II', self.buf, 4, SHM_VERSION, capacity)
+        struct.pack_into('<I', self.buf, 0, SHM_MAGIC)
+
+    def _release_rx(self):
+        if self.pendingRx:
+            self.rx.tail.value += self.pendingRx
+            self.pendingRx = 0
+            self.rx.release()
+
+    def recv(self, timeout=None):
+        if self.replyPending:
+            raise RuntimeError("Operation cannot be accomplished in current state")
+        self._release_rx()
+        ring = self.rx
+        spin = 0
+        deadline = None if timeout is None else time.time() + timeout
+        while True:
+            seq = ring.dataSeq.value
+            tail = ring.tail.value
+            if ring.head.value != tail:
+                offset = tail & (ring.capacity - 1)
+                start = ring.dataOffset + offset
+                size = struct.unpack_from('<I', self.buf, start)[0]
+                if size == SHM_SKIP:
+                    ring.tail.value = tail + (ring.capacity - offset)
+                    ring.release()
+                    continue
+                self.pendingRx = _Ring.record_size(size)
+                self.replyPending = True
+                return self.buf[start + 4:start + 4 + size]
+            spin += 1
+            if spin < SHM_SPIN:
+                continue
+            remaining = None
+            if deadline is not None:
+                remaining = deadline - time.time()
+                if remaining <= 0:
+                    return None
+            ring.wait(ring.dataSeq, ring.dataWaiters, seq, remaining)
+
+    def send(self, data):
+        if not self.replyPending:
+            raise RuntimeError("Operation cannot be accomplished in current state")
+        self.replyPending = False
+        self._release_rx()
+        ring = self.tx
+        size = len(data)
+        need = _Ring.record_size(size)
+        if need > ring.capacity // 2:
+            raise ValueError("Message of %d bytes does not fit shm ring of %d bytes" % (size, ring.capacity))
+
+        head = ring.head.value
+        offset = head & (ring.capacity - 1)
+        skip = ring.capacity - offset if ring.capacity - offset < need else 0
+        spin = 0
+        while True:
+            seq = ring.spaceSeq.value
+            if ring.capacity - (head - ring.tail.value) >= skip + need:
+                break
+            spin += 1
+            if spin < SHM_SPIN:
+                continue
+            ring.wait(ring.spaceSeq, ring.spaceWaiters, seq)
+
+        if skip:
+            struct.pack_into('<I', self.buf, ring.dataOffset + offset, SHM_SKIP)
+            head += skip
+            ring.head.value = head
+            offset = 0
+        start = ring.dataOffset + offset
+        struct.pack_into('<I', self.buf, start, size)
+        self.buf[start + 4:start + 4 + size] = data
+        ring.head.value = head + need
+        ring.wake(ring.dataSeq)
+
+    def close(self):
+        if self.shm is None:
+            return
+        self.pendingRx = 0
+        # drop every export of the buffer before closing the mapping
+        self.rx = None
+        self.tx = None
+        self.buf = None
+        try:
+            self.shm.close()
+            self.shm.unlink()
+        except Exception:
+            pass
+        self.shm = None
@@ -1,7 +1,12 @@
 import sys
 import os
+import glob
+import re
 import time
+import random
+import socket
 import subprocess
+from collections import deque
 
 
 def find_waf_path(cwd):
@@ -133,4 +138,206 @@ def start_sim_script(port=5555, simSeed=0, simArgs={}, debug=False):
 
 	# go back to my dir
 	os.chdir(cwd)
-	return ns3Proc
\ No newline at end of file
+	return ns3Proc
+
+
+def find_sim_binary(baseNs3Dir, simScriptName, profile=None):
+	"""
+	\return path of the built executable of simScriptName below
+	baseNs3Dir/build, e.g. build/scratch/<name>/ns3-dev-<name>-debug.
+	Several builds (profiles) of the script are an error unless profile
+	('debug', 'optimized', ...) selects one.
+	"""
+	nameRe = re.compile(r'^ns3(?:-dev|\.[0-9][0-9.]*(?:-dev)?)?-' + re.escape(simScriptName) +
+	                    r'-(' + (re.escape(profile) if profile else r'[a-z]+') + r')$')
+	pattern = os.path.join(baseNs3Dir, 'build', '**', 'ns3*-' + glob.escape(simScriptName) + '-*')
+	candidates = [f for f in glob.glob(pattern, recursive=True)
+	              if nameRe.match(os.path.basename(f)) and os.path.isfile(f) and os.access(f, os.X_OK)]
+	if not candidates:
+		raise RuntimeError("No built binary of {} below {}, build ns-3 first".format(
+			simScriptName, os.path.join(baseNs3Dir, 'build')))
+	if len(candidates) > 1:
+		raise RuntimeError("Several built binaries of {}: {}, select one with profile".format(
+			simScriptName, ', '.join(sorted(candidates))))
+	return candidates[0]
+
+
+def sim_arguments(port=5555, simSeed=0, simArgs={}):
+	args = []
+	if port:
+		args.append('--openGymPort=' + str(port))
+	if simSeed:
+		args.append('--simSeed=' + str(simSeed))
+	for k, v in simArgs.items():
+		args.append(str(k) + '=' + str(v))
+	return args
+
+
+class SimLauncher(object):
+	"""
+	Starts the built simulation binary directly instead of through waf, so a
+	start does not pay for the waf startup and its build check. The binary
+	of the script in the current directory (or simScriptName) is resolved
+	once, it is not rebuilt when the sources change. profile selects the
+	build ('debug', 'optimized', ...) when there are several.
+	"""
+	def __init__(self, simScriptName=None, cwd=None, profile=None):
+		cwd = cwd or os.getcwd()
+		simScriptName = simScriptName or os.path.basename(cwd)
+		self.baseNs3Dir = os.path.dirname(find_waf_path(cwd))
+		self.binary = find_sim_binary(self.baseNs3Dir, simScriptName, profile)
+		libDir = os.path.join(self.baseNs3Dir, 'build', 'lib')
+		self.env = dict(os.environ)
+		libPath = self.env.get('LD_LIBRARY_PATH')
+		self.env['LD_LIBRARY_PATH'] = libDir + (':' + libPath if libPath else '')
+
+	def launch(self, port=5555, simSeed=0, simArgs={}, debug=False):
+		"""
+		Same arguments and result as start_sim_script.
+		"""
+		cmd = [self.binary] + sim_arguments(port, simSeed, simArgs)
+		if debug:
+			cmd = ['gdb', '--args'] + cmd
+			print("Start command: ", ' '.join(cmd))
+			return subprocess.Popen(cmd, cwd=self.baseNs3Dir, env=self.env)
+		return subprocess.Popen(cmd, cwd=self.baseNs3Dir, env=self.env, stderr=subprocess.DEVNULL)
+
+
+class SimPool(object):
+	"""
+	Keeps size simulations started ahead of time, each one connecting to
+	its own port and waiting there for an agent once its script is set up.
+	acquire() hands out the oldest one and starts its replacement, so a
+	reset or a new vectorized env attaches to an initialized simulation.
+	Only for the tcp transport, the agent binds the port later.
+
+	seeds: iterator with the seed of every simulation started, random if None
+	launcher: the SimLauncher to start them with, one for the current
+	          directory if None
+	"""
+	def __init__(self, size=1, seeds=None, launcher=None, debug=False):
+		self.size = max(int(size), 1)
+		self.seeds = seeds
+		self.launch = (launcher or SimLauncher()).launch
+		self.debug = debug
+		self.simArgs = None
+		self.idle = deque()
+
+	def _free_port(self, min_port=5001, max_port=10000):
+		# below the ephemeral ports, a waiting simulation could connect to itself there
+		taken = set(port for port, _, _ in self.idle)
+		for _ in range(100):
+			port = random.randint(min_port, max_port)
+			if port in taken:
+				continue
+			s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+			try:
+				s.bind(('', port))
+				return port
+			except OSError:
+				pass
+			finally:
+				s.close()
+		raise RuntimeError("Could not find a free port for a pooled simulation")
+
+	def _spawn(self):
+		port = self._free_port()
+		seed = next(self.seeds) if self.seeds is not None else random.randint(1, 2 ** 32 - 1)
+		self.idle.append((port, self.launch(port, seed, self.simArgs, self.debug), seed))
+
+	def _drain(self):
+		while self.idle:
+			_, proc, _ = self.idle.popleft()
+			proc.kill()
+			proc.wait()
+
+	def acquire(self, simArgs={}):
+		"""
+		\return (port, process, seed) of a simulation started with simArgs
+		"""
+		if simArgs != self.simArgs:
+			# started for other arguments
+			self._drain()
+			self.simArgs = dict(simArgs)
+		if not self.idle:
+			self._spawn()
+		sim = self.idle.popleft()
+		while len(self.idle) < self.size:
+			self._spawn()
+		return sim
+
+	def close(self):
+		self._drain()
+
+
+class ForkServer(object):
+	"""
+	Warm start of the simulations: the script is started once with
+	--OpenGymMultiInterface::ForkServerPort, builds its topology and parks
+	in OpenGymMultiEnv::ServeForks before Simulator::Run. Every fork() then
+	forks a simulation from that process with its own port, RNG run and
+	OpenGymMultiInterface attributes, which takes milliseconds instead of a
+	script start. The script has to call ServeForks.
+
+	startTimeout: seconds to wait for the script to reach ServeForks
+	launcher: a SimLauncher, start_sim_script if None
+	"""
+	def __init__(self, startTimeout=60, launcher=None):
+		self.startTimeout = startTimeout
+		self.launch = launcher.launch if launcher else start_sim_script
+		self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+		self.listener.bind(('127.0.0.1', 0))
+		self.listener.listen(1)
+		self.port = self.listener.getsockname()[1]
+		self.conn = None
+		self.reader = None
+		self.ns3Process = None
+
+	def start(self, simArgs={}, debug=False):
+		args = dict(simArgs)
+		args["--OpenGymMultiInterface::ForkServerPort"] = self.port
+		self.ns3Process = self.launch(0, 0, args, debug)
+		self.listener.settimeout(self.startTimeout)
+		try:
+			self.conn, _ = self.listener.accept()
+		except socket.timeout:
+			raise RuntimeError("Simulation script did not call ServeForks within {} s".format(self.startTimeout))
+		self.conn.settimeout(None)
+		self.reader = self.conn.makefile('r')
+
+	def fork(self, port, run=0, simArgs={}, debug=False):
+		"""
+		Fork a simulation talking to the agent on port with RNG run run
+		(0 keeps the run of the script). The --OpenGymMultiInterface::
+		arguments of simArgs are applied to the forked simulation, the
+		script is started with simArgs on the first call.
+		\return process id of the simulation
+		"""
+		if self.conn is None:
+			self.start(simArgs, debug)
+		line = "fork {} {}".format(int(port), int(run))
+		prefix = "--OpenGymMultiInterface::"
+		for k, v in simArgs.items():
+			if str(k).startswith(prefix):
+				line += " {}={}".format(str(k)[len(prefix):], v)
+		self.conn.sendall((line + "\n").encode())
+		reply = self.reader.readline()
+		pid = int(reply) if reply else -1
+		if pid <= 0:
+			raise RuntimeError("Fork server could not start a simulation: " + line)
+		return pid
+
+	def close(self):
+		if self.conn is not None:
+			try:
+				self.conn.sendall(b"exit\n")
+			except OSError:
+				pass
+			self.reader.close()
+			self.conn.close()
+			self.conn = None
+		# the script exits on its own after "exit"
+		if self.ns3Process is not None:
+			self.ns3Process.kill()
+			self.ns3Process = None
+		self.listener.close()
@@ -29,5 +29,5 @@ setup(
     long_description='OpenAI Gym meets ns-3',
     keywords='openAI gym, ML, RL, ns-3',
     install_requires=['pyzmq', 'numpy', 'protobuf', 'gym'],
-    extras_require={},
+    extras_require={'sparse': ['scipy']},
 )
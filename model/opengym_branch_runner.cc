@@ -0,0 +1,261 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Zhangmin Wang
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "opengym_branch_runner.h"
+#include "opengym_multi_interface.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymBranchRunner");
+
+namespace {
+
+bool
+WriteAll (int fd, const std::string &data)
+{
+  size_t sent = 0;
+  while (sent < data.size ())
+    {
+      ssize_t n = ::write (fd, data.data () + sent, data.size () - sent);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n <= 0)
+        {
+          return false;
+        }
+      sent += n;
+    }
+  return true;
+}
+
+} // namespace
+
+OpenGymBranchRunner::OpenGymBranchRunner (OpenGymMultiInterface *iface)
+    : m_iface (iface), m_active (false), m_horizon (0), m_fd (-1)
+{
+}
+
+bool
+OpenGymBranchRunner::IsActive () const
+{
+  return m_active;
+}
+
+bool
+OpenGymBranchRunner::Run (const ns3opengym::BranchRequest &request)
+{
+  NS_LOG_FUNCTION (this << request.plans_size () << request.horizon ());
+  // a forked copy that reports through a pipe
+  struct Running
+  {
+    int plan;
+    pid_t pid;
+    int fd;
+    std::string data;
+  };
+
+  int count = request.plans_size ();
+  size_t maxParallel = request.maxparallel () > 0 ? request.maxparallel () : count;
+  m_msg.Clear ();
+  m_msg.set_stepidx (m_iface->m_stateMsg.stepidx ());
+  for (int k = 0; k < count; k++)
+    {
+      m_msg.add_branchresults ();
+    }
+
+  std::vector<Running> running;
+  int next = 0;
+  // buffered output would be written by the copies as well
+  std::cout.flush ();
+  std::fflush (0);
+  while (next < count || !running.empty ())
+    {
+      while (next < count && running.size () < maxParallel)
+        {
+          int fds[2];
+          if (::pipe (fds) != 0)
+            {
+              NS_LOG_WARN ("pipe failed: " << std::strerror (errno));
+              m_msg.mutable_branchresults (next++)->set_failed (true);
+              continue;
+            }
+          pid_t pid = ::fork ();
+          if (pid == 0)
+            {
+              ::close (fds[0]);
+              for (size_t i = 0; i < running.size (); i++)
+                {
+                  ::close (running[i].fd);
+                }
+              m_active = true;
+              m_plan = request.plans (next);
+              m_horizon = request.horizon ();
+              m_fd = fds[1];
+              m_result.Clear ();
+              for (size_t idx = 0; idx < m_iface->m_agentIdVec.size (); idx++)
+                {
+                  m_result.add_agentids (m_iface->m_agentIdVec[idx]);
+                }
+              // the script may end the simulation before the horizon
+              Simulator::ScheduleDestroy (&OpenGymBranchRunner::Finish, this, true);
+              if (m_horizon == 0)
+                {
+                  Finish (false);
+                }
+              ExecuteActions ();
+              return true;
+            }
+          ::close (fds[1]);
+          if (pid < 0)
+            {
+              NS_LOG_WARN ("fork failed: " << std::strerror (errno));
+              ::close (fds[0]);
+              m_msg.mutable_branchresults (next++)->set_failed (true);
+              continue;
+            }
+          Running branch = {next++, pid, fds[0], std::string ()};
+          running.push_back (branch);
+        }
+
+      // collect the results, a copy is done when its pipe is closed
+      std::vector<pollfd> pollFds (running.size ());
+      for (size_t i = 0; i < running.size (); i++)
+        {
+          pollFds[i].fd = running[i].fd;
+          pollFds[i].events = POLLIN;
+          pollFds[i].revents = 0;
+        }
+      if (!running.empty () && ::poll (&pollFds[0], pollFds.size (), -1) < 0 && errno != EINTR)
+        {
+          NS_FATAL_ERROR ("poll failed: " << std::strerror (errno));
+        }
+      for (size_t i = running.size (); i-- > 0;)
+        {
+          if (pollFds[i].revents == 0)
+            {
+              continue;
+            }
+          char buffer[4096];
+          ssize_t n = ::read (running[i].fd, buffer, sizeof (buffer));
+          if (n > 0 || (n < 0 && errno == EINTR))
+            {
+              running[i].data.append (buffer, n > 0 ? n : 0);
+              continue;
+            }
+          ::close (running[i].fd);
+          int status = 0;
+          ::waitpid (running[i].pid, &status, 0);
+          ns3opengym::BranchResult *result = m_msg.mutable_branchresults (running[i].plan);
+          // a copy that left without Finish wrote nothing
+          if (!WIFEXITED (status) || WEXITSTATUS (status) != 0 || running[i].data.empty () ||
+              !result->ParseFromString (running[i].data))
+            {
+              NS_LOG_WARN ("Branch " << running[i].plan << " (pid " << running[i].pid
+                                     << ") ended without a result");
+              result->Clear ();
+              result->set_failed (true);
+            }
+          running.erase (running.begin () + i);
+        }
+    }
+
+  m_iface->SendMsg (m_msg);
+  return false;
+}
+
+void
+OpenGymBranchRunner::Step ()
+{
+  NS_LOG_FUNCTION (this);
+  OpenGymMultiInterface &iface = *m_iface;
+  // rewards and dones of all agents, from the same callbacks as a state
+  iface.m_batchAgentIds.assign (iface.m_agentIdVec.begin (), iface.m_agentIdVec.end ());
+  size_t count = iface.m_batchAgentIds.size ();
+  if (!iface.m_rewardBatchCb.IsNull ())
+    {
+      iface.m_batchRewards.resize (count);
+      iface.m_rewardBatchCb (iface.m_batchAgentIds, iface.m_batchRewards);
+    }
+  if (!iface.m_doneBatchCb.IsNull ())
+    {
+      iface.m_batchDones.resize (count);
+      iface.m_doneBatchCb (iface.m_batchAgentIds, iface.m_batchDones);
+    }
+  m_result.clear_dones ();
+  bool allDone = count > 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      uint32_t agent_id = iface.m_batchAgentIds[i];
+      m_result.add_rewards (iface.m_rewardBatchCb.IsNull () ? iface.GetReward (agent_id)
+                                                            : iface.m_batchRewards[i]);
+      bool done = iface.m_doneBatchCb.IsNull () ? iface.GetDone (agent_id) : iface.m_batchDones[i];
+      m_result.add_dones (done);
+      allDone = allDone && done;
+    }
+  m_result.set_steps (m_result.steps () + 1);
+  if (m_result.steps () >= m_horizon || allDone || iface.m_simEnd)
+    {
+      Finish (iface.m_simEnd);
+    }
+  ExecuteActions ();
+}
+
+void
+OpenGymBranchRunner::ExecuteActions ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_plan.steps_size () == 0)
+    {
+      return;
+    }
+  int step = std::min<int> (m_result.steps (), m_plan.steps_size () - 1);
+  m_iface->ExecuteLocalActions (m_plan.steps (step));
+}
+
+void
+OpenGymBranchRunner::Finish (bool simEnd)
+{
+  NS_LOG_FUNCTION (this << simEnd);
+  m_result.set_simend (simEnd);
+  std::string data;
+  m_result.SerializeToString (&data);
+  bool sent = WriteAll (m_fd, data);
+  std::cout.flush ();
+  std::fflush (0);
+  // the parent's sockets and objects are not ours to clean up
+  ::_exit (sent ? 0 : 1);
+}
+
+} // namespace ns3
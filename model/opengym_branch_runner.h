@@ -0,0 +1,85 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * ********************************************************************************
+ *
+ * Lookahead branches for OpenGymMultiInterface: the plans of a
+ * ns3opengym::BranchRequest run in forked copies of the simulation.
+ *
+ * Author: Zhangmin Wang
+ */
+
+#ifndef OPENGYM_BRANCH_RUNNER_H
+#define OPENGYM_BRANCH_RUNNER_H
+
+#include <stdint.h>
+#include "messages.pb.h"
+
+namespace ns3 {
+
+class OpenGymMultiInterface;
+
+/**
+ * Branching (lockstep without workers and StepDeadline): instead of
+ * actions the agent may send a BranchRequest with K plans. The simulation
+ * forks a copy per plan (copy-on-write, at most maxParallel at once),
+ * each copy executes its plan for horizon steps without talking to the
+ * agent and reports the rewards of all agents after every step through a
+ * pipe. The results are sent back without a new state and the agent
+ * answers again, with actions or another request.
+ *
+ * A copy ends at the horizon, when all agents are done or at the end of
+ * the simulation. Scripts have to call Simulator::Destroy as usual, a
+ * copy never runs the destructors of its parent.
+ */
+class OpenGymBranchRunner
+{
+public:
+  OpenGymBranchRunner (OpenGymMultiInterface *iface);
+
+  // true in a copy running a plan
+  bool IsActive () const;
+  /**
+   * Fork a copy per plan of \p request and send their results.
+   * \return true in a copy, which goes on with the simulation
+   */
+  bool Run (const ns3opengym::BranchRequest &request);
+  // in a copy: record the rewards of the step and execute the next actions
+  void Step ();
+  // in a copy: send the result to the parent and exit
+  void Finish (bool simEnd);
+
+private:
+  // in a copy: the actions of the plan for the current step
+  void ExecuteActions ();
+
+  OpenGymMultiInterface *m_iface;
+  // set in a forked copy running a plan
+  bool m_active;
+  ns3opengym::BranchPlan m_plan;
+  uint32_t m_horizon;
+  // write end of the pipe to the parent
+  int m_fd;
+  ns3opengym::BranchResult m_result;
+  // results of a BranchRequest
+  ns3opengym::MultiAgentStateMsg m_msg;
+};
+
+} // namespace ns3
+
+#endif // OPENGYM_BRANCH_RUNNER_H
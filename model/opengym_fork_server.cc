@@ -0,0 +1,167 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Zhangmin Wang
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "ns3/log.h"
+#include "opengym_fork_server.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymForkServer");
+
+namespace {
+
+// read one '\n' terminated line of the control connection
+bool
+ReadLine (int fd, std::string &line)
+{
+  line.clear ();
+  char c;
+  while (true)
+    {
+      ssize_t n = ::read (fd, &c, 1);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n <= 0)
+        {
+          return false;
+        }
+      if (c == '\n')
+        {
+          return true;
+        }
+      line.push_back (c);
+    }
+}
+
+bool
+WriteLine (int fd, const std::string &line)
+{
+  std::string data = line + "\n";
+  size_t sent = 0;
+  while (sent < data.size ())
+    {
+      ssize_t n = ::write (fd, data.data () + sent, data.size () - sent);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n <= 0)
+        {
+          return false;
+        }
+      sent += n;
+    }
+  return true;
+}
+
+} // namespace
+
+OpenGymForkServer::OpenGymForkServer (uint16_t controlPort)
+    : m_controlPort (controlPort)
+{
+}
+
+OpenGymForkServer::Command
+OpenGymForkServer::Serve ()
+{
+  NS_LOG_FUNCTION (this << m_controlPort);
+  int fd = ::socket (AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  std::memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (m_controlPort);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (fd < 0 || ::connect (fd, (sockaddr *) &addr, sizeof (addr)) != 0)
+    {
+      NS_FATAL_ERROR ("Cannot connect to the fork server control port " << m_controlPort);
+    }
+  NS_LOG_UNCOND ("Fork server process id: " << ::getpid ()
+                                            << ", control port: " << m_controlPort);
+
+  std::string line;
+  while (ReadLine (fd, line))
+    {
+      // reap the simulations that ended
+      while (::waitpid (-1, 0, WNOHANG) > 0)
+        {
+        }
+
+      // fork <port> <run> [<attribute>=<value> ...]
+      std::istringstream cmd (line);
+      std::string verb;
+      Command command;
+      command.port = 0;
+      command.run = 0;
+      cmd >> verb;
+      if (verb == "exit")
+        {
+          break;
+        }
+      bool valid = verb == "fork" && (cmd >> command.port >> command.run);
+      std::string token;
+      while (valid && cmd >> token)
+        {
+          size_t eq = token.find ('=');
+          valid = eq != std::string::npos && eq > 0;
+          command.attributes.push_back (std::make_pair (token.substr (0, eq), token.substr (eq + 1)));
+        }
+      if (!valid)
+        {
+          NS_LOG_WARN ("Malformed fork server command: " << line);
+          WriteLine (fd, "-1");
+          continue;
+        }
+
+      // buffered output would be written by the child as well
+      std::cout.flush ();
+      std::fflush (0);
+      pid_t pid = ::fork ();
+      if (pid == 0)
+        {
+          ::close (fd);
+          return command;
+        }
+      if (pid < 0)
+        {
+          NS_LOG_WARN ("fork failed: " << std::strerror (errno));
+        }
+      WriteLine (fd, std::to_string (pid));
+    }
+
+  ::close (fd);
+  NS_LOG_UNCOND ("Fork server " << ::getpid () << " exits");
+  std::exit (0);
+}
+
+} // namespace ns3
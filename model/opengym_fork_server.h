@@ -0,0 +1,69 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * ********************************************************************************
+ *
+ * Fork server for OpenGymMultiInterface: a simulation built once forks a
+ * copy per episode requested over a local control connection.
+ *
+ * Author: Zhangmin Wang
+ */
+
+#ifndef OPENGYM_FORK_SERVER_H
+#define OPENGYM_FORK_SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * The template process connects to the control port of the agent and
+ * forks one simulation per "fork <port> <run> [<attribute>=<value> ...]"
+ * line. It replies the child's process id and exits once the agent
+ * closes the connection or sends "exit", only the children return.
+ */
+class OpenGymForkServer
+{
+public:
+  // a fork command of the agent
+  struct Command
+  {
+    uint32_t port;
+    // RNG run, 0 keeps the template's
+    uint64_t run;
+    std::vector<std::pair<std::string, std::string>> attributes;
+  };
+
+  OpenGymForkServer (uint16_t controlPort);
+
+  /**
+   * Serve the control connection.
+   * \return in a forked child with the command it was forked for
+   */
+  Command Serve ();
+
+private:
+  uint16_t m_controlPort;
+};
+
+} // namespace ns3
+
+#endif // OPENGYM_FORK_SERVER_H
@@ -24,6 +24,7 @@
 #include "ns3/log.h"
 #include "ns3/config.h"
 #include "ns3/simulator.h"
+#include <google/protobuf/io/coded_stream.h>
 #include "opengym_interface.h"
 #include "opengym_env.h"
 #include "container.h"
@@ -36,6 +37,21 @@ NS_LOG_COMPONENT_DEFINE ("OpenGymInterface");
 
 NS_OBJECT_ENSURE_REGISTERED (OpenGymInterface);
 
+namespace {
+
+// Parse an EnvActMsg into the message of the previous step, keeping its
+// submessages (ParseFromArray would Clear() and free them)
+bool
+MergeActMsg(const uint8_t *data, uint32_t size, ns3opengym::EnvActMsg &msg)
+{
+  msg.set_stopsimreq(false);
+  OpenGymDataContainer::ResetDataContainerPbMsg(msg.mutable_actdata());
+  google::protobuf::io::CodedInputStream input(data, size);
+  return msg.MergeFromCodedStream(&input) && input.ConsumedEntireMessage();
+}
+
+} // namespace
+
 
 TypeId
 OpenGymInterface::GetTypeId (void)
@@ -80,7 +96,8 @@ OpenGymInterface::Delete (void)
 
 OpenGymInterface::OpenGymInterface(uint32_t port)
   : m_port(port), m_zmq_context(1), m_zmq_socket(m_zmq_context, ZMQ_REQ),
-    m_simEnd(false), m_stopEnvRequested(false), m_initSimMsgSent(false)
+    m_simEnd(false), m_stopEnvRequested(false), m_initSimMsgSent(false), m_rawTensorVersion(0),
+    m_containerPool(Create<OpenGymContainerPool> ()), m_boundEnv(0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -94,6 +111,9 @@ void
 OpenGymInterface::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  if (OpenGymContainerPool::GetCurrent() == PeekPointer(m_containerPool)) {
+    OpenGymContainerPool::SetCurrent(0);
+  }
 }
 
 void
@@ -171,6 +191,7 @@ OpenGymInterface::Init()
 
   Ptr<OpenGymSpace> obsSpace = GetObservationSpace();
   Ptr<OpenGymSpace> actionSpace = GetActionSpace();
+  m_actionDictSpace = DynamicCast<OpenGymDictSpace>(actionSpace);
 
   NS_LOG_UNCOND("\nSimulation process id: " << ::getpid() << " (parent (waf shell) id: " << ::getppid() << ")");
   NS_LOG_UNCOND("Waiting for Python process to connect on port: "<< connectAddr);
@@ -179,6 +200,7 @@ OpenGymInterface::Init()
   ns3opengym::SimInitMsg simInitMsg;
   simInitMsg.set_simprocessid(::getpid());
   simInitMsg.set_wafshellprocessid(::getppid());
+  simInitMsg.set_rawtensorversion(OpenGymDataContainer::GetRawTensorVersion());
 
   if (obsSpace) {
     ns3opengym::SpaceDescription spaceDesc;
@@ -193,9 +215,7 @@ OpenGymInterface::Init()
   }
 
   // send init msg to python
-  zmq::message_t request(simInitMsg.ByteSize());;
-  simInitMsg.SerializeToArray(request.data(), simInitMsg.ByteSize());
-  m_zmq_socket.send (request);
+  SendMsg(simInitMsg);
 
   // receive init ack msg form python
   ns3opengym::SimInitAck simInitAck;
@@ -205,6 +225,7 @@ OpenGymInterface::Init()
 
   // bool done = simInitAck.done();
   // NS_LOG_DEBUG("Sim Init Ack: " << done);
+  m_rawTensorVersion = std::min(simInitAck.rawtensorversion(), OpenGymDataContainer::GetRawTensorVersion());
 
   bool stopSim = simInitAck.stopsimreq();
   if (stopSim) {
@@ -237,6 +258,10 @@ OpenGymInterface::NotifyCurrentState()
     return;
   }
 
+  // containers of the previous step were serialized or executed by now
+  OpenGymContainerPool::SetCurrent(PeekPointer(m_containerPool));
+  m_containerPool->ReleaseStep();
+
   // collect current env state
   // NS_LOG_UNCOND("OpenGymInterface collect current env state: ");
   Ptr<OpenGymDataContainer> obsDataContainer = GetObservation();
@@ -248,17 +273,19 @@ OpenGymInterface::NotifyCurrentState()
   //               << isGameOver << " , " << extraInfo
   //               << " ]");
 
-  ns3opengym::EnvStateMsg envStateMsg;
+  // the message of the previous step is overwritten field by field
+  ns3opengym::EnvStateMsg &envStateMsg = m_stateMsg;
   // observation
-  ns3opengym::DataContainer obsDataContainerPbMsg;
   if (obsDataContainer) {
-    obsDataContainerPbMsg = obsDataContainer->GetDataContainerPbMsg();
-    envStateMsg.mutable_obsdata()->CopyFrom(obsDataContainerPbMsg);
+    obsDataContainer->FillDataContainerPbMsg(*envStateMsg.mutable_obsdata(), m_rawTensorVersion);
+  } else {
+    envStateMsg.clear_obsdata();
   }
   // reward
   envStateMsg.set_reward(reward);
   // game over
   envStateMsg.set_isgameover(false);
+  envStateMsg.set_reason(ns3opengym::EnvStateMsg::SimulationEnd);
   if (isGameOver)
   {
     envStateMsg.set_isgameover(true);
@@ -273,15 +300,14 @@ OpenGymInterface::NotifyCurrentState()
   envStateMsg.set_info(extraInfo);
 
   // send env state msg to python
-  zmq::message_t request(envStateMsg.ByteSize());;
-  envStateMsg.SerializeToArray(request.data(), envStateMsg.ByteSize());
-  m_zmq_socket.send (request);
+  SendMsg(envStateMsg);
 
   // receive act msg form python
-  ns3opengym::EnvActMsg envActMsg;
-  zmq::message_t reply;
-  m_zmq_socket.recv (&reply);
-  envActMsg.ParseFromArray(reply.data(), reply.size());
+  ns3opengym::EnvActMsg &envActMsg = m_actMsg;
+  m_zmq_socket.recv (&m_zmqReply);
+  if (!MergeActMsg(static_cast<const uint8_t *>(m_zmqReply.data()), m_zmqReply.size(), envActMsg)) {
+    NS_LOG_ERROR("Cannot parse actions msg of " << m_zmqReply.size() << " bytes");
+  }
 
   if (m_simEnd) {
     // if sim end only rx ms and quit
@@ -298,12 +324,36 @@ OpenGymInterface::NotifyCurrentState()
   }
 
   // first step after reset is called without actions, just to get current state
-  ns3opengym::DataContainer actDataContainerPbMsg = envActMsg.actdata();
-  Ptr<OpenGymDataContainer> actDataContainer = OpenGymDataContainer::CreateFromDataContainerPbMsg(actDataContainerPbMsg);
-  ExecuteActions(actDataContainer);
+  // recycle the container of the previous step unless the env kept it
+  if (!m_actionContainer || m_actionContainer->GetReferenceCount() > 1 ||
+      !m_actionContainer->UpdateFromDataContainerPbMsg(envActMsg.actdata())) {
+    m_actionContainer = OpenGymDataContainer::CreateFromDataContainerPbMsg(envActMsg.actdata());
+  }
+  if (m_actionDictSpace) {
+    // the env can look elements up by slot
+    Ptr<OpenGymDictContainer> dict = DynamicCast<OpenGymDictContainer>(m_actionContainer);
+    if (dict) {
+      dict->Bind(m_actionDictSpace);
+    }
+  }
+  ExecuteActions(m_actionContainer);
 
 }
 
+void
+OpenGymInterface::SendMsg(const google::protobuf::MessageLite &msg)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t size = msg.ByteSizeLong();
+  if (m_txBuffer.size() < size) {
+    m_txBuffer.resize(size);
+  }
+  msg.SerializeWithCachedSizesToArray(m_txBuffer.data());
+  // zero copy, the buffer is written again only after the reply arrived
+  zmq::message_t request(m_txBuffer.data(), size, NULL);
+  m_zmq_socket.send (request);
+}
+
 void
 OpenGymInterface::WaitForStop()
 {
@@ -409,17 +459,27 @@ OpenGymInterface::ExecuteActions(Ptr<OpenGymDataContainer> action)
   return reply;
 }
 
+Ptr<OpenGymContainerPool>
+OpenGymInterface::GetContainerPool() const
+{
+  return m_containerPool;
+}
+
 void
 OpenGymInterface::Notify(Ptr<OpenGymEnv> entity)
 {
   NS_LOG_FUNCTION (this);
   NS_LOG_INFO("OpenGymInterface Notify.");
 
-  SetGetGameOverCb( MakeCallback (&OpenGymEnv::GetGameOver, entity) );
-  SetGetObservationCb( MakeCallback (&OpenGymEnv::GetObservation, entity) );
-  SetGetRewardCb( MakeCallback (&OpenGymEnv::GetReward, entity) );
-  SetGetExtraInfoCb( MakeCallback (&OpenGymEnv::GetExtraInfo, entity) );
-  SetExecuteActionsCb( MakeCallback (&OpenGymEnv::ExecuteActions, entity) );
+  // bind once, the callbacks hold a reference to the env
+  if (PeekPointer(entity) != m_boundEnv) {
+    SetGetGameOverCb( MakeCallback (&OpenGymEnv::GetGameOver, entity) );
+    SetGetObservationCb( MakeCallback (&OpenGymEnv::GetObservation, entity) );
+    SetGetRewardCb( MakeCallback (&OpenGymEnv::GetReward, entity) );
+    SetGetExtraInfoCb( MakeCallback (&OpenGymEnv::GetExtraInfo, entity) );
+    SetExecuteActionsCb( MakeCallback (&OpenGymEnv::ExecuteActions, entity) );
+    m_boundEnv = PeekPointer(entity);
+  }
 
   NotifyCurrentState();
 }
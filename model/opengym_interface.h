@@ -24,12 +24,15 @@
 
 #include "ns3/object.h"
 #include <zmq.hpp>
+#include "messages.pb.h"
 
 namespace ns3 {
 
 class OpenGymSpace;
 class OpenGymDataContainer;
 class OpenGymEnv;
+class OpenGymContainerPool;
+class OpenGymDictSpace;
 
 class OpenGymInterface : public Object
 {
@@ -45,6 +48,9 @@ public:
   /**
    * 1. Collect current env state
    * 2. Execute Actions
+   *
+   * Messages, send buffer and action container are reused between steps,
+   * see OpenGymMultiInterface::NotifyCurrentState.
    */
   void NotifyCurrentState();
   void WaitForStop();
@@ -58,6 +64,8 @@ public:
   bool IsGameOver();
   std::string GetExtraInfo();
   bool ExecuteActions(Ptr<OpenGymDataContainer> action);
+  // see OpenGymMultiInterface::GetContainerPool
+  Ptr<OpenGymContainerPool> GetContainerPool() const;
 
   void SetGetActionSpaceCb(Callback< Ptr<OpenGymSpace> > cb);
   void SetGetObservationSpaceCb(Callback< Ptr<OpenGymSpace> > cb);
@@ -83,13 +91,29 @@ private:
   static Ptr<OpenGymInterface> *DoGet (uint32_t port=5555);
   static void Delete (void);
 
+  void SendMsg(const google::protobuf::MessageLite &msg);
+
   uint32_t m_port;
   zmq::context_t m_zmq_context;
   zmq::socket_t m_zmq_socket;
+  zmq::message_t m_zmqReply;
 
   bool m_simEnd;
   bool m_stopEnvRequested;
   bool m_initSimMsgSent;
+  // raw tensor version negotiated in Init, 0: Box data as BoxDataContainer
+  uint32_t m_rawTensorVersion;
+
+  // reused between steps
+  ns3opengym::EnvStateMsg m_stateMsg;
+  ns3opengym::EnvActMsg m_actMsg;
+  std::vector<uint8_t> m_txBuffer;
+  Ptr<OpenGymDataContainer> m_actionContainer;
+  // a Dict action space, received Dict actions are bound to it
+  Ptr<OpenGymDictSpace> m_actionDictSpace;
+  Ptr<OpenGymContainerPool> m_containerPool;
+  // env the step callbacks are bound to
+  OpenGymEnv *m_boundEnv;
 
   Callback< Ptr<OpenGymSpace> > m_actionSpaceCb;
   Callback< Ptr<OpenGymSpace> > m_observationSpaceCb;
@@ -27,10 +27,12 @@
 #include "container.h"
 #include "spaces.h"
 #include "opengym_multi_interface.h"
+#include "opengym_value.h"
 
 namespace ns3 {
 
 NS_OBJECT_ENSURE_REGISTERED (OpenGymMultiEnv);
+NS_OBJECT_ENSURE_REGISTERED (OpenGymMultiValueEnv);
 
 NS_LOG_COMPONENT_DEFINE ("OpenGymMultiEnv");
 
@@ -42,7 +44,8 @@ OpenGymMultiEnv::GetTypeId (void)
           .SetParent<Object> ()
           .SetGroupName ("OpenGym")
           .AddAttribute ("OpenGymPort", "OpenGymPort, default 5555", UintegerValue (5555),
-                         MakeUintegerAccessor (&OpenGymMultiEnv::m_openGymPort),
+                         MakeUintegerAccessor (&OpenGymMultiEnv::SetOpenGymPort,
+                                               &OpenGymMultiEnv::GetOpenGymPort),
                          MakeUintegerChecker<uint32_t> ());
   return tid;
 }
@@ -80,6 +83,20 @@ OpenGymMultiEnv::AddAgentId (uint32_t agent_id)
   m_openGymMultiInterface->AddAgent (agent_id);
 }
 
+void
+OpenGymMultiEnv::SetAgentStepInterval (uint32_t agent_id, Time interval)
+{
+  NS_LOG_FUNCTION (this << agent_id << interval);
+  m_openGymMultiInterface->SetAgentStepInterval (agent_id, interval);
+}
+
+void
+OpenGymMultiEnv::TriggerAgent (uint32_t agent_id)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  m_openGymMultiInterface->TriggerAgent (agent_id);
+}
+
 void
 OpenGymMultiEnv::SetOpenGymMultiInterface (Ptr<OpenGymMultiInterface> multiInterface)
 {
@@ -93,6 +110,161 @@ OpenGymMultiEnv::SetOpenGymMultiInterface (Ptr<OpenGymMultiInterface> multiInter
   multiInterface->SetGetDoneCb (MakeCallback (&OpenGymMultiEnv::GetDone, this));
   multiInterface->SetGetInfoCb (MakeCallback (&OpenGymMultiEnv::GetInfo, this));
   multiInterface->SetExecuteActionsCb (MakeCallback (&OpenGymMultiEnv::ExecuteActions, this));
+  multiInterface->SetGetFallbackActionCb (MakeCallback (&OpenGymMultiEnv::GetFallbackAction, this));
+  multiInterface->SetResetEpisodeCb (MakeCallback (&OpenGymMultiEnv::ResetEpisode, this));
+}
+
+bool
+OpenGymMultiEnv::GetObservationData (uint32_t agent_id, opengym::Data &obs)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  Ptr<OpenGymDataContainer> container = GetObservation (agent_id);
+  if (!container)
+    {
+      return false;
+    }
+  obs = opengym::Data::FromContainer (container);
+  return true;
+}
+
+bool
+OpenGymMultiEnv::ExecuteActionData (uint32_t agent_id, const opengym::Data &action)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  return ExecuteActions (agent_id, action.ToContainer ());
+}
+
+void
+OpenGymMultiEnv::SetValueData (bool valueData)
+{
+  NS_LOG_FUNCTION (this << valueData);
+  m_valueData = valueData;
+  if (valueData)
+    {
+      m_openGymMultiInterface->SetGetObservationDataCb (
+          MakeCallback (&OpenGymMultiEnv::GetObservationData, this));
+      m_openGymMultiInterface->SetExecuteActionDataCb (
+          MakeCallback (&OpenGymMultiEnv::ExecuteActionData, this));
+    }
+  else
+    {
+      m_openGymMultiInterface->SetGetObservationDataCb (
+          MakeNullCallback<bool, uint32_t, opengym::Data &> ());
+      m_openGymMultiInterface->SetExecuteActionDataCb (
+          MakeNullCallback<bool, uint32_t, const opengym::Data &> ());
+    }
+}
+
+bool
+OpenGymMultiEnv::GetValueData () const
+{
+  return m_valueData;
+}
+
+void
+OpenGymMultiEnv::GetObservations (const std::vector<uint32_t> &agentIds,
+                                  std::vector<opengym::Data> &obs)
+{
+  NS_LOG_FUNCTION (this);
+  for (size_t i = 0; i < agentIds.size (); i++)
+    {
+      if (!GetObservationData (agentIds[i], obs[i]))
+        {
+          obs[i] = opengym::Data ();
+        }
+    }
+}
+
+void
+OpenGymMultiEnv::GetRewards (const std::vector<uint32_t> &agentIds, std::vector<float> &rewards)
+{
+  NS_LOG_FUNCTION (this);
+  for (size_t i = 0; i < agentIds.size (); i++)
+    {
+      rewards[i] = GetReward (agentIds[i]);
+    }
+}
+
+void
+OpenGymMultiEnv::GetDones (const std::vector<uint32_t> &agentIds, std::vector<bool> &dones)
+{
+  NS_LOG_FUNCTION (this);
+  for (size_t i = 0; i < agentIds.size (); i++)
+    {
+      dones[i] = GetDone (agentIds[i]);
+    }
+}
+
+void
+OpenGymMultiEnv::GetInfos (const std::vector<uint32_t> &agentIds, std::vector<std::string> &infos)
+{
+  NS_LOG_FUNCTION (this);
+  for (size_t i = 0; i < agentIds.size (); i++)
+    {
+      infos[i] = GetInfo (agentIds[i]);
+    }
+}
+
+void
+OpenGymMultiEnv::ExecuteActionsBatch (const std::vector<uint32_t> &agentIds,
+                                      const std::vector<const opengym::Data *> &actions)
+{
+  NS_LOG_FUNCTION (this);
+  for (size_t i = 0; i < agentIds.size (); i++)
+    {
+      ExecuteActionData (agentIds[i], *actions[i]);
+    }
+}
+
+void
+OpenGymMultiEnv::SetBatchedCallbacks (bool batched)
+{
+  NS_LOG_FUNCTION (this << batched);
+  m_batchedCallbacks = batched;
+  if (batched)
+    {
+      m_openGymMultiInterface->SetGetObservationsCb (
+          MakeCallback (&OpenGymMultiEnv::GetObservations, this));
+      m_openGymMultiInterface->SetGetRewardsCb (MakeCallback (&OpenGymMultiEnv::GetRewards, this));
+      m_openGymMultiInterface->SetGetDonesCb (MakeCallback (&OpenGymMultiEnv::GetDones, this));
+      m_openGymMultiInterface->SetGetInfosCb (MakeCallback (&OpenGymMultiEnv::GetInfos, this));
+      m_openGymMultiInterface->SetExecuteActionsBatchCb (
+          MakeCallback (&OpenGymMultiEnv::ExecuteActionsBatch, this));
+    }
+  else
+    {
+      m_openGymMultiInterface->SetGetObservationsCb (
+          MakeNullCallback<void, const std::vector<uint32_t> &, std::vector<opengym::Data> &> ());
+      m_openGymMultiInterface->SetGetRewardsCb (
+          MakeNullCallback<void, const std::vector<uint32_t> &, std::vector<float> &> ());
+      m_openGymMultiInterface->SetGetDonesCb (
+          MakeNullCallback<void, const std::vector<uint32_t> &, std::vector<bool> &> ());
+      m_openGymMultiInterface->SetGetInfosCb (
+          MakeNullCallback<void, const std::vector<uint32_t> &, std::vector<std::string> &> ());
+      m_openGymMultiInterface->SetExecuteActionsBatchCb (
+          MakeNullCallback<void, const std::vector<uint32_t> &,
+                           const std::vector<const opengym::Data *> &> ());
+    }
+}
+
+bool
+OpenGymMultiEnv::GetBatchedCallbacks () const
+{
+  return m_batchedCallbacks;
+}
+
+Ptr<OpenGymDataContainer>
+OpenGymMultiEnv::GetFallbackAction (uint32_t agent_id)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  return 0;
+}
+
+bool
+OpenGymMultiEnv::ResetEpisode (void)
+{
+  NS_LOG_FUNCTION (this);
+  return false;
 }
 
 /**
@@ -116,6 +288,69 @@ OpenGymMultiEnv::Step ()
     }
 }
 
+void
+OpenGymMultiEnv::SetPipelined (bool pipelined)
+{
+  NS_LOG_FUNCTION (this << pipelined);
+  m_openGymMultiInterface->SetPipelined (pipelined);
+}
+
+bool
+OpenGymMultiEnv::GetPipelined () const
+{
+  return m_openGymMultiInterface->GetPipelined ();
+}
+
+void
+OpenGymMultiEnv::SetStepDeadline (Time deadline)
+{
+  NS_LOG_FUNCTION (this << deadline);
+  m_openGymMultiInterface->SetStepDeadline (deadline);
+}
+
+void
+OpenGymMultiEnv::SetDefaultAction (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  m_openGymMultiInterface->SetDefaultAction (agent_id, action);
+}
+
+uint64_t
+OpenGymMultiEnv::GetDeadlineMisses (uint32_t agent_id) const
+{
+  return m_openGymMultiInterface->GetDeadlineMisses (agent_id);
+}
+
+Ptr<OpenGymContainerPool>
+OpenGymMultiEnv::GetContainerPool () const
+{
+  return m_openGymMultiInterface->GetContainerPool ();
+}
+
+void
+OpenGymMultiEnv::SetOpenGymPort (uint32_t port)
+{
+  NS_LOG_FUNCTION (this << port);
+  m_openGymPort = port;
+  m_openGymMultiInterface->SetPort (port);
+}
+
+uint32_t
+OpenGymMultiEnv::GetOpenGymPort () const
+{
+  return m_openGymPort;
+}
+
+void
+OpenGymMultiEnv::ServeForks (Callback<void, uint64_t> forkCb)
+{
+  NS_LOG_FUNCTION (this);
+  m_openGymMultiInterface->SetForkCb (forkCb);
+  m_openGymMultiInterface->ServeForks ();
+  // a forked simulation got its own port
+  m_openGymPort = m_openGymMultiInterface->GetPort ();
+}
+
 void
 OpenGymMultiEnv::NotifySimulationEnd ()
 {
@@ -126,4 +361,38 @@ OpenGymMultiEnv::NotifySimulationEnd ()
     }
 }
 
+TypeId
+OpenGymMultiValueEnv::GetTypeId (void)
+{
+  static TypeId tid =
+      TypeId ("ns3::OpenGymMultiValueEnv").SetParent<OpenGymMultiEnv> ().SetGroupName ("OpenGym");
+  return tid;
+}
+
+OpenGymMultiValueEnv::OpenGymMultiValueEnv ()
+{
+  NS_LOG_FUNCTION (this);
+  SetValueData (true);
+}
+
+OpenGymMultiValueEnv::~OpenGymMultiValueEnv ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<OpenGymDataContainer>
+OpenGymMultiValueEnv::GetObservation (uint32_t agent_id)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  opengym::Data obs;
+  return GetObservationData (agent_id, obs) ? obs.ToContainer () : 0;
+}
+
+bool
+OpenGymMultiValueEnv::ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  return ExecuteActionData (agent_id, opengym::Data::FromContainer (action));
+}
+
 } // namespace ns3
\ No newline at end of file
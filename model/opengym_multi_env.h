@@ -44,12 +44,19 @@
 #define OPENGYM_MULTI_ENV_H
 
 #include "ns3/object.h"
+#include "ns3/nstime.h"
+#include <vector>
 
 namespace ns3{
 
 class OpenGymSpace;
 class OpenGymDataContainer;
 class OpenGymMultiInterface;
+class OpenGymContainerPool;
+
+namespace opengym {
+class Data;
+}
 
 class OpenGymMultiEnv : public Object
 {
@@ -62,15 +69,86 @@ public:
   // Add agent ID
   void AddAgentId(uint32_t agent_id);
 
+  /**
+   * Per-agent step scheduling: Step() only includes the agents whose
+   * interval elapsed or that were triggered since their last step. Zero
+   * (default) includes the agent in every Step(), Time::Max () only when
+   * triggered. Once an interval is set, the Python MultiEnv returns dicts
+   * keyed by agent id. Call after AddAgentId() and before the first Step().
+   * Same as OpenGymMultiInterface::SetAgentStepInterval.
+   */
+  void SetAgentStepInterval(uint32_t agent_id, Time interval);
+  // include agent_id in the next Step(), e.g. on an event that needs a decision
+  void TriggerAgent(uint32_t agent_id);
+
   ///\{ Each agent OpenGym Env 
   virtual Ptr<OpenGymSpace> GetActionSpace(uint32_t agent_id) = 0;
   virtual Ptr<OpenGymSpace> GetObservationSpace(uint32_t agent_id) = 0;
-  virtual Ptr<OpenGymDataContainer> GetObservation(uint32_t agent_id) = 0;
   virtual float GetReward(uint32_t agent_id) = 0;
   virtual bool GetDone(uint32_t agent_id) = 0;
   virtual std::string GetInfo(uint32_t agent_id) = 0;
+  ///\}
+
+  ///\{ Observation and action as containers, see OpenGymMultiValueEnv for value types
+  virtual Ptr<OpenGymDataContainer> GetObservation(uint32_t agent_id) = 0;
   virtual bool ExecuteActions(uint32_t agent_id, Ptr<OpenGymDataContainer> action) = 0;
   ///\}
+  /**
+   * Observation and action as value types (opengym_value.h), used once
+   * SetValueData (true) is set. The defaults convert the containers.
+   */
+  ///\{
+  // \return false if the agent has no observation
+  virtual bool GetObservationData(uint32_t agent_id, opengym::Data &obs);
+  virtual bool ExecuteActionData(uint32_t agent_id, const opengym::Data &action);
+  ///\}
+  /**
+   * Exchange observations and actions through GetObservationData and
+   * ExecuteActionData, the interface then reuses one opengym::Data per
+   * agent. Off by default.
+   */
+  void SetValueData(bool valueData);
+  bool GetValueData() const;
+
+  /**
+   * Batched state and actions: one call per step for all due agents, so
+   * state the agents share (node scans, queue lookups) is computed once.
+   * Entry i of every vector belongs to agentIds[i], the output vectors
+   * already have agentIds.size () entries. Observations are gathered
+   * before rewards, dones and infos. Set an observation to opengym::Data ()
+   * if the agent has none. The defaults call the per-agent functions.
+   */
+  ///\{
+  virtual void GetObservations(const std::vector<uint32_t> &agentIds,
+                               std::vector<opengym::Data> &obs);
+  virtual void GetRewards(const std::vector<uint32_t> &agentIds, std::vector<float> &rewards);
+  virtual void GetDones(const std::vector<uint32_t> &agentIds, std::vector<bool> &dones);
+  virtual void GetInfos(const std::vector<uint32_t> &agentIds, std::vector<std::string> &infos);
+  virtual void ExecuteActionsBatch(const std::vector<uint32_t> &agentIds,
+                                   const std::vector<const opengym::Data *> &actions);
+  ///\}
+  /**
+   * Make the interface call the batched functions above instead of the
+   * per-agent ones. Off by default.
+   */
+  void SetBatchedCallbacks(bool batched);
+  bool GetBatchedCallbacks() const;
+
+  /**
+   * Action of an agent that missed the step deadline, used with
+   * FallbackAction "callback". The default executes no action.
+   */
+  virtual Ptr<OpenGymDataContainer> GetFallbackAction(uint32_t agent_id);
+
+  /**
+   * Soft reset: end the episode and start the next one in this process
+   * when the agent resets (lockstep only). Reset counters, applications
+   * and reward accumulators here; the topology, routing tables and the
+   * current simulation time stay. The first state of the new episode is
+   * gathered right after the call. The default returns false and ns3gym
+   * restarts the simulation instead.
+   */
+  virtual bool ResetEpisode();
   
   /**
    * \brief Notify Current State, similar gym step.
@@ -88,6 +166,50 @@ public:
   void Step();
   void NotifySimulationEnd();
 
+  /**
+   * Pipelined mode: Step() sends the current state and executes the actions
+   * the agent computed for the previous state without waiting for new ones,
+   * so simulation and inference overlap. Actions lag one step behind.
+   * Same as attribute OpenGymMultiInterface::Pipelined, call before the
+   * first Step().
+   */
+  void SetPipelined(bool pipelined);
+  bool GetPipelined() const;
+
+  /**
+   * Wait at most \p deadline of wall-clock time for the actions of a step,
+   * agents without actions get their fallback action (attribute
+   * OpenGymMultiInterface::FallbackAction, the last action by default).
+   * Call before the first Step().
+   */
+  void SetStepDeadline(Time deadline);
+  // fallback action of agent_id with FallbackAction "default"
+  void SetDefaultAction(uint32_t agent_id, Ptr<OpenGymDataContainer> action);
+  // number of steps agent_id missed the deadline
+  uint64_t GetDeadlineMisses(uint32_t agent_id) const;
+  /**
+   * Pool that recycles the containers of OpenGymDataContainer::Acquire,
+   * e.g. in GetObservation, see OpenGymMultiInterface::GetContainerPool.
+   */
+  Ptr<OpenGymContainerPool> GetContainerPool() const;
+
+  /**
+   * Port of the Python agent, usually the --openGymPort argument passed by
+   * ns3gym. Same as attribute OpenGymPort, call before the first Step().
+   */
+  void SetOpenGymPort(uint32_t port);
+  uint32_t GetOpenGymPort() const;
+
+  /**
+   * Warm start: with --OpenGymMultiInterface::ForkServerPort (set by
+   * ns3gym's ForkServer) the process parks here as a template and every
+   * reset of the agent forks a simulation from it, see
+   * OpenGymMultiInterface::ServeForks. Call after building the topology,
+   * right before Simulator::Run(). \p forkCb runs in each forked
+   * simulation with its RNG run, e.g. to re-assign random streams.
+   */
+  void ServeForks(Callback<void, uint64_t> forkCb = MakeNullCallback<void, uint64_t> ());
+
 protected:
   // Inherited
   virtual void DoInitialize(void);
@@ -96,6 +218,29 @@ protected:
   uint32_t m_openGymPort = 5555;
 private: 
   void SetOpenGymMultiInterface(Ptr<OpenGymMultiInterface> multiInterface);
+
+  bool m_valueData = false;
+  bool m_batchedCallbacks = false;
+};
+
+/**
+ * Multi-agent env that observes and acts through the value types only,
+ * they skip the Object overhead of the containers. Value data is on.
+ */
+class OpenGymMultiValueEnv : public OpenGymMultiEnv
+{
+public:
+  OpenGymMultiValueEnv();
+  virtual ~OpenGymMultiValueEnv();
+
+  static TypeId GetTypeId();
+
+  virtual bool GetObservationData(uint32_t agent_id, opengym::Data &obs) = 0;
+  virtual bool ExecuteActionData(uint32_t agent_id, const opengym::Data &action) = 0;
+
+  // convert the value types
+  virtual Ptr<OpenGymDataContainer> GetObservation(uint32_t agent_id);
+  virtual bool ExecuteActions(uint32_t agent_id, Ptr<OpenGymDataContainer> action);
 };
 
 } // namespace ns3
@@ -30,11 +30,25 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
 #include "ns3/log.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/string.h"
 #include "ns3/config.h"
 #include "ns3/simulator.h"
+#include "ns3/enum.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include "opengym_multi_interface.h"
 #include "opengym_multi_env.h"
+#include "opengym_shm_channel.h"
+#include "opengym_fork_server.h"
 #include "container.h"
 #include "spaces.h"
 #include "messages.pb.h"
@@ -45,13 +59,235 @@ NS_LOG_COMPONENT_DEFINE ("OpenGymMultiInterface");
 
 NS_OBJECT_ENSURE_REGISTERED (OpenGymMultiInterface);
 
+namespace {
+
+/**
+ * Parse a MultiAgentActMsg into the message of the previous step.
+ * ParseFromArray would Clear() it first, which frees the actData
+ * submessages. Here every AgentActMsg is reset field by field and the new
+ * one is merged into it, so the submessages and string buffers are reused.
+ */
+bool
+MergeActMsg (const uint8_t *data, uint32_t size, ns3opengym::MultiAgentActMsg &msg)
+{
+  using google::protobuf::internal::WireFormatLite;
+  google::protobuf::io::CodedInputStream input (data, size);
+  int count = 0;
+  msg.set_stopsimreq (false);
+  msg.set_stepidx (0);
+  msg.clear_branch ();
+  msg.set_resetreq (false);
+  msg.clear_policy ();
+  while (uint32_t tag = input.ReadTag ())
+    {
+      int field = WireFormatLite::GetTagFieldNumber (tag);
+      if (field == ns3opengym::MultiAgentActMsg::kAgentActMsgFieldNumber &&
+          WireFormatLite::GetTagWireType (tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+        {
+          uint32_t length;
+          if (!input.ReadVarint32 (&length))
+            {
+              return false;
+            }
+          ns3opengym::AgentActMsg *agentActMsg = count < msg.agentactmsg_size ()
+                                                     ? msg.mutable_agentactmsg (count)
+                                                     : msg.add_agentactmsg ();
+          count++;
+          agentActMsg->set_agentid (0);
+          OpenGymDataContainer::ResetDataContainerPbMsg (agentActMsg->mutable_actdata ());
+          google::protobuf::io::CodedInputStream::Limit limit = input.PushLimit (length);
+          if (!agentActMsg->MergeFromCodedStream (&input) || !input.ConsumedEntireMessage ())
+            {
+              return false;
+            }
+          input.PopLimit (limit);
+        }
+      else if (field == ns3opengym::MultiAgentActMsg::kStopSimReqFieldNumber &&
+               WireFormatLite::GetTagWireType (tag) == WireFormatLite::WIRETYPE_VARINT)
+        {
+          uint64_t value;
+          if (!input.ReadVarint64 (&value))
+            {
+              return false;
+            }
+          msg.set_stopsimreq (value != 0);
+        }
+      else if (field == ns3opengym::MultiAgentActMsg::kStepIdxFieldNumber &&
+               WireFormatLite::GetTagWireType (tag) == WireFormatLite::WIRETYPE_VARINT)
+        {
+          uint64_t value;
+          if (!input.ReadVarint64 (&value))
+            {
+              return false;
+            }
+          msg.set_stepidx (value);
+        }
+      else if (field == ns3opengym::MultiAgentActMsg::kResetReqFieldNumber &&
+               WireFormatLite::GetTagWireType (tag) == WireFormatLite::WIRETYPE_VARINT)
+        {
+          uint64_t value;
+          if (!input.ReadVarint64 (&value))
+            {
+              return false;
+            }
+          msg.set_resetreq (value != 0);
+        }
+      else if ((field == ns3opengym::MultiAgentActMsg::kBranchFieldNumber ||
+                field == ns3opengym::MultiAgentActMsg::kPolicyFieldNumber) &&
+               WireFormatLite::GetTagWireType (tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+        {
+          uint32_t length;
+          if (!input.ReadVarint32 (&length))
+            {
+              return false;
+            }
+          google::protobuf::MessageLite *request =
+              field == ns3opengym::MultiAgentActMsg::kBranchFieldNumber
+                  ? static_cast<google::protobuf::MessageLite *> (msg.mutable_branch ())
+                  : msg.mutable_policy ();
+          google::protobuf::io::CodedInputStream::Limit limit = input.PushLimit (length);
+          if (!request->MergeFromCodedStream (&input) || !input.ConsumedEntireMessage ())
+            {
+              return false;
+            }
+          input.PopLimit (limit);
+        }
+      else if (!WireFormatLite::SkipField (&input, tag))
+        {
+          return false;
+        }
+    }
+  if (count < msg.agentactmsg_size ())
+    {
+      msg.mutable_agentactmsg ()->DeleteSubrange (count, msg.agentactmsg_size () - count);
+    }
+  return input.ConsumedEntireMessage ();
+}
+
+/**
+ * Add \p space to the interned spaces of \p msg unless an equal space is
+ * there already.
+ * \return id of the space, its index in msg.spaces () + 1
+ */
+uint32_t
+InternSpace (Ptr<OpenGymSpace> space, ns3opengym::MultiAgentInitMsg &msg,
+             std::map<Ptr<OpenGymSpace>, uint32_t> &spaceIds,
+             std::map<uint64_t, uint32_t> &fingerprintIds)
+{
+  // agents usually share one space object, skip serializing it again
+  std::map<Ptr<OpenGymSpace>, uint32_t>::const_iterator it = spaceIds.find (space);
+  if (it != spaceIds.end ())
+    {
+      return it->second;
+    }
+
+  ns3opengym::SpaceDescription spaceDesc = space->GetSpaceDescription ();
+  uint64_t fingerprint = OpenGymSpace::GetFingerprint (spaceDesc);
+  uint32_t id;
+  std::map<uint64_t, uint32_t>::const_iterator fit = fingerprintIds.find (fingerprint);
+  if (fit != fingerprintIds.end ())
+    {
+      id = fit->second;
+    }
+  else
+    {
+      ns3opengym::InternedSpace *internedSpace = msg.add_spaces ();
+      internedSpace->set_fingerprint (fingerprint);
+      internedSpace->mutable_space ()->Swap (&spaceDesc);
+      id = msg.spaces_size ();
+      fingerprintIds[fingerprint] = id;
+    }
+  spaceIds[space] = id;
+  return id;
+}
+
+// wait until a message can be received, timeoutMs -1 blocks
+bool
+WaitReadable (zmq::socket_t &socket, int64_t timeoutMs)
+{
+  if (timeoutMs < 0)
+    {
+      return true;
+    }
+  zmq_pollitem_t item = {(void *) socket, 0, ZMQ_POLLIN, 0};
+  return zmq_poll (&item, 1, timeoutMs) > 0;
+}
+
+} // namespace
+
 TypeId
 OpenGymMultiInterface::GetTypeId (void)
 {
   static TypeId tid = TypeId ("OpenGymMultiInterface")
                           .SetParent<Object> ()
                           .SetGroupName ("OpenGym")
-                          .AddConstructor<OpenGymMultiInterface> ();
+                          .AddConstructor<OpenGymMultiInterface> ()
+                          .AddAttribute ("Transport",
+                                         "Transport to the Python agent: tcp (ZMQ REQ/REP) or "
+                                         "shm (shared memory rings, same host only)",
+                                         EnumValue (TRANSPORT_TCP),
+                                         MakeEnumAccessor (&OpenGymMultiInterface::m_transport),
+                                         MakeEnumChecker (TRANSPORT_TCP, "tcp", TRANSPORT_SHM, "shm"))
+                          .AddAttribute ("Pipelined",
+                                         "Overlap simulation and agent inference: the actions for "
+                                         "step t are executed at step t+1 (action lag 1)",
+                                         BooleanValue (false),
+                                         MakeBooleanAccessor (&OpenGymMultiInterface::SetPipelined,
+                                                              &OpenGymMultiInterface::GetPipelined),
+                                         MakeBooleanChecker ())
+                          .AddAttribute ("EnvIndex",
+                                         "Index of this simulation reported to the agent, used when "
+                                         "one agent steps several simulations",
+                                         UintegerValue (0),
+                                         MakeUintegerAccessor (&OpenGymMultiInterface::m_envIndex),
+                                         MakeUintegerChecker<uint32_t> ())
+                          .AddAttribute ("Workers",
+                                         "Number of Python workers serving the agents, connected "
+                                         "to a ROUTER socket on the port, 0 for a single agent",
+                                         UintegerValue (0),
+                                         MakeUintegerAccessor (&OpenGymMultiInterface::SetWorkers,
+                                                               &OpenGymMultiInterface::GetWorkers),
+                                         MakeUintegerChecker<uint32_t> ())
+                          .AddAttribute ("DeltaObservations",
+                                         "Send Box observations as the elements changed since the "
+                                         "previous step, needs raw tensor version 2 on the agent",
+                                         BooleanValue (false),
+                                         MakeBooleanAccessor (&OpenGymMultiInterface::m_deltaObs),
+                                         MakeBooleanChecker ())
+                          .AddAttribute ("KeyframeInterval",
+                                         "Observations of an agent between its full Box observations "
+                                         "in delta mode, 0 sends them only when needed",
+                                         UintegerValue (100),
+                                         MakeUintegerAccessor (&OpenGymMultiInterface::m_keyframeInterval),
+                                         MakeUintegerChecker<uint32_t> ())
+                          .AddAttribute ("BatchedStates",
+                                         "Send the states of agents with one common Box observation "
+                                         "space as one batch, needs raw tensor version 4 on the agent",
+                                         BooleanValue (true),
+                                         MakeBooleanAccessor (&OpenGymMultiInterface::m_batchedStates),
+                                         MakeBooleanChecker ())
+                          .AddAttribute ("StepDeadline",
+                                         "Wall-clock time to wait for the actions of a step, "
+                                         "0 waits forever",
+                                         TimeValue (Seconds (0)),
+                                         MakeTimeAccessor (&OpenGymMultiInterface::SetStepDeadline,
+                                                           &OpenGymMultiInterface::GetStepDeadline),
+                                         MakeTimeChecker ())
+                          .AddAttribute ("FallbackAction",
+                                         "Action of an agent that missed the StepDeadline: repeat "
+                                         "its last action, its default action, the action of the "
+                                         "fallback callback or none",
+                                         EnumValue (FALLBACK_REPEAT),
+                                         MakeEnumAccessor (&OpenGymMultiInterface::m_fallbackAction),
+                                         MakeEnumChecker (FALLBACK_REPEAT, "repeat", FALLBACK_DEFAULT,
+                                                          "default", FALLBACK_CALLBACK, "callback",
+                                                          FALLBACK_NONE, "none"))
+                          .AddAttribute ("ForkServerPort",
+                                         "Local tcp port of the agent's fork server control "
+                                         "connection, see ServeForks. 0 runs a single simulation",
+                                         UintegerValue (0),
+                                         MakeUintegerAccessor (&OpenGymMultiInterface::m_forkServerPort),
+                                         MakeUintegerChecker<uint16_t> ());
   return tid;
 }
 
@@ -86,11 +322,35 @@ OpenGymMultiInterface::Delete (void)
 
 OpenGymMultiInterface::OpenGymMultiInterface (uint32_t port)
     : m_port (port),
+      m_envIndex (0),
+      m_transport (TRANSPORT_TCP),
       m_zmq_context (1),
-      m_zmq_socket (m_zmq_context, ZMQ_REQ),
+      m_dealer (false),
+      m_numWorkers (0),
+      m_forkServerPort (0),
       m_simEnd (false),
       m_stopEnvRequested (false),
-      m_initSimMsgSent (false)
+      m_initSimMsgSent (false),
+      m_pipelined (false),
+      m_rawTensorVersion (0),
+      m_actionPending (false),
+      m_deltaObs (false),
+      m_deltaActive (false),
+      m_keyframeInterval (100),
+      m_batchedStates (true),
+      m_batchedActive (false),
+      m_stepIdx (0),
+      m_episode (0),
+      m_stepDeadline (Seconds (0)),
+      m_fallbackAction (FALLBACK_REPEAT),
+      m_actionRx (false),
+      m_replyStepIdx (0),
+      m_replyPending (false),
+      m_containerPool (Create<OpenGymContainerPool> ()),
+      m_boundEnv (0),
+      m_agentSubsets (false),
+      m_branchRunner (this),
+      m_policyRollout (this)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -104,6 +364,10 @@ void
 OpenGymMultiInterface::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  if (OpenGymContainerPool::GetCurrent () == PeekPointer (m_containerPool))
+    {
+      OpenGymContainerPool::SetCurrent (0);
+    }
 }
 
 void
@@ -136,21 +400,21 @@ OpenGymMultiInterface::SetGetObservationCb (Callback<Ptr<OpenGymDataContainer>,
 void
 OpenGymMultiInterface::SetGetRewardCb (Callback<float, uint32_t> cb)
 {
-  NS_LOG_UNCOND (this);
+  NS_LOG_FUNCTION (this);
   m_rewardCb = cb;
 }
 
 void
 OpenGymMultiInterface::SetGetDoneCb (Callback<bool, uint32_t> cb)
 {
-  NS_LOG_UNCOND (this);
+  NS_LOG_FUNCTION (this);
   m_doneCb = cb;
 }
 
 void
 OpenGymMultiInterface::SetGetInfoCb (Callback<std::string, uint32_t> cb)
 {
-  NS_LOG_UNCOND (this);
+  NS_LOG_FUNCTION (this);
   m_infoCb = cb;
 }
 
@@ -161,6 +425,74 @@ OpenGymMultiInterface::SetExecuteActionsCb (Callback<bool, uint32_t, Ptr<OpenGym
   m_actionCb = cb;
 }
 
+void
+OpenGymMultiInterface::SetGetFallbackActionCb (Callback<Ptr<OpenGymDataContainer>, uint32_t> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_fallbackActionCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetResetEpisodeCb (Callback<bool> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_resetEpisodeCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetGetObservationDataCb (Callback<bool, uint32_t, opengym::Data &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_obsDataCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetExecuteActionDataCb (Callback<bool, uint32_t, const opengym::Data &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_actionDataCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetGetObservationsCb (
+    Callback<void, const std::vector<uint32_t> &, std::vector<opengym::Data> &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_obsBatchCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetGetRewardsCb (
+    Callback<void, const std::vector<uint32_t> &, std::vector<float> &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_rewardBatchCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetGetDonesCb (
+    Callback<void, const std::vector<uint32_t> &, std::vector<bool> &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_doneBatchCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetGetInfosCb (
+    Callback<void, const std::vector<uint32_t> &, std::vector<std::string> &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_infoBatchCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetExecuteActionsBatchCb (
+    Callback<void, const std::vector<uint32_t> &, const std::vector<const opengym::Data *> &> cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_actionBatchCb = cb;
+}
+
 void
 OpenGymMultiInterface::Init ()
 {
@@ -181,58 +513,110 @@ OpenGymMultiInterface::Init ()
     }
   m_initSimMsgSent = true;
 
-  std::string connectAddr = "tcp://localhost:" + std::to_string (m_port);
-  zmq_connect ((void *) m_zmq_socket, connectAddr.c_str ());
-
-  NS_LOG_UNCOND ("\nAgent vector size: " << m_agentIdVec.size ());
-
-  ns3opengym::MultiAgentInitMsg multiAgentInitMsg;
-  multiAgentInitMsg.set_simprocessid (::getpid ());
-  multiAgentInitMsg.set_wafshellprocessid (::getppid ());
-
-  for (std::vector<uint32_t>::const_iterator i = m_agentIdVec.begin (); i != m_agentIdVec.end ();
-       i++)
+  std::string connectAddr;
+  if (m_numWorkers > 0)
     {
-      uint32_t agent_id = *i;
-      Ptr<OpenGymSpace> obsSpace = GetObservationSpace (agent_id);
-      Ptr<OpenGymSpace> actionSpace = GetActionSpace (agent_id);
-
-      ns3opengym::AgentInitMsg *agentInitMsg;
-      agentInitMsg = multiAgentInitMsg.add_agentinitmsg ();
-      // agent ID
-      agentInitMsg->set_agentid (agent_id);
-      if (obsSpace)
+      if (m_transport != TRANSPORT_TCP)
         {
-          ns3opengym::SpaceDescription spaceDecs;
-          spaceDecs = obsSpace->GetSpaceDescription ();
-          agentInitMsg->mutable_obsspace ()->CopyFrom (spaceDecs);
+          NS_FATAL_ERROR ("Workers need the tcp transport");
         }
-      if (actionSpace)
+      connectAddr = "tcp://*:" + std::to_string (m_port);
+      m_zmqRouter = zmq::socket_t (m_zmq_context, ZMQ_ROUTER);
+      zmq_bind ((void *) m_zmqRouter, connectAddr.c_str ());
+    }
+  else if (m_transport == TRANSPORT_SHM)
+    {
+      connectAddr = "shm://" + OpenGymShmChannel::GetSegmentName (m_port);
+      m_shmChannel = Create<OpenGymShmChannel> ();
+    }
+  else
+    {
+      connectAddr = "tcp://localhost:" + std::to_string (m_port);
+      // a REQ socket cannot send the next state before the reply arrived
+      m_dealer = m_stepDeadline.IsStrictlyPositive ();
+      if (m_dealer)
+        {
+          m_zmqDealer = zmq::socket_t (m_zmq_context, ZMQ_DEALER);
+        }
+      else
         {
-          ns3opengym::SpaceDescription spaceDecs;
-          spaceDecs = actionSpace->GetSpaceDescription ();
-          agentInitMsg->mutable_actspace ()->CopyFrom (spaceDecs);
+          m_zmq_socket = zmq::socket_t (m_zmq_context, ZMQ_REQ);
         }
+      zmq_connect (m_dealer ? (void *) m_zmqDealer : (void *) m_zmq_socket, connectAddr.c_str ());
     }
+
+  NS_LOG_UNCOND ("\nEnv index: " << m_envIndex);
+  NS_LOG_UNCOND ("Agent vector size: " << m_agentIdVec.size ());
+
+  m_agentStateMsgs.resize (m_agentIdVec.size ());
+  m_actionContainers.resize (m_agentIdVec.size ());
+  m_obsData.resize (m_agentIdVec.size ());
+  m_actionDictSpaces.resize (m_agentIdVec.size ());
+  m_actionData.resize (m_agentIdVec.size ());
+  m_dueAgents.reserve (m_agentIdVec.size ());
+  m_pendingAgents.reserve (m_agentIdVec.size ());
+  m_missedAgents.reserve (m_agentIdVec.size ());
   NS_LOG_UNCOND ("\n=============================================================================");
   NS_LOG_UNCOND ("\nSimulation process id: " << ::getpid ()
                                              << " (parent (waf shell) id: " << ::getppid () << ")");
-  NS_LOG_UNCOND ("Waiting for Python process to connect on port: " << connectAddr);
+  if (m_numWorkers > 0)
+    {
+      NS_LOG_UNCOND ("Waiting for " << m_numWorkers << " Python workers on port: " << connectAddr);
+    }
+  else
+    {
+      NS_LOG_UNCOND ("Waiting for Python process to connect on port: " << connectAddr);
+    }
   NS_LOG_UNCOND ("Please start proper Python AI Agent ...\n");
 
-  // send init msg to python
-  zmq::message_t request (multiAgentInitMsg.ByteSize ());
-  multiAgentInitMsg.SerializeToArray (request.data (), multiAgentInitMsg.ByteSize ());
-  m_zmq_socket.send (request);
+  if (m_shmChannel && !m_shmChannel->Open (OpenGymShmChannel::GetSegmentName (m_port)))
+    {
+      NS_FATAL_ERROR ("Cannot attach to shared memory segment " << connectAddr);
+    }
 
-  // receive init ack msg from python
   ns3opengym::SimInitAck simInitAck;
-  zmq::message_t reply;
-  m_zmq_socket.recv (&reply);
-  simInitAck.ParseFromArray (reply.data (), reply.size ());
+  bool homogeneous = false;
+  if (m_numWorkers > 0)
+    {
+      InitWorkers (simInitAck);
+    }
+  else
+    {
+      std::vector<uint32_t> agents;
+      for (uint32_t idx = 0; idx < m_agentIdVec.size (); idx++)
+        {
+          agents.push_back (idx);
+        }
+      ns3opengym::MultiAgentInitMsg multiAgentInitMsg;
+      FillInitMsg (multiAgentInitMsg, agents);
+      // one interned Box observation space for all agents
+      uint32_t obsSpaceId = multiAgentInitMsg.agentinitmsg (0).obsspaceid ();
+      homogeneous = obsSpaceId &&
+                    multiAgentInitMsg.spaces (obsSpaceId - 1).space ().type () == ns3opengym::Box;
+      for (int i = 1; homogeneous && i < multiAgentInitMsg.agentinitmsg_size (); i++)
+        {
+          homogeneous = multiAgentInitMsg.agentinitmsg (i).obsspaceid () == obsSpaceId;
+        }
+
+      // send init msg to python
+      SendMsg (multiAgentInitMsg);
+
+      // receive init ack msg from python
+      RecvMsg (simInitAck);
+    }
 
   bool done = simInitAck.done ();
   NS_LOG_DEBUG ("Sim Init Ack: " << done);
+  // old agents do not set the version and keep the BoxDataContainer format
+  m_rawTensorVersion = std::min (simInitAck.rawtensorversion (), OpenGymDataContainer::GetRawTensorVersion ());
+  NS_LOG_DEBUG ("Raw tensor version: " << m_rawTensorVersion);
+  m_deltaActive = m_deltaObs && m_rawTensorVersion >= 2;
+  if (m_deltaObs && !m_deltaActive)
+    {
+      NS_LOG_WARN ("Agent does not support delta observations, sending full tensors");
+    }
+  m_batchedActive = m_batchedStates && homogeneous && m_rawTensorVersion >= 4 && !m_deltaActive;
+  NS_LOG_DEBUG ("Batched states: " << m_batchedActive);
   bool stopSim = simInitAck.stopsimreq ();
   if (stopSim)
     {
@@ -244,6 +628,158 @@ OpenGymMultiInterface::Init ()
     }
 }
 
+void
+OpenGymMultiInterface::FillInitMsg (ns3opengym::MultiAgentInitMsg &multiAgentInitMsg,
+                                    const std::vector<uint32_t> &agents)
+{
+  NS_LOG_FUNCTION (this);
+  multiAgentInitMsg.set_simprocessid (::getpid ());
+  multiAgentInitMsg.set_wafshellprocessid (::getppid ());
+  multiAgentInitMsg.set_actionlag (GetActionLag ());
+  multiAgentInitMsg.set_envindex (m_envIndex);
+  multiAgentInitMsg.set_rawtensorversion (OpenGymDataContainer::GetRawTensorVersion ());
+  multiAgentInitMsg.set_agentsubsets (m_agentSubsets);
+  multiAgentInitMsg.set_branching (IsExclusiveLockstep ());
+  multiAgentInitMsg.set_softreset (IsExclusiveLockstep ());
+  multiAgentInitMsg.set_policyoffload (IsExclusiveLockstep () && !m_agentSubsets);
+
+  // every distinct space is sent once, agents refer to it by id
+  std::map<Ptr<OpenGymSpace>, uint32_t> spaceIds;
+  std::map<uint64_t, uint32_t> fingerprintIds;
+  for (std::vector<uint32_t>::const_iterator i = agents.begin (); i != agents.end (); i++)
+    {
+      uint32_t agent_id = m_agentIdVec[*i];
+      Ptr<OpenGymSpace> obsSpace = GetObservationSpace (agent_id);
+      Ptr<OpenGymSpace> actionSpace = GetActionSpace (agent_id);
+      m_actionDictSpaces[*i] = DynamicCast<OpenGymDictSpace> (actionSpace);
+
+      ns3opengym::AgentInitMsg *agentInitMsg;
+      agentInitMsg = multiAgentInitMsg.add_agentinitmsg ();
+      // agent ID
+      agentInitMsg->set_agentid (agent_id);
+      if (obsSpace)
+        {
+          agentInitMsg->set_obsspaceid (
+              InternSpace (obsSpace, multiAgentInitMsg, spaceIds, fingerprintIds));
+        }
+      if (actionSpace)
+        {
+          agentInitMsg->set_actspaceid (
+              InternSpace (actionSpace, multiAgentInitMsg, spaceIds, fingerprintIds));
+        }
+    }
+  NS_LOG_DEBUG ("Distinct spaces: " << multiAgentInitMsg.spaces_size ());
+}
+
+void
+OpenGymMultiInterface::InitWorkers (ns3opengym::SimInitAck &simInitAck)
+{
+  NS_LOG_FUNCTION (this);
+  // hello of every worker, in any order, kept sorted by worker id: the
+  // execution order and the share of unclaimed agents follow the id
+  std::map<uint32_t, ns3opengym::WorkerHelloMsg> hellos;
+  std::map<uint32_t, std::string> identities;
+  while (hellos.size () < m_numWorkers)
+    {
+      m_zmqRouter.recv (&m_zmqIdentity);
+      m_zmqRouter.recv (&m_zmqDelimiter);
+      m_zmqRouter.recv (&m_zmqReply);
+      ns3opengym::WorkerHelloMsg hello;
+      if (!hello.ParseFromArray (m_zmqReply.data (), m_zmqReply.size ()))
+        {
+          NS_LOG_WARN ("Ignoring invalid worker hello");
+          continue;
+        }
+      if (hellos.find (hello.workerid ()) != hellos.end ())
+        {
+          NS_FATAL_ERROR ("Two workers with id " << hello.workerid ());
+        }
+      NS_LOG_UNCOND ("Worker " << hello.workerid () << " connected, agents: " << hello.agentids_size ());
+      hellos[hello.workerid ()] = hello;
+      identities[hello.workerid ()].assign (static_cast<const char *> (m_zmqIdentity.data ()),
+                                            m_zmqIdentity.size ());
+    }
+  m_workers.resize (hellos.size ());
+  std::vector<Worker>::iterator worker = m_workers.begin ();
+  for (std::map<uint32_t, std::string>::const_iterator it = identities.begin ();
+       it != identities.end (); it++, worker++)
+    {
+      worker->workerId = it->first;
+      worker->identity = it->second;
+      worker->stepIdx = 0;
+      worker->replyPending = false;
+      worker->actionRx = false;
+    }
+
+  // agents claimed by a worker first, the rest round robin over the
+  // workers that did not claim any
+  const uint32_t unassigned = m_workers.size ();
+  m_agentWorker.assign (m_agentIdVec.size (), unassigned);
+  std::vector<uint32_t> sharing;
+  for (uint32_t w = 0; w < m_workers.size (); w++)
+    {
+      const ns3opengym::WorkerHelloMsg &hello = hellos[m_workers[w].workerId];
+      if (hello.agentids_size () == 0)
+        {
+          sharing.push_back (w);
+        }
+      for (int i = 0; i < hello.agentids_size (); i++)
+        {
+          std::map<uint32_t, uint32_t>::const_iterator it = m_agentIndex.find (hello.agentids (i));
+          if (it == m_agentIndex.end ())
+            {
+              NS_LOG_WARN ("Worker " << hello.workerid () << " claims unknown agent " << hello.agentids (i));
+            }
+          else if (m_agentWorker[it->second] != unassigned)
+            {
+              NS_LOG_WARN ("Agent " << hello.agentids (i) << " is claimed by two workers");
+            }
+          else
+            {
+              m_agentWorker[it->second] = w;
+            }
+        }
+    }
+  uint32_t next = 0;
+  for (uint32_t idx = 0; idx < m_agentIdVec.size (); idx++)
+    {
+      if (m_agentWorker[idx] == unassigned)
+        {
+          if (sharing.empty ())
+            {
+              NS_FATAL_ERROR ("Agent " << m_agentIdVec[idx] << " is not served by any worker");
+            }
+          m_agentWorker[idx] = sharing[next++ % sharing.size ()];
+        }
+      m_workers[m_agentWorker[idx]].agents.push_back (idx);
+    }
+
+  for (std::vector<Worker>::iterator w = m_workers.begin (); w != m_workers.end (); w++)
+    {
+      ns3opengym::MultiAgentInitMsg multiAgentInitMsg;
+      FillInitMsg (multiAgentInitMsg, w->agents);
+      multiAgentInitMsg.set_workerid (w->workerId);
+      multiAgentInitMsg.set_numworkers (m_workers.size ());
+      SendToWorker (*w, multiAgentInitMsg);
+    }
+
+  // all acks, the raw tensor version is the one every worker supports
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (OpenGymDataContainer::GetRawTensorVersion ());
+  for (uint32_t received = 0; received < m_workers.size ();)
+    {
+      uint32_t workerIdx;
+      uint32_t size;
+      const uint8_t *data = ReceiveFromWorker (workerIdx, size);
+      ns3opengym::SimInitAck workerAck;
+      workerAck.ParseFromArray (data, size);
+      simInitAck.set_rawtensorversion (
+          std::min (simInitAck.rawtensorversion (), workerAck.rawtensorversion ()));
+      simInitAck.set_stopsimreq (simInitAck.stopsimreq () || workerAck.stopsimreq ());
+      received++;
+    }
+}
+
 /**
  * Notify network environment current state, including each agent
  */
@@ -262,59 +798,110 @@ OpenGymMultiInterface::NotifyCurrentState ()
       return;
     }
 
-  // collect current env state
-  ns3opengym::MultiAgentStateMsg multiAgentStateMsg;
+  // containers of the previous step were serialized or executed by now
+  OpenGymContainerPool::SetCurrent (PeekPointer (m_containerPool));
+  m_containerPool->ReleaseStep ();
 
-  for (std::vector<uint32_t>::const_iterator i = m_agentIdVec.begin (); i != m_agentIdVec.end ();
-       i++)
+  if (m_branchRunner.IsActive ())
+    {
+      // a forked copy runs its plan without the agent
+      m_branchRunner.Step ();
+      return;
+    }
+  if (m_policyRollout.IsActive ())
     {
-      uint32_t agent_id = *i;
-      Ptr<OpenGymDataContainer> obsDataContainer = GetObservation (agent_id);
-      float reward = GetReward (agent_id);
-      bool done = GetDone (agent_id);
-      std::string info = GetInfo (agent_id);
+      // the policy of the agent acts until the rollout is due
+      m_policyRollout.Step ();
+      return;
+    }
 
-      ns3opengym::AgentStateMsg *agentStateMsg;
-      agentStateMsg = multiAgentStateMsg.add_agentstatemsg ();
-      // agent ID
-      agentStateMsg->set_agentid (agent_id);
-      // observation
-      ns3opengym::DataContainer obsDataContainerPbMsg;
-      if (obsDataContainer)
+  UpdateDueAgents ();
+  if (m_dueAgents.empty ())
+    {
+      // nothing to send, pending actions are collected with the next state
+      return;
+    }
+
+  // pipelined mode: first collect the actions computed for the previous state
+  bool actionRx = false;
+  if (m_actionPending)
+    {
+      ReceiveActions ();
+      m_actionPending = false;
+      actionRx = true;
+      if (StopRequested ())
         {
-          obsDataContainerPbMsg = obsDataContainer->GetDataContainerPbMsg ();
-          agentStateMsg->mutable_obsdata ()->CopyFrom (obsDataContainerPbMsg);
+          NS_LOG_DEBUG ("---Stop requested");
+          m_stopEnvRequested = true;
+          Simulator::Stop ();
+          Simulator::Destroy ();
+          std::exit (0);
         }
-      // reward
-      agentStateMsg->set_reward (reward);
-      // done
-      agentStateMsg->set_done (false);
-      if (done)
+    }
+
+  // collect current env state of the due agents and send it to python
+  SendStates ();
+
+  if (m_pipelined && !m_simEnd)
+    {
+      // run the next interval with the previous actions, the reply to this
+      // state is received in the next call
+      m_actionPending = true;
+      if (actionRx)
         {
-          agentStateMsg->set_done (true);
+          ExecuteReceivedActions ();
         }
-      // info
-      agentStateMsg->set_info (info);
+      return;
     }
 
-  // send env state msg to python
-  zmq::message_t request (multiAgentStateMsg.ByteSize ());
-  multiAgentStateMsg.SerializeToArray (request.data (), multiAgentStateMsg.ByteSize ());
-  m_zmq_socket.send (request);
-
   // receive multi-agent actions msg from python
-  ns3opengym::MultiAgentActMsg multiAgentActMsg;
-  zmq::message_t reply;
-  m_zmq_socket.recv (&reply);
-  multiAgentActMsg.ParseFromArray (reply.data (), reply.size ());
+  ReceiveActions ();
+  HandleReply ();
+}
 
+void
+OpenGymMultiInterface::HandleReply ()
+{
+  NS_LOG_FUNCTION (this);
+  m_policyRollout.Stop ();
   if (m_simEnd)
     {
       // if sim end only rx ms and quit
       return;
     }
 
-  bool stopSim = multiAgentActMsg.stopsimreq ();
+  // lookahead, reset and policy requests are answered until the agent
+  // sends actions
+  while (m_actionRx && !m_actMsg.stopsimreq () && IsExclusiveLockstep ())
+    {
+      if (m_actMsg.resetreq ())
+        {
+          m_policyRollout.ClearPendingRow ();
+          ResetEpisode ();
+        }
+      else if (m_actMsg.has_branch ())
+        {
+          if (m_branchRunner.Run (m_actMsg.branch ()))
+            {
+              return;
+            }
+        }
+      else if (m_actMsg.has_policy ())
+        {
+          if (m_policyRollout.Start (m_actMsg.policy ()))
+            {
+              return;
+            }
+        }
+      else
+        {
+          break;
+        }
+      ReceiveActions ();
+    }
+  m_policyRollout.ClearPendingRow ();
+
+  bool stopSim = StopRequested ();
   if (stopSim)
     {
       NS_LOG_DEBUG ("---Stop requested: " << stopSim);
@@ -324,47 +911,1269 @@ OpenGymMultiInterface::NotifyCurrentState ()
       std::exit (0);
     }
 
-  // first step after reset is called without actions, just to get current state
-  // execute actions for each agent
-  NS_LOG_DEBUG ("multiAgentActMsg.agentactmsg_size " << multiAgentActMsg.agentactmsg_size ());
-  for (int i = 0; i < multiAgentActMsg.agentactmsg_size (); i++)
-    {
-      const ns3opengym::AgentActMsg &agentActMsg = multiAgentActMsg.agentactmsg (i);
-      uint32_t agent_id = agentActMsg.agentid ();
-      ns3opengym::DataContainer actDataContainerPbMsg = agentActMsg.actdata ();
-      Ptr<OpenGymDataContainer> actDataContainer =
-          OpenGymDataContainer::CreateFromDataContainerPbMsg (actDataContainerPbMsg);
-      NS_LOG_DEBUG ("NotifyCurrentState ExecuteActions"
-                    << " agent_id," << agent_id << " actDataContainer," << actDataContainer);
-      ExecuteActions (agent_id, actDataContainer);
-    }
+  ExecuteReceivedActions ();
 }
 
 void
-OpenGymMultiInterface::WaitForStop ()
+OpenGymMultiInterface::SendStates ()
 {
   NS_LOG_FUNCTION (this);
-  NS_LOG_INFO ("Wait for stop message");
-  NotifyCurrentState ();
-}
+  // the message of each agent is overwritten field by field to keep its buffers
+  m_stateMsg.set_stepidx (m_stepIdx++);
+  m_stateMsg.set_ns3simulationend (m_simEnd);
 
-void
-OpenGymMultiInterface::NotifySimulationEnd ()
-{
-  NS_LOG_FUNCTION (this);
-  m_simEnd = true;
-  if (m_initSimMsgSent)
+  m_stepGraphs.clear ();
+
+  // batched callbacks gather the state of all due agents at once
+  size_t count = m_dueAgents.size ();
+  m_batchAgentIds.clear ();
+  for (size_t i = 0; i < count; i++)
     {
-      WaitForStop ();
+      m_batchAgentIds.push_back (m_agentIdVec[m_dueAgents[i]]);
     }
+  if (!m_obsBatchCb.IsNull ())
+    {
+      m_batchObs.resize (count);
+      m_obsBatchCb (m_batchAgentIds, m_batchObs);
+    }
+  if (!m_rewardBatchCb.IsNull ())
+    {
+      m_batchRewards.resize (count);
+      m_rewardBatchCb (m_batchAgentIds, m_batchRewards);
+    }
+  if (!m_doneBatchCb.IsNull ())
+    {
+      m_batchDones.resize (count);
+      m_doneBatchCb (m_batchAgentIds, m_batchDones);
+    }
+  if (!m_infoBatchCb.IsNull ())
+    {
+      m_batchInfos.resize (count);
+      m_infoBatchCb (m_batchAgentIds, m_batchInfos);
+    }
+
+  for (size_t i = 0; i < count; i++)
+    {
+      uint32_t idx = m_dueAgents[i];
+      uint32_t agent_id = m_batchAgentIds[i];
+      // value observations are written into the one kept for the agent
+      bool valueObs = !m_obsBatchCb.IsNull () || !m_obsDataCb.IsNull ();
+      const opengym::Data *obsData = &m_obsData[idx];
+      Ptr<OpenGymDataContainer> obsDataContainer;
+      bool hasObs;
+      if (!m_obsBatchCb.IsNull ())
+        {
+          obsData = &m_batchObs[i];
+          hasObs = obsData->GetType () != ns3opengym::NoSpaceType;
+        }
+      else if (valueObs)
+        {
+          hasObs = m_obsDataCb (agent_id, m_obsData[idx]);
+        }
+      else
+        {
+          obsDataContainer = GetObservation (agent_id);
+          hasObs = obsDataContainer;
+        }
+      float reward = m_rewardBatchCb.IsNull () ? GetReward (agent_id) : m_batchRewards[i];
+      bool done = m_doneBatchCb.IsNull () ? GetDone (agent_id) : m_batchDones[i];
+
+      ns3opengym::AgentStateMsg *agentStateMsg = &m_agentStateMsgs[idx];
+      // agent ID
+      agentStateMsg->set_agentid (agent_id);
+      // observation, filled in place
+      if (hasObs && valueObs)
+        {
+          obsData->Fill (*agentStateMsg->mutable_obsdata (), m_rawTensorVersion);
+        }
+      else if (hasObs)
+        {
+          FillObservation (idx, obsDataContainer, *agentStateMsg->mutable_obsdata ());
+        }
+      else
+        {
+          agentStateMsg->clear_obsdata ();
+        }
+      if (m_deltaActive)
+        {
+          EncodeObservationDelta (idx, *agentStateMsg->mutable_obsdata ());
+        }
+      // reward
+      agentStateMsg->set_reward (reward);
+      // done
+      agentStateMsg->set_done (false);
+      if (done)
+        {
+          agentStateMsg->set_done (true);
+        }
+      // info
+      if (m_infoBatchCb.IsNull ())
+        {
+          agentStateMsg->set_info (GetInfo (agent_id));
+        }
+      else
+        {
+          agentStateMsg->set_info (m_batchInfos[i]);
+        }
+    }
+
+  // the agents that wait for actions, m_dueAgents changes before the
+  // pipelined reply is received
+  m_pendingAgents.assign (m_dueAgents.begin (), m_dueAgents.end ());
+
+  // m_stateMsg borrows the messages of the agents it carries, they stay
+  // owned by m_agentStateMsgs
+  google::protobuf::RepeatedPtrField<ns3opengym::AgentStateMsg> *agentStateMsgs =
+      m_stateMsg.mutable_agentstatemsg ();
+  bool deadline = m_stepDeadline.IsStrictlyPositive ();
+  if (m_workers.empty ())
+    {
+      // deadline mode: like a late worker, the agent gets no state before
+      // it replied to the previous one, and no send blocks the step
+      int64_t timeoutMs = -1;
+      if (deadline)
+        {
+          // a late reply that arrived meanwhile. The last state is worth
+          // waiting one more deadline for, it is sent in any case: the
+          // agent waits for it.
+          timeoutMs = (m_stepDeadline.GetMicroSeconds () + 999) / 1000;
+          if (m_replyPending)
+            {
+              ReceiveAgentReply (m_simEnd ? timeoutMs : 0);
+            }
+          if (m_replyPending && !m_simEnd)
+            {
+              NS_LOG_DEBUG ("Agent is late, skipping step " << m_stateMsg.stepidx ());
+              for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin ();
+                   it != m_dueAgents.end (); it++)
+                {
+                  SkipAgentState (*it);
+                }
+              return;
+            }
+        }
+      bool batched = m_batchedActive && FillBatch ();
+      if (m_batchedActive && !batched)
+        {
+          NS_LOG_DEBUG ("Observations differ, per-agent states at step " << m_stateMsg.stepidx ());
+          m_stateMsg.clear_batch ();
+        }
+      if (!batched)
+        {
+          for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin ();
+               it != m_dueAgents.end (); it++)
+            {
+              agentStateMsgs->AddAllocated (&m_agentStateMsgs[*it]);
+            }
+        }
+      bool sent = SendMsg (m_stateMsg, timeoutMs);
+      agentStateMsgs->UnsafeArenaExtractSubrange (0, agentStateMsgs->size (), NULL);
+      if (!deadline)
+        {
+          return;
+        }
+      if (!sent)
+        {
+          NS_LOG_WARN ("Agent does not read, skipping step " << m_stateMsg.stepidx ());
+          for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin ();
+               it != m_dueAgents.end (); it++)
+            {
+              SkipAgentState (*it);
+            }
+          return;
+        }
+      m_replyStepIdx = m_stateMsg.stepidx ();
+      m_replyPending = true;
+      return;
+    }
+
+  // worker mode: one burst, every worker gets its due agents. All workers
+  // get the first and the last state, even without due agents.
+  bool allWorkers = m_simEnd || m_stateMsg.stepidx () == 0;
+  if (deadline)
+    {
+      // late replies that arrived meanwhile, their workers are ready again.
+      // The last state is worth waiting one more deadline for.
+      std::chrono::steady_clock::time_point deadlineEnd = std::chrono::steady_clock::now ();
+      if (m_simEnd)
+        {
+          deadlineEnd += std::chrono::microseconds (m_stepDeadline.GetMicroSeconds ());
+        }
+      bool late = true;
+      while (late && ReceiveWorkerReply (GetRemainingMs (deadlineEnd)))
+        {
+          late = false;
+          for (std::vector<Worker>::const_iterator w = m_workers.begin (); w != m_workers.end (); w++)
+            {
+              late = late || w->replyPending;
+            }
+        }
+    }
+  for (uint32_t w = 0; w < m_workers.size (); w++)
+    {
+      if (deadline && m_workers[w].replyPending)
+        {
+          // a REQ worker drops a state that arrives before it replied, its
+          // agents miss this step as well
+          NS_LOG_DEBUG ("Worker " << m_workers[w].workerId << " is late, skipping step "
+                                  << m_stateMsg.stepidx ());
+          for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin ();
+               it != m_dueAgents.end (); it++)
+            {
+              if (m_agentWorker[*it] == w)
+                {
+                  SkipAgentState (*it);
+                }
+            }
+          continue;
+        }
+      for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin ();
+           it != m_dueAgents.end (); it++)
+        {
+          if (m_agentWorker[*it] == w)
+            {
+              agentStateMsgs->AddAllocated (&m_agentStateMsgs[*it]);
+            }
+        }
+      if (agentStateMsgs->size () > 0 || allWorkers)
+        {
+          SendToWorker (m_workers[w], m_stateMsg);
+          m_workers[w].stepIdx = m_stateMsg.stepidx ();
+          m_workers[w].replyPending = true;
+        }
+      agentStateMsgs->UnsafeArenaExtractSubrange (0, agentStateMsgs->size (), NULL);
+    }
+}
+
+void
+OpenGymMultiInterface::ReceiveActions ()
+{
+  NS_LOG_FUNCTION (this);
+  m_missedAgents.clear ();
+  bool deadline = m_stepDeadline.IsStrictlyPositive ();
+  std::chrono::steady_clock::time_point deadlineEnd;
+  if (deadline)
+    {
+      deadlineEnd = std::chrono::steady_clock::now () +
+                    std::chrono::microseconds (m_stepDeadline.GetMicroSeconds ());
+    }
+
+  if (m_workers.empty ())
+    {
+      if (!deadline)
+        {
+          RecvActMsg ();
+          m_actionRx = true;
+          return;
+        }
+      // a stop request that came late is still pending. After a skipped
+      // state the late reply is waited for, the agent gets the next one.
+      m_actionRx = m_actMsg.stopsimreq ();
+      while (!m_actionRx && m_replyPending)
+        {
+          if (!ReceiveAgentReply (GetRemainingMs (deadlineEnd)))
+            {
+              break;
+            }
+        }
+      if (!m_actionRx)
+        {
+          m_missedAgents = m_pendingAgents;
+        }
+    }
+  else
+    {
+      // gather the replies in arrival order
+      while (HasAwaitedReplies ())
+        {
+          if (!ReceiveWorkerReply (deadline ? GetRemainingMs (deadlineEnd) : -1))
+            {
+              break;
+            }
+        }
+      if (deadline)
+        {
+          for (std::vector<uint32_t>::const_iterator it = m_pendingAgents.begin ();
+               it != m_pendingAgents.end (); it++)
+            {
+              if (!m_workers[m_agentWorker[*it]].actionRx)
+                {
+                  m_missedAgents.push_back (*it);
+                }
+            }
+        }
+    }
+
+  for (std::vector<uint32_t>::const_iterator it = m_missedAgents.begin ();
+       it != m_missedAgents.end (); it++)
+    {
+      m_deadlineMisses[*it]++;
+    }
+  if (!m_missedAgents.empty ())
+    {
+      NS_LOG_WARN ("Step " << m_stateMsg.stepidx () << ": " << m_missedAgents.size ()
+                           << " agents missed the deadline");
+    }
+}
+
+bool
+OpenGymMultiInterface::HasAwaitedReplies () const
+{
+  for (std::vector<Worker>::const_iterator w = m_workers.begin (); w != m_workers.end (); w++)
+    {
+      if (w->replyPending && w->stepIdx == m_stateMsg.stepidx ())
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+bool
+OpenGymMultiInterface::ReceiveWorkerReply (int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this << timeoutMs);
+  uint32_t workerIdx;
+  uint32_t size;
+  const uint8_t *data = ReceiveFromWorker (workerIdx, size, timeoutMs);
+  if (!data)
+    {
+      return false;
+    }
+  Worker &worker = m_workers[workerIdx];
+  if (!worker.replyPending)
+    {
+      NS_LOG_WARN ("Unexpected message of worker " << worker.workerId);
+      return true;
+    }
+  if (!MergeActMsg (data, size, worker.actMsg))
+    {
+      NS_LOG_ERROR ("Cannot parse actions msg of worker " << worker.workerId << " of " << size
+                                                           << " bytes");
+    }
+  worker.replyPending = false;
+  // actions for an earlier state missed their deadline and are dropped,
+  // a stop request never is
+  if (worker.stepIdx == m_stateMsg.stepidx () || worker.actMsg.stopsimreq ())
+    {
+      worker.actionRx = true;
+    }
+  else
+    {
+      NS_LOG_DEBUG ("Dropping late actions of worker " << worker.workerId << " for step "
+                                                       << worker.stepIdx);
+    }
+  return true;
+}
+
+bool
+OpenGymMultiInterface::ReceiveAgentReply (int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this << timeoutMs);
+  uint32_t size = 0;
+  const uint8_t *data = ReceiveRecord (size, timeoutMs);
+  if (!data)
+    {
+      return false;
+    }
+  if (!MergeActMsg (data, size, m_actMsg))
+    {
+      NS_LOG_ERROR ("Cannot parse multi-agent actions msg of " << size << " bytes");
+    }
+  ReleaseRecord ();
+  if (m_actMsg.stepidx () == m_replyStepIdx)
+    {
+      m_replyPending = false;
+    }
+  // a late reply to an earlier state is dropped, a stop request never
+  m_actionRx = (!m_replyPending && m_replyStepIdx == m_stateMsg.stepidx ()) ||
+               m_actMsg.stopsimreq ();
+  if (!m_actionRx)
+    {
+      NS_LOG_DEBUG ("Dropping late actions of step " << m_actMsg.stepidx ());
+    }
+  return true;
+}
+
+void
+OpenGymMultiInterface::SkipAgentState (uint32_t idx)
+{
+  // the references moved on with observations the agent never gets, its
+  // next ones are keyframes
+  m_graphSeen[idx] = std::make_pair (0, 0);
+  if (idx < m_lastObs.size ())
+    {
+      m_lastObs[idx].mutable_data ()->clear ();
+    }
+}
+
+bool
+OpenGymMultiInterface::StopRequested () const
+{
+  if (m_workers.empty ())
+    {
+      return m_actionRx && m_actMsg.stopsimreq ();
+    }
+  for (std::vector<Worker>::const_iterator w = m_workers.begin (); w != m_workers.end (); w++)
+    {
+      if (w->actionRx && w->actMsg.stopsimreq ())
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+OpenGymMultiInterface::ExecuteReceivedActions ()
+{
+  NS_LOG_FUNCTION (this);
+  m_batchActionIds.clear ();
+  m_batchActions.clear ();
+  if (m_workers.empty ())
+    {
+      if (m_actionRx)
+        {
+          ExecuteActMsg (m_actMsg);
+        }
+    }
+  else
+    {
+      // worker id order, independent of the arrival order
+      for (std::vector<Worker>::iterator w = m_workers.begin (); w != m_workers.end (); w++)
+        {
+          if (w->actionRx)
+            {
+              ExecuteActMsg (w->actMsg);
+              w->actionRx = false;
+            }
+        }
+    }
+
+  for (std::vector<uint32_t>::const_iterator it = m_missedAgents.begin ();
+       it != m_missedAgents.end (); it++)
+    {
+      ExecuteFallbackAction (*it);
+    }
+  m_missedAgents.clear ();
+
+  if (!m_batchActionIds.empty ())
+    {
+      m_actionBatchCb (m_batchActionIds, m_batchActions);
+    }
+}
+
+void
+OpenGymMultiInterface::ExecuteFallbackAction (uint32_t idx)
+{
+  NS_LOG_FUNCTION (this << idx);
+  uint32_t agent_id = m_agentIdVec[idx];
+  if (!m_actionBatchCb.IsNull () && m_fallbackAction == FALLBACK_REPEAT)
+    {
+      if (m_actionData[idx].GetType () != ns3opengym::NoSpaceType)
+        {
+          m_batchActionIds.push_back (agent_id);
+          m_batchActions.push_back (&m_actionData[idx]);
+        }
+      return;
+    }
+  if (!m_actionDataCb.IsNull () && m_fallbackAction == FALLBACK_REPEAT)
+    {
+      // nothing to repeat before the first action
+      if (m_actionData[idx].GetType () != ns3opengym::NoSpaceType)
+        {
+          m_actionDataCb (agent_id, m_actionData[idx]);
+        }
+      return;
+    }
+  Ptr<OpenGymDataContainer> action;
+  switch (m_fallbackAction)
+    {
+    case FALLBACK_REPEAT:
+      action = m_actionContainers[idx];
+      break;
+    case FALLBACK_DEFAULT:
+      action = m_defaultActions[idx];
+      break;
+    case FALLBACK_CALLBACK:
+      if (!m_fallbackActionCb.IsNull ())
+        {
+          action = m_fallbackActionCb (agent_id);
+        }
+      break;
+    case FALLBACK_NONE:
+      break;
+    }
+  if (action)
+    {
+      NS_LOG_DEBUG ("Fallback action of agent " << agent_id << ": " << action);
+      ExecuteActions (agent_id, action);
+    }
+}
+
+int64_t
+OpenGymMultiInterface::GetRemainingMs (std::chrono::steady_clock::time_point deadlineEnd) const
+{
+  std::chrono::steady_clock::duration remaining = deadlineEnd - std::chrono::steady_clock::now ();
+  // round up, a zero timeout only polls
+  int64_t ms = (std::chrono::duration_cast<std::chrono::microseconds> (remaining).count () + 999) / 1000;
+  return ms > 0 ? ms : 0;
+}
+
+void
+OpenGymMultiInterface::ExecuteActMsg (const ns3opengym::MultiAgentActMsg &multiAgentActMsg)
+{
+  NS_LOG_FUNCTION (this);
+  // first step after reset is called without actions, just to get current state
+  // execute actions for each agent
+  NS_LOG_DEBUG ("multiAgentActMsg.agentactmsg_size " << multiAgentActMsg.agentactmsg_size ());
+  for (int i = 0; i < multiAgentActMsg.agentactmsg_size (); i++)
+    {
+      const ns3opengym::AgentActMsg &agentActMsg = multiAgentActMsg.agentactmsg (i);
+      uint32_t agent_id = agentActMsg.agentid ();
+      std::map<uint32_t, uint32_t>::const_iterator index = m_agentIndex.find (agent_id);
+      if (!m_actionBatchCb.IsNull () && index != m_agentIndex.end ())
+        {
+          // executed together after the last act msg of the step
+          opengym::Data &action = m_actionData[index->second];
+          action.Update (agentActMsg.actdata ());
+          m_batchActionIds.push_back (agent_id);
+          m_batchActions.push_back (&action);
+          continue;
+        }
+      if (!m_actionDataCb.IsNull () && index != m_agentIndex.end ())
+        {
+          opengym::Data &action = m_actionData[index->second];
+          action.Update (agentActMsg.actdata ());
+          NS_LOG_DEBUG ("NotifyCurrentState ExecuteActionData"
+                        << " agent_id," << agent_id << " action," << action);
+          m_actionDataCb (agent_id, action);
+          continue;
+        }
+      // recycle the container of the agent's last action unless the env kept it
+      Ptr<OpenGymDataContainer> unknownAgentContainer;
+      Ptr<OpenGymDataContainer> &actDataContainer =
+          index != m_agentIndex.end () ? m_actionContainers[index->second] : unknownAgentContainer;
+      if (!actDataContainer || actDataContainer->GetReferenceCount () > 1 ||
+          !actDataContainer->UpdateFromDataContainerPbMsg (agentActMsg.actdata ()))
+        {
+          actDataContainer = OpenGymDataContainer::CreateFromDataContainerPbMsg (agentActMsg.actdata ());
+        }
+      if (index != m_agentIndex.end () && m_actionDictSpaces[index->second])
+        {
+          // the env can look elements up by slot
+          Ptr<OpenGymDictContainer> dict = DynamicCast<OpenGymDictContainer> (actDataContainer);
+          if (dict)
+            {
+              dict->Bind (m_actionDictSpaces[index->second]);
+            }
+        }
+      NS_LOG_DEBUG ("NotifyCurrentState ExecuteActions"
+                    << " agent_id," << agent_id << " actDataContainer," << actDataContainer);
+      ExecuteActions (agent_id, actDataContainer);
+    }
+}
+
+void
+OpenGymMultiInterface::UpdateDueAgents ()
+{
+  NS_LOG_FUNCTION (this);
+  m_dueAgents.clear ();
+  Time now = Simulator::Now ();
+  for (uint32_t idx = 0; idx < m_agentIdVec.size (); idx++)
+    {
+      if (m_agentSubsets && !m_simEnd && !m_agentTriggered[idx] && now < m_agentNextStep[idx])
+        {
+          continue;
+        }
+      m_dueAgents.push_back (idx);
+      m_agentTriggered[idx] = false;
+
+      // a triggered step does not move the interval
+      Time interval = m_agentInterval[idx];
+      if (interval.IsStrictlyPositive () && now >= m_agentNextStep[idx])
+        {
+          // stay on the grid of the interval, restart it after missed steps
+          Time next = Time::Max () - interval < m_agentNextStep[idx] ? Time::Max ()
+                                                                      : m_agentNextStep[idx] + interval;
+          m_agentNextStep[idx] = next > now ? next : now + interval;
+        }
+    }
+}
+
+void
+OpenGymMultiInterface::FillObservation (uint32_t idx, Ptr<OpenGymDataContainer> obs,
+                                        ns3opengym::DataContainer &obsData)
+{
+  Ptr<OpenGymGraphContainer> graph = DynamicCast<OpenGymGraphContainer> (obs);
+  if (!graph || m_rawTensorVersion < 7)
+    {
+      obs->FillDataContainerPbMsg (obsData, m_rawTensorVersion);
+      return;
+    }
+
+  // every fill is the next message of the graph: agents that share it get
+  // the message of this step once it is filled, an agent that missed the
+  // message it applies to gets a keyframe
+  std::pair<uint64_t, uint32_t> &seen = m_graphSeen[idx];
+  bool missed = seen.first != graph->GetGraphId ();
+  for (std::vector<StepGraph>::iterator it = m_stepGraphs.begin (); it != m_stepGraphs.end (); it++)
+    {
+      if (it->graph != PeekPointer (graph))
+        {
+          continue;
+        }
+      if (it->baseSeq == 0 || (!missed && seen.second == it->baseSeq))
+        {
+          obsData.CopyFrom (m_agentStateMsgs[it->idx].obsdata ());
+          seen = std::make_pair (graph->GetGraphId (), graph->GetSeq ());
+          return;
+        }
+      NS_LOG_LOGIC ("Agent " << m_agentIdVec[idx] << " missed graph " << graph->GetGraphId ()
+                             << " message " << it->baseSeq << ", keyframe");
+      graph->RequestKeyframe ();
+      graph->FillDataContainerPbMsg (obsData, m_rawTensorVersion);
+      it->idx = idx;
+      it->baseSeq = 0;
+      seen = std::make_pair (graph->GetGraphId (), graph->GetSeq ());
+      return;
+    }
+  bool keyframe = missed || seen.second != graph->GetSeq ();
+  if (keyframe)
+    {
+      graph->RequestKeyframe ();
+    }
+  StepGraph stepGraph = {PeekPointer (graph), idx, keyframe ? 0 : graph->GetSeq ()};
+  m_stepGraphs.push_back (stepGraph);
+  graph->FillDataContainerPbMsg (obsData, m_rawTensorVersion);
+  seen = std::make_pair (graph->GetGraphId (), graph->GetSeq ());
+}
+
+void
+OpenGymMultiInterface::EncodeObservationDelta (size_t idx, ns3opengym::DataContainer &obsData)
+{
+  NS_LOG_FUNCTION (this << idx);
+  if (idx >= m_lastObs.size ())
+    {
+      m_lastObs.resize (m_agentIdVec.size ());
+      m_deltaFills.resize (m_agentIdVec.size (), 0);
+      m_deltaSeq.resize (m_agentIdVec.size (), 0);
+    }
+  ns3opengym::RawTensor &last = m_lastObs[idx];
+  if (obsData.type () != ns3opengym::Box || !obsData.has_tensor ())
+    {
+      // no reference, the next Box observation is a keyframe
+      last.mutable_data ()->clear ();
+      return;
+    }
+
+  ns3opengym::RawTensor *tensor = obsData.mutable_tensor ();
+  ns3opengym::TensorDelta *delta = tensor->mutable_delta ();
+  delta->set_encoding (ns3opengym::TensorDelta::NONE);
+  delta->set_seq (++m_deltaSeq[idx]);
+  delta->mutable_indices ()->Clear ();
+  delta->mutable_runs ()->Clear ();
+  delta->mutable_values ()->clear ();
+
+  const std::string &data = tensor->data ();
+  size_t elemSize = OpenGymDataContainer::GetDtypeSize (tensor->dtype ());
+  uint32_t count = data.size () / elemSize;
+  // counted per agent, agents with their own step interval may never be
+  // due at a common step
+  bool keyframe = m_keyframeInterval > 0 && m_deltaFills[idx] + 1 >= m_keyframeInterval;
+  bool sameLayout = last.dtype () == tensor->dtype () && last.data ().size () == data.size () &&
+                    last.shape_size () == tensor->shape_size () &&
+                    std::equal (last.shape ().begin (), last.shape ().end (), tensor->shape ().begin ());
+  if (keyframe || count == 0 || !sameLayout)
+    {
+      last.set_dtype (tensor->dtype ());
+      last.mutable_shape ()->CopyFrom (tensor->shape ());
+      last.set_data (data);
+      m_deltaFills[idx] = 0;
+      return;
+    }
+
+  // size of both encodings, the values are the same for both
+  using google::protobuf::io::CodedOutputStream;
+  const char *cur = data.data ();
+  const char *prev = last.data ().data ();
+  uint32_t changed = 0;
+  size_t sparseBytes = 0;
+  size_t runsBytes = 0;
+  uint32_t unchangedRun = 0;
+  uint32_t changedRun = 0;
+  for (uint32_t i = 0; i < count; i++)
+    {
+      if (std::memcmp (cur + i * elemSize, prev + i * elemSize, elemSize) == 0)
+        {
+          if (changedRun)
+            {
+              runsBytes += CodedOutputStream::VarintSize32 (unchangedRun) +
+                           CodedOutputStream::VarintSize32 (changedRun);
+              unchangedRun = 0;
+              changedRun = 0;
+            }
+          unchangedRun++;
+        }
+      else
+        {
+          changed++;
+          changedRun++;
+          sparseBytes += CodedOutputStream::VarintSize32 (i);
+        }
+    }
+  if (changedRun)
+    {
+      runsBytes += CodedOutputStream::VarintSize32 (unchangedRun) +
+                   CodedOutputStream::VarintSize32 (changedRun);
+    }
+  bool sparse = sparseBytes <= runsBytes;
+  if (std::min (sparseBytes, runsBytes) + changed * elemSize >= data.size ())
+    {
+      // dense changes, the full tensor is smaller
+      last.set_data (data);
+      m_deltaFills[idx] = 0;
+      return;
+    }
+
+  std::string *values = delta->mutable_values ();
+  values->resize (changed * elemSize);
+  char *out = &(*values)[0];
+  delta->set_encoding (sparse ? ns3opengym::TensorDelta::SPARSE : ns3opengym::TensorDelta::RUNS);
+  unchangedRun = 0;
+  changedRun = 0;
+  for (uint32_t i = 0; i < count; i++)
+    {
+      if (std::memcmp (cur + i * elemSize, prev + i * elemSize, elemSize) == 0)
+        {
+          if (changedRun)
+            {
+              delta->add_runs (unchangedRun);
+              delta->add_runs (changedRun);
+              unchangedRun = 0;
+              changedRun = 0;
+            }
+          unchangedRun++;
+          continue;
+        }
+      if (sparse)
+        {
+          delta->add_indices (i);
+        }
+      else
+        {
+          changedRun++;
+        }
+      std::memcpy (out, cur + i * elemSize, elemSize);
+      out += elemSize;
+    }
+  if (changedRun)
+    {
+      delta->add_runs (unchangedRun);
+      delta->add_runs (changedRun);
+    }
+
+  // the sent tensor becomes the reference, its old buffer is reused next step
+  m_deltaFills[idx]++;
+  last.mutable_data ()->swap (*tensor->mutable_data ());
+  tensor->mutable_data ()->clear ();
+}
+
+bool
+OpenGymMultiInterface::FillBatch ()
+{
+  NS_LOG_FUNCTION (this);
+  // the observations were filled per agent as usual, they have to agree
+  const ns3opengym::RawTensor *first = 0;
+  for (std::vector<uint32_t>::const_iterator it = m_dueAgents.begin (); it != m_dueAgents.end ();
+       it++)
+    {
+      const ns3opengym::DataContainer &obsData = m_agentStateMsgs[*it].obsdata ();
+      if (obsData.type () != ns3opengym::Box || !obsData.has_tensor ())
+        {
+          return false;
+        }
+      const ns3opengym::RawTensor &tensor = obsData.tensor ();
+      if (!first)
+        {
+          first = &tensor;
+          continue;
+        }
+      if (tensor.dtype () != first->dtype () || tensor.data ().size () != first->data ().size () ||
+          tensor.shape_size () != first->shape_size () ||
+          !std::equal (tensor.shape ().begin (), tensor.shape ().end (), first->shape ().begin ()))
+        {
+          return false;
+        }
+    }
+  if (!first)
+    {
+      return false;
+    }
+
+  // overwritten in place, the buffers keep their capacity
+  size_t count = m_dueAgents.size ();
+  size_t rowSize = first->data ().size ();
+  ns3opengym::BatchedStateMsg *batch = m_stateMsg.mutable_batch ();
+  batch->mutable_agentids ()->Clear ();
+  ns3opengym::RawTensor *obs = batch->mutable_obs ();
+  obs->set_dtype (first->dtype ());
+  obs->mutable_shape ()->Clear ();
+  obs->add_shape (count);
+  obs->mutable_shape ()->MergeFrom (first->shape ());
+  std::string *data = obs->mutable_data ();
+  data->resize (count * rowSize);
+  std::string *reward = batch->mutable_reward ();
+  reward->resize (count * sizeof (float));
+  std::string *done = batch->mutable_done ();
+  done->assign ((count + 7) / 8, '\0');
+  google::protobuf::RepeatedPtrField<std::string> *info = batch->mutable_info ();
+  while (info->size () > (int) count)
+    {
+      info->RemoveLast ();
+    }
+
+  for (size_t i = 0; i < count; i++)
+    {
+      const ns3opengym::AgentStateMsg &state = m_agentStateMsgs[m_dueAgents[i]];
+      batch->add_agentids (state.agentid ());
+      if (rowSize)
+        {
+          std::memcpy (&(*data)[i * rowSize], state.obsdata ().tensor ().data ().data (), rowSize);
+        }
+      float value = state.reward ();
+      std::memcpy (&(*reward)[i * sizeof (float)], &value, sizeof (float));
+      if (state.done ())
+        {
+          (*done)[i / 8] |= 1 << (i % 8);
+        }
+      if ((int) i < info->size ())
+        {
+          *info->Mutable (i) = state.info ();
+        }
+      else
+        {
+          *info->Add () = state.info ();
+        }
+    }
+  return true;
+}
+
+bool
+OpenGymMultiInterface::IsExclusiveLockstep () const
+{
+  return !m_pipelined && m_numWorkers == 0 && !m_stepDeadline.IsStrictlyPositive ();
+}
+
+void
+OpenGymMultiInterface::ExecuteLocalActions (const ns3opengym::MultiAgentActMsg &multiAgentActMsg)
+{
+  NS_LOG_FUNCTION (this);
+  m_batchActionIds.clear ();
+  m_batchActions.clear ();
+  ExecuteActMsg (multiAgentActMsg);
+  if (!m_batchActionIds.empty ())
+    {
+      m_actionBatchCb (m_batchActionIds, m_batchActions);
+    }
+}
+
+void
+OpenGymMultiInterface::ResetEpisode ()
+{
+  NS_LOG_FUNCTION (this << m_episode);
+  if (m_resetEpisodeCb.IsNull () || !m_resetEpisodeCb ())
+    {
+      NS_LOG_WARN ("The env cannot reset its episode");
+      // the state was not gathered again, the agent keeps the last one
+      ns3opengym::MultiAgentStateMsg refusal;
+      refusal.set_stepidx (m_stateMsg.stepidx ());
+      refusal.set_ns3simulationend (m_simEnd);
+      refusal.set_episode (m_episode);
+      refusal.set_resetfailed (true);
+      SendMsg (refusal);
+      return;
+    }
+
+  m_episode++;
+  m_stateMsg.set_episode (m_episode);
+  // the first state of an episode holds all agents and no deltas
+  m_lastObs.clear ();
+  std::fill (m_agentTriggered.begin (), m_agentTriggered.end (), true);
+  UpdateDueAgents ();
+  SendStates ();
+}
+
+void
+OpenGymMultiInterface::WaitForStop ()
+{
+  NS_LOG_FUNCTION (this);
+  NS_LOG_INFO ("Wait for stop message");
+  NotifyCurrentState ();
+}
+
+void
+OpenGymMultiInterface::NotifySimulationEnd ()
+{
+  NS_LOG_FUNCTION (this);
+  m_simEnd = true;
+  if (m_branchRunner.IsActive ())
+    {
+      m_branchRunner.Finish (true);
+    }
+  if (m_initSimMsgSent)
+    {
+      WaitForStop ();
+    }
+}
+
+bool
+OpenGymMultiInterface::SendMsg (const google::protobuf::MessageLite &msg, int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this << timeoutMs);
+  uint32_t size = msg.ByteSizeLong ();
+  if (m_shmChannel)
+    {
+      // serialize straight into the shared ring
+      uint8_t *buffer = m_shmChannel->Reserve (size, timeoutMs);
+      if (!buffer)
+        {
+          return false;
+        }
+      msg.SerializeWithCachedSizesToArray (buffer);
+      m_shmChannel->Commit (size);
+      return true;
+    }
+
+  if (m_txBuffer.size () < size)
+    {
+      m_txBuffer.resize (size);
+    }
+  msg.SerializeWithCachedSizesToArray (m_txBuffer.data ());
+  if (m_dealer)
+    {
+      // the agent may not have read the previous state yet, so the payload
+      // is copied. The empty frame stands in for the REQ envelope. With a
+      // timeout the state is dropped at the high-water mark, the further
+      // parts of a message are always queued.
+      zmq::message_t delimiter;
+      zmq::message_t request (m_txBuffer.data (), size);
+      if (!m_zmqDealer.send (delimiter, ZMQ_SNDMORE | (timeoutMs >= 0 ? ZMQ_DONTWAIT : 0)))
+        {
+          return false;
+        }
+      m_zmqDealer.send (request);
+      return true;
+    }
+  // zero copy: with REQ/REP the reply to this message arrives, and libzmq
+  // is done with the buffer, before the buffer is written again
+  zmq::message_t request (m_txBuffer.data (), size, NULL);
+  m_zmq_socket.send (request);
+  return true;
+}
+
+void
+OpenGymMultiInterface::SendToWorker (Worker &worker, const google::protobuf::MessageLite &msg)
+{
+  NS_LOG_FUNCTION (this << worker.workerId);
+  uint32_t size = msg.ByteSizeLong ();
+  if (worker.txBuffer.size () < size)
+    {
+      worker.txBuffer.resize (size);
+    }
+  msg.SerializeWithCachedSizesToArray (worker.txBuffer.data ());
+  // envelope of a REQ peer: routing id, empty delimiter, payload. Zero copy
+  // as in SendMsg, every worker has its own buffer. In deadline mode a
+  // late worker may still hold the previous state, the payload is copied.
+  zmq::message_t identity (&worker.identity[0], worker.identity.size (), NULL);
+  zmq::message_t delimiter;
+  m_zmqRouter.send (identity, ZMQ_SNDMORE);
+  m_zmqRouter.send (delimiter, ZMQ_SNDMORE);
+  if (m_stepDeadline.IsStrictlyPositive ())
+    {
+      zmq::message_t request (worker.txBuffer.data (), size);
+      m_zmqRouter.send (request);
+      return;
+    }
+  zmq::message_t request (worker.txBuffer.data (), size, NULL);
+  m_zmqRouter.send (request);
+}
+
+const uint8_t *
+OpenGymMultiInterface::ReceiveFromWorker (uint32_t &workerIdx, uint32_t &size, int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this);
+  while (true)
+    {
+      if (!WaitReadable (m_zmqRouter, timeoutMs))
+        {
+          size = 0;
+          return 0;
+        }
+      m_zmqRouter.recv (&m_zmqIdentity);
+      m_zmqRouter.recv (&m_zmqDelimiter);
+      m_zmqRouter.recv (&m_zmqReply);
+      for (workerIdx = 0; workerIdx < m_workers.size (); workerIdx++)
+        {
+          const std::string &identity = m_workers[workerIdx].identity;
+          if (identity.size () == m_zmqIdentity.size () &&
+              std::memcmp (identity.data (), m_zmqIdentity.data (), identity.size ()) == 0)
+            {
+              size = m_zmqReply.size ();
+              return static_cast<const uint8_t *> (m_zmqReply.data ());
+            }
+        }
+      NS_LOG_WARN ("Ignoring message of an unknown worker");
+    }
+}
+
+const uint8_t *
+OpenGymMultiInterface::ReceiveRecord (uint32_t &size, int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_shmChannel)
+    {
+      // parse in place, the record is released afterwards
+      return m_shmChannel->Receive (size, timeoutMs);
+    }
+
+  if (m_dealer)
+    {
+      if (!WaitReadable (m_zmqDealer, timeoutMs))
+        {
+          size = 0;
+          return 0;
+        }
+      m_zmqDealer.recv (&m_zmqDelimiter);
+      m_zmqDealer.recv (&m_zmqReply);
+      size = m_zmqReply.size ();
+      return static_cast<const uint8_t *> (m_zmqReply.data ());
+    }
+  m_zmq_socket.recv (&m_zmqReply);
+  size = m_zmqReply.size ();
+  return static_cast<const uint8_t *> (m_zmqReply.data ());
+}
+
+void
+OpenGymMultiInterface::ReleaseRecord ()
+{
+  if (m_shmChannel)
+    {
+      m_shmChannel->Release ();
+    }
+}
+
+void
+OpenGymMultiInterface::RecvMsg (google::protobuf::MessageLite &msg)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t size = 0;
+  const uint8_t *data = ReceiveRecord (size);
+  msg.ParseFromArray (data, size);
+  ReleaseRecord ();
+}
+
+void
+OpenGymMultiInterface::RecvActMsg ()
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t size = 0;
+  const uint8_t *data = ReceiveRecord (size);
+  if (!MergeActMsg (data, size, m_actMsg))
+    {
+      NS_LOG_ERROR ("Cannot parse multi-agent actions msg of " << size << " bytes");
+    }
+  ReleaseRecord ();
+}
+
+void
+OpenGymMultiInterface::AddAgent (uint32_t agent_id)
+{
+  m_agentIndex[agent_id] = m_agentIdVec.size ();
+  m_agentIdVec.push_back (agent_id);
+  m_agentInterval.push_back (Time (0));
+  m_agentNextStep.push_back (Time (0));
+  m_agentTriggered.push_back (false);
+  m_defaultActions.push_back (0);
+  m_deadlineMisses.push_back (0);
+  m_graphSeen.push_back (std::make_pair (0, 0));
+}
+
+void
+OpenGymMultiInterface::SetAgentStepInterval (uint32_t agent_id, Time interval)
+{
+  NS_LOG_FUNCTION (this << agent_id << interval);
+  if (m_initSimMsgSent)
+    {
+      NS_FATAL_ERROR ("Set agent step intervals before the first step");
+    }
+  std::map<uint32_t, uint32_t>::const_iterator it = m_agentIndex.find (agent_id);
+  if (it == m_agentIndex.end ())
+    {
+      NS_FATAL_ERROR ("Unknown agent " << agent_id << ", call AddAgentId first");
+    }
+  m_agentInterval[it->second] = interval;
+  m_agentSubsets = true;
+}
+
+void
+OpenGymMultiInterface::TriggerAgent (uint32_t agent_id)
+{
+  NS_LOG_FUNCTION (this << agent_id);
+  std::map<uint32_t, uint32_t>::const_iterator it = m_agentIndex.find (agent_id);
+  if (it == m_agentIndex.end ())
+    {
+      NS_LOG_WARN ("Cannot trigger unknown agent " << agent_id);
+      return;
+    }
+  m_agentTriggered[it->second] = true;
+}
+
+void
+OpenGymMultiInterface::ServeForks ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_forkServerPort == 0)
+    {
+      return;
+    }
+  if (m_initSimMsgSent)
+    {
+      NS_FATAL_ERROR ("ServeForks has to be called before the first step");
+    }
+
+  OpenGymForkServer server (m_forkServerPort);
+  OpenGymForkServer::Command command = server.Serve ();
+  // the parent's context never created a socket, still do not share its
+  // descriptors with the sibling simulations
+  m_zmq_context = zmq::context_t (1);
+  m_forkServerPort = 0;
+  SetPort (command.port);
+  if (command.run > 0)
+    {
+      RngSeedManager::SetRun (command.run);
+    }
+  for (size_t i = 0; i < command.attributes.size (); i++)
+    {
+      SetAttribute (command.attributes[i].first, StringValue (command.attributes[i].second));
+    }
+  if (!m_forkCb.IsNull ())
+    {
+      m_forkCb (command.run);
+    }
+}
+
+void
+OpenGymMultiInterface::SetForkCb (Callback<void, uint64_t> cb)
+{
+  m_forkCb = cb;
+}
+
+void
+OpenGymMultiInterface::SetPort (uint32_t port)
+{
+  NS_LOG_FUNCTION (this << port);
+  if (m_initSimMsgSent && port != m_port)
+    {
+      NS_FATAL_ERROR ("Port has to be set before the first step");
+    }
+  m_port = port;
+}
+
+uint32_t
+OpenGymMultiInterface::GetPort () const
+{
+  return m_port;
+}
+
+void
+OpenGymMultiInterface::SetPipelined (bool pipelined)
+{
+  NS_LOG_FUNCTION (this << pipelined);
+  if (m_initSimMsgSent && pipelined != m_pipelined)
+    {
+      NS_FATAL_ERROR ("Pipelined mode has to be set before the first step");
+    }
+  m_pipelined = pipelined;
+}
+
+bool
+OpenGymMultiInterface::GetPipelined () const
+{
+  return m_pipelined;
+}
+
+void
+OpenGymMultiInterface::SetWorkers (uint32_t workers)
+{
+  NS_LOG_FUNCTION (this << workers);
+  if (m_initSimMsgSent)
+    {
+      NS_LOG_WARN ("Workers can only be set before Init");
+      return;
+    }
+  m_numWorkers = workers;
+}
+
+uint32_t
+OpenGymMultiInterface::GetWorkers () const
+{
+  return m_numWorkers;
+}
+
+void
+OpenGymMultiInterface::SetStepDeadline (Time deadline)
+{
+  NS_LOG_FUNCTION (this << deadline);
+  if (m_initSimMsgSent && deadline.IsStrictlyPositive () && !m_dealer && !m_shmChannel &&
+      m_workers.empty ())
+    {
+      NS_FATAL_ERROR ("A step deadline on the tcp transport has to be set before the first step");
+    }
+  m_stepDeadline = deadline;
+}
+
+Time
+OpenGymMultiInterface::GetStepDeadline () const
+{
+  return m_stepDeadline;
+}
+
+void
+OpenGymMultiInterface::SetDefaultAction (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  NS_LOG_FUNCTION (this << agent_id << action);
+  std::map<uint32_t, uint32_t>::const_iterator it = m_agentIndex.find (agent_id);
+  if (it == m_agentIndex.end ())
+    {
+      NS_FATAL_ERROR ("Unknown agent " << agent_id << ", call AddAgentId first");
+    }
+  m_defaultActions[it->second] = action;
+}
+
+uint64_t
+OpenGymMultiInterface::GetDeadlineMisses (uint32_t agent_id) const
+{
+  std::map<uint32_t, uint32_t>::const_iterator it = m_agentIndex.find (agent_id);
+  if (it == m_agentIndex.end ())
+    {
+      return 0;
+    }
+  return m_deadlineMisses[it->second];
+}
+
+Ptr<OpenGymContainerPool>
+OpenGymMultiInterface::GetContainerPool () const
+{
+  return m_containerPool;
+}
+
+uint32_t
+OpenGymMultiInterface::GetActionLag () const
+{
+  return m_pipelined ? 1 : 0;
 }
 
-void
-OpenGymMultiInterface::AddAgent (uint32_t agent_id)
-{
-  m_agentIdVec.push_back (agent_id);
-}
-
 Ptr<OpenGymSpace>
 OpenGymMultiInterface::GetObservationSpace (uint32_t agent_id)
 {
@@ -460,11 +2269,16 @@ void
 OpenGymMultiInterface::Notify (Ptr<OpenGymMultiEnv> entity)
 {
   NS_LOG_FUNCTION (this);
-  SetGetObservationCb (MakeCallback (&OpenGymMultiEnv::GetObservation, entity));
-  SetGetRewardCb (MakeCallback (&OpenGymMultiEnv::GetReward, entity));
-  SetGetDoneCb (MakeCallback (&OpenGymMultiEnv::GetDone, entity));
-  SetGetInfoCb (MakeCallback (&OpenGymMultiEnv::GetInfo, entity));
-  SetExecuteActionsCb (MakeCallback (&OpenGymMultiEnv::ExecuteActions, entity));
+  // bind once, the callbacks hold a reference to the env
+  if (PeekPointer (entity) != m_boundEnv)
+    {
+      SetGetObservationCb (MakeCallback (&OpenGymMultiEnv::GetObservation, entity));
+      SetGetRewardCb (MakeCallback (&OpenGymMultiEnv::GetReward, entity));
+      SetGetDoneCb (MakeCallback (&OpenGymMultiEnv::GetDone, entity));
+      SetGetInfoCb (MakeCallback (&OpenGymMultiEnv::GetInfo, entity));
+      SetExecuteActionsCb (MakeCallback (&OpenGymMultiEnv::ExecuteActions, entity));
+      m_boundEnv = PeekPointer (entity);
+    }
 
   NotifyCurrentState ();
 }
@@ -32,13 +32,23 @@
 #define OPENGYM_MULTI_INTERFACE_H
 
 #include "ns3/object.h"
+#include "ns3/nstime.h"
+#include <chrono>
+#include <map>
 #include <zmq.hpp>
+#include "messages.pb.h"
+#include "opengym_value.h"
+#include "opengym_branch_runner.h"
+#include "opengym_policy_rollout.h"
 
 namespace ns3 {
 
 class OpenGymSpace;
 class OpenGymDataContainer;
 class OpenGymMultiEnv;
+class OpenGymShmChannel;
+class OpenGymContainerPool;
+class OpenGymDictSpace;
 
 /**
  * \note This class should only be called by OpenGymMultiEnv.
@@ -46,6 +56,28 @@ class OpenGymMultiEnv;
 class OpenGymMultiInterface : public Object
 {
 public:
+  /**
+   * Transport between the simulation and the Python agent.
+   * TRANSPORT_SHM only works when both run on the same host.
+   */
+  enum Transport
+  {
+    TRANSPORT_TCP,
+    TRANSPORT_SHM
+  };
+
+  /**
+   * Action executed for an agent whose actions did not arrive before the
+   * StepDeadline.
+   */
+  enum FallbackAction
+  {
+    FALLBACK_REPEAT, // the last action executed for the agent
+    FALLBACK_DEFAULT, // the action set with SetDefaultAction
+    FALLBACK_CALLBACK, // the action returned by the fallback callback
+    FALLBACK_NONE // no action
+  };
+
   static Ptr<OpenGymMultiInterface> Get (uint32_t port = 5555);
 
   OpenGymMultiInterface (uint32_t port = 5555);
@@ -73,6 +105,11 @@ public:
    * 1. Collect current env state
    * 2. Execute Actions
    * \note Similar gym step, this function should only be called by Notify.
+   *
+   * The exchange depends on the mode: lockstep (default), Pipelined,
+   * Workers, StepDeadline and per-agent step intervals. In lockstep the
+   * agent may answer with a BranchRequest (OpenGymBranchRunner), resetReq
+   * (SetResetEpisodeCb) or PolicyMsg (OpenGymPolicyRollout) instead.
    */
   void NotifyCurrentState ();
   void WaitForStop ();
@@ -80,6 +117,78 @@ public:
 
   void AddAgent(uint32_t agent_id);
 
+  /**
+   * Step \p agent_id once per \p interval of simulation time instead of at
+   * every NotifyCurrentState. Zero (default) steps the agent every time,
+   * Time::Max () only when triggered. Setting an interval switches the
+   * messages to the due agents, call it before the first step.
+   */
+  void SetAgentStepInterval (uint32_t agent_id, Time interval);
+  /**
+   * Include \p agent_id in the next step even if its interval did not
+   * elapse, e.g. when an event needs a decision.
+   */
+  void TriggerAgent (uint32_t agent_id);
+
+  void SetPort (uint32_t port);
+  uint32_t GetPort () const;
+
+  /**
+   * Fork server (attribute ForkServerPort > 0, see OpenGymForkServer):
+   * call after the topology is built and before Simulator::Run. Returns
+   * in each forked simulation with the port, RNG run and attributes it
+   * was forked for, without a fork server port immediately.
+   *
+   * Random variables created before the fork keep the streams of the
+   * template's run. Re-assign their streams in the fork callback
+   * (AssignStreams recreates them with the new run) where it matters.
+   */
+  void ServeForks ();
+  // called in the forked child with its RNG run, before it returns
+  void SetForkCb (Callback<void, uint64_t> cb);
+
+  /**
+   * Pipelined mode, action lag 1: receive the actions computed for the
+   * previous state, send the current one without waiting for its reply
+   * and execute the received actions. No action is executed in the first
+   * interval after Init.
+   */
+  void SetPipelined (bool pipelined);
+  bool GetPipelined () const;
+
+  /**
+   * Number of Python workers to wait for in Init, 0 (default) talks to a
+   * single agent over the Transport. Workers need the tcp transport.
+   * Every step the states go out to the workers in one burst and the
+   * replies are gathered as they arrive, actions are executed in worker
+   * id order to keep runs reproducible.
+   */
+  void SetWorkers (uint32_t workers);
+  uint32_t GetWorkers () const;
+
+  /**
+   * Wall-clock time to wait for the actions of a step, zero (default)
+   * waits forever. Has to be positive at Init to be used at all. An agent
+   * that missed it gets its FallbackAction and skips the next states
+   * until its late reply arrived, a state is never queued or blocks.
+   */
+  void SetStepDeadline (Time deadline);
+  Time GetStepDeadline () const;
+  // fallback of agent_id with FALLBACK_DEFAULT
+  void SetDefaultAction (uint32_t agent_id, Ptr<OpenGymDataContainer> action);
+  // number of steps agent_id missed the deadline
+  uint64_t GetDeadlineMisses (uint32_t agent_id) const;
+  /**
+   * \return number of steps between a state and the execution of the
+   * actions computed for it, 0 in lockstep mode, 1 in pipelined mode
+   */
+  uint32_t GetActionLag () const;
+  /**
+   * Pool of OpenGymDataContainer::Acquire, current while this interface
+   * steps. Its hit and miss counters show whether steps still allocate.
+   */
+  Ptr<OpenGymContainerPool> GetContainerPool () const;
+
   // Each agent
   Ptr<OpenGymSpace> GetActionSpace (uint32_t agent_id);
   Ptr<OpenGymSpace> GetObservationSpace (uint32_t agent_id);
@@ -97,6 +206,43 @@ public:
   void SetGetDoneCb (Callback<bool, uint32_t> cb);
   void SetGetInfoCb (Callback<std::string, uint32_t> cb);
   void SetExecuteActionsCb (Callback<bool, uint32_t, Ptr<OpenGymDataContainer>> cb);
+  // fallback with FALLBACK_CALLBACK, a null container executes nothing
+  void SetGetFallbackActionCb (Callback<Ptr<OpenGymDataContainer>, uint32_t> cb);
+  /**
+   * Soft reset on a resetReq of the agent, \return false if the env
+   * cannot. The answer is the first state of the next episode with all
+   * agents, full observations and MultiAgentStateMsg.episode counted up,
+   * or resetFailed without states.
+   */
+  void SetResetEpisodeCb (Callback<bool> cb);
+  /**
+   * Value-type observations and actions (opengym::Data). Once set they
+   * replace the observation / execute actions callback: the interface
+   * keeps one observation and one action per agent and the callbacks
+   * overwrite and read them in place, so no container is created per step.
+   * A null callback switches back. The observation callback returns false
+   * if the agent has no observation.
+   */
+  void SetGetObservationDataCb (Callback<bool, uint32_t, opengym::Data &> cb);
+  void SetExecuteActionDataCb (Callback<bool, uint32_t, const opengym::Data &> cb);
+  /**
+   * Batched callbacks, one call per step for all due agents instead of one
+   * per agent. Entry i of the output vector belongs to agentIds[i], the
+   * vectors are resized to agentIds.size () before the call. Observations
+   * left NoSpaceType mean no observation. Within a step the observations
+   * are gathered first, then rewards, dones and infos. Each one that is set
+   * replaces its per-agent callback, a null callback switches back.
+   */
+  void SetGetObservationsCb (
+      Callback<void, const std::vector<uint32_t> &, std::vector<opengym::Data> &> cb);
+  void SetGetRewardsCb (Callback<void, const std::vector<uint32_t> &, std::vector<float> &> cb);
+  void SetGetDonesCb (Callback<void, const std::vector<uint32_t> &, std::vector<bool> &> cb);
+  void SetGetInfosCb (
+      Callback<void, const std::vector<uint32_t> &, std::vector<std::string> &> cb);
+  // the actions of all agents of a step, repeated fallback actions included
+  void SetExecuteActionsBatchCb (
+      Callback<void, const std::vector<uint32_t> &, const std::vector<const opengym::Data *> &>
+          cb);
 
 protected:
   // Inherited
@@ -104,19 +250,185 @@ protected:
   virtual void DoDispose (void);
 
 private:
+  friend class OpenGymBranchRunner;
+  friend class OpenGymPolicyRollout;
+
   static Ptr<OpenGymMultiInterface> *DoGet (uint32_t port = 5555);
   static void Delete (void);
 
+  // a Python worker in worker mode
+  struct Worker
+  {
+    uint32_t workerId;
+    // ZMQ routing id of its REQ socket
+    std::string identity;
+    // indices of its agents in m_agentIdVec
+    std::vector<uint32_t> agents;
+    // reused between steps
+    ns3opengym::MultiAgentActMsg actMsg;
+    std::vector<uint8_t> txBuffer;
+    // stepIdx of the last state sent
+    uint64_t stepIdx;
+    // a state was sent and its reply is not received yet, stays set
+    // after a missed deadline until the late reply arrived
+    bool replyPending;
+    // actions received and not executed yet
+    bool actionRx;
+  };
+
+  // \return false if the message could not be queued within timeoutMs, -1
+  // blocks
+  bool SendMsg (const google::protobuf::MessageLite &msg, int64_t timeoutMs = -1);
+  void RecvMsg (google::protobuf::MessageLite &msg);
+  // receive the next actions into m_actMsg without allocating
+  void RecvActMsg ();
+  // \return 0 if nothing arrived within timeoutMs, -1 blocks
+  const uint8_t *ReceiveRecord (uint32_t &size, int64_t timeoutMs = -1);
+  void ReleaseRecord ();
+  void ExecuteActMsg (const ns3opengym::MultiAgentActMsg &multiAgentActMsg);
+  // init msg for the agents with the given indices
+  void FillInitMsg (ns3opengym::MultiAgentInitMsg &multiAgentInitMsg,
+                    const std::vector<uint32_t> &agents);
+  // worker mode: hello of every worker, agent partition, init msg and ack
+  void InitWorkers (ns3opengym::SimInitAck &simInitAck);
+  void SendStates ();
+  void ReceiveActions ();
+  bool StopRequested () const;
+  // worker mode: some worker owes the reply to the last state
+  bool HasAwaitedReplies () const;
+  // receive and file one worker reply, \return false on timeout
+  bool ReceiveWorkerReply (int64_t timeoutMs);
+  // deadline mode: receive one reply of the single agent into m_actMsg,
+  // \return false on timeout
+  bool ReceiveAgentReply (int64_t timeoutMs);
+  // agent idx misses the state of this step, its delta and graph
+  // references are void
+  void SkipAgentState (uint32_t idx);
+  void ExecuteReceivedActions ();
+  void SendToWorker (Worker &worker, const google::protobuf::MessageLite &msg);
+  // receive the next message of any worker, sets the worker index
+  const uint8_t *ReceiveFromWorker (uint32_t &workerIdx, uint32_t &size, int64_t timeoutMs = -1);
+  // wall-clock ms left until deadlineEnd, -1 without a deadline
+  int64_t GetRemainingMs (std::chrono::steady_clock::time_point deadlineEnd) const;
+  void ExecuteFallbackAction (uint32_t idx);
+  // collect the indices of the agents to step into m_dueAgents
+  void UpdateDueAgents ();
+  // fill the container observation of agent idx, a graph shared by several
+  // agents only once per step
+  void FillObservation (uint32_t idx, Ptr<OpenGymDataContainer> obs,
+                        ns3opengym::DataContainer &obsData);
+  // replace the Box observation of agent idx by its changes if that is smaller
+  void EncodeObservationDelta (size_t idx, ns3opengym::DataContainer &obsData);
+  // copy the states of the due agents into m_stateMsg.batch, \return false
+  // if their observations differ in dtype or shape
+  bool FillBatch ();
+  // the agent answers every state in lockstep on its own, it may send a
+  // BranchRequest or resetReq
+  bool IsExclusiveLockstep () const;
+  // answer a resetReq with the first state of the next episode
+  void ResetEpisode ();
+  // act on the reply to a state: requests, stop or actions
+  void HandleReply ();
+  // execute actions chosen in the simulation, branch plans and policies
+  void ExecuteLocalActions (const ns3opengym::MultiAgentActMsg &multiAgentActMsg);
+
   uint32_t m_port;
+  uint32_t m_envIndex;
+  Transport m_transport;
   zmq::context_t m_zmq_context;
+  // the sockets are created in Init, no ZMQ thread may run before a fork
   zmq::socket_t m_zmq_socket;
+  Ptr<OpenGymShmChannel> m_shmChannel;
+  zmq::message_t m_zmqReply;
+  // tcp transport in deadline mode
+  zmq::socket_t m_zmqDealer;
+  bool m_dealer;
+  // worker mode
+  uint32_t m_numWorkers;
+  zmq::socket_t m_zmqRouter;
+  zmq::message_t m_zmqIdentity;
+  zmq::message_t m_zmqDelimiter;
+  std::vector<Worker> m_workers;
+  // agent index -> index in m_workers
+  std::vector<uint32_t> m_agentWorker;
+  uint16_t m_forkServerPort;
+  Callback<void, uint64_t> m_forkCb;
 
   bool m_simEnd;
   bool m_stopEnvRequested;
   bool m_initSimMsgSent;
-  
+  bool m_pipelined;
+  // raw tensor version negotiated in Init, 0: Box data as BoxDataContainer
+  uint32_t m_rawTensorVersion;
+  // pipelined mode: a state was sent and its actions are not received yet
+  bool m_actionPending;
+  // delta observations requested by attribute / negotiated in Init
+  bool m_deltaObs;
+  bool m_deltaActive;
+  uint32_t m_keyframeInterval;
+  // batched states requested by attribute / possible with the agent and spaces
+  bool m_batchedStates;
+  bool m_batchedActive;
+  uint64_t m_stepIdx;
+  // episodes reset in place
+  uint64_t m_episode;
+  Time m_stepDeadline;
+  FallbackAction m_fallbackAction;
+  // the actions in m_actMsg belong to the last state
+  bool m_actionRx;
+  // single agent in deadline mode, as Worker: stepIdx of the last state
+  // sent and whether its reply is not received yet
+  uint64_t m_replyStepIdx;
+  bool m_replyPending;
+
+  // reused between steps
+  ns3opengym::MultiAgentStateMsg m_stateMsg;
+  ns3opengym::MultiAgentActMsg m_actMsg;
+  std::vector<uint8_t> m_txBuffer;
+  std::vector<Ptr<OpenGymDataContainer>> m_actionContainers;
+  Ptr<OpenGymContainerPool> m_containerPool;
+  // Box observation last sent to each agent in full, delta reference
+  std::vector<ns3opengym::RawTensor> m_lastObs;
+  // per agent index: deltas sent since the last keyframe, TensorDelta.seq
+  std::vector<uint32_t> m_deltaFills;
+  std::vector<uint32_t> m_deltaSeq;
+  // env the step callbacks are bound to
+  OpenGymMultiEnv *m_boundEnv;
+
   // agent ID vector
   std::vector<uint32_t> m_agentIdVec;
+  // agent ID -> index in m_agentIdVec
+  std::map<uint32_t, uint32_t> m_agentIndex;
+  // per agent index: step interval, time the agent is due next, triggered
+  std::vector<Time> m_agentInterval;
+  std::vector<Time> m_agentNextStep;
+  std::vector<bool> m_agentTriggered;
+  // some agent has its own interval, steps only carry the due agents
+  bool m_agentSubsets;
+  std::vector<uint32_t> m_dueAgents;
+  // per agent index, m_stateMsg borrows the ones of the due agents
+  std::vector<ns3opengym::AgentStateMsg> m_agentStateMsgs;
+  // deadline mode: agents of the last state, agents that missed the
+  // deadline and wait for their fallback
+  std::vector<uint32_t> m_pendingAgents;
+  std::vector<uint32_t> m_missedAgents;
+  // per agent index
+  std::vector<Ptr<OpenGymDataContainer>> m_defaultActions;
+  // Dict action spaces, received Dict actions are bound to them
+  std::vector<Ptr<OpenGymDictSpace>> m_actionDictSpaces;
+  std::vector<uint64_t> m_deadlineMisses;
+  // per agent index: graph id and seq of the last graph message sent, an
+  // update is only sent on top of it
+  std::vector<std::pair<uint64_t, uint32_t> > m_graphSeen;
+  // graphs filled this step: graph, agent index it was filled for and the
+  // seq its message applies to, 0 for a keyframe
+  struct StepGraph
+  {
+    OpenGymGraphContainer *graph;
+    uint32_t idx;
+    uint32_t baseSeq;
+  };
+  std::vector<StepGraph> m_stepGraphs;
 
   Callback<Ptr<OpenGymSpace>, uint32_t> m_actionSpaceCb;
   Callback<Ptr<OpenGymSpace>, uint32_t> m_observationSpaceCb;
@@ -125,6 +437,32 @@ private:
   Callback<bool, uint32_t> m_doneCb;
   Callback<std::string, uint32_t> m_infoCb;
   Callback<bool, uint32_t, Ptr<OpenGymDataContainer>> m_actionCb;
+  Callback<Ptr<OpenGymDataContainer>, uint32_t> m_fallbackActionCb;
+  Callback<bool> m_resetEpisodeCb;
+  Callback<bool, uint32_t, opengym::Data &> m_obsDataCb;
+  Callback<bool, uint32_t, const opengym::Data &> m_actionDataCb;
+  Callback<void, const std::vector<uint32_t> &, std::vector<opengym::Data> &> m_obsBatchCb;
+  Callback<void, const std::vector<uint32_t> &, std::vector<float> &> m_rewardBatchCb;
+  Callback<void, const std::vector<uint32_t> &, std::vector<bool> &> m_doneBatchCb;
+  Callback<void, const std::vector<uint32_t> &, std::vector<std::string> &> m_infoBatchCb;
+  Callback<void, const std::vector<uint32_t> &, const std::vector<const opengym::Data *> &>
+      m_actionBatchCb;
+  // per agent index, reused by the value callbacks
+  std::vector<opengym::Data> m_obsData;
+  std::vector<opengym::Data> m_actionData;
+  // arguments of the batched callbacks, per due agent
+  std::vector<uint32_t> m_batchAgentIds;
+  std::vector<opengym::Data> m_batchObs;
+  std::vector<float> m_batchRewards;
+  std::vector<bool> m_batchDones;
+  std::vector<std::string> m_batchInfos;
+  // actions of the step collected for m_actionBatchCb, pointing into m_actionData
+  std::vector<uint32_t> m_batchActionIds;
+  std::vector<const opengym::Data *> m_batchActions;
+
+  // lookahead branches and policy offload requested by the agent
+  OpenGymBranchRunner m_branchRunner;
+  OpenGymPolicyRollout m_policyRollout;
 };
 
 } // namespace ns3
@@ -0,0 +1,359 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Zhangmin Wang
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <type_traits>
+#include "ns3/log.h"
+#include "opengym_policy.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymPolicy");
+
+namespace {
+
+// round to the nearest W, out of range values saturate and NaN gives 0
+template <typename W>
+W
+SaturateCast (float v, std::true_type)
+{
+  if (std::isnan (v))
+    {
+      return 0;
+    }
+  // the limits are exact or rounded up to a power of 2 in double
+  double r = std::nearbyint (double (v));
+  if (r <= double (std::numeric_limits<W>::lowest ()))
+    {
+      return std::numeric_limits<W>::lowest ();
+    }
+  if (r >= double (std::numeric_limits<W>::max ()))
+    {
+      return std::numeric_limits<W>::max ();
+    }
+  return static_cast<W> (r);
+}
+
+template <typename W>
+W
+SaturateCast (float v, std::false_type)
+{
+  return static_cast<W> (v);
+}
+
+template <typename W>
+void
+EncodeAs (const float *values, size_t count, std::string &bytes)
+{
+  bytes.resize (count * sizeof (W));
+  for (size_t i = 0; i < count; i++)
+    {
+      W value = SaturateCast<W> (values[i], std::is_integral<W> ());
+      std::memcpy (&bytes[i * sizeof (W)], &value, sizeof (W));
+    }
+}
+
+// a per-element parameter given once for all elements or not at all
+bool
+ExpandParameter (const google::protobuf::RepeatedField<float> &field, uint32_t size, float fill,
+                 std::vector<float> &values)
+{
+  if (field.size () == 0 || field.size () == 1)
+    {
+      values.assign (size, field.size () ? field.Get (0) : fill);
+      return true;
+    }
+  values.assign (field.begin (), field.end ());
+  return values.size () == size;
+}
+
+} // namespace
+
+OpenGymPolicy::OpenGymPolicy ()
+    : m_inputSize (0), m_tableOutputs (0), m_epsilon (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+bool
+OpenGymPolicy::ReadFloats (const std::string &bytes, size_t count, std::vector<float> &values)
+{
+  if (bytes.size () != count * sizeof (float))
+    {
+      return false;
+    }
+  values.resize (count);
+  if (count > 0)
+    {
+      std::memcpy (values.data (), bytes.data (), bytes.size ());
+    }
+  return true;
+}
+
+bool
+OpenGymPolicy::Load (const ns3opengym::AgentPolicy &msg, std::string &error)
+{
+  NS_LOG_FUNCTION (this);
+  std::ostringstream reason;
+  m_tableDims.clear ();
+  m_table.clear ();
+  m_tableOutputs = 0;
+  m_layers.clear ();
+
+  if ((msg.tabledims_size () > 0) == (msg.layers_size () > 0))
+    {
+      error = "a policy needs either a table or layers";
+      return false;
+    }
+  if (msg.tabledims_size () > 0)
+    {
+      size_t rows = 1;
+      for (int i = 0; i < msg.tabledims_size (); i++)
+        {
+          uint32_t dim = msg.tabledims (i);
+          if (dim == 0 || rows > (size_t (1) << 32) / dim)
+            {
+              error = "invalid table dims";
+              return false;
+            }
+          rows *= dim;
+          m_tableDims.push_back (dim);
+        }
+      size_t count = msg.table ().size () / sizeof (float);
+      if (count == 0 || count % rows != 0 || !ReadFloats (msg.table (), count, m_table))
+        {
+          reason << "table of " << msg.table ().size () << " bytes for " << rows << " rows";
+          error = reason.str ();
+          return false;
+        }
+      m_tableOutputs = count / rows;
+      m_inputSize = m_tableDims.size ();
+    }
+  else
+    {
+      m_inputSize = msg.layers (0).inputs ();
+      uint32_t inputs = m_inputSize;
+      std::vector<float> weights;
+      for (int l = 0; l < msg.layers_size (); l++)
+        {
+          const ns3opengym::DenseLayer &layerMsg = msg.layers (l);
+          Layer layer;
+          layer.inputs = layerMsg.inputs ();
+          layer.outputs = layerMsg.outputs ();
+          layer.activation = layerMsg.activation ();
+          size_t count = size_t (layer.inputs) * layer.outputs;
+          if (layer.inputs != inputs || layer.outputs == 0 ||
+              !ReadFloats (layerMsg.weights (), count, weights) ||
+              (!layerMsg.bias ().empty () &&
+               !ReadFloats (layerMsg.bias (), layer.outputs, layer.bias)))
+            {
+              reason << "layer " << l << " with " << layer.inputs << " inputs and "
+                     << layer.outputs << " outputs does not fit";
+              error = reason.str ();
+              return false;
+            }
+          if (layerMsg.bias ().empty ())
+            {
+              layer.bias.assign (layer.outputs, 0);
+            }
+          // [outputs, inputs] -> [inputs, outputs]
+          layer.weights.resize (count);
+          for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+              for (uint32_t i = 0; i < layer.inputs; i++)
+                {
+                  layer.weights[size_t (i) * layer.outputs + o] = weights[size_t (o) * layer.inputs + i];
+                }
+            }
+          m_layers.push_back (layer);
+          inputs = layer.outputs;
+        }
+    }
+
+  if (m_inputSize == 0 || !ExpandParameter (msg.inputscale (), m_inputSize, 1, m_inputScale) ||
+      !ExpandParameter (msg.inputoffset (), m_inputSize, 0, m_inputOffset))
+    {
+      reason << "input scale or offset do not fit " << m_inputSize << " inputs";
+      error = reason.str ();
+      return false;
+    }
+  m_actionValues.assign (msg.actionvalues ().begin (), msg.actionvalues ().end ());
+  if (!m_actionValues.empty () && m_actionValues.size () != GetOutputSize ())
+    {
+      reason << m_actionValues.size () << " action values for " << GetOutputSize () << " outputs";
+      error = reason.str ();
+      return false;
+    }
+  m_epsilon = msg.epsilon ();
+  if (!(m_epsilon >= 0 && m_epsilon <= 1))
+    {
+      error = "epsilon outside [0, 1]";
+      return false;
+    }
+  m_input.resize (m_inputSize);
+  return true;
+}
+
+uint32_t
+OpenGymPolicy::GetInputSize () const
+{
+  return m_inputSize;
+}
+
+uint32_t
+OpenGymPolicy::GetOutputSize () const
+{
+  return m_layers.empty () ? m_tableOutputs : m_layers.back ().outputs;
+}
+
+const std::vector<float> &
+OpenGymPolicy::Evaluate (const float *obs)
+{
+  for (uint32_t i = 0; i < m_inputSize; i++)
+    {
+      m_input[i] = obs[i] * m_inputScale[i] + m_inputOffset[i];
+    }
+
+  if (m_layers.empty ())
+    {
+      size_t row = 0;
+      for (uint32_t i = 0; i < m_inputSize; i++)
+        {
+          // NaN and bins below 0 select the first bin, +inf and bins past the end the last
+          float bin = std::floor (m_input[i]);
+          uint32_t last = m_tableDims[i] - 1;
+          uint32_t idx = 0;
+          if (bin > 0)
+            {
+              idx = std::isfinite (bin) && double (bin) < last ? uint32_t (bin) : last;
+            }
+          row = row * m_tableDims[i] + idx;
+        }
+      const float *values = &m_table[row * m_tableOutputs];
+      m_hidden[0].assign (values, values + m_tableOutputs);
+      return m_hidden[0];
+    }
+
+  const float *x = m_input.data ();
+  std::vector<float> *y = 0;
+  for (size_t l = 0; l < m_layers.size (); l++)
+    {
+      const Layer &layer = m_layers[l];
+      y = &m_hidden[l % 2];
+      y->assign (layer.bias.begin (), layer.bias.end ());
+      float *out = y->data ();
+      for (uint32_t i = 0; i < layer.inputs; i++)
+        {
+          // out += x[i] * row i, contiguous in the transposed weights
+          const float xi = x[i];
+          const float *w = &layer.weights[size_t (i) * layer.outputs];
+          for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+              out[o] += w[o] * xi;
+            }
+        }
+      switch (layer.activation)
+        {
+        case ns3opengym::DenseLayer::RELU:
+          for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+              out[o] = out[o] > 0 ? out[o] : 0;
+            }
+          break;
+        case ns3opengym::DenseLayer::TANH:
+          for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+              out[o] = std::tanh (out[o]);
+            }
+          break;
+        case ns3opengym::DenseLayer::SIGMOID:
+          for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+              out[o] = 1 / (1 + std::exp (-out[o]));
+            }
+          break;
+        default:
+          break;
+        }
+      x = out;
+    }
+  return *y;
+}
+
+bool
+OpenGymPolicy::HasActionValues () const
+{
+  return !m_actionValues.empty ();
+}
+
+float
+OpenGymPolicy::GetActionValue (uint32_t output) const
+{
+  return m_actionValues.empty () ? output : m_actionValues[output];
+}
+
+float
+OpenGymPolicy::GetEpsilon () const
+{
+  return m_epsilon;
+}
+
+uint32_t
+OpenGymPolicy::Argmax (const std::vector<float> &values)
+{
+  return std::max_element (values.begin (), values.end ()) - values.begin ();
+}
+
+void
+OpenGymPolicy::EncodeFloats (ns3opengym::Dtype dtype, const float *values, size_t count,
+                             std::string &bytes)
+{
+  switch (dtype)
+    {
+    case ns3opengym::INT:
+      return EncodeAs<int32_t> (values, count, bytes);
+    case ns3opengym::UINT:
+      return EncodeAs<uint32_t> (values, count, bytes);
+    case ns3opengym::DOUBLE:
+      return EncodeAs<double> (values, count, bytes);
+    case ns3opengym::INT8:
+      return EncodeAs<int8_t> (values, count, bytes);
+    case ns3opengym::UINT8:
+      return EncodeAs<uint8_t> (values, count, bytes);
+    case ns3opengym::BOOL:
+      return EncodeAs<bool> (values, count, bytes);
+    case ns3opengym::INT16:
+      return EncodeAs<int16_t> (values, count, bytes);
+    case ns3opengym::UINT16:
+      return EncodeAs<uint16_t> (values, count, bytes);
+    case ns3opengym::INT64:
+      return EncodeAs<int64_t> (values, count, bytes);
+    case ns3opengym::UINT64:
+      return EncodeAs<uint64_t> (values, count, bytes);
+    default:
+      return EncodeAs<float> (values, count, bytes);
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,110 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * ********************************************************************************
+ *
+ * Policy offload for OpenGymMultiInterface: small policies pushed by the
+ * Python agent (ns3opengym::AgentPolicy) are evaluated in the simulation,
+ * so the steps between two synchronizations need no round trip.
+ *
+ * Author: Zhangmin Wang
+ */
+
+#ifndef OPENGYM_POLICY_H
+#define OPENGYM_POLICY_H
+
+#include "ns3/simple-ref-count.h"
+#include <string>
+#include <vector>
+#include "messages.pb.h"
+
+namespace ns3 {
+
+/**
+ * A lookup table indexed by the binned observation or a multi-layer
+ * perceptron. The layer weights are kept transposed, [inputs, outputs],
+ * so a layer is one loop over contiguous outputs per input that compilers
+ * vectorize without reassociating sums.
+ */
+class OpenGymPolicy : public SimpleRefCount<OpenGymPolicy>
+{
+public:
+  OpenGymPolicy ();
+
+  /**
+   * Take the weights of \p msg.
+   * \return false with the reason in \p error if its shapes do not fit
+   */
+  bool Load (const ns3opengym::AgentPolicy &msg, std::string &error);
+
+  // observation elements expected
+  uint32_t GetInputSize () const;
+  uint32_t GetOutputSize () const;
+
+  /**
+   * Outputs for one flattened observation of GetInputSize () elements.
+   * \return the outputs, valid until the next call
+   */
+  const std::vector<float> &Evaluate (const float *obs);
+
+  // the action is chosen by Argmax and mapped by GetActionValue
+  bool HasActionValues () const;
+  float GetActionValue (uint32_t output) const;
+  float GetEpsilon () const;
+  static uint32_t Argmax (const std::vector<float> &values);
+
+  /**
+   * Write \p count floats as little-endian elements of \p dtype, e.g.
+   * the raw tensor of a Box action. Integer elements are rounded and
+   * saturate at the limits of the dtype, NaN gives 0.
+   */
+  static void EncodeFloats (ns3opengym::Dtype dtype, const float *values, size_t count,
+                            std::string &bytes);
+
+private:
+  struct Layer
+  {
+    uint32_t inputs;
+    uint32_t outputs;
+    // [inputs, outputs]
+    std::vector<float> weights;
+    std::vector<float> bias;
+    ns3opengym::DenseLayer::Activation activation;
+  };
+
+  static bool ReadFloats (const std::string &bytes, size_t count, std::vector<float> &values);
+
+  uint32_t m_inputSize;
+  std::vector<float> m_inputScale;
+  std::vector<float> m_inputOffset;
+  // lookup table
+  std::vector<uint32_t> m_tableDims;
+  std::vector<float> m_table;
+  uint32_t m_tableOutputs;
+  // MLP
+  std::vector<Layer> m_layers;
+  std::vector<float> m_actionValues;
+  float m_epsilon;
+  // reused between calls
+  std::vector<float> m_input;
+  std::vector<float> m_hidden[2];
+};
+
+} // namespace ns3
+
+#endif /* OPENGYM_POLICY_H */
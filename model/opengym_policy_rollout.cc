@@ -0,0 +1,470 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Zhangmin Wang
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "ns3/log.h"
+#include "ns3/random-variable-stream.h"
+#include "opengym_policy_rollout.h"
+#include "opengym_multi_interface.h"
+#include "opengym_policy.h"
+#include "container.h"
+#include "spaces.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymPolicyRollout");
+
+OpenGymPolicyRollout::OpenGymPolicyRollout (OpenGymMultiInterface *iface)
+    : m_iface (iface), m_active (false), m_maxStaleness (0), m_steps (0), m_rowPending (false)
+{
+}
+
+OpenGymPolicyRollout::~OpenGymPolicyRollout ()
+{
+}
+
+bool
+OpenGymPolicyRollout::IsActive () const
+{
+  return m_active;
+}
+
+void
+OpenGymPolicyRollout::Stop ()
+{
+  m_active = false;
+}
+
+void
+OpenGymPolicyRollout::ClearPendingRow ()
+{
+  m_rowPending = false;
+}
+
+bool
+OpenGymPolicyRollout::Start (const ns3opengym::PolicyMsg &msg)
+{
+  NS_LOG_FUNCTION (this);
+  OpenGymMultiInterface &iface = *m_iface;
+  if (!m_rowPending)
+    {
+      // the rollout starts at the state the agent answered
+      DecodeRow ();
+    }
+  ns3opengym::PolicyRollout *rollout = m_msg.mutable_rollout ();
+  std::string error;
+  if (!LoadPolicies (msg, error))
+    {
+      NS_LOG_WARN ("Policy refused: " << error);
+      m_msg.clear_rollout ();
+      m_msg.mutable_rollout ()->set_error (error);
+      m_msg.set_stepidx (iface.m_stateMsg.stepidx ());
+      m_msg.set_ns3simulationend (iface.m_simEnd);
+      m_msg.set_episode (iface.m_episode);
+      iface.SendMsg (m_msg);
+      return false;
+    }
+  m_maxStaleness = msg.maxstaleness ();
+  m_steps = 0;
+  m_rowPending = false;
+  m_active = true;
+
+  uint32_t obsSize = 0;
+  for (size_t idx = 0; idx < m_obs.size (); idx++)
+    {
+      obsSize = std::max<uint32_t> (obsSize, m_obs[idx].size ());
+    }
+  uint32_t actionSize = 0;
+  for (size_t a = 0; a < m_actAgents.size (); a++)
+    {
+      const ns3opengym::AgentActMsg &agentActMsg = m_actMsg.agentactmsg (a);
+      const OpenGymPolicy &policy = *m_policies[m_agentPolicy[m_actAgents[a]]];
+      bool argmax = agentActMsg.actdata ().type () == ns3opengym::Discrete || policy.HasActionValues ();
+      actionSize = std::max<uint32_t> (actionSize, argmax ? 1 : m_actElements[a]);
+    }
+  rollout->Clear ();
+  for (size_t idx = 0; idx < iface.m_agentIdVec.size (); idx++)
+    {
+      rollout->add_agentids (iface.m_agentIdVec[idx]);
+    }
+  rollout->set_obssize (obsSize);
+  rollout->set_actionsize (actionSize);
+  AppendRow ();
+  Act ();
+  return true;
+}
+
+bool
+OpenGymPolicyRollout::LoadPolicies (const ns3opengym::PolicyMsg &msg, std::string &error)
+{
+  NS_LOG_FUNCTION (this);
+  OpenGymMultiInterface &iface = *m_iface;
+  std::ostringstream reason;
+  if (iface.m_agentSubsets)
+    {
+      error = "policy offload needs all agents to step together";
+      return false;
+    }
+  if (msg.policies_size () == 0)
+    {
+      // keep the policies of the previous rollout
+      if (m_policies.empty ())
+        {
+          error = "no policy loaded";
+          return false;
+        }
+      return true;
+    }
+
+  // a refused message keeps the loaded policies
+  std::vector<Ptr<OpenGymPolicy>> policies;
+  std::vector<int32_t> agentPolicy (iface.m_agentIdVec.size (), -1);
+  // policies for listed agents first, the others take the default
+  for (int pass = 0; pass < 2; pass++)
+    {
+      for (int p = 0; p < msg.policies_size (); p++)
+        {
+          const ns3opengym::AgentPolicy &policyMsg = msg.policies (p);
+          if ((policyMsg.agentids_size () == 0) != (pass == 1))
+            {
+              continue;
+            }
+          Ptr<OpenGymPolicy> policy = Create<OpenGymPolicy> ();
+          if (!policy->Load (policyMsg, error))
+            {
+              reason << "policy " << p << ": " << error;
+              error = reason.str ();
+              return false;
+            }
+          int32_t policyIdx = policies.size ();
+          policies.push_back (policy);
+          for (int i = 0; i < policyMsg.agentids_size (); i++)
+            {
+              std::map<uint32_t, uint32_t>::const_iterator index =
+                  iface.m_agentIndex.find (policyMsg.agentids (i));
+              if (index == iface.m_agentIndex.end ())
+                {
+                  reason << "policy " << p << ": unknown agent " << policyMsg.agentids (i);
+                  error = reason.str ();
+                  return false;
+                }
+              agentPolicy[index->second] = policyIdx;
+            }
+          for (size_t idx = 0; pass == 1 && idx < agentPolicy.size (); idx++)
+            {
+              if (agentPolicy[idx] < 0)
+                {
+                  agentPolicy[idx] = policyIdx;
+                }
+            }
+        }
+    }
+
+  // one action message per agent with a policy, filled in place each step
+  ns3opengym::MultiAgentActMsg actMsg;
+  std::vector<uint32_t> actAgents;
+  std::vector<uint32_t> actElements;
+  bool explore = false;
+  for (size_t idx = 0; idx < iface.m_agentIdVec.size (); idx++)
+    {
+      if (agentPolicy[idx] < 0)
+        {
+          continue;
+        }
+      uint32_t agent_id = iface.m_agentIdVec[idx];
+      const OpenGymPolicy &policy = *policies[agentPolicy[idx]];
+      if (m_obs[idx].size () != policy.GetInputSize ())
+        {
+          reason << "agent " << agent_id << ": " << m_obs[idx].size ()
+                 << " observation elements for " << policy.GetInputSize () << " inputs";
+          break;
+        }
+      Ptr<OpenGymSpace> space = iface.GetActionSpace (agent_id);
+      ns3opengym::SpaceDescription description;
+      if (space)
+        {
+          description = space->GetSpaceDescription ();
+        }
+      ns3opengym::AgentActMsg *agentActMsg = actMsg.add_agentactmsg ();
+      agentActMsg->set_agentid (agent_id);
+      ns3opengym::DataContainer *actData = agentActMsg->mutable_actdata ();
+      uint32_t elements = 1;
+      if (description.type () == ns3opengym::Discrete)
+        {
+          actData->set_type (ns3opengym::Discrete);
+        }
+      else if (description.type () == ns3opengym::Box)
+        {
+          ns3opengym::BoxSpace box;
+          description.space ().UnpackTo (&box);
+          actData->set_type (ns3opengym::Box);
+          ns3opengym::RawTensor *tensor = actData->mutable_tensor ();
+          // the action is decoded here, in the space's own element type
+          tensor->set_dtype (box.nativedtype () != ns3opengym::NoDType ? box.nativedtype ()
+                                                                       : box.dtype ());
+          tensor->mutable_shape ()->CopyFrom (box.shape ());
+          for (int i = 0; i < box.shape_size (); i++)
+            {
+              elements *= box.shape (i);
+            }
+          if (!policy.HasActionValues () && policy.GetOutputSize () != elements)
+            {
+              reason << "agent " << agent_id << ": " << policy.GetOutputSize ()
+                     << " outputs for " << elements << " action elements";
+              break;
+            }
+        }
+      else
+        {
+          reason << "agent " << agent_id << ": only Discrete and Box actions";
+          break;
+        }
+      actAgents.push_back (idx);
+      actElements.push_back (elements);
+      explore = explore || policy.GetEpsilon () > 0;
+    }
+  if (!reason.str ().empty ())
+    {
+      error = reason.str ();
+      return false;
+    }
+  m_policies.swap (policies);
+  m_agentPolicy.swap (agentPolicy);
+  m_actMsg.Swap (&actMsg);
+  m_actAgents.swap (actAgents);
+  m_actElements.swap (actElements);
+  if (explore && !m_rng)
+    {
+      m_rng = CreateObject<UniformRandomVariable> ();
+    }
+  return true;
+}
+
+void
+OpenGymPolicyRollout::GatherRow ()
+{
+  NS_LOG_FUNCTION (this);
+  OpenGymMultiInterface &iface = *m_iface;
+  iface.m_batchAgentIds.assign (iface.m_agentIdVec.begin (), iface.m_agentIdVec.end ());
+  size_t count = iface.m_batchAgentIds.size ();
+  if (!iface.m_obsBatchCb.IsNull ())
+    {
+      iface.m_batchObs.resize (count);
+      iface.m_obsBatchCb (iface.m_batchAgentIds, iface.m_batchObs);
+    }
+  if (!iface.m_rewardBatchCb.IsNull ())
+    {
+      iface.m_batchRewards.resize (count);
+      iface.m_rewardBatchCb (iface.m_batchAgentIds, iface.m_batchRewards);
+    }
+  if (!iface.m_doneBatchCb.IsNull ())
+    {
+      iface.m_batchDones.resize (count);
+      iface.m_doneBatchCb (iface.m_batchAgentIds, iface.m_batchDones);
+    }
+
+  m_obs.resize (count);
+  m_rewards.resize (count);
+  m_dones.resize (count);
+  for (size_t idx = 0; idx < count; idx++)
+    {
+      uint32_t agent_id = iface.m_batchAgentIds[idx];
+      std::vector<float> &obs = m_obs[idx];
+      bool hasObs;
+      if (!iface.m_obsBatchCb.IsNull ())
+        {
+          hasObs = iface.m_batchObs[idx].ToFloats (obs);
+        }
+      else if (!iface.m_obsDataCb.IsNull ())
+        {
+          hasObs = iface.m_obsDataCb (agent_id, iface.m_obsData[idx]) &&
+                   iface.m_obsData[idx].ToFloats (obs);
+        }
+      else
+        {
+          Ptr<OpenGymDataContainer> obsDataContainer = iface.GetObservation (agent_id);
+          hasObs = obsDataContainer && opengym::Data::FromContainer (obsDataContainer).ToFloats (obs);
+        }
+      if (!hasObs)
+        {
+          obs.clear ();
+        }
+      m_rewards[idx] = iface.m_rewardBatchCb.IsNull () ? iface.GetReward (agent_id)
+                                                        : iface.m_batchRewards[idx];
+      m_dones[idx] = iface.m_doneBatchCb.IsNull () ? iface.GetDone (agent_id)
+                                                    : iface.m_batchDones[idx];
+    }
+}
+
+void
+OpenGymPolicyRollout::DecodeRow ()
+{
+  NS_LOG_FUNCTION (this);
+  OpenGymMultiInterface &iface = *m_iface;
+  size_t count = iface.m_agentIdVec.size ();
+  m_obs.resize (count);
+  m_rewards.resize (count);
+  m_dones.resize (count);
+  ns3opengym::DataContainer full;
+  for (size_t idx = 0; idx < count; idx++)
+    {
+      const ns3opengym::AgentStateMsg &state = iface.m_agentStateMsgs[idx];
+      m_rewards[idx] = state.reward ();
+      m_dones[idx] = state.done ();
+      std::vector<float> &obs = m_obs[idx];
+      obs.clear ();
+      if (!state.has_obsdata ())
+        {
+          continue;
+        }
+      const ns3opengym::DataContainer *obsData = &state.obsdata ();
+      if (obsData->has_tensor () && obsData->tensor ().has_delta () &&
+          obsData->tensor ().delta ().encoding () != ns3opengym::TensorDelta::NONE)
+        {
+          // only the changes were sent, the whole observation is the reference
+          full.CopyFrom (*obsData);
+          full.mutable_tensor ()->set_data (iface.m_lastObs[idx].data ());
+          full.mutable_tensor ()->clear_delta ();
+          obsData = &full;
+        }
+      Ptr<OpenGymDataContainer> container = OpenGymDataContainer::CreateFromDataContainerPbMsg (*obsData);
+      if (!container || !opengym::Data::FromContainer (container).ToFloats (obs))
+        {
+          obs.clear ();
+        }
+    }
+}
+
+void
+OpenGymPolicyRollout::AppendRow ()
+{
+  NS_LOG_FUNCTION (this);
+  ns3opengym::PolicyRollout *rollout = m_msg.mutable_rollout ();
+  size_t count = m_obs.size ();
+  uint32_t obsSize = rollout->obssize ();
+  // missing elements stay zero, extra ones are cut
+  std::string *obs = rollout->mutable_obs ();
+  size_t offset = obs->size ();
+  obs->resize (offset + count * obsSize * sizeof (float));
+  for (size_t idx = 0; idx < count; idx++)
+    {
+      size_t size = std::min<size_t> (m_obs[idx].size (), obsSize);
+      if (size > 0)
+        {
+          std::memcpy (&(*obs)[offset + idx * obsSize * sizeof (float)], m_obs[idx].data (),
+                       size * sizeof (float));
+        }
+    }
+  std::string *rewards = rollout->mutable_rewards ();
+  if (count > 0)
+    {
+      rewards->append (reinterpret_cast<const char *> (m_rewards.data ()), count * sizeof (float));
+      rollout->mutable_dones ()->append (reinterpret_cast<const char *> (m_dones.data ()), count);
+    }
+  rollout->set_steps (rollout->steps () + 1);
+}
+
+void
+OpenGymPolicyRollout::Act ()
+{
+  NS_LOG_FUNCTION (this);
+  ns3opengym::PolicyRollout *rollout = m_msg.mutable_rollout ();
+  uint32_t actionSize = rollout->actionsize ();
+  // agents without a policy keep zero actions in the rollout
+  std::string *actions = rollout->mutable_actions ();
+  size_t offset = actions->size ();
+  actions->resize (offset + m_iface->m_agentIdVec.size () * actionSize * sizeof (float));
+  for (size_t a = 0; a < m_actAgents.size (); a++)
+    {
+      uint32_t idx = m_actAgents[a];
+      OpenGymPolicy &policy = *m_policies[m_agentPolicy[idx]];
+      // a done agent may have no observation
+      std::vector<float> &obs = m_obs[idx];
+      obs.resize (policy.GetInputSize (), 0);
+      const std::vector<float> &outputs = policy.Evaluate (obs.data ());
+
+      ns3opengym::DataContainer *actData = m_actMsg.mutable_agentactmsg (a)->mutable_actdata ();
+      uint32_t elements = m_actElements[a];
+      std::vector<float> &action = m_action;
+      if (actData->type () == ns3opengym::Discrete || policy.HasActionValues ())
+        {
+          uint32_t output = OpenGymPolicy::Argmax (outputs);
+          if (policy.GetEpsilon () > 0 && m_rng->GetValue () < policy.GetEpsilon ())
+            {
+              output = m_rng->GetInteger (0, outputs.size () - 1);
+            }
+          action.assign (1, policy.GetActionValue (output));
+        }
+      else
+        {
+          action.assign (outputs.begin (), outputs.end ());
+        }
+      std::memcpy (&(*actions)[offset + idx * actionSize * sizeof (float)], action.data (),
+                   std::min<size_t> (action.size (), actionSize) * sizeof (float));
+
+      if (actData->type () == ns3opengym::Discrete)
+        {
+          m_discrete.set_data (static_cast<int32_t> (std::nearbyint (action[0])));
+          actData->mutable_data ()->PackFrom (m_discrete);
+          continue;
+        }
+      // one action value for all elements
+      action.resize (elements, action[0]);
+      OpenGymPolicy::EncodeFloats (actData->tensor ().dtype (), action.data (), elements,
+                                   *actData->mutable_tensor ()->mutable_data ());
+    }
+  m_steps++;
+  m_iface->ExecuteLocalActions (m_actMsg);
+}
+
+void
+OpenGymPolicyRollout::Step ()
+{
+  NS_LOG_FUNCTION (this << m_steps);
+  OpenGymMultiInterface &iface = *m_iface;
+  GatherRow ();
+  AppendRow ();
+  bool allDone = !m_dones.empty ();
+  for (size_t idx = 0; idx < m_dones.size (); idx++)
+    {
+      allDone = allDone && m_dones[idx];
+    }
+  if (!iface.m_simEnd && !allDone && (m_maxStaleness == 0 || m_steps < m_maxStaleness))
+    {
+      Act ();
+      return;
+    }
+
+  // the rollout replaces the state, its last row is the current state
+  m_rowPending = true;
+  iface.m_stateMsg.set_stepidx (iface.m_stepIdx++);
+  m_msg.set_stepidx (iface.m_stateMsg.stepidx ());
+  m_msg.set_ns3simulationend (iface.m_simEnd);
+  m_msg.set_episode (iface.m_episode);
+  iface.SendMsg (m_msg);
+  iface.ReceiveActions ();
+  iface.HandleReply ();
+}
+
+} // namespace ns3
@@ -0,0 +1,110 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * ********************************************************************************
+ *
+ * Policy rollouts for OpenGymMultiInterface: the simulation steps with the
+ * policies of a ns3opengym::PolicyMsg (OpenGymPolicy) and records the steps.
+ *
+ * Author: Zhangmin Wang
+ */
+
+#ifndef OPENGYM_POLICY_ROLLOUT_H
+#define OPENGYM_POLICY_ROLLOUT_H
+
+#include "ns3/ptr.h"
+#include <string>
+#include <vector>
+#include "messages.pb.h"
+
+namespace ns3 {
+
+class OpenGymMultiInterface;
+class OpenGymPolicy;
+class UniformRandomVariable;
+
+/**
+ * Policy offload (lockstep without workers, StepDeadline and per-agent
+ * step intervals): instead of actions the agent may send a PolicyMsg with
+ * lookup tables or small MLPs. The simulation then chooses and executes
+ * the actions itself and records every step. After maxStaleness steps,
+ * when all agents are done or at the end of the simulation it sends the
+ * recorded steps (PolicyRollout) instead of a state and waits for the
+ * agent: new weights, the same ones (a PolicyMsg without policies) or
+ * anything else, which ends the offload. Only observations, rewards and
+ * dones are gathered while offloaded, infos are not.
+ */
+class OpenGymPolicyRollout
+{
+public:
+  OpenGymPolicyRollout (OpenGymMultiInterface *iface);
+  ~OpenGymPolicyRollout ();
+
+  // true while the policies act
+  bool IsActive () const;
+  /**
+   * Load the policies of \p msg and act on the current state.
+   * \return false if refused, the error is sent to the agent
+   */
+  bool Start (const ns3opengym::PolicyMsg &msg);
+  // record the step and act, or send the rollout and handle the reply
+  void Step ();
+  // the agent answered the rollout, the policies stop acting
+  void Stop ();
+  // the last row of the rollout sent is no longer the current state
+  void ClearPendingRow ();
+
+private:
+  bool LoadPolicies (const ns3opengym::PolicyMsg &msg, std::string &error);
+  // observations, rewards and dones of all agents from the callbacks
+  void GatherRow ();
+  // the same decoded from the last state sent, the callbacks are not
+  // called again
+  void DecodeRow ();
+  void AppendRow ();
+  void Act ();
+
+  OpenGymMultiInterface *m_iface;
+  bool m_active;
+  uint32_t m_maxStaleness;
+  // actions executed since the rollout started
+  uint32_t m_steps;
+  std::vector<Ptr<OpenGymPolicy>> m_policies;
+  // per agent index: index in m_policies, -1 without
+  std::vector<int32_t> m_agentPolicy;
+  // actions of a step, one per agent with a policy, with the agent index
+  // and Box element count of each
+  ns3opengym::MultiAgentActMsg m_actMsg;
+  std::vector<uint32_t> m_actAgents;
+  std::vector<uint32_t> m_actElements;
+  ns3opengym::DiscreteDataContainer m_discrete;
+  // last state gathered, per agent index
+  std::vector<std::vector<float>> m_obs;
+  std::vector<float> m_rewards;
+  std::vector<uint8_t> m_dones;
+  // the last row of the rollout sent, the next policy starts there
+  bool m_rowPending;
+  std::vector<float> m_action;
+  // rollout or error answering a PolicyMsg
+  ns3opengym::MultiAgentStateMsg m_msg;
+  Ptr<UniformRandomVariable> m_rng;
+};
+
+} // namespace ns3
+
+#endif // OPENGYM_POLICY_ROLLOUT_H
@@ -0,0 +1,373 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Zhangmin Wang
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "ns3/log.h"
+#include "opengym_shm_channel.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymShmChannel");
+
+namespace {
+
+const uint32_t SHM_MAGIC = 0x4733534e; // "NS3G"
+const uint32_t SHM_VERSION = 1;
+const uint32_t SHM_RING0_HEADER = 64;
+const uint32_t SHM_RING1_HEADER = 256;
+const uint32_t SHM_DATA = 512;
+const uint32_t SHM_SKIP = 0xFFFFFFFF;
+const uint32_t SHM_SPIN = 2000;
+
+inline uint32_t
+RecordSize (uint32_t size)
+{
+  return (4 + size + 7) & ~7u;
+}
+
+} // namespace
+
+OpenGymShmChannel::OpenGymShmChannel ()
+    : m_fd (-1), m_base (0), m_size (0), m_capacity (0), m_pendingRx (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymShmChannel::~OpenGymShmChannel ()
+{
+  NS_LOG_FUNCTION (this);
+  Close ();
+}
+
+std::string
+OpenGymShmChannel::GetSegmentName (uint32_t port)
+{
+  return "/ns3gym-" + std::to_string (port);
+}
+
+bool
+OpenGymShmChannel::Open (std::string name)
+{
+  NS_LOG_FUNCTION (this << name);
+  // wait for the agent to create and initialize the segment
+  while (true)
+    {
+      m_fd = shm_open (name.c_str (), O_RDWR, 0600);
+      if (m_fd >= 0)
+        {
+          struct stat st;
+          if (fstat (m_fd, &st) == 0 && st.st_size > SHM_DATA)
+            {
+              uint32_t magic = 0;
+              if (pread (m_fd, &magic, sizeof (magic), 0) == sizeof (magic) && magic == SHM_MAGIC)
+                {
+                  m_size = st.st_size;
+                  break;
+                }
+            }
+          close (m_fd);
+          m_fd = -1;
+        }
+      else if (errno != ENOENT)
+        {
+          NS_LOG_ERROR ("shm_open " << name << " failed: " << std::strerror (errno));
+          return false;
+        }
+      usleep (1000);
+    }
+
+  void *addr = mmap (0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (addr == MAP_FAILED)
+    {
+      NS_LOG_ERROR ("mmap " << name << " failed: " << std::strerror (errno));
+      close (m_fd);
+      m_fd = -1;
+      return false;
+    }
+  m_base = static_cast<uint8_t *> (addr);
+
+  uint32_t version;
+  std::memcpy (&version, m_base + 4, sizeof (version));
+  std::memcpy (&m_capacity, m_base + 8, sizeof (m_capacity));
+  if (version != SHM_VERSION || SHM_DATA + 2 * (size_t) m_capacity > m_size)
+    {
+      NS_LOG_ERROR ("Unsupported shm segment " << name << " version: " << version
+                                               << " capacity: " << m_capacity);
+      Close ();
+      return false;
+    }
+
+  MapRing (m_tx, SHM_RING0_HEADER, SHM_DATA);
+  MapRing (m_rx, SHM_RING1_HEADER, SHM_DATA + m_capacity);
+  return true;
+}
+
+bool
+OpenGymShmChannel::Create (std::string name, uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << name << capacity);
+  m_capacity = 8;
+  while (m_capacity < capacity)
+    {
+      m_capacity <<= 1;
+    }
+  m_size = SHM_DATA + 2 * (size_t) m_capacity;
+
+  shm_unlink (name.c_str ());
+  m_fd = shm_open (name.c_str (), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (m_fd < 0 || ftruncate (m_fd, m_size) != 0)
+    {
+      NS_LOG_ERROR ("Cannot create shm segment " << name << ": " << std::strerror (errno));
+      Close ();
+      return false;
+    }
+  m_createdName = name;
+
+  void *addr = mmap (0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (addr == MAP_FAILED)
+    {
+      NS_LOG_ERROR ("mmap " << name << " failed: " << std::strerror (errno));
+      Close ();
+      return false;
+    }
+  m_base = static_cast<uint8_t *> (addr);
+
+  MapRing (m_rx, SHM_RING0_HEADER, SHM_DATA);
+  MapRing (m_tx, SHM_RING1_HEADER, SHM_DATA + m_capacity);
+  // magic is written last, the simulation waits for it
+  std::memcpy (m_base + 4, &SHM_VERSION, sizeof (SHM_VERSION));
+  std::memcpy (m_base + 8, &m_capacity, sizeof (m_capacity));
+  reinterpret_cast<std::atomic<uint32_t> *> (m_base)->store (SHM_MAGIC, std::memory_order_release);
+  return true;
+}
+
+void
+OpenGymShmChannel::Close ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_base)
+    {
+      munmap (m_base, m_size);
+      m_base = 0;
+    }
+  if (m_fd >= 0)
+    {
+      close (m_fd);
+      m_fd = -1;
+    }
+  if (!m_createdName.empty ())
+    {
+      shm_unlink (m_createdName.c_str ());
+      m_createdName.clear ();
+    }
+}
+
+void
+OpenGymShmChannel::MapRing (Ring &ring, uint32_t headerOffset, uint32_t dataOffset)
+{
+  uint8_t *header = m_base + headerOffset;
+  ring.head = reinterpret_cast<std::atomic<uint64_t> *> (header);
+  ring.tail = reinterpret_cast<std::atomic<uint64_t> *> (header + 64);
+  ring.dataSeq = reinterpret_cast<std::atomic<uint32_t> *> (header + 128);
+  ring.spaceSeq = reinterpret_cast<std::atomic<uint32_t> *> (header + 132);
+  ring.dataWaiters = reinterpret_cast<std::atomic<uint32_t> *> (header + 136);
+  ring.spaceWaiters = reinterpret_cast<std::atomic<uint32_t> *> (header + 140);
+  ring.data = m_base + dataOffset;
+}
+
+uint32_t
+OpenGymShmChannel::GetCapacity () const
+{
+  return m_capacity;
+}
+
+int64_t
+OpenGymShmChannel::MonotonicNs ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return int64_t (ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool
+OpenGymShmChannel::Wait (std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters,
+                         uint32_t expected, int64_t timeoutNs)
+{
+  struct timespec ts;
+  struct timespec *tsp = 0;
+  if (timeoutNs >= 0)
+    {
+      ts.tv_sec = timeoutNs / 1000000000;
+      ts.tv_nsec = timeoutNs % 1000000000;
+      tsp = &ts;
+    }
+  waiters->fetch_add (1);
+  long rc = syscall (SYS_futex, reinterpret_cast<uint32_t *> (seq), FUTEX_WAIT, expected, tsp, 0, 0);
+  waiters->fetch_sub (1);
+  return !(rc != 0 && errno == ETIMEDOUT);
+}
+
+void
+OpenGymShmChannel::Wake (std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters)
+{
+  seq->fetch_add (1);
+  if (waiters->load () > 0)
+    {
+      syscall (SYS_futex, reinterpret_cast<uint32_t *> (seq), FUTEX_WAKE, 1, 0, 0, 0);
+    }
+}
+
+uint8_t *
+OpenGymShmChannel::Reserve (uint32_t size, int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this << size << timeoutMs);
+  uint32_t need = RecordSize (size);
+  if (need > m_capacity / 2)
+    {
+      NS_FATAL_ERROR ("Message of " << size << " bytes does not fit shm ring of " << m_capacity
+                                    << " bytes, increase shmSize on the Python side");
+    }
+
+  uint64_t head = m_tx.head->load (std::memory_order_relaxed);
+  uint32_t offset = head & (m_capacity - 1);
+  // keep every record contiguous, skip the unused end of the ring
+  uint32_t skip = (m_capacity - offset < need) ? m_capacity - offset : 0;
+
+  int64_t deadline = timeoutMs >= 0 ? MonotonicNs () + timeoutMs * 1000000 : -1;
+  uint32_t spin = 0;
+  while (true)
+    {
+      uint32_t seq = m_tx.spaceSeq->load ();
+      uint64_t tail = m_tx.tail->load (std::memory_order_acquire);
+      if (m_capacity - (head - tail) >= skip + need)
+        {
+          break;
+        }
+      if (++spin < SHM_SPIN)
+        {
+          continue;
+        }
+      int64_t remaining = -1;
+      if (deadline >= 0)
+        {
+          remaining = std::max<int64_t> (deadline - MonotonicNs (), 0);
+        }
+      if (!Wait (m_tx.spaceSeq, m_tx.spaceWaiters, seq, remaining))
+        {
+          return 0;
+        }
+    }
+
+  if (skip)
+    {
+      std::memcpy (m_tx.data + offset, &SHM_SKIP, sizeof (SHM_SKIP));
+      m_tx.head->store (head + skip, std::memory_order_release);
+      offset = 0;
+    }
+  std::memcpy (m_tx.data + offset, &size, sizeof (size));
+  return m_tx.data + offset + 4;
+}
+
+void
+OpenGymShmChannel::Commit (uint32_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  uint64_t head = m_tx.head->load (std::memory_order_relaxed);
+  m_tx.head->store (head + RecordSize (size), std::memory_order_release);
+  Wake (m_tx.dataSeq, m_tx.dataWaiters);
+}
+
+bool
+OpenGymShmChannel::Send (const void *data, uint32_t size, int64_t timeoutMs)
+{
+  uint8_t *dst = Reserve (size, timeoutMs);
+  if (!dst)
+    {
+      return false;
+    }
+  std::memcpy (dst, data, size);
+  Commit (size);
+  return true;
+}
+
+const uint8_t *
+OpenGymShmChannel::Receive (uint32_t &size, int64_t timeoutMs)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (m_pendingRx == 0, "Release previous shm record first");
+
+  // wakes without a record (e.g. a skip marker) must not restart the timeout
+  int64_t deadline = timeoutMs >= 0 ? MonotonicNs () + timeoutMs * 1000000 : -1;
+  uint32_t spin = 0;
+  while (true)
+    {
+      uint32_t seq = m_rx.dataSeq->load ();
+      uint64_t tail = m_rx.tail->load (std::memory_order_relaxed);
+      uint64_t head = m_rx.head->load (std::memory_order_acquire);
+      if (head != tail)
+        {
+          uint32_t offset = tail & (m_capacity - 1);
+          std::memcpy (&size, m_rx.data + offset, sizeof (size));
+          if (size == SHM_SKIP)
+            {
+              m_rx.tail->store (tail + (m_capacity - offset), std::memory_order_release);
+              Wake (m_rx.spaceSeq, m_rx.spaceWaiters);
+              continue;
+            }
+          m_pendingRx = RecordSize (size);
+          return m_rx.data + offset + 4;
+        }
+      if (++spin < SHM_SPIN)
+        {
+          continue;
+        }
+      int64_t remaining = -1;
+      if (deadline >= 0)
+        {
+          remaining = std::max<int64_t> (deadline - MonotonicNs (), 0);
+        }
+      if (!Wait (m_rx.dataSeq, m_rx.dataWaiters, seq, remaining))
+        {
+          size = 0;
+          return 0;
+        }
+    }
+}
+
+void
+OpenGymShmChannel::Release ()
+{
+  NS_LOG_FUNCTION (this);
+  uint64_t tail = m_rx.tail->load (std::memory_order_relaxed);
+  m_rx.tail->store (tail + m_pendingRx, std::memory_order_release);
+  m_pendingRx = 0;
+  Wake (m_rx.spaceSeq, m_rx.spaceWaiters);
+}
+
+} // namespace ns3
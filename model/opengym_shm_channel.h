@@ -0,0 +1,134 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2019
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * ********************************************************************************
+ *
+ * Same-host transport for OpenGymMultiInterface. The Python agent creates a
+ * POSIX shared memory segment "/ns3gym-<port>" holding two single-producer /
+ * single-consumer byte rings (sim -> agent and agent -> sim). Every record is
+ * stored contiguously, so both sides parse payloads in place. A blocked side
+ * sleeps on a futex placed in the segment.
+ *
+ * Segment layout (all offsets in bytes, little-endian):
+ *     0  uint32 magic ("NS3G")
+ *     4  uint32 version
+ *     8  uint32 ring capacity (power of two, multiple of 8)
+ *    64  ring 0 header (sim -> agent)
+ *   256  ring 1 header (agent -> sim)
+ *   512  ring 0 data, followed by ring 1 data
+ *
+ * Ring header (relative to its start):
+ *     0  uint64 head (bytes written)
+ *    64  uint64 tail (bytes consumed)
+ *   128  uint32 data sequence (futex word of the consumer)
+ *   132  uint32 space sequence (futex word of the producer)
+ *   136  uint32 data waiters
+ *   140  uint32 space waiters
+ *
+ * Record: uint32 length, payload, padded to 8 bytes. A length of 0xFFFFFFFF
+ * marks the unused end of the ring, the next record starts at offset 0.
+ *
+ * Author: Zhangmin Wang
+ */
+
+#ifndef OPENGYM_SHM_CHANNEL_H
+#define OPENGYM_SHM_CHANNEL_H
+
+#include "ns3/simple-ref-count.h"
+#include <atomic>
+#include <string>
+
+namespace ns3 {
+
+class OpenGymShmChannel : public SimpleRefCount<OpenGymShmChannel>
+{
+public:
+  OpenGymShmChannel ();
+  ~OpenGymShmChannel ();
+
+  static std::string GetSegmentName (uint32_t port);
+
+  /**
+   * Attach to the segment created by the Python agent.
+   * Blocks until the segment exists, similar to zmq connect.
+   */
+  bool Open (std::string name);
+  /**
+   * Create the segment the way the Python agent does and use the agent
+   * side of it (receive on ring 0, send on ring 1). Drives an interface
+   * without a Python process, e.g. in tests. Close unlinks the segment.
+   * \param capacity ring size in bytes, rounded up to a power of two
+   */
+  bool Create (std::string name, uint32_t capacity);
+  void Close ();
+
+  /**
+   * Reserve a contiguous region of \p size bytes in the outgoing ring.
+   * The caller writes the payload and then calls Commit with the same size.
+   * \param timeoutMs -1 blocks forever
+   * \return 0 if the ring had no room before the timeout
+   */
+  uint8_t *Reserve (uint32_t size, int64_t timeoutMs = -1);
+  void Commit (uint32_t size);
+  bool Send (const void *data, uint32_t size, int64_t timeoutMs = -1);
+
+  /**
+   * Wait for the next incoming record and return a pointer into the ring.
+   * The payload stays valid until Release is called.
+   * \param timeoutMs -1 blocks forever
+   * \return 0 if nothing arrived before the timeout
+   */
+  const uint8_t *Receive (uint32_t &size, int64_t timeoutMs = -1);
+  void Release ();
+
+  uint32_t GetCapacity () const;
+
+private:
+  struct Ring
+  {
+    std::atomic<uint64_t> *head;
+    std::atomic<uint64_t> *tail;
+    std::atomic<uint32_t> *dataSeq;
+    std::atomic<uint32_t> *spaceSeq;
+    std::atomic<uint32_t> *dataWaiters;
+    std::atomic<uint32_t> *spaceWaiters;
+    uint8_t *data;
+  };
+
+  void MapRing (Ring &ring, uint32_t headerOffset, uint32_t dataOffset);
+  static int64_t MonotonicNs ();
+  // timeoutNs -1 blocks forever, false once it elapsed
+  static bool Wait (std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters,
+                    uint32_t expected, int64_t timeoutNs);
+  static void Wake (std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters);
+
+  int m_fd;
+  // set if the segment was created (and is unlinked) by this channel
+  std::string m_createdName;
+  uint8_t *m_base;
+  size_t m_size;
+  uint32_t m_capacity;
+
+  Ring m_tx;
+  Ring m_rx;
+  uint32_t m_pendingRx;
+};
+
+} // namespace ns3
+
+#endif /* OPENGYM_SHM_CHANNEL_H */
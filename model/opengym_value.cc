@@ -0,0 +1,476 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2018 Piotr Gawlowicz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Piotr Gawlowicz <gawlowicz.p@gmail.com>
+ *
+ */
+
+#include "ns3/log.h"
+#include "opengym_value.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("OpenGymValue");
+
+namespace opengym {
+
+namespace {
+
+template <typename W>
+void
+AssignBytes(const google::protobuf::RepeatedField<W> &field, std::string &bytes)
+{
+  bytes.assign(reinterpret_cast<const char *>(field.data()), field.size() * sizeof(W));
+}
+
+// dtypes every raw tensor version sends as they are
+bool
+IsLegacyDtype(ns3opengym::Dtype dtype)
+{
+  return dtype == ns3opengym::INT || dtype == ns3opengym::UINT ||
+         dtype == ns3opengym::FLOAT || dtype == ns3opengym::DOUBLE;
+}
+
+const std::string g_noKey;
+
+} // namespace
+
+Data::Data ()
+  : m_type(ns3opengym::NoSpaceType),
+    m_n(0),
+    m_value(0),
+    m_dtype(ns3opengym::NoDType),
+    m_size(0)
+{
+}
+
+Data::Data (const Discrete &discrete)
+  : Data()
+{
+  Set(discrete);
+}
+
+Data::Data (const Tuple &tuple)
+  : Data()
+{
+  Set(tuple);
+}
+
+Data::Data (const Dict &dict)
+  : Data()
+{
+  Set(dict);
+}
+
+ns3opengym::SpaceType
+Data::GetType() const
+{
+  return m_type;
+}
+
+void
+Data::Set(const Discrete &discrete)
+{
+  m_type = ns3opengym::Discrete;
+  m_n = discrete.n;
+  m_value = discrete.value;
+}
+
+void
+Data::Set(const Tuple &tuple)
+{
+  SetElements(ns3opengym::Tuple, tuple.elements.size());
+  for (size_t i = 0; i < m_size; i++) {
+    m_elements[i] = tuple.elements[i];
+    m_keys[i].clear();
+  }
+}
+
+void
+Data::Set(const Dict &dict)
+{
+  SetElements(ns3opengym::Dict, dict.elements.size());
+  for (size_t i = 0; i < m_size; i++) {
+    m_keys[i] = dict.elements[i].first;
+    m_elements[i] = dict.elements[i].second;
+  }
+}
+
+bool
+Data::Get(Discrete &discrete) const
+{
+  if (m_type != ns3opengym::Discrete) {
+    return false;
+  }
+  discrete.n = m_n;
+  discrete.value = m_value;
+  return true;
+}
+
+bool
+Data::Get(Tuple &tuple) const
+{
+  if (m_type != ns3opengym::Tuple) {
+    return false;
+  }
+  tuple.elements.assign(m_elements.begin(), m_elements.begin() + m_size);
+  return true;
+}
+
+bool
+Data::Get(Dict &dict) const
+{
+  if (m_type != ns3opengym::Dict) {
+    return false;
+  }
+  dict.elements.clear();
+  for (size_t i = 0; i < m_size; i++) {
+    dict.elements.push_back(std::make_pair(m_keys[i], m_elements[i]));
+  }
+  return true;
+}
+
+uint32_t
+Data::GetValue() const
+{
+  return m_type == ns3opengym::Discrete ? m_value : 0;
+}
+
+ns3opengym::Dtype
+Data::GetDtype() const
+{
+  return m_dtype;
+}
+
+const std::vector<uint32_t> &
+Data::GetShape() const
+{
+  return m_shape;
+}
+
+bool
+Data::ToFloats(std::vector<float> &values) const
+{
+  if (m_type == ns3opengym::Discrete) {
+    values.assign(1, m_value);
+    return true;
+  }
+  if (m_type != ns3opengym::Box) {
+    return false;
+  }
+  switch (m_dtype) {
+    case ns3opengym::INT:
+      Decode<int32_t>(m_bytes, values);
+      break;
+    case ns3opengym::UINT:
+      Decode<uint32_t>(m_bytes, values);
+      break;
+    case ns3opengym::DOUBLE:
+      Decode<double>(m_bytes, values);
+      break;
+    case ns3opengym::INT8:
+      Decode<int8_t>(m_bytes, values);
+      break;
+    case ns3opengym::UINT8:
+    case ns3opengym::BOOL:
+      Decode<uint8_t>(m_bytes, values);
+      break;
+    case ns3opengym::INT16:
+      Decode<int16_t>(m_bytes, values);
+      break;
+    case ns3opengym::UINT16:
+      Decode<uint16_t>(m_bytes, values);
+      break;
+    case ns3opengym::INT64:
+      Decode<int64_t>(m_bytes, values);
+      break;
+    case ns3opengym::UINT64:
+      Decode<uint64_t>(m_bytes, values);
+      break;
+    default:
+      Decode<float>(m_bytes, values);
+      break;
+  }
+  return true;
+}
+
+size_t
+Data::GetElementCount() const
+{
+  return m_size;
+}
+
+const Data &
+Data::GetElement(size_t idx) const
+{
+  NS_ASSERT_MSG(idx < m_size, "No element " << idx);
+  return m_elements[idx];
+}
+
+const std::string &
+Data::GetKey(size_t idx) const
+{
+  return idx < m_size ? m_keys[idx] : g_noKey;
+}
+
+const Data *
+Data::Find(const std::string &key) const
+{
+  for (size_t i = 0; i < m_size; i++) {
+    if (m_keys[i] == key) {
+      return &m_elements[i];
+    }
+  }
+  return 0;
+}
+
+void
+Data::SetBox(ns3opengym::Dtype dtype)
+{
+  m_type = ns3opengym::Box;
+  m_dtype = dtype;
+}
+
+void
+Data::SetElements(ns3opengym::SpaceType type, size_t count)
+{
+  m_type = type;
+  // elements beyond count keep their buffers for the next Set
+  if (m_elements.size() < count) {
+    m_elements.resize(count);
+    m_keys.resize(count);
+  }
+  m_size = count;
+}
+
+void
+Data::Fill(ns3opengym::DataContainer &dataContainerPbMsg, uint32_t rawTensorVersion) const
+{
+  switch (m_type) {
+    case ns3opengym::Discrete: {
+      ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+      discreteContainerPbMsg.set_data(m_value);
+      dataContainerPbMsg.set_type(ns3opengym::Discrete);
+      google::protobuf::Any *any = dataContainerPbMsg.mutable_data();
+      if (any->Is<ns3opengym::DiscreteDataContainer>()) {
+        discreteContainerPbMsg.SerializeToString(any->mutable_value());
+      } else {
+        any->PackFrom(discreteContainerPbMsg);
+      }
+      break;
+    }
+    case ns3opengym::Box: {
+      if (!rawTensorVersion || (rawTensorVersion < 3 && !IsLegacyDtype(m_dtype))) {
+        // the agent needs a conversion, leave it to the containers
+        ToContainer()->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+        break;
+      }
+      dataContainerPbMsg.set_type(ns3opengym::Box);
+      ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor();
+      tensor->set_dtype(m_dtype);
+      tensor->mutable_shape()->Clear();
+      tensor->mutable_shape()->Add(m_shape.begin(), m_shape.end());
+      tensor->mutable_data()->assign(m_bytes);
+      break;
+    }
+    case ns3opengym::Tuple: {
+      dataContainerPbMsg.set_type(ns3opengym::Tuple);
+      ns3opengym::TupleDataContainer tupleContainerPbMsg;
+      for (size_t i = 0; i < m_size; i++) {
+        m_elements[i].Fill(*tupleContainerPbMsg.add_element(), rawTensorVersion);
+      }
+      dataContainerPbMsg.mutable_data()->PackFrom(tupleContainerPbMsg);
+      break;
+    }
+    case ns3opengym::Dict: {
+      dataContainerPbMsg.set_type(ns3opengym::Dict);
+      ns3opengym::DictDataContainer dictContainerPbMsg;
+      for (size_t i = 0; i < m_size; i++) {
+        ns3opengym::DataContainer *subDataContainer = dictContainerPbMsg.add_element();
+        m_elements[i].Fill(*subDataContainer, rawTensorVersion);
+        subDataContainer->set_name(m_keys[i]);
+      }
+      dataContainerPbMsg.mutable_data()->PackFrom(dictContainerPbMsg);
+      break;
+    }
+    default:
+      dataContainerPbMsg.Clear();
+      break;
+  }
+}
+
+bool
+Data::Update(const ns3opengym::DataContainer &dataContainerPbMsg)
+{
+  switch (dataContainerPbMsg.type()) {
+    case ns3opengym::Discrete: {
+      ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+      if (!dataContainerPbMsg.data().UnpackTo(&discreteContainerPbMsg)) {
+        return false;
+      }
+      // n is not sent, keep the one of the last Discrete
+      if (m_type != ns3opengym::Discrete) {
+        m_n = 0;
+      }
+      m_type = ns3opengym::Discrete;
+      m_value = discreteContainerPbMsg.data();
+      return true;
+    }
+    case ns3opengym::MultiBinary:
+      if (dataContainerPbMsg.has_tensor()) {
+        // a bool Box, one byte per bit
+        const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+        uint32_t n = tensor.shape_size() ? tensor.shape(0) : 0;
+        if (tensor.data().size() != (n + 7) / 8) {
+          return false;
+        }
+        SetBox(ns3opengym::BOOL);
+        m_shape.assign(1, n);
+        m_bytes.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+          m_bytes[i] = (static_cast<uint8_t>(tensor.data()[i / 8]) >> (i % 8)) & 1;
+        }
+        return true;
+      }
+      // fall through, uintData of a BoxDataContainer
+    case ns3opengym::MultiDiscrete:
+    // a Box of the wire dtype
+    case ns3opengym::Box: {
+      if (dataContainerPbMsg.has_tensor()) {
+        const ns3opengym::RawTensor &tensor = dataContainerPbMsg.tensor();
+        SetBox(tensor.dtype());
+        m_shape.assign(tensor.shape().begin(), tensor.shape().end());
+        m_bytes.assign(tensor.data());
+        return true;
+      }
+      ns3opengym::BoxDataContainer boxContainerPbMsg;
+      if (!dataContainerPbMsg.data().UnpackTo(&boxContainerPbMsg)) {
+        return false;
+      }
+      m_shape.assign(boxContainerPbMsg.shape().begin(), boxContainerPbMsg.shape().end());
+      ns3opengym::Dtype dtype = boxContainerPbMsg.dtype();
+      if (dtype >= ns3opengym::INT8) {
+        m_bytes.assign(boxContainerPbMsg.packeddata());
+      } else if (dtype == ns3opengym::INT) {
+        AssignBytes(boxContainerPbMsg.intdata(), m_bytes);
+      } else if (dtype == ns3opengym::UINT) {
+        AssignBytes(boxContainerPbMsg.uintdata(), m_bytes);
+      } else if (dtype == ns3opengym::DOUBLE) {
+        AssignBytes(boxContainerPbMsg.doubledata(), m_bytes);
+      } else {
+        dtype = ns3opengym::FLOAT;
+        AssignBytes(boxContainerPbMsg.floatdata(), m_bytes);
+      }
+      SetBox(dtype);
+      return true;
+    }
+    case ns3opengym::Tuple: {
+      ns3opengym::TupleDataContainer tupleContainerPbMsg;
+      if (!dataContainerPbMsg.data().UnpackTo(&tupleContainerPbMsg)) {
+        return false;
+      }
+      SetElements(ns3opengym::Tuple, tupleContainerPbMsg.element_size());
+      for (size_t i = 0; i < m_size; i++) {
+        m_elements[i].Update(tupleContainerPbMsg.element(i));
+        m_keys[i].clear();
+      }
+      return true;
+    }
+    case ns3opengym::Dict: {
+      ns3opengym::DictDataContainer dictContainerPbMsg;
+      if (!dataContainerPbMsg.data().UnpackTo(&dictContainerPbMsg)) {
+        return false;
+      }
+      SetElements(ns3opengym::Dict, dictContainerPbMsg.element_size());
+      for (size_t i = 0; i < m_size; i++) {
+        m_elements[i].Update(dictContainerPbMsg.element(i));
+        m_keys[i] = dictContainerPbMsg.element(i).name();
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+Ptr<OpenGymDataContainer>
+Data::ToContainer() const
+{
+  switch (m_type) {
+    case ns3opengym::Discrete: {
+      Ptr<OpenGymDiscreteContainer> discrete = CreateObject<OpenGymDiscreteContainer>(m_n);
+      discrete->SetValue(m_value);
+      return discrete;
+    }
+    case ns3opengym::Box: {
+      // the bytes are a raw tensor already
+      ns3opengym::DataContainer dataContainerPbMsg;
+      dataContainerPbMsg.set_type(ns3opengym::Box);
+      ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor();
+      tensor->set_dtype(m_dtype);
+      tensor->mutable_shape()->Add(m_shape.begin(), m_shape.end());
+      tensor->set_data(m_bytes);
+      return OpenGymDataContainer::CreateFromDataContainerPbMsg(dataContainerPbMsg);
+    }
+    case ns3opengym::Tuple: {
+      Ptr<OpenGymTupleContainer> tuple = CreateObject<OpenGymTupleContainer>();
+      for (size_t i = 0; i < m_size; i++) {
+        tuple->Add(m_elements[i].ToContainer());
+      }
+      return tuple;
+    }
+    case ns3opengym::Dict: {
+      Ptr<OpenGymDictContainer> dict = CreateObject<OpenGymDictContainer>();
+      for (size_t i = 0; i < m_size; i++) {
+        dict->Add(m_keys[i], m_elements[i].ToContainer());
+      }
+      return dict;
+    }
+    default:
+      return 0;
+  }
+}
+
+Data
+Data::FromContainer(Ptr<OpenGymDataContainer> container)
+{
+  Data data;
+  if (!container) {
+    return data;
+  }
+  ns3opengym::DataContainer dataContainerPbMsg;
+  // before version 5 Dict elements keep their keys instead of slots
+  uint32_t rawTensorVersion = std::min(OpenGymDataContainer::GetRawTensorVersion(), 4u);
+  container->FillDataContainerPbMsg(dataContainerPbMsg, rawTensorVersion);
+  data.Update(dataContainerPbMsg);
+  return data;
+}
+
+std::ostream&
+operator<< (std::ostream& os, const Data &data)
+{
+  Ptr<OpenGymDataContainer> container = data.ToContainer();
+  if (container) {
+    container->Print(os);
+  } else {
+    os << "None";
+  }
+  return os;
+}
+
+} // namespace opengym
+} // namespace ns3
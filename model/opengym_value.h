@@ -0,0 +1,237 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2018 Piotr Gawlowicz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Piotr Gawlowicz <gawlowicz.p@gmail.com>
+ *
+ */
+
+#ifndef OPENGYM_VALUE_H
+#define OPENGYM_VALUE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "container.h"
+
+namespace ns3 {
+namespace opengym {
+
+/**
+ * Value types for observations and actions, the counterpart of the
+ * OpenGymDataContainer classes without Object, TypeId and Ptr. They are
+ * copied like any struct, OpenGymMultiEnv::GetObservationData and
+ * ExecuteActionData exchange them with the interface.
+ */
+struct Discrete
+{
+  Discrete (uint32_t n = 0, uint32_t value = 0) : n(n), value(value) {}
+
+  uint32_t n;
+  uint32_t value;
+};
+
+// row-major like OpenGymBoxContainer, bool elements are stored as uint8_t
+template <typename T = float>
+struct Box
+{
+  typedef typename OpenGymBoxContainer<T>::StorageType StorageType;
+
+  Box () {}
+  // all elements of shape set to fill
+  Box (std::vector<uint32_t> shape, T fill = T());
+
+  std::vector<uint32_t> shape;
+  std::vector<StorageType> data;
+};
+
+class Data;
+
+struct Tuple
+{
+  std::vector<Data> elements;
+};
+
+struct Dict
+{
+  std::vector<std::pair<std::string, Data> > elements;
+};
+
+/**
+ * One observation or action of any space type. Box data is kept as the
+ * bytes of a RawTensor, so filling a state message is a copy and setting
+ * the same Box type again reuses the buffers. Get fails if the held type
+ * (for Box the dtype) differs.
+ */
+class Data
+{
+public:
+  Data ();
+  Data (const Discrete &discrete);
+  template <typename T>
+  Data (const Box<T> &box);
+  Data (const Tuple &tuple);
+  Data (const Dict &dict);
+
+  // NoSpaceType until something was set
+  ns3opengym::SpaceType GetType() const;
+
+  void Set(const Discrete &discrete);
+  template <typename T>
+  void Set(const Box<T> &box);
+  void Set(const Tuple &tuple);
+  void Set(const Dict &dict);
+
+  bool Get(Discrete &discrete) const;
+  template <typename T>
+  bool Get(Box<T> &box) const;
+  bool Get(Tuple &tuple) const;
+  bool Get(Dict &dict) const;
+
+  // Discrete value, 0 for other types
+  uint32_t GetValue() const;
+  // Box
+  ns3opengym::Dtype GetDtype() const;
+  const std::vector<uint32_t> &GetShape() const;
+  // Discrete value or Box elements as float, false for other types
+  bool ToFloats(std::vector<float> &values) const;
+  // Tuple and Dict elements in place, keys are empty for Tuple
+  size_t GetElementCount() const;
+  const Data &GetElement(size_t idx) const;
+  const std::string &GetKey(size_t idx) const;
+  // 0 if there is no element with key
+  const Data *Find(const std::string &key) const;
+
+  /**
+   * Fill \p dataContainer in place like
+   * OpenGymDataContainer::FillDataContainerPbMsg.
+   */
+  void Fill(ns3opengym::DataContainer &dataContainer, uint32_t rawTensorVersion) const;
+  /**
+   * Overwrite with the content of \p dataContainer, raw tensors are
+   * copied into the existing buffers. MultiDiscrete and MultiBinary data
+   * becomes a Box, of bool for MultiBinary.
+   * \return false if the message holds no data
+   */
+  bool Update(const ns3opengym::DataContainer &dataContainer);
+
+  ///\{ adapters to the container classes
+  Ptr<OpenGymDataContainer> ToContainer() const;
+  static Data FromContainer(Ptr<OpenGymDataContainer> container);
+  ///\}
+
+  friend std::ostream& operator<< (std::ostream& os, const Data &data);
+
+private:
+  void SetBox(ns3opengym::Dtype dtype);
+  void SetElements(ns3opengym::SpaceType type, size_t count);
+  template <typename W, typename S>
+  static void Encode(const std::vector<S> &data, std::string &bytes);
+  template <typename W, typename S>
+  static void Decode(const std::string &bytes, std::vector<S> &data);
+
+  ns3opengym::SpaceType m_type;
+  // Discrete
+  uint32_t m_n;
+  uint32_t m_value;
+  // Box: native dtype, RawTensor data in host byte order
+  ns3opengym::Dtype m_dtype;
+  std::vector<uint32_t> m_shape;
+  std::string m_bytes;
+  // Tuple and Dict, m_size of them are used
+  std::vector<Data> m_elements;
+  std::vector<std::string> m_keys;
+  size_t m_size;
+};
+
+template <typename T>
+Box<T>::Box (std::vector<uint32_t> shape, T fill)
+  : shape(shape)
+{
+  size_t size = 1;
+  for (size_t i = 0; i < shape.size(); i++) {
+    size *= shape[i];
+  }
+  data.assign(size, fill);
+}
+
+template <typename T>
+Data::Data (const Box<T> &box)
+  : Data()
+{
+  Set(box);
+}
+
+template <typename W, typename S>
+void
+Data::Encode(const std::vector<S> &data, std::string &bytes)
+{
+  bytes.resize(data.size() * sizeof(W));
+  if (data.empty()) {
+    return;
+  }
+  char *out = &bytes[0];
+  if (std::is_same<S, W>::value) {
+    std::memcpy(out, data.data(), bytes.size());
+    return;
+  }
+  for (size_t i = 0; i < data.size(); i++) {
+    W value = static_cast<W>(data[i]);
+    std::memcpy(out + i * sizeof(W), &value, sizeof(W));
+  }
+}
+
+template <typename W, typename S>
+void
+Data::Decode(const std::string &bytes, std::vector<S> &data)
+{
+  data.resize(bytes.size() / sizeof(W));
+  if (std::is_same<S, W>::value) {
+    std::memcpy(data.data(), bytes.data(), data.size() * sizeof(W));
+    return;
+  }
+  for (size_t i = 0; i < data.size(); i++) {
+    W value;
+    std::memcpy(&value, bytes.data() + i * sizeof(W), sizeof(W));
+    data[i] = static_cast<S>(value);
+  }
+}
+
+template <typename T>
+void
+Data::Set(const Box<T> &box)
+{
+  SetBox(OpenGymDtype<T>::value);
+  m_shape.assign(box.shape.begin(), box.shape.end());
+  Encode<typename OpenGymDtype<T>::Wire>(box.data, m_bytes);
+}
+
+template <typename T>
+bool
+Data::Get(Box<T> &box) const
+{
+  if (m_type != ns3opengym::Box || m_dtype != OpenGymDtype<T>::value) {
+    return false;
+  }
+  box.shape.assign(m_shape.begin(), m_shape.end());
+  Decode<typename OpenGymDtype<T>::Wire>(m_bytes, box.data);
+  return true;
+}
+
+} // namespace opengym
+} // namespace ns3
+
+#endif /* OPENGYM_VALUE_H */
@@ -21,6 +21,10 @@
 
 #include "ns3/object.h"
 #include "ns3/log.h"
+#include "ns3/type-name.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <algorithm>
 #include "spaces.h"
 
 namespace ns3 {
@@ -62,6 +66,25 @@ OpenGymSpace::DoInitialize (void)
   NS_LOG_FUNCTION (this);
 }
 
+uint64_t
+OpenGymSpace::GetFingerprint(const ns3opengym::SpaceDescription &spaceDesc)
+{
+  std::string bytes;
+  {
+    google::protobuf::io::StringOutputStream stream(&bytes);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    output.SetSerializationDeterministic(true);
+    spaceDesc.SerializeToCodedStream(&output);
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < bytes.size(); i++) {
+    hash ^= static_cast<uint8_t>(bytes[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
 
 TypeId
 OpenGymDiscreteSpace::GetTypeId (void)
@@ -127,6 +150,145 @@ OpenGymDiscreteSpace::Print(std::ostream& where) const
   where << " DiscreteSpace N: " << m_n;
 }
 
+TypeId
+OpenGymMultiDiscreteSpace::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("OpenGymMultiDiscreteSpace")
+    .SetParent<OpenGymSpace> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymMultiDiscreteSpace> ()
+    ;
+  return tid;
+}
+
+OpenGymMultiDiscreteSpace::OpenGymMultiDiscreteSpace()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymMultiDiscreteSpace::OpenGymMultiDiscreteSpace(std::vector<uint32_t> nvec):
+  m_nvec(nvec)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymMultiDiscreteSpace::~OpenGymMultiDiscreteSpace ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymMultiDiscreteSpace::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymMultiDiscreteSpace::DoInitialize (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+std::vector<uint32_t>
+OpenGymMultiDiscreteSpace::GetNvec (void)
+{
+  NS_LOG_FUNCTION (this);
+  return m_nvec;
+}
+
+ns3opengym::SpaceDescription
+OpenGymMultiDiscreteSpace::GetSpaceDescription()
+{
+  NS_LOG_FUNCTION (this);
+  ns3opengym::SpaceDescription desc;
+  desc.set_type(ns3opengym::MultiDiscrete);
+  ns3opengym::MultiDiscreteSpace multiDiscreteSpace;
+  for (auto i = m_nvec.begin(); i != m_nvec.end(); ++i)
+  {
+    multiDiscreteSpace.add_nvec(*i);
+  }
+  desc.mutable_space()->PackFrom(multiDiscreteSpace);
+  return desc;
+}
+
+void
+OpenGymMultiDiscreteSpace::Print(std::ostream& where) const
+{
+  where << " MultiDiscreteSpace nvec: [";
+  for (auto i = m_nvec.begin(); i != m_nvec.end(); ++i)
+  {
+    where << *i;
+    if (i + 1 != m_nvec.end())
+      where << ", ";
+  }
+  where << "]";
+}
+
+TypeId
+OpenGymMultiBinarySpace::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("OpenGymMultiBinarySpace")
+    .SetParent<OpenGymSpace> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymMultiBinarySpace> ()
+    ;
+  return tid;
+}
+
+OpenGymMultiBinarySpace::OpenGymMultiBinarySpace():
+  m_n(0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymMultiBinarySpace::OpenGymMultiBinarySpace(uint32_t n):
+  m_n(n)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymMultiBinarySpace::~OpenGymMultiBinarySpace ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymMultiBinarySpace::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymMultiBinarySpace::DoInitialize (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+uint32_t
+OpenGymMultiBinarySpace::GetN (void)
+{
+  NS_LOG_FUNCTION (this);
+  return m_n;
+}
+
+ns3opengym::SpaceDescription
+OpenGymMultiBinarySpace::GetSpaceDescription()
+{
+  NS_LOG_FUNCTION (this);
+  ns3opengym::SpaceDescription desc;
+  desc.set_type(ns3opengym::MultiBinary);
+  ns3opengym::MultiBinarySpace multiBinarySpace;
+  multiBinarySpace.set_n(m_n);
+  desc.mutable_space()->PackFrom(multiBinarySpace);
+  return desc;
+}
+
+void
+OpenGymMultiBinarySpace::Print(std::ostream& where) const
+{
+  where << " MultiBinarySpace N: " << m_n;
+}
+
 TypeId
 OpenGymBoxSpace::GetTypeId (void)
 {
@@ -141,6 +303,7 @@ OpenGymBoxSpace::GetTypeId (void)
 OpenGymBoxSpace::OpenGymBoxSpace ()
 {
   NS_LOG_FUNCTION (this);
+  SetDtype ();
 }
 
 OpenGymBoxSpace::OpenGymBoxSpace (float low, float high, std::vector<uint32_t> shape, std::string dtype):
@@ -179,16 +342,39 @@ void
 OpenGymBoxSpace::SetDtype ()
 {
   std::string name = m_dtypeName;
-  if (name == "int8_t" || name == "int16_t" || name == "int32_t" || name == "int64_t")
+  if (name == "int8_t")
+    m_dtype = ns3opengym::INT8;
+  else if (name == "uint8_t")
+    m_dtype = ns3opengym::UINT8;
+  else if (name == "int16_t")
+    m_dtype = ns3opengym::INT16;
+  else if (name == "uint16_t")
+    m_dtype = ns3opengym::UINT16;
+  else if (name == "int32_t")
     m_dtype = ns3opengym::INT;
-  else if (name == "uint8_t" || name == "uint16_t" || name == "uint32_t" || name == "uint64_t")
+  else if (name == "uint32_t")
     m_dtype = ns3opengym::UINT;
+  else if (name == "int64_t")
+    m_dtype = ns3opengym::INT64;
+  else if (name == "uint64_t")
+    m_dtype = ns3opengym::UINT64;
+  else if (name == "bool")
+    m_dtype = ns3opengym::BOOL;
   else if (name == "float")
     m_dtype = ns3opengym::FLOAT;
   else if (name == "double")
     m_dtype = ns3opengym::DOUBLE;
   else
     m_dtype = ns3opengym::FLOAT;
+
+  // what OpenGymDtype<T>::legacy sends below raw tensor version 3
+  if (m_dtype == ns3opengym::INT8 || m_dtype == ns3opengym::INT16 || m_dtype == ns3opengym::INT64)
+    m_legacyDtype = ns3opengym::INT;
+  else if (m_dtype == ns3opengym::UINT8 || m_dtype == ns3opengym::UINT16 ||
+           m_dtype == ns3opengym::UINT64 || m_dtype == ns3opengym::BOOL)
+    m_legacyDtype = ns3opengym::UINT;
+  else
+    m_legacyDtype = m_dtype;
 }
 
 float
@@ -229,7 +415,13 @@ OpenGymBoxSpace::GetSpaceDescription()
     boxSpacePb.add_shape(*i);
   }
 
-  boxSpacePb.set_dtype(m_dtype);
+  // the agent only learns the negotiated raw tensor version after this
+  // description, older agents do not know the native dtypes
+  boxSpacePb.set_dtype(m_legacyDtype);
+  if (m_dtype != m_legacyDtype)
+  {
+    boxSpacePb.set_nativedtype(m_dtype);
+  }
   desc.mutable_space()->PackFrom(boxSpacePb);
   return desc;
 }
@@ -373,7 +565,13 @@ bool
 OpenGymDictSpace::Add(std::string key, Ptr<OpenGymSpace> space)
 {
   NS_LOG_FUNCTION (this);
-  m_dict.insert(std::pair<std::string, Ptr<OpenGymSpace> > (key, space));
+  // like std::map::insert, an existing key keeps its space
+  std::vector<std::string>::iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+  if (it != m_keys.end() && *it == key) {
+    return true;
+  }
+  m_spaces.insert(m_spaces.begin() + (it - m_keys.begin()), space);
+  m_keys.insert(it, key);
   return true;
 }
 
@@ -382,14 +580,47 @@ OpenGymDictSpace::Get(std::string key)
 {
   NS_LOG_FUNCTION (this);
   Ptr<OpenGymSpace> space;
-  std::map< std::string, Ptr<OpenGymSpace> >::iterator it = m_dict.find(key);
-  if ( it != m_dict.end() ) {
-    space = it->second;
+  int32_t slot = GetSlot(key);
+  if (slot >= 0) {
+    space = m_spaces[slot];
   }
 
   return space;
 }
 
+uint32_t
+OpenGymDictSpace::GetSlotCount() const
+{
+  return m_keys.size();
+}
+
+int32_t
+OpenGymDictSpace::GetSlot(const std::string &key) const
+{
+  std::vector<std::string>::const_iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+  if (it == m_keys.end() || *it != key) {
+    return -1;
+  }
+  return it - m_keys.begin();
+}
+
+const std::string &
+OpenGymDictSpace::GetKey(uint32_t slot) const
+{
+  NS_ASSERT (slot < m_keys.size());
+  return m_keys[slot];
+}
+
+Ptr<OpenGymSpace>
+OpenGymDictSpace::Get(uint32_t slot)
+{
+  Ptr<OpenGymSpace> space;
+  if (slot < m_spaces.size()) {
+    space = m_spaces[slot];
+  }
+  return space;
+}
+
 ns3opengym::SpaceDescription
 OpenGymDictSpace::GetSpaceDescription()
 {
@@ -399,11 +630,10 @@ OpenGymDictSpace::GetSpaceDescription()
 
   ns3opengym::DictSpace dictSpacePb;
 
-  std::map< std::string, Ptr<OpenGymSpace> >::iterator it;
-  for (it=m_dict.begin(); it!=m_dict.end(); ++it)
+  for (uint32_t slot = 0; slot < m_keys.size(); slot++)
   {
-    std::string name = it->first;
-    Ptr<OpenGymSpace> subSpace = it->second;
+    std::string name = m_keys[slot];
+    Ptr<OpenGymSpace> subSpace = m_spaces[slot];
 
     ns3opengym::SpaceDescription subDesc = subSpace->GetSpaceDescription();
     subDesc.set_name(name);
@@ -420,14 +650,105 @@ OpenGymDictSpace::Print(std::ostream& where) const
 {
   where << " DictSpace: " << std::endl;
 
-  std::map< std::string, Ptr<OpenGymSpace> > myMap = m_dict;
-  std::map< std::string, Ptr<OpenGymSpace> >::iterator it;
-  for (it=myMap.begin(); it!=myMap.end(); ++it)
+  for (uint32_t slot = 0; slot < m_keys.size(); slot++)
   {
-    where << "---" << it->first << ":";
-    it->second->Print(where);
+    where << "---" << m_keys[slot] << ":";
+    m_spaces[slot]->Print(where);
     where << std::endl;
   }
 }
 
+TypeId
+OpenGymGraphSpace::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("OpenGymGraphSpace")
+    .SetParent<OpenGymSpace> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<OpenGymGraphSpace> ()
+    ;
+  return tid;
+}
+
+OpenGymGraphSpace::OpenGymGraphSpace ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymGraphSpace::OpenGymGraphSpace (Ptr<OpenGymBoxSpace> nodeSpace, Ptr<OpenGymBoxSpace> edgeSpace):
+  m_nodeSpace(nodeSpace),
+  m_edgeSpace(edgeSpace)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+OpenGymGraphSpace::OpenGymGraphSpace (uint32_t nodeFeatures, uint32_t edgeFeatures, float low, float high)
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<uint32_t> shape(1, nodeFeatures);
+  m_nodeSpace = CreateObject<OpenGymBoxSpace> (low, high, shape, TypeNameGet<float> ());
+  shape[0] = edgeFeatures;
+  m_edgeSpace = CreateObject<OpenGymBoxSpace> (low, high, shape, TypeNameGet<float> ());
+}
+
+OpenGymGraphSpace::~OpenGymGraphSpace ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymGraphSpace::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+OpenGymGraphSpace::DoInitialize (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<OpenGymBoxSpace>
+OpenGymGraphSpace::GetNodeSpace()
+{
+  return m_nodeSpace;
+}
+
+Ptr<OpenGymBoxSpace>
+OpenGymGraphSpace::GetEdgeSpace()
+{
+  return m_edgeSpace;
+}
+
+ns3opengym::SpaceDescription
+OpenGymGraphSpace::GetSpaceDescription()
+{
+  NS_LOG_FUNCTION (this);
+  ns3opengym::SpaceDescription desc;
+  desc.set_type(ns3opengym::Graph);
+
+  ns3opengym::GraphSpace graphSpacePb;
+  if (m_nodeSpace) {
+    m_nodeSpace->GetSpaceDescription().space().UnpackTo(graphSpacePb.mutable_nodespace());
+  }
+  if (m_edgeSpace) {
+    m_edgeSpace->GetSpaceDescription().space().UnpackTo(graphSpacePb.mutable_edgespace());
+  }
+
+  desc.mutable_space()->PackFrom(graphSpacePb);
+  return desc;
+}
+
+void
+OpenGymGraphSpace::Print(std::ostream& where) const
+{
+  where << " GraphSpace: " << std::endl;
+  where << "---nodes:";
+  if (m_nodeSpace)
+    m_nodeSpace->Print(where);
+  where << std::endl << "---edges:";
+  if (m_edgeSpace)
+    m_edgeSpace->Print(where);
+  where << std::endl;
+}
+
 }
\ No newline at end of file
@@ -37,6 +37,13 @@ public:
 
   virtual ns3opengym::SpaceDescription GetSpaceDescription() = 0;
   virtual void Print(std::ostream& where) const = 0;
+
+  /**
+   * FNV-1a 64 hash of the deterministic serialization of \p spaceDesc.
+   * Equal spaces get the same fingerprint in every run, so an agent can
+   * cache the spaces it built across simulation restarts.
+   */
+  static uint64_t GetFingerprint(const ns3opengym::SpaceDescription &spaceDesc);
 protected:
   // Inherited
   virtual void DoInitialize (void);
@@ -72,10 +79,69 @@ private:
 	int m_n;
 };
 
+// gym.spaces.MultiDiscrete, element i in [0, nvec[i])
+class OpenGymMultiDiscreteSpace : public OpenGymSpace
+{
+public:
+  OpenGymMultiDiscreteSpace ();
+  OpenGymMultiDiscreteSpace (std::vector<uint32_t> nvec);
+  virtual ~OpenGymMultiDiscreteSpace ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::SpaceDescription GetSpaceDescription();
+
+  std::vector<uint32_t> GetNvec(void);
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymMultiDiscreteSpace> space)
+  {
+    space->Print(os);
+    return os;
+  }
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  std::vector<uint32_t> m_nvec;
+};
+
+// gym.spaces.MultiBinary of n elements
+class OpenGymMultiBinarySpace : public OpenGymSpace
+{
+public:
+  OpenGymMultiBinarySpace ();
+  OpenGymMultiBinarySpace (uint32_t n);
+  virtual ~OpenGymMultiBinarySpace ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::SpaceDescription GetSpaceDescription();
+
+  uint32_t GetN(void);
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymMultiBinarySpace> space)
+  {
+    space->Print(os);
+    return os;
+  }
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  uint32_t m_n;
+};
+
 class OpenGymBoxSpace : public OpenGymSpace
 {
 public:
   OpenGymBoxSpace ();
+  // dtype: TypeNameGet<T> () of the container element type, e.g. "uint8_t", or "bool"
   OpenGymBoxSpace (float low, float high, std::vector<uint32_t> shape, std::string dtype);
   OpenGymBoxSpace (std::vector<float> low, std::vector<float> high, std::vector<uint32_t> shape, std::string dtype);
   virtual ~OpenGymBoxSpace ();
@@ -111,6 +177,8 @@ private:
   std::vector<float> m_highVec;
 
   ns3opengym::Dtype m_dtype;
+  // INT / UINT for the native dtypes
+  ns3opengym::Dtype m_legacyDtype;
 };
 
 
@@ -157,6 +225,17 @@ public:
   bool Add(std::string key, Ptr<OpenGymSpace> value);
   Ptr<OpenGymSpace> Get(std::string key);
 
+  /**
+   * Keys are interned to slots 0 .. GetSlotCount () - 1 in key order, the
+   * order of the space description. Adding a key moves the slots of the
+   * keys after it, look slots up once the space is complete.
+   */
+  uint32_t GetSlotCount() const;
+  // -1 if there is no such key
+  int32_t GetSlot(const std::string &key) const;
+  const std::string &GetKey(uint32_t slot) const;
+  Ptr<OpenGymSpace> Get(uint32_t slot);
+
   virtual void Print(std::ostream& where) const;
   friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymDictSpace> space)
   {
@@ -170,7 +249,47 @@ protected:
   virtual void DoDispose (void);
 
 private:
-  std::map< std::string, Ptr<OpenGymSpace> > m_dict;
+  // sorted keys and their spaces, index is the slot
+  std::vector<std::string> m_keys;
+  std::vector< Ptr<OpenGymSpace> > m_spaces;
+};
+
+/**
+ * Space of an OpenGymGraphContainer: Box spaces of the features of one
+ * node and of one edge, e.g. shape {n}. The number of nodes and edges is
+ * not part of the space.
+ */
+class OpenGymGraphSpace : public OpenGymSpace
+{
+public:
+  OpenGymGraphSpace ();
+  OpenGymGraphSpace (Ptr<OpenGymBoxSpace> nodeSpace, Ptr<OpenGymBoxSpace> edgeSpace);
+  // float features in [low, high]
+  OpenGymGraphSpace (uint32_t nodeFeatures, uint32_t edgeFeatures, float low, float high);
+  virtual ~OpenGymGraphSpace ();
+
+  static TypeId GetTypeId ();
+
+  virtual ns3opengym::SpaceDescription GetSpaceDescription();
+
+  Ptr<OpenGymBoxSpace> GetNodeSpace();
+  Ptr<OpenGymBoxSpace> GetEdgeSpace();
+
+  virtual void Print(std::ostream& where) const;
+  friend std::ostream& operator<< (std::ostream& os, const Ptr<OpenGymGraphSpace> space)
+  {
+    space->Print(os);
+    return os;
+  }
+
+protected:
+  // Inherited
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+private:
+  Ptr<OpenGymBoxSpace> m_nodeSpace;
+  Ptr<OpenGymBoxSpace> m_edgeSpace;
 };
 
 } // end of namespace ns3
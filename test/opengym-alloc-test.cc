@@ -0,0 +1,320 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Heap allocations of steady-state multi-agent steps. This is a program of
+ * its own instead of a case of the opengym test suite: allocations are
+ * counted by replacing the global operator new, which must not leak into
+ * the test-runner and the other modules tested by it. Run by test.py (see
+ * examples-to-run.py), the exit code is not 0 if a step allocated.
+ *
+ *   ./waf --run opengym-alloc-test
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/opengym-module.h"
+
+using namespace ns3;
+
+// Heap allocations made while g_countAllocations is set
+static bool g_countAllocations = false;
+static uint64_t g_allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+  if (g_countAllocations)
+    {
+      g_allocations++;
+    }
+  void *p = std::malloc (size ? size : 1);
+  if (!p)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void *
+operator new[] (std::size_t size)
+{
+  return operator new (size);
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+void
+operator delete[] (void *p) noexcept
+{
+  std::free (p);
+}
+
+void
+operator delete (void *p, std::size_t) noexcept
+{
+  std::free (p);
+}
+
+void
+operator delete[] (void *p, std::size_t) noexcept
+{
+  std::free (p);
+}
+
+namespace {
+
+// Agent 0 observes a persistent Box container and takes a Discrete
+// action, agent 1 observes a Discrete container and takes a Box action
+class ContainerEnv : public OpenGymMultiEnv
+{
+public:
+  ContainerEnv (uint32_t port)
+    : m_actionSum (0)
+  {
+    m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+    SetOpenGymPort (port);
+    AddAgentId (0);
+    AddAgentId (1);
+    std::vector<uint32_t> shape = {64};
+    m_boxObs = CreateObject<OpenGymBoxContainer<float> > (shape);
+    m_boxObs->SetData (std::vector<float> (64, 0.5));
+    m_discreteObs = CreateObject<OpenGymDiscreteContainer> (4);
+    m_discreteObs->SetValue (2);
+  }
+
+  virtual Ptr<OpenGymSpace>
+  GetActionSpace (uint32_t agent_id)
+  {
+    if (agent_id == 0)
+      {
+        return CreateObject<OpenGymDiscreteSpace> (4);
+      }
+    std::vector<uint32_t> shape = {3};
+    return CreateObject<OpenGymBoxSpace> (-10, 10, shape, TypeNameGet<int32_t> ());
+  }
+  virtual Ptr<OpenGymSpace>
+  GetObservationSpace (uint32_t agent_id)
+  {
+    if (agent_id == 0)
+      {
+        std::vector<uint32_t> shape = {64};
+        return CreateObject<OpenGymBoxSpace> (0, 1, shape, TypeNameGet<float> ());
+      }
+    return CreateObject<OpenGymDiscreteSpace> (4);
+  }
+  virtual Ptr<OpenGymDataContainer>
+  GetObservation (uint32_t agent_id)
+  {
+    if (agent_id == 0)
+      {
+        return m_boxObs;
+      }
+    return m_discreteObs;
+  }
+  virtual float
+  GetReward (uint32_t agent_id)
+  {
+    return 1.0;
+  }
+  virtual bool
+  GetDone (uint32_t agent_id)
+  {
+    return false;
+  }
+  virtual std::string
+  GetInfo (uint32_t agent_id)
+  {
+    return "ok";
+  }
+  virtual bool
+  ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+  {
+    if (agent_id == 0)
+      {
+        m_actionSum += DynamicCast<OpenGymDiscreteContainer> (action)->GetValue ();
+        return true;
+      }
+    Ptr<OpenGymBoxContainer<int32_t> > box = DynamicCast<OpenGymBoxContainer<int32_t> > (action);
+    m_actionSum += box->GetValue (0) + box->GetValue (1) + box->GetValue (2);
+    return true;
+  }
+
+  int64_t m_actionSum;
+
+private:
+  Ptr<OpenGymBoxContainer<float> > m_boxObs;
+  Ptr<OpenGymDiscreteContainer> m_discreteObs;
+};
+
+// Agents 4 and 7 with a common Box space, observed and controlled
+// through the opengym value types, so their states are batched
+class BatchedEnv : public OpenGymMultiValueEnv
+{
+public:
+  BatchedEnv (uint32_t port)
+  {
+    m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+    SetOpenGymPort (port);
+    AddAgentId (4);
+    AddAgentId (7);
+    m_box.shape.assign (1, 3);
+  }
+
+  virtual Ptr<OpenGymSpace>
+  GetActionSpace (uint32_t agent_id)
+  {
+    return CreateObject<OpenGymDiscreteSpace> (2);
+  }
+  virtual Ptr<OpenGymSpace>
+  GetObservationSpace (uint32_t agent_id)
+  {
+    std::vector<uint32_t> shape = {3};
+    return CreateObject<OpenGymBoxSpace> (0, 255, shape, TypeNameGet<uint8_t> ());
+  }
+  virtual bool
+  GetObservationData (uint32_t agent_id, opengym::Data &obs)
+  {
+    m_box.data.assign (3, agent_id);
+    obs.Set (m_box);
+    return true;
+  }
+  virtual float
+  GetReward (uint32_t agent_id)
+  {
+    return agent_id * 0.5;
+  }
+  virtual bool
+  GetDone (uint32_t agent_id)
+  {
+    return false;
+  }
+  virtual std::string
+  GetInfo (uint32_t agent_id)
+  {
+    return "";
+  }
+  virtual bool
+  ExecuteActionData (uint32_t agent_id, const opengym::Data &action)
+  {
+    return true;
+  }
+
+private:
+  opengym::Box<uint8_t> m_box;
+};
+
+// Discrete 3 for agent 0 and Box [1, 2, 4] as raw tensor for agent 1 of ContainerEnv
+std::string
+SerializeContainerActions ()
+{
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  ns3opengym::AgentActMsg *agentActMsg = multiAgentActMsg.add_agentactmsg ();
+  agentActMsg->set_agentid (0);
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  discreteContainerPbMsg.set_data (3);
+  agentActMsg->mutable_actdata ()->set_type (ns3opengym::Discrete);
+  agentActMsg->mutable_actdata ()->mutable_data ()->PackFrom (discreteContainerPbMsg);
+  agentActMsg = multiAgentActMsg.add_agentactmsg ();
+  agentActMsg->set_agentid (1);
+  agentActMsg->mutable_actdata ()->set_type (ns3opengym::Box);
+  ns3opengym::RawTensor *tensor = agentActMsg->mutable_actdata ()->mutable_tensor ();
+  tensor->set_dtype (ns3opengym::INT);
+  tensor->add_shape (3);
+  int32_t boxAction[3] = {1, 2, 4};
+  tensor->set_data (boxAction, sizeof (boxAction));
+  return multiAgentActMsg.SerializeAsString ();
+}
+
+// Play the agent side of env over its shm segment for steps steps with
+// the same actions, the first step (init handshake) is not counted.
+// \return allocations of the other steps, -1 if the env did not talk
+int64_t
+CountStepAllocations (Ptr<OpenGymShmChannel> agent, Ptr<OpenGymMultiEnv> env,
+                      uint32_t rawTensorVersion, const std::string &actBytes, uint32_t steps)
+{
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (rawTensorVersion);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  agent->Send (ackBytes.data (), ackBytes.size ());
+
+  int64_t allocations = 0;
+  uint32_t size;
+  for (uint32_t step = 0; step < steps; step++)
+    {
+      agent->Send (actBytes.data (), actBytes.size ());
+      g_allocations = 0;
+      g_countAllocations = step > 0;
+      env->Step ();
+      g_countAllocations = false;
+      allocations += g_allocations;
+      // the init msg comes with the first state
+      for (uint32_t i = 0; i < (step ? 1 : 2); i++)
+        {
+          if (!agent->Receive (size, 1000))
+            {
+              return -1;
+            }
+          agent->Release ();
+        }
+    }
+  return allocations;
+}
+
+bool
+Check (const std::string &name, int64_t allocations, uint32_t steps)
+{
+  if (allocations < 0)
+    {
+      std::cerr << name << ": no state received" << std::endl;
+      return false;
+    }
+  if (allocations > 0)
+    {
+      std::cerr << name << ": " << allocations << " allocations in " << steps - 1 << " steps" << std::endl;
+      return false;
+    }
+  std::cout << name << ": no allocations" << std::endl;
+  return true;
+}
+
+} // namespace
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t steps = 100;
+  CommandLine cmd;
+  cmd.AddValue ("steps", "Number of steps per check. Default: 100", steps);
+  cmd.Parse (argc, argv);
+
+  uint32_t port = 40000 + ::getpid () % 20000;
+  bool ok = true;
+  {
+    Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+    NS_ABORT_MSG_UNLESS (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16),
+                         "Cannot create shm segment");
+    Ptr<ContainerEnv> env = CreateObject<ContainerEnv> (port);
+    ok &= Check ("Container step", CountStepAllocations (agent, env, 1, SerializeContainerActions (), steps),
+                 steps);
+    NS_ABORT_MSG_UNLESS (env->m_actionSum == 10 * int64_t (steps), "Actions not executed");
+  }
+  port++;
+  {
+    Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+    NS_ABORT_MSG_UNLESS (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16),
+                         "Cannot create shm segment");
+    Ptr<BatchedEnv> env = CreateObject<BatchedEnv> (port);
+    std::string actBytes = ns3opengym::MultiAgentActMsg ().SerializeAsString ();
+    ok &= Check ("Batched step", CountStepAllocations (agent, env, 4, actBytes, steps), steps);
+  }
+  Simulator::Destroy ();
+  return ok ? 0 : 1;
+}
@@ -5,6 +5,18 @@
 
 // An essential include is test.h
 #include "ns3/test.h"
+#include "ns3/enum.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/simulator.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <unistd.h>
 
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
@@ -46,6 +58,2487 @@ OpengymTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// Multi-agent env with persistent observation containers, as required for
+// the allocation-free step path
+class StepAllocationTestEnv : public OpenGymMultiEnv
+{
+public:
+  StepAllocationTestEnv (uint32_t port);
+
+  virtual Ptr<OpenGymSpace> GetActionSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymSpace> GetObservationSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymDataContainer> GetObservation (uint32_t agent_id);
+  virtual float GetReward (uint32_t agent_id);
+  virtual bool GetDone (uint32_t agent_id);
+  virtual std::string GetInfo (uint32_t agent_id);
+  virtual bool ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action);
+
+  void SetBoxObsValue (uint32_t idx, float value);
+  void EnableDeltaObservations (uint32_t keyframeInterval);
+  void SetFallbackAction (OpenGymMultiInterface::FallbackAction fallback);
+  void UseTcp ();
+  void UseWorkers (uint32_t workers);
+
+  uint32_t m_discreteAction;
+  int32_t m_boxActionSum;
+  // agent ids in the order their actions were executed
+  std::vector<uint32_t> m_executed;
+
+private:
+  Ptr<OpenGymBoxContainer<float> > m_boxObs;
+  Ptr<OpenGymDiscreteContainer> m_discreteObs;
+};
+
+StepAllocationTestEnv::StepAllocationTestEnv (uint32_t port)
+  : m_discreteAction (0),
+    m_boxActionSum (0)
+{
+  m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+  SetOpenGymPort (port);
+  AddAgentId (0);
+  AddAgentId (1);
+
+  std::vector<uint32_t> shape = {64};
+  m_boxObs = CreateObject<OpenGymBoxContainer<float> > (shape);
+  m_boxObs->SetData (std::vector<float> (64, 0.5));
+  m_discreteObs = CreateObject<OpenGymDiscreteContainer> (4);
+  m_discreteObs->SetValue (2);
+}
+
+Ptr<OpenGymSpace>
+StepAllocationTestEnv::GetActionSpace (uint32_t agent_id)
+{
+  if (agent_id == 0)
+    {
+      return CreateObject<OpenGymDiscreteSpace> (4);
+    }
+  std::vector<uint32_t> shape = {3};
+  return CreateObject<OpenGymBoxSpace> (-10, 10, shape, TypeNameGet<int32_t> ());
+}
+
+Ptr<OpenGymSpace>
+StepAllocationTestEnv::GetObservationSpace (uint32_t agent_id)
+{
+  if (agent_id == 0)
+    {
+      std::vector<uint32_t> shape = {64};
+      return CreateObject<OpenGymBoxSpace> (0, 1, shape, TypeNameGet<float> ());
+    }
+  return CreateObject<OpenGymDiscreteSpace> (4);
+}
+
+Ptr<OpenGymDataContainer>
+StepAllocationTestEnv::GetObservation (uint32_t agent_id)
+{
+  if (agent_id == 0)
+    {
+      return m_boxObs;
+    }
+  return m_discreteObs;
+}
+
+float
+StepAllocationTestEnv::GetReward (uint32_t agent_id)
+{
+  return 1.0;
+}
+
+bool
+StepAllocationTestEnv::GetDone (uint32_t agent_id)
+{
+  return false;
+}
+
+std::string
+StepAllocationTestEnv::GetInfo (uint32_t agent_id)
+{
+  return "ok";
+}
+
+bool
+StepAllocationTestEnv::ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  m_executed.push_back (agent_id);
+  if (agent_id == 0)
+    {
+      m_discreteAction = DynamicCast<OpenGymDiscreteContainer> (action)->GetValue ();
+      return true;
+    }
+  Ptr<OpenGymBoxContainer<int32_t> > box = DynamicCast<OpenGymBoxContainer<int32_t> > (action);
+  m_boxActionSum = box->GetValue (0) + box->GetValue (1) + box->GetValue (2);
+  return true;
+}
+
+void
+StepAllocationTestEnv::SetBoxObsValue (uint32_t idx, float value)
+{
+  std::vector<float> data = m_boxObs->GetData ();
+  data[idx] = value;
+  m_boxObs->SetData (data);
+}
+
+void
+StepAllocationTestEnv::EnableDeltaObservations (uint32_t keyframeInterval)
+{
+  m_openGymMultiInterface->SetAttribute ("DeltaObservations", BooleanValue (true));
+  m_openGymMultiInterface->SetAttribute ("KeyframeInterval", UintegerValue (keyframeInterval));
+}
+
+void
+StepAllocationTestEnv::SetFallbackAction (OpenGymMultiInterface::FallbackAction fallback)
+{
+  m_openGymMultiInterface->SetAttribute ("FallbackAction", EnumValue (fallback));
+}
+
+void
+StepAllocationTestEnv::UseTcp ()
+{
+  m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_TCP));
+}
+
+void
+StepAllocationTestEnv::UseWorkers (uint32_t workers)
+{
+  UseTcp ();
+  m_openGymMultiInterface->SetAttribute ("Workers", UintegerValue (workers));
+}
+
+// Actions of StepAllocationTestEnv answering state stepIdx: Discrete
+// discrete for agent 0, Box [box, box, box] for agent 1
+static std::string
+SerializeTestActions (uint64_t stepIdx, uint32_t discrete, int32_t box)
+{
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  multiAgentActMsg.set_stepidx (stepIdx);
+  ns3opengym::AgentActMsg *agentActMsg = multiAgentActMsg.add_agentactmsg ();
+  agentActMsg->set_agentid (0);
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  discreteContainerPbMsg.set_data (discrete);
+  agentActMsg->mutable_actdata ()->set_type (ns3opengym::Discrete);
+  agentActMsg->mutable_actdata ()->mutable_data ()->PackFrom (discreteContainerPbMsg);
+  agentActMsg = multiAgentActMsg.add_agentactmsg ();
+  agentActMsg->set_agentid (1);
+  agentActMsg->mutable_actdata ()->set_type (ns3opengym::Box);
+  ns3opengym::RawTensor *tensor = agentActMsg->mutable_actdata ()->mutable_tensor ();
+  tensor->set_dtype (ns3opengym::INT);
+  tensor->add_shape (3);
+  int32_t boxAction[3] = {box, box, box};
+  tensor->set_data (boxAction, sizeof (boxAction));
+  return multiAgentActMsg.SerializeAsString ();
+}
+
+// Both ends of one shm ring: records wrapping behind the skip marker and
+// the timeouts of an empty and a full ring
+class OpengymShmChannelTestCase : public TestCase
+{
+public:
+  OpengymShmChannelTestCase ();
+  virtual ~OpengymShmChannelTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymShmChannelTestCase::OpengymShmChannelTestCase ()
+  : TestCase ("Opengym shm channel wraps records and times out")
+{
+}
+
+OpengymShmChannelTestCase::~OpengymShmChannelTestCase ()
+{
+}
+
+void
+OpengymShmChannelTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 11) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 256), true,
+                         "Cannot create shm segment");
+  Ptr<OpenGymShmChannel> sim = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (sim->Open (OpenGymShmChannel::GetSegmentName (port)), true,
+                         "Cannot open shm segment");
+  NS_TEST_ASSERT_MSG_EQ (sim->GetCapacity (), 256, "Wrong ring capacity");
+
+  // records of 104 bytes, every third one does not fit the end of the ring
+  std::vector<uint8_t> payload (100);
+  const uint8_t *ringStart = 0;
+  uint32_t size;
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      std::fill (payload.begin (), payload.end (), i + 1);
+      NS_TEST_ASSERT_MSG_EQ (sim->Send (payload.data (), payload.size (), 0), true, "Send failed");
+      const uint8_t *data = agent->Receive (size, 0);
+      NS_TEST_ASSERT_MSG_EQ (data != 0, true, "Record " << i << " not received");
+      NS_TEST_ASSERT_MSG_EQ (size, payload.size (), "Wrong size of record " << i);
+      NS_TEST_ASSERT_MSG_EQ (std::memcmp (data, payload.data (), size), 0, "Record " << i << " corrupted");
+      if (i == 0)
+        {
+          ringStart = data;
+        }
+      if (i == 2)
+        {
+          NS_TEST_ASSERT_MSG_EQ (data == ringStart, true, "Record not wrapped to the ring start");
+        }
+      agent->Release ();
+    }
+
+  // nothing sent
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Receive (size, 20) == 0, true, "Received from an empty ring");
+  NS_TEST_ASSERT_MSG_EQ (std::chrono::steady_clock::now () - start >= std::chrono::milliseconds (20), true,
+                         "Receive returned before its timeout");
+
+  // two records fill the ring, the third one fits once the first is released
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      std::fill (payload.begin (), payload.end (), 10 + i);
+      NS_TEST_ASSERT_MSG_EQ (sim->Send (payload.data (), payload.size (), 0), true, "Send failed");
+    }
+  start = std::chrono::steady_clock::now ();
+  NS_TEST_ASSERT_MSG_EQ (sim->Reserve (payload.size (), 20) == 0, true, "Reserved in a full ring");
+  NS_TEST_ASSERT_MSG_EQ (std::chrono::steady_clock::now () - start >= std::chrono::milliseconds (20), true,
+                         "Reserve returned before its timeout");
+  NS_TEST_ASSERT_MSG_EQ (agent->Receive (size, 0) != 0, true, "First record not received");
+  agent->Release ();
+  uint8_t *region = sim->Reserve (payload.size (), 0);
+  NS_TEST_ASSERT_MSG_EQ (region != 0, true, "Released space not reused");
+  std::memset (region, 12, payload.size ());
+  sim->Commit (payload.size ());
+  for (uint32_t i = 1; i < 3; i++)
+    {
+      const uint8_t *data = agent->Receive (size, 0);
+      NS_TEST_ASSERT_MSG_EQ (data != 0, true, "Record " << 10 + i << " not received");
+      NS_TEST_ASSERT_MSG_EQ (uint32_t (data[0]), 10 + i, "Records out of order");
+      agent->Release ();
+    }
+  sim->Close ();
+  agent->Close ();
+}
+
+// Drive OpenGymMultiInterface over the shm transport, with this test as the
+// agent side, for steady-state steps with new actions every step. Their heap
+// allocations are counted by the opengym-alloc-test program.
+class OpengymSteadyStepTestCase : public TestCase
+{
+public:
+  OpengymSteadyStepTestCase ();
+  virtual ~OpengymSteadyStepTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymSteadyStepTestCase::OpengymSteadyStepTestCase ()
+  : TestCase ("Opengym multi-agent steady-state steps execute the actions of every step")
+{
+}
+
+OpengymSteadyStepTestCase::~OpengymSteadyStepTestCase ()
+{
+}
+
+void
+OpengymSteadyStepTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + ::getpid () % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  uint32_t size;
+  const int steps = 100;
+  for (int i = 0; i < steps; i++)
+    {
+      std::string actBytes = SerializeTestActions (i, i % 4, i % 10);
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      NS_TEST_ASSERT_MSG_EQ (env->m_discreteAction, uint32_t (i % 4),
+                             "Discrete action of step " << i << " not executed");
+      NS_TEST_ASSERT_MSG_EQ (env->m_boxActionSum, 3 * (i % 10),
+                             "Box action of step " << i << " not executed");
+      // the init msg comes with the first state
+      for (int j = 0; j < (i ? 1 : 2); j++)
+        {
+          NS_TEST_ASSERT_MSG_NE (agent->Receive (size, 0), 0, "Message to the agent missing");
+          agent->Release ();
+        }
+    }
+  NS_TEST_ASSERT_MSG_GT (size, 64 * sizeof (float), "Observation missing in state msg");
+}
+
+// Agents with their own step interval, stepped every second: agent 0
+// every 2 s, agent 1 (Time::Max) only when triggered
+class OpengymAgentIntervalTestCase : public TestCase
+{
+public:
+  OpengymAgentIntervalTestCase ();
+  virtual ~OpengymAgentIntervalTestCase ();
+
+private:
+  virtual void DoRun (void);
+  // answer in advance, step and record the agents of the state sent
+  void Step (Ptr<StepAllocationTestEnv> env, Ptr<OpenGymShmChannel> agent);
+
+  std::vector<std::vector<uint32_t> > m_dueAgents;
+};
+
+OpengymAgentIntervalTestCase::OpengymAgentIntervalTestCase ()
+  : TestCase ("Opengym multi-agent step only sends the due agents")
+{
+}
+
+OpengymAgentIntervalTestCase::~OpengymAgentIntervalTestCase ()
+{
+}
+
+void
+OpengymAgentIntervalTestCase::Step (Ptr<StepAllocationTestEnv> env, Ptr<OpenGymShmChannel> agent)
+{
+  uint32_t step = m_dueAgents.size ();
+  std::string actBytes = SerializeTestActions (step, 1, 1);
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  m_dueAgents.push_back (std::vector<uint32_t> ());
+  uint32_t size;
+  // the init msg comes with the first state
+  for (uint32_t i = 0; i < (step ? 1 : 2); i++)
+    {
+      const uint8_t *data = agent->Receive (size, 0);
+      if (!data)
+        {
+          return;
+        }
+      ns3opengym::MultiAgentStateMsg stateMsg;
+      bool state = i == (step ? 0 : 1) && stateMsg.ParseFromArray (data, size);
+      agent->Release ();
+      for (int j = 0; state && j < stateMsg.agentstatemsg_size (); j++)
+        {
+          m_dueAgents.back ().push_back (stateMsg.agentstatemsg (j).agentid ());
+        }
+    }
+}
+
+void
+OpengymAgentIntervalTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 12) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  agent->Send (ackBytes.data (), ackBytes.size ());
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->SetAgentStepInterval (0, Seconds (2));
+  env->SetAgentStepInterval (1, Time::Max ());
+  const uint32_t steps = 7;
+  for (uint32_t i = 0; i < steps; i++)
+    {
+      // the triggers run before the step of the same time
+      if (i == 3)
+        {
+          Simulator::Schedule (Seconds (i), &OpenGymMultiEnv::TriggerAgent, env, 1);
+        }
+      if (i == 5)
+        {
+          Simulator::Schedule (Seconds (i), &OpenGymMultiEnv::TriggerAgent, env, 0);
+        }
+      Simulator::Schedule (Seconds (i), &OpengymAgentIntervalTestCase::Step, this, env, agent);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  // all agents at the first step, a triggered step does not move the
+  // interval of agent 0
+  std::vector<std::vector<uint32_t> > expected = {{0, 1}, {}, {0}, {1}, {0}, {0}, {0}};
+  NS_TEST_ASSERT_MSG_EQ (m_dueAgents.size (), steps, "Steps missing");
+  for (uint32_t i = 0; i < steps; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_dueAgents[i].size (), expected[i].size (), "Wrong due agents at " << i << " s");
+      for (uint32_t j = 0; j < expected[i].size (); j++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (m_dueAgents[i][j], expected[i][j], "Wrong due agents at " << i << " s");
+        }
+    }
+}
+
+// Check the Box observation deltas sent with DeltaObservations
+class OpengymDeltaObservationTestCase : public TestCase
+{
+public:
+  OpengymDeltaObservationTestCase ();
+  virtual ~OpengymDeltaObservationTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymDeltaObservationTestCase::OpengymDeltaObservationTestCase ()
+  : TestCase ("Opengym multi-agent Box observations are sent as deltas between keyframes")
+{
+}
+
+OpengymDeltaObservationTestCase::~OpengymDeltaObservationTestCase ()
+{
+}
+
+void
+OpengymDeltaObservationTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 1) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (2);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  // no actions, the first step after Init does not execute any either
+  std::string actBytes = ns3opengym::MultiAgentActMsg ().SerializeAsString ();
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->EnableDeltaObservations (4);
+
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  uint32_t size;
+  std::vector<float> expected (64, 0.5);
+  for (uint32_t step = 0; step < 9; step++)
+    {
+      // one changed element per step, none at step 2
+      if (step > 0 && step != 2)
+        {
+          env->SetBoxObsValue (step, step);
+          expected[step] = step;
+        }
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      if (step == 0)
+        {
+          // init msg
+          agent->Receive (size);
+          agent->Release ();
+        }
+      const uint8_t *data = agent->Receive (size);
+      ns3opengym::MultiAgentStateMsg stateMsg;
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse state msg");
+      agent->Release ();
+
+      const ns3opengym::RawTensor &tensor = stateMsg.agentstatemsg (0).obsdata ().tensor ();
+      const ns3opengym::TensorDelta &delta = tensor.delta ();
+      NS_TEST_ASSERT_MSG_EQ (delta.seq (), step + 1, "Wrong observation number");
+      if (step % 4 == 0)
+        {
+          NS_TEST_ASSERT_MSG_EQ (delta.encoding (), ns3opengym::TensorDelta::NONE,
+                                 "No keyframe at step " << step);
+          NS_TEST_ASSERT_MSG_EQ (std::memcmp (tensor.data ().data (), expected.data (),
+                                              expected.size () * sizeof (float)),
+                                 0, "Wrong keyframe at step " << step);
+          continue;
+        }
+      NS_TEST_ASSERT_MSG_EQ (delta.encoding (), ns3opengym::TensorDelta::SPARSE,
+                             "No sparse delta at step " << step);
+      NS_TEST_ASSERT_MSG_EQ (tensor.data ().size (), 0, "Full data sent with delta");
+      if (step == 2)
+        {
+          NS_TEST_ASSERT_MSG_EQ (delta.indices_size (), 0, "Unchanged element sent");
+          continue;
+        }
+      NS_TEST_ASSERT_MSG_EQ (delta.indices_size (), 1, "Wrong number of changed elements");
+      NS_TEST_ASSERT_MSG_EQ (delta.indices (0), step, "Wrong changed element");
+      float value;
+      std::memcpy (&value, delta.values ().data (), sizeof (value));
+      NS_TEST_ASSERT_MSG_EQ (value, expected[step], "Wrong changed value");
+    }
+}
+
+// Pipelined mode: a step executes the actions answered for the state of
+// the previous step, the first step executes none
+class OpengymPipelinedTestCase : public TestCase
+{
+public:
+  OpengymPipelinedTestCase ();
+  virtual ~OpengymPipelinedTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymPipelinedTestCase::OpengymPipelinedTestCase ()
+  : TestCase ("Opengym multi-agent pipelined step executes the actions of the previous state")
+{
+}
+
+OpengymPipelinedTestCase::~OpengymPipelinedTestCase ()
+{
+}
+
+void
+OpengymPipelinedTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 14) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  agent->Send (ackBytes.data (), ackBytes.size ());
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->SetPipelined (true);
+  // no reply is waited for
+  env->Step ();
+  NS_TEST_ASSERT_MSG_EQ (env->m_executed.size (), 0, "Actions executed at the first step");
+  uint32_t size;
+  NS_TEST_ASSERT_MSG_NE (agent->Receive (size, 0), 0, "Init msg missing");
+  agent->Release ();
+
+  const uint32_t steps = 10;
+  for (uint32_t i = 1; i <= steps; i++)
+    {
+      const uint8_t *data = agent->Receive (size, 0);
+      NS_TEST_ASSERT_MSG_NE (data, 0, "State of step " << i - 1 << " missing");
+      ns3opengym::MultiAgentStateMsg stateMsg;
+      stateMsg.ParseFromArray (data, size);
+      agent->Release ();
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), i - 1, "Wrong state");
+
+      std::string actBytes = SerializeTestActions (stateMsg.stepidx (), i % 4, i % 10);
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      NS_TEST_ASSERT_MSG_EQ (env->m_executed.size (), 2 * i, "Actions of state " << i - 1 << " not executed");
+      NS_TEST_ASSERT_MSG_EQ (env->m_discreteAction, i % 4,
+                             "Step " << i << " did not execute the actions of state " << i - 1);
+      NS_TEST_ASSERT_MSG_EQ (env->m_boxActionSum, int32_t (3 * (i % 10)),
+                             "Step " << i << " did not execute the actions of state " << i - 1);
+    }
+  // the state of the last step is not answered yet
+  NS_TEST_ASSERT_MSG_NE (agent->Receive (size, 0), 0, "State of the last step missing");
+  agent->Release ();
+}
+
+// A step without actions before the StepDeadline executes the fallback
+// actions, the late actions are dropped at the next step
+class OpengymStepDeadlineTestCase : public TestCase
+{
+public:
+  OpengymStepDeadlineTestCase ();
+  virtual ~OpengymStepDeadlineTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymStepDeadlineTestCase::OpengymStepDeadlineTestCase ()
+  : TestCase ("Opengym multi-agent step falls back to default actions after the deadline")
+{
+}
+
+OpengymStepDeadlineTestCase::~OpengymStepDeadlineTestCase ()
+{
+}
+
+void
+OpengymStepDeadlineTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 2) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->SetStepDeadline (MilliSeconds (20));
+  env->SetFallbackAction (OpenGymMultiInterface::FALLBACK_DEFAULT);
+  // only agent 0 has a default action
+  Ptr<OpenGymDiscreteContainer> defaultAction = CreateObject<OpenGymDiscreteContainer> (4);
+  defaultAction->SetValue (1);
+  env->SetDefaultAction (0, defaultAction);
+
+  // step 0 in time
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  std::string actBytes = SerializeTestActions (0, 3, 1);
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  NS_TEST_ASSERT_MSG_EQ (env->m_discreteAction, 3, "Actions of step 0 not executed");
+  NS_TEST_ASSERT_MSG_EQ (env->m_boxActionSum, 3, "Actions of step 0 not executed");
+
+  // step 1 misses the deadline
+  env->Step ();
+  NS_TEST_ASSERT_MSG_EQ (env->m_discreteAction, 1, "Default action not executed");
+  NS_TEST_ASSERT_MSG_EQ (env->m_boxActionSum, 3, "Action executed without a default");
+  NS_TEST_ASSERT_MSG_EQ (env->GetDeadlineMisses (0), 1, "Deadline miss not counted");
+  NS_TEST_ASSERT_MSG_EQ (env->GetDeadlineMisses (1), 1, "Deadline miss not counted");
+
+  // the late actions of step 1 arrive before the ones of step 2
+  actBytes = SerializeTestActions (1, 0, 5);
+  agent->Send (actBytes.data (), actBytes.size ());
+  actBytes = SerializeTestActions (2, 2, 2);
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  NS_TEST_ASSERT_MSG_EQ (env->m_discreteAction, 2, "Actions of step 2 not executed");
+  NS_TEST_ASSERT_MSG_EQ (env->m_boxActionSum, 6, "Actions of step 2 not executed");
+  NS_TEST_ASSERT_MSG_EQ (env->GetDeadlineMisses (0), 1, "Step in time counted as miss");
+
+  // init msg and the three states
+  uint32_t size;
+  for (int i = 0; i < 4; i++)
+    {
+      NS_TEST_ASSERT_MSG_NE (agent->Receive (size, 0), 0, "Message to the agent missing");
+      agent->Release ();
+    }
+}
+
+// In deadline mode a late agent gets no new states until it replied, so
+// they neither pile up in the DEALER socket nor block a full shm ring
+class OpengymLateAgentTestCase : public TestCase
+{
+public:
+  OpengymLateAgentTestCase ();
+  virtual ~OpengymLateAgentTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymLateAgentTestCase::OpengymLateAgentTestCase ()
+  : TestCase ("Opengym multi-agent step skips the states of a late agent")
+{
+}
+
+OpengymLateAgentTestCase::~OpengymLateAgentTestCase ()
+{
+}
+
+void
+OpengymLateAgentTestCase::DoRun (void)
+{
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+
+  // tcp: the agent takes the init msg and never answers a state, for more
+  // steps than the default SNDHWM of 1000 messages
+  uint32_t port = 40000 + (::getpid () + 9) % 20000;
+  zmq::context_t context (1);
+  zmq::socket_t agent (context, ZMQ_REP);
+  agent.bind ("tcp://*:" + std::to_string (port));
+  std::thread handshake ([&agent, &ackBytes] () {
+    zmq::message_t init;
+    agent.recv (&init);
+    zmq::message_t ack (ackBytes.data (), ackBytes.size ());
+    agent.send (ack);
+  });
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->UseTcp ();
+  env->SetStepDeadline (MilliSeconds (1));
+  const uint32_t steps = 1100;
+  for (uint32_t i = 0; i < steps; i++)
+    {
+      env->Step ();
+      if (i == 0)
+        {
+          handshake.join ();
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (env->GetDeadlineMisses (0), steps, "Steps of the late agent not missed");
+
+  // only the first state was sent, the next one follows the late reply
+  zmq::message_t request;
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  agent.recv (&request);
+  stateMsg.ParseFromArray (request.data (), request.size ());
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), 0, "Wrong first state");
+  std::string actBytes = SerializeTestActions (0, 1, 1);
+  zmq::message_t reply (actBytes.data (), actBytes.size ());
+  agent.send (reply);
+  zmq_pollitem_t item = {(void *) agent, 0, ZMQ_POLLIN, 0};
+  uint32_t lateSteps = 0;
+  do
+    {
+      env->Step ();
+      lateSteps++;
+    }
+  while (zmq_poll (&item, 1, 10) == 0 && lateSteps < 100);
+  NS_TEST_ASSERT_MSG_EQ (zmq_poll (&item, 1, 0), 1, "No state after the late reply");
+  agent.recv (&request);
+  stateMsg.ParseFromArray (request.data (), request.size ());
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), steps + lateSteps - 1, "States of skipped steps sent");
+
+  // shm: the agent answers every step in advance but never reads a state,
+  // a state that does not fit the ring is skipped after the deadline
+  port = 40000 + (::getpid () + 10) % 20000;
+  Ptr<OpenGymShmChannel> shmAgent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (shmAgent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 12), true,
+                         "Cannot create shm segment");
+  shmAgent->Send (ackBytes.data (), ackBytes.size ());
+  env = CreateObject<StepAllocationTestEnv> (port);
+  env->SetStepDeadline (MilliSeconds (5));
+  const uint32_t shmSteps = 30;
+  for (uint32_t i = 0; i < shmSteps; i++)
+    {
+      actBytes = SerializeTestActions (i, 2, 1);
+      shmAgent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+    }
+  NS_TEST_ASSERT_MSG_GT (env->GetDeadlineMisses (0), 0, "Ring never full");
+  uint32_t received = 0;
+  uint32_t size;
+  while (shmAgent->Receive (size, 0))
+    {
+      shmAgent->Release ();
+      received++;
+    }
+  // init msg and the states sent
+  NS_TEST_ASSERT_MSG_EQ (received - 1 + env->GetDeadlineMisses (0), shmSteps, "States lost or blocked");
+}
+
+// Worker mode with two REQ workers in this process: worker 0 serves agent 1
+// and worker 1 agent 0. Each worker only answers once the other one got
+// its state, worker 0 only after the reply of worker 1.
+class OpengymWorkerTestCase : public TestCase
+{
+public:
+  OpengymWorkerTestCase ();
+  virtual ~OpengymWorkerTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymWorkerTestCase::OpengymWorkerTestCase ()
+  : TestCase ("Opengym multi-agent worker mode routes states and gathers replies")
+{
+}
+
+OpengymWorkerTestCase::~OpengymWorkerTestCase ()
+{
+}
+
+void
+OpengymWorkerTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 13) % 20000;
+  const uint32_t steps = 5;
+  zmq::context_t context (1);
+  // per worker: states received and replies sent
+  std::atomic<uint32_t> states[2];
+  std::atomic<uint32_t> replies[2];
+  // per worker: agents of each state, steps it did not wait in vain for
+  // the other worker
+  std::vector<std::vector<uint32_t> > agents[2];
+  uint32_t inOrder[2] = {0, 0};
+  std::thread workers[2];
+  for (uint32_t w = 0; w < 2; w++)
+    {
+      states[w] = 0;
+      replies[w] = 0;
+    }
+  for (uint32_t w = 0; w < 2; w++)
+    {
+      workers[w] = std::thread ([&, w] () {
+        // wait up to 1 s for condition, \return false on timeout
+        auto waitFor = [] (std::function<bool ()> condition) {
+          for (uint32_t ms = 0; ms < 1000 && !condition (); ms++)
+            {
+              std::this_thread::sleep_for (std::chrono::milliseconds (1));
+            }
+          return condition ();
+        };
+        uint32_t other = 1 - w;
+        uint32_t agentId = other;
+        zmq::socket_t socket (context, ZMQ_REQ);
+        socket.connect ("tcp://localhost:" + std::to_string (port));
+        ns3opengym::WorkerHelloMsg hello;
+        hello.set_workerid (w);
+        hello.add_agentids (agentId);
+        std::string bytes = hello.SerializeAsString ();
+        zmq::message_t request (bytes.data (), bytes.size ());
+        socket.send (request);
+
+        zmq::message_t reply;
+        socket.recv (&reply);
+        ns3opengym::SimInitAck simInitAck;
+        simInitAck.set_done (true);
+        simInitAck.set_rawtensorversion (1);
+        bytes = simInitAck.SerializeAsString ();
+        zmq::message_t ack (bytes.data (), bytes.size ());
+        socket.send (ack);
+
+        for (uint32_t step = 0; step < steps; step++)
+          {
+            socket.recv (&reply);
+            ns3opengym::MultiAgentStateMsg stateMsg;
+            stateMsg.ParseFromArray (reply.data (), reply.size ());
+            agents[w].push_back (std::vector<uint32_t> ());
+            for (int i = 0; i < stateMsg.agentstatemsg_size (); i++)
+              {
+                agents[w].back ().push_back (stateMsg.agentstatemsg (i).agentid ());
+              }
+            states[w]++;
+            // both states are out before any reply, worker 1 replies first
+            bool ok = waitFor ([&] () { return states[other] > step; });
+            if (w == 0)
+              {
+                ok = ok && waitFor ([&] () { return replies[other] > step; });
+              }
+            inOrder[w] += ok;
+
+            ns3opengym::MultiAgentActMsg actMsg;
+            actMsg.ParseFromString (SerializeTestActions (stateMsg.stepidx (), 1, 1));
+            // only the action of the worker's agent
+            if (agentId == 1)
+              {
+                actMsg.mutable_agentactmsg ()->SwapElements (0, 1);
+              }
+            actMsg.mutable_agentactmsg ()->RemoveLast ();
+            bytes = actMsg.SerializeAsString ();
+            zmq::message_t actions (bytes.data (), bytes.size ());
+            socket.send (actions);
+            replies[w]++;
+          }
+      });
+    }
+
+  Ptr<StepAllocationTestEnv> env = CreateObject<StepAllocationTestEnv> (port);
+  env->UseWorkers (2);
+  for (uint32_t i = 0; i < steps; i++)
+    {
+      env->Step ();
+    }
+  for (uint32_t w = 0; w < 2; w++)
+    {
+      workers[w].join ();
+    }
+
+  for (uint32_t w = 0; w < 2; w++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (agents[w].size (), steps, "States of worker " << w << " missing");
+      for (uint32_t step = 0; step < agents[w].size (); step++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (agents[w][step].size (), 1, "Wrong agents sent to worker " << w);
+          NS_TEST_ASSERT_MSG_EQ (agents[w][step][0], 1 - w, "Wrong agents sent to worker " << w);
+        }
+      NS_TEST_ASSERT_MSG_EQ (inOrder[w], steps, "States of worker " << w << " not sent in one burst");
+    }
+  // worker id order, not arrival order
+  NS_TEST_ASSERT_MSG_EQ (env->m_executed.size (), 2 * steps, "Actions not executed");
+  for (uint32_t i = 0; i + 1 < env->m_executed.size (); i += 2)
+    {
+      NS_TEST_ASSERT_MSG_EQ (env->m_executed[i], 1, "Actions not executed in worker order");
+      NS_TEST_ASSERT_MSG_EQ (env->m_executed[i + 1], 0, "Actions not executed in worker order");
+    }
+}
+
+// Fixed-shape Box container: N-d writes, views and reuse
+class OpengymBoxContainerTestCase : public TestCase
+{
+public:
+  OpengymBoxContainerTestCase ();
+  virtual ~OpengymBoxContainerTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymBoxContainerTestCase::OpengymBoxContainerTestCase ()
+  : TestCase ("Opengym fixed-shape Box container")
+{
+}
+
+OpengymBoxContainerTestCase::~OpengymBoxContainerTestCase ()
+{
+}
+
+void
+OpengymBoxContainerTestCase::DoRun (void)
+{
+  std::vector<uint32_t> shape = {2, 3};
+  Ptr<OpenGymBoxContainer<int32_t> > box = CreateObject<OpenGymBoxContainer<int32_t> > (shape, 0);
+  NS_TEST_ASSERT_MSG_EQ (box->IsFixedShape (), true, "Container not fixed-shape");
+  NS_TEST_ASSERT_MSG_EQ (box->GetDataView ().size (), 6, "Data not sized from the shape");
+  NS_TEST_ASSERT_MSG_EQ (box->GetShapeView ().size (), 2, "Wrong shape view");
+
+  NS_TEST_ASSERT_MSG_EQ (box->Set ({1, 2}, 7), true, "N-d write failed");
+  NS_TEST_ASSERT_MSG_EQ (box->Set (1, 3), true, "Flat write failed");
+  NS_TEST_ASSERT_MSG_EQ (box->Set ({2, 0}, 1), false, "Out of range N-d write accepted");
+  NS_TEST_ASSERT_MSG_EQ (box->Set (6, 1), false, "Out of range write accepted");
+  NS_TEST_ASSERT_MSG_EQ (box->GetFlatIndex ({1, 2}), 5, "Index not row-major");
+  NS_TEST_ASSERT_MSG_EQ (box->Get ({0, 1}), 3, "Wrong N-d read");
+
+  // views share the buffer
+  OpenGymSpan<const int32_t> view = box->GetDataView ();
+  box->GetMutableDataView ()[0] = 4;
+  NS_TEST_ASSERT_MSG_EQ (view[0], 4, "View does not see writes");
+  NS_TEST_ASSERT_MSG_EQ (view[5], 7, "View does not see writes");
+
+  // raw tensor streamed from the buffer
+  ns3opengym::DataContainer dataContainerPbMsg;
+  box->FillDataContainerPbMsg (dataContainerPbMsg, OpenGymDataContainer::GetRawTensorVersion ());
+  NS_TEST_ASSERT_MSG_EQ (std::memcmp (dataContainerPbMsg.tensor ().data ().data (), view.data (),
+                                      6 * sizeof (int32_t)),
+                         0, "Wrong raw tensor data");
+
+  // reuse: AddValue writes from the start and cannot grow the buffer
+  box->Reset ();
+  NS_TEST_ASSERT_MSG_EQ (view[5], 0, "Reset did not clear the data");
+  for (int32_t i = 0; i < 6; i++)
+    {
+      box->AddValue (i);
+    }
+  NS_TEST_ASSERT_MSG_EQ (box->AddValue (6), false, "Fixed-shape container grew");
+  NS_TEST_ASSERT_MSG_EQ (box->GetDataView ().data (), view.data (), "Buffer reallocated");
+  NS_TEST_ASSERT_MSG_EQ (box->Get ({1, 0}), 3, "Wrong value after reuse");
+  NS_TEST_ASSERT_MSG_EQ (box->SetData (std::vector<int32_t> (5)), false, "Wrong data size accepted");
+
+  // updates must bring the elements of their shape
+  box->FillDataContainerPbMsg (dataContainerPbMsg, OpenGymDataContainer::GetRawTensorVersion ());
+  ns3opengym::RawTensor *tensor = dataContainerPbMsg.mutable_tensor ();
+  tensor->mutable_data ()->resize (5 * sizeof (int32_t));
+  NS_TEST_ASSERT_MSG_EQ (box->UpdateFromDataContainerPbMsg (dataContainerPbMsg), false,
+                         "Data of a different size accepted");
+  NS_TEST_ASSERT_MSG_EQ (box->GetDataView ().size (), 6, "Element count changed");
+  tensor->mutable_data ()->resize (6 * sizeof (int32_t));
+  NS_TEST_ASSERT_MSG_EQ (box->UpdateFromDataContainerPbMsg (dataContainerPbMsg), true, "Not updated");
+  NS_TEST_ASSERT_MSG_EQ (box->AddValue (9), true, "Cursor not reset by the update");
+  NS_TEST_ASSERT_MSG_EQ (box->Get ({0, 0}), 9, "AddValue did not write from the start");
+}
+
+// Native Box dtypes: packed on the wire, INT / UINT for older agents
+class OpengymBoxDtypeTestCase : public TestCase
+{
+public:
+  OpengymBoxDtypeTestCase ();
+  virtual ~OpengymBoxDtypeTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymBoxDtypeTestCase::OpengymBoxDtypeTestCase ()
+  : TestCase ("Opengym native Box dtypes")
+{
+}
+
+OpengymBoxDtypeTestCase::~OpengymBoxDtypeTestCase ()
+{
+}
+
+void
+OpengymBoxDtypeTestCase::DoRun (void)
+{
+  std::vector<uint32_t> shape = {4};
+  Ptr<OpenGymBoxContainer<uint8_t> > occupancy = CreateObject<OpenGymBoxContainer<uint8_t> > (shape, 0);
+  occupancy->Set (2, 200);
+  ns3opengym::DataContainer dataContainerPbMsg;
+  occupancy->FillDataContainerPbMsg (dataContainerPbMsg, 3);
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().dtype (), ns3opengym::UINT8, "Wrong dtype");
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().data ().size (), 4, "Elements not packed");
+
+  Ptr<OpenGymDataContainer> created = OpenGymDataContainer::CreateFromDataContainerPbMsg (dataContainerPbMsg);
+  Ptr<OpenGymBoxContainer<uint8_t> > decoded = DynamicCast<OpenGymBoxContainer<uint8_t> > (created);
+  NS_TEST_ASSERT_MSG_NE (decoded, 0, "Decoded with a different element type");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) decoded->GetValue (2), 200, "Wrong decoded value");
+
+  // older agents get uint32 elements
+  occupancy->FillDataContainerPbMsg (dataContainerPbMsg, 2);
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().dtype (), ns3opengym::UINT, "Wrong legacy dtype");
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().data ().size (), 16, "Wrong legacy size");
+
+  // 64-bit values are not narrowed
+  Ptr<OpenGymBoxContainer<uint64_t> > bytes = CreateObject<OpenGymBoxContainer<uint64_t> > (shape);
+  bytes->AddValue (uint64_t (1) << 40);
+  bytes->FillDataContainerPbMsg (dataContainerPbMsg, 3);
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().dtype (), ns3opengym::UINT64, "Wrong dtype");
+  uint64_t value;
+  std::memcpy (&value, dataContainerPbMsg.tensor ().data ().data (), sizeof (value));
+  NS_TEST_ASSERT_MSG_EQ (value, uint64_t (1) << 40, "Value narrowed");
+
+  Ptr<OpenGymBoxContainer<bool> > flags = CreateObject<OpenGymBoxContainer<bool> > (shape, false);
+  flags->Set (1, true);
+  flags->FillDataContainerPbMsg (dataContainerPbMsg, 3);
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().dtype (), ns3opengym::BOOL, "Wrong dtype");
+  NS_TEST_ASSERT_MSG_EQ (dataContainerPbMsg.tensor ().data (), std::string ("\0\1\0\0", 4), "Wrong bool data");
+  Ptr<OpenGymBoxContainer<bool> > recycled = CreateObject<OpenGymBoxContainer<bool> > ();
+  NS_TEST_ASSERT_MSG_EQ (recycled->UpdateFromDataContainerPbMsg (dataContainerPbMsg), true, "Not updated");
+  NS_TEST_ASSERT_MSG_EQ (recycled->GetData ()[1], true, "Wrong bool value");
+  NS_TEST_ASSERT_MSG_EQ (OpenGymDataContainer::GetDtypeSize (ns3opengym::INT16), 2, "Wrong element size");
+
+  // spaces are described before the raw tensor version is negotiated
+  Ptr<OpenGymBoxSpace> space = CreateObject<OpenGymBoxSpace> (0, 255, shape, TypeNameGet<uint8_t> ());
+  ns3opengym::BoxSpace boxSpacePb;
+  space->GetSpaceDescription ().space ().UnpackTo (&boxSpacePb);
+  NS_TEST_ASSERT_MSG_EQ (boxSpacePb.dtype (), ns3opengym::UINT, "Native dtype shown to older agents");
+  NS_TEST_ASSERT_MSG_EQ (boxSpacePb.nativedtype (), ns3opengym::UINT8, "Wrong native dtype");
+  space = CreateObject<OpenGymBoxSpace> (0, 1, shape, TypeNameGet<float> ());
+  space->GetSpaceDescription ().space ().UnpackTo (&boxSpacePb);
+  NS_TEST_ASSERT_MSG_EQ (boxSpacePb.dtype (), ns3opengym::FLOAT, "Wrong dtype");
+  NS_TEST_ASSERT_MSG_EQ (boxSpacePb.nativedtype (), ns3opengym::NoDType, "Native dtype of a float space");
+}
+
+// Container pool: released containers are handed out again, kept ones are not
+class OpengymContainerPoolTestCase : public TestCase
+{
+public:
+  OpengymContainerPoolTestCase ();
+  virtual ~OpengymContainerPoolTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymContainerPoolTestCase::OpengymContainerPoolTestCase ()
+  : TestCase ("Opengym container pool")
+{
+}
+
+OpengymContainerPoolTestCase::~OpengymContainerPoolTestCase ()
+{
+}
+
+void
+OpengymContainerPoolTestCase::DoRun (void)
+{
+  Ptr<OpenGymContainerPool> pool = Create<OpenGymContainerPool> ();
+  OpenGymContainerPool::SetCurrent (PeekPointer (pool));
+  std::vector<uint32_t> shape = {3};
+  Ptr<OpenGymBoxContainer<uint32_t> > kept;
+  OpenGymBoxContainer<uint32_t> *first = 0;
+  for (int step = 0; step < 3; step++)
+    {
+      pool->ReleaseStep ();
+      Ptr<OpenGymTupleContainer> tuple = OpenGymDataContainer::Acquire<OpenGymTupleContainer> ();
+      Ptr<OpenGymBoxContainer<uint32_t> > box =
+          OpenGymDataContainer::Acquire<OpenGymBoxContainer<uint32_t> > (shape);
+      NS_TEST_ASSERT_MSG_EQ (box->GetDataView ().size (), 0, "Recycled box not cleared");
+      box->AddValue (step);
+      tuple->Add (box);
+      tuple->Add (OpenGymDataContainer::Acquire<OpenGymDiscreteContainer> (4));
+      if (step == 0)
+        {
+          first = PeekPointer (box);
+        }
+      if (step == 1)
+        {
+          NS_TEST_ASSERT_MSG_EQ (PeekPointer (box), first, "Box not recycled");
+          kept = box;
+        }
+      if (step == 2)
+        {
+          NS_TEST_ASSERT_MSG_NE (PeekPointer (box), PeekPointer (kept), "Kept box handed out");
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (kept->GetValue (0), 1, "Kept box changed");
+  // step 0 misses all three, step 1 hits all three, step 2 misses the kept box
+  NS_TEST_ASSERT_MSG_EQ (pool->GetMisses (), 4, "Wrong miss count");
+  NS_TEST_ASSERT_MSG_EQ (pool->GetHits (), 5, "Wrong hit count");
+  OpenGymContainerPool::SetCurrent (0);
+}
+
+// Value types: same wire format as the containers, adapters in both directions
+class OpengymValueTestCase : public TestCase
+{
+public:
+  OpengymValueTestCase ();
+  virtual ~OpengymValueTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymValueTestCase::OpengymValueTestCase ()
+  : TestCase ("Opengym value types")
+{
+}
+
+OpengymValueTestCase::~OpengymValueTestCase ()
+{
+}
+
+void
+OpengymValueTestCase::DoRun (void)
+{
+  std::vector<uint32_t> shape = {3};
+  opengym::Box<int16_t> queue (shape, 0);
+  queue.data[1] = -7;
+  opengym::Dict dict;
+  // in key order like the std::map of OpenGymDictContainer
+  dict.elements.push_back (std::make_pair ("channel", opengym::Data (opengym::Discrete (4, 2))));
+  dict.elements.push_back (std::make_pair ("queue", opengym::Data (queue)));
+  opengym::Data obs (dict);
+
+  // the value path sends the same message as the containers
+  Ptr<OpenGymDictContainer> container = DynamicCast<OpenGymDictContainer> (obs.ToContainer ());
+  NS_TEST_ASSERT_MSG_NE (container, 0, "Wrong container type");
+  Ptr<OpenGymBoxContainer<int16_t> > box =
+      DynamicCast<OpenGymBoxContainer<int16_t> > (container->Get ("queue"));
+  NS_TEST_ASSERT_MSG_NE (box, 0, "Wrong element type");
+  NS_TEST_ASSERT_MSG_EQ (box->GetValue (1), -7, "Wrong element value");
+  ns3opengym::DataContainer fromValue;
+  ns3opengym::DataContainer fromContainer;
+  obs.Fill (fromValue, 3);
+  container->FillDataContainerPbMsg (fromContainer, 3);
+  NS_TEST_ASSERT_MSG_EQ (fromValue.SerializeAsString (), fromContainer.SerializeAsString (),
+                         "Value and container messages differ");
+
+  opengym::Data decoded;
+  NS_TEST_ASSERT_MSG_EQ (decoded.Update (fromValue), true, "Not decoded");
+  const opengym::Data *channel = decoded.Find ("channel");
+  NS_TEST_ASSERT_MSG_NE (channel, 0, "Key lost");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetValue (), 2, "Wrong discrete value");
+  opengym::Box<int16_t> queueOut;
+  NS_TEST_ASSERT_MSG_EQ (decoded.Find ("queue")->Get (queueOut), true, "Box not decoded");
+  NS_TEST_ASSERT_MSG_EQ (queueOut.data[1], -7, "Wrong decoded value");
+  opengym::Box<float> wrongDtype;
+  NS_TEST_ASSERT_MSG_EQ (decoded.Find ("queue")->Get (wrongDtype), false, "Dtype not checked");
+
+  // older agents get a legacy dtype through the containers
+  opengym::Data legacy (queue);
+  legacy.Fill (fromValue, 2);
+  NS_TEST_ASSERT_MSG_EQ (fromValue.tensor ().dtype (), ns3opengym::INT, "Wrong legacy dtype");
+  Ptr<OpenGymDiscreteContainer> action = CreateObject<OpenGymDiscreteContainer> (5);
+  action->SetValue (3);
+  NS_TEST_ASSERT_MSG_EQ (opengym::Data::FromContainer (action).GetValue (), 3, "Wrong adapted action");
+}
+
+// Schema-bound dicts: keys interned to slots, sent by slot from version 5
+class OpengymDictSlotTestCase : public TestCase
+{
+public:
+  OpengymDictSlotTestCase ();
+  virtual ~OpengymDictSlotTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymDictSlotTestCase::OpengymDictSlotTestCase ()
+  : TestCase ("Opengym dict keys interned to slots")
+{
+}
+
+OpengymDictSlotTestCase::~OpengymDictSlotTestCase ()
+{
+}
+
+void
+OpengymDictSlotTestCase::DoRun (void)
+{
+  Ptr<OpenGymDictSpace> space = CreateObject<OpenGymDictSpace> ();
+  space->Add ("queue", CreateObject<OpenGymDiscreteSpace> (10));
+  space->Add ("channel", CreateObject<OpenGymDiscreteSpace> (4));
+  space->Add ("rate", CreateObject<OpenGymDiscreteSpace> (8));
+  NS_TEST_ASSERT_MSG_EQ (space->GetSlotCount (), 3, "Wrong slot count");
+  // slots in key order, the order of the space description
+  NS_TEST_ASSERT_MSG_EQ (space->GetSlot ("channel"), 0, "Wrong slot");
+  NS_TEST_ASSERT_MSG_EQ (space->GetSlot ("rate"), 2, "Wrong slot");
+  NS_TEST_ASSERT_MSG_EQ (space->GetSlot ("missing"), -1, "Unknown key has a slot");
+  NS_TEST_ASSERT_MSG_EQ (space->GetSpaceDescription ().space ().value ().find ("queue") !=
+                             std::string::npos,
+                         true, "Key missing in the space description");
+
+  Ptr<OpenGymDictContainer> dict = CreateObject<OpenGymDictContainer> (space);
+  Ptr<OpenGymDiscreteContainer> queue = CreateObject<OpenGymDiscreteContainer> (10);
+  queue->SetValue (7);
+  NS_TEST_ASSERT_MSG_EQ (dict->Set (space->GetSlot ("queue"), queue), true, "Slot not set");
+  NS_TEST_ASSERT_MSG_EQ (dict->Add ("channel", CreateObject<OpenGymDiscreteContainer> (4)), true,
+                         "Key not added");
+  NS_TEST_ASSERT_MSG_EQ (dict->Add ("missing", queue), false, "Key outside the space added");
+  NS_TEST_ASSERT_MSG_EQ (dict->Get ("queue"), queue, "Lookup by key");
+
+  // slots instead of keys from version 5
+  ns3opengym::DataContainer msg;
+  dict->FillDataContainerPbMsg (msg, 5);
+  ns3opengym::DictDataContainer dictMsg;
+  msg.data ().UnpackTo (&dictMsg);
+  NS_TEST_ASSERT_MSG_EQ (dictMsg.element_size (), 2, "Unset slot sent");
+  NS_TEST_ASSERT_MSG_EQ (dictMsg.element (1).slot (), 2, "Wrong slot sent, index + 1");
+  NS_TEST_ASSERT_MSG_EQ (dictMsg.element (1).name (), "", "Key sent with the slot");
+  ns3opengym::DataContainer legacyMsg;
+  dict->FillDataContainerPbMsg (legacyMsg, 4);
+  legacyMsg.data ().UnpackTo (&dictMsg);
+  NS_TEST_ASSERT_MSG_EQ (dictMsg.element (1).name (), "queue", "Older agents need keys");
+
+  // received by slot, keys once bound
+  Ptr<OpenGymDictContainer> received =
+      DynamicCast<OpenGymDictContainer> (OpenGymDataContainer::CreateFromDataContainerPbMsg (msg));
+  Ptr<OpenGymDiscreteContainer> element = DynamicCast<OpenGymDiscreteContainer> (received->Get (1));
+  NS_TEST_ASSERT_MSG_NE (element, 0, "Element lost");
+  NS_TEST_ASSERT_MSG_EQ (element->GetValue (), 7, "Wrong element value");
+  NS_TEST_ASSERT_MSG_EQ (received->Bind (space), true, "Not bound");
+  NS_TEST_ASSERT_MSG_EQ (received->Get ("queue"), element, "Lookup by key after Bind");
+
+  // received by key, bound to the slots of the space
+  received =
+      DynamicCast<OpenGymDictContainer> (OpenGymDataContainer::CreateFromDataContainerPbMsg (legacyMsg));
+  NS_TEST_ASSERT_MSG_EQ (received->Bind (space), true, "Not bound");
+  element = DynamicCast<OpenGymDiscreteContainer> (received->Get (space->GetSlot ("queue")));
+  NS_TEST_ASSERT_MSG_NE (element, 0, "Element not moved to its slot");
+  NS_TEST_ASSERT_MSG_EQ (element->GetValue (), 7, "Wrong element value");
+}
+
+// Sparse Box: COO and CSR from version 6, a dense Box before
+class OpengymSparseBoxTestCase : public TestCase
+{
+public:
+  OpengymSparseBoxTestCase ();
+  virtual ~OpengymSparseBoxTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymSparseBoxTestCase::OpengymSparseBoxTestCase ()
+  : TestCase ("Opengym sparse Box container")
+{
+}
+
+OpengymSparseBoxTestCase::~OpengymSparseBoxTestCase ()
+{
+}
+
+void
+OpengymSparseBoxTestCase::DoRun (void)
+{
+  std::vector<uint32_t> shape = {3, 4};
+  Ptr<OpenGymSparseBoxContainer<float> > links = CreateObject<OpenGymSparseBoxContainer<float> > (shape);
+  NS_TEST_ASSERT_MSG_EQ (links->Add ({2, 1}, 1.5), true, "Element not added");
+  NS_TEST_ASSERT_MSG_EQ (links->Add ({0, 3}, 2.0), true, "Element not added");
+  NS_TEST_ASSERT_MSG_EQ (links->Add (9, 0.5), true, "Element not added");
+  NS_TEST_ASSERT_MSG_EQ (links->Add ({3, 0}, 1.0), false, "Out of range element added");
+  NS_TEST_ASSERT_MSG_EQ (links->GetNnz (), 3, "Wrong element count");
+  NS_TEST_ASSERT_MSG_EQ (links->GetDense ()[9], 2.0, "Duplicates not summed");
+
+  ns3opengym::DataContainer msg;
+  links->FillDataContainerPbMsg (msg, 6);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::SparseBox, "Wrong type");
+  NS_TEST_ASSERT_MSG_EQ (msg.sparse ().format (), ns3opengym::SparseTensor::COO, "Wrong format");
+  std::vector<uint32_t> coords (6);
+  NS_TEST_ASSERT_MSG_EQ (msg.sparse ().indices ().size (), coords.size () * sizeof (uint32_t), "Wrong index size");
+  std::memcpy (coords.data (), msg.sparse ().indices ().data (), msg.sparse ().indices ().size ());
+  // rows of the three elements, then their columns
+  NS_TEST_ASSERT_MSG_EQ (coords == std::vector<uint32_t> ({2, 0, 2, 1, 3, 1}), true, "Wrong coordinates");
+  NS_TEST_ASSERT_MSG_EQ (msg.sparse ().values ().size (), 3 * sizeof (float), "Wrong value size");
+
+  // CSR: elements ordered by row
+  links->SetFormat (OpenGymSparseBoxContainer<float>::CSR);
+  links->FillDataContainerPbMsg (msg, 6);
+  NS_TEST_ASSERT_MSG_EQ (msg.sparse ().format (), ns3opengym::SparseTensor::CSR, "Wrong format");
+  std::vector<uint32_t> indptr (4);
+  std::memcpy (indptr.data (), msg.sparse ().indptr ().data (), msg.sparse ().indptr ().size ());
+  NS_TEST_ASSERT_MSG_EQ (indptr == std::vector<uint32_t> ({0, 1, 1, 3}), true, "Wrong row pointers");
+  std::vector<float> values (3);
+  std::memcpy (values.data (), msg.sparse ().values ().data (), msg.sparse ().values ().size ());
+  NS_TEST_ASSERT_MSG_EQ (values[0], 2.0, "Wrong value order");
+  NS_TEST_ASSERT_MSG_EQ (values[1], 1.5, "Wrong value order");
+
+  // older agents get the dense Box
+  links->FillDataContainerPbMsg (msg, 5);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::Box, "Not densified");
+  Ptr<OpenGymBoxContainer<float> > dense =
+      DynamicCast<OpenGymBoxContainer<float> > (OpenGymDataContainer::CreateFromDataContainerPbMsg (msg));
+  NS_TEST_ASSERT_MSG_NE (dense, 0, "Dense Box not decoded");
+  NS_TEST_ASSERT_MSG_EQ (dense->GetValue (9), 2.0, "Wrong dense value");
+  NS_TEST_ASSERT_MSG_EQ (dense->GetValue (3), 2.0, "Wrong dense value");
+  NS_TEST_ASSERT_MSG_EQ (dense->GetValue (0), 0.0, "Wrong dense value");
+
+  links->Reset ();
+  links->FillDataContainerPbMsg (msg, 6);
+  NS_TEST_ASSERT_MSG_EQ (msg.sparse ().values ().size (), 0, "Elements kept after Reset");
+}
+
+// Graph: keyframe after structural changes, changed feature rows otherwise
+class OpengymGraphTestCase : public TestCase
+{
+public:
+  OpengymGraphTestCase ();
+  virtual ~OpengymGraphTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymGraphTestCase::OpengymGraphTestCase ()
+  : TestCase ("Opengym graph container")
+{
+}
+
+OpengymGraphTestCase::~OpengymGraphTestCase ()
+{
+}
+
+void
+OpengymGraphTestCase::DoRun (void)
+{
+  Ptr<OpenGymGraphContainer> graph = CreateObject<OpenGymGraphContainer> (2, 1);
+  NS_TEST_ASSERT_MSG_EQ (graph->AddNodes (3), 0, "Wrong first node");
+  int32_t link = graph->AddEdge (2, 0);
+  NS_TEST_ASSERT_MSG_EQ (graph->AddEdge (0, 1), 1, "Wrong edge id");
+  NS_TEST_ASSERT_MSG_EQ (graph->AddEdge (0, 3), -1, "Edge to a missing node added");
+  graph->SetEdgeFeature (link, 0, 5.0);
+  graph->SetNodeFeatures (1, {1.0, 2.0});
+
+  ns3opengym::DataContainer msg;
+  ns3opengym::GraphDataContainer graphMsg;
+  graph->FillDataContainerPbMsg (msg, 7);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::Graph, "Wrong type");
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.keyframe (), true, "First fill is no keyframe");
+  std::vector<uint32_t> indptr (4);
+  std::memcpy (indptr.data (), graphMsg.indptr ().data (), graphMsg.indptr ().size ());
+  NS_TEST_ASSERT_MSG_EQ (indptr == std::vector<uint32_t> ({0, 1, 1, 2}), true, "Wrong row pointers");
+  float feature;
+  // edge 2 -> 0 is second in CSR order
+  std::memcpy (&feature, graphMsg.edgefeatures ().data ().data () + sizeof (float), sizeof (float));
+  NS_TEST_ASSERT_MSG_EQ (feature, 5.0, "Edge features not in CSR order");
+
+  // only the changed rows, unchanged values are not sent again
+  graph->SetNodeFeature (2, 1, 3.0);
+  graph->SetNodeFeatures (1, {1.0, 2.0});
+  graph->SetEdgeFeature (link, 0, 6.0);
+  graph->FillDataContainerPbMsg (msg, 7);
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.keyframe (), false, "Keyframe without a structural change");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.seq (), 2, "Wrong sequence number");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.indptr ().size (), 0, "Adjacency sent again");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.noderows (), std::string ("\2\0\0\0", 4), "Wrong changed node");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.edgerows (), std::string ("\1\0\0\0", 4), "Wrong changed edge position");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.nodefeatures ().data ().size (), 2 * sizeof (float), "Wrong node rows");
+
+  graph->FillDataContainerPbMsg (msg, 7);
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.noderows ().size () + graphMsg.edgerows ().size (), 0, "Rows sent twice");
+  graph->RemoveEdge (0);
+  NS_TEST_ASSERT_MSG_EQ (graph->GetEdgeSource (0), 0, "Last edge did not take the removed id");
+  graph->FillDataContainerPbMsg (msg, 7);
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.keyframe (), true, "No keyframe after a structural change");
+
+  // older agents get a Tuple of Boxes
+  graph->FillDataContainerPbMsg (msg, 5);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::Tuple, "Wrong legacy type");
+  Ptr<OpenGymTupleContainer> tuple =
+      DynamicCast<OpenGymTupleContainer> (OpenGymDataContainer::CreateFromDataContainerPbMsg (msg));
+  Ptr<OpenGymBoxContainer<float> > nodes = DynamicCast<OpenGymBoxContainer<float> > (tuple->Get (2));
+  NS_TEST_ASSERT_MSG_NE (nodes, 0, "Node features missing");
+  NS_TEST_ASSERT_MSG_EQ (nodes->GetValue (5), 3.0, "Wrong node feature");
+}
+
+// Removing an edge with a pending feature change leaves no stale change rows
+class OpengymGraphRemoveEdgeTestCase : public TestCase
+{
+public:
+  OpengymGraphRemoveEdgeTestCase ();
+  virtual ~OpengymGraphRemoveEdgeTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymGraphRemoveEdgeTestCase::OpengymGraphRemoveEdgeTestCase ()
+  : TestCase ("Opengym graph removes an edge with pending changes")
+{
+}
+
+OpengymGraphRemoveEdgeTestCase::~OpengymGraphRemoveEdgeTestCase ()
+{
+}
+
+void
+OpengymGraphRemoveEdgeTestCase::DoRun (void)
+{
+  Ptr<OpenGymGraphContainer> graph = CreateObject<OpenGymGraphContainer> (1, 1);
+  graph->AddNodes (3);
+  graph->AddEdge (0, 1);
+  graph->AddEdge (1, 2);
+  graph->AddEdge (2, 0);
+  ns3opengym::DataContainer msg;
+  ns3opengym::GraphDataContainer graphMsg;
+  graph->FillDataContainerPbMsg (msg, 7);
+
+  // edge 2 is pending and takes the id of edge 0
+  graph->SetEdgeFeature (2, 0, 4.0);
+  graph->SetNodeFeature (1, 0, 2.0);
+  NS_TEST_ASSERT_MSG_EQ (graph->RemoveEdge (0), true, "Edge not removed");
+  graph->FillDataContainerPbMsg (msg, 7);
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.keyframe (), true, "No keyframe after a structural change");
+  NS_TEST_ASSERT_MSG_EQ (graph->GetEdgeFeature (0, 0), 4.0, "Moved edge lost its features");
+
+  // the moved edge is tracked under its new id
+  graph->SetEdgeFeature (0, 0, 5.0);
+  graph->FillDataContainerPbMsg (msg, 7);
+  msg.data ().UnpackTo (&graphMsg);
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.keyframe (), false, "Keyframe without a structural change");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.noderows ().size (), 0, "Stale node row sent");
+  NS_TEST_ASSERT_MSG_EQ (graphMsg.edgerows ().size (), sizeof (uint32_t), "Wrong changed edges");
+}
+
+// Agents 0, 1 and 2 observe one graph, agent 2 only every other step
+class SharedGraphTestEnv : public OpenGymMultiEnv
+{
+public:
+  SharedGraphTestEnv (uint32_t port);
+
+  virtual Ptr<OpenGymSpace> GetActionSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymSpace> GetObservationSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymDataContainer> GetObservation (uint32_t agent_id);
+  virtual float GetReward (uint32_t agent_id);
+  virtual bool GetDone (uint32_t agent_id);
+  virtual std::string GetInfo (uint32_t agent_id);
+  virtual bool ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action);
+
+  Ptr<OpenGymGraphContainer> m_graph;
+  uint32_t m_step;
+};
+
+SharedGraphTestEnv::SharedGraphTestEnv (uint32_t port)
+  : m_step (0)
+{
+  m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+  SetOpenGymPort (port);
+  AddAgentId (0);
+  AddAgentId (1);
+  AddAgentId (2);
+  m_graph = CreateObject<OpenGymGraphContainer> (1, 1);
+  m_graph->AddNodes (2);
+  m_graph->AddEdge (0, 1);
+}
+
+Ptr<OpenGymSpace>
+SharedGraphTestEnv::GetActionSpace (uint32_t agent_id)
+{
+  return CreateObject<OpenGymDiscreteSpace> (2);
+}
+
+Ptr<OpenGymSpace>
+SharedGraphTestEnv::GetObservationSpace (uint32_t agent_id)
+{
+  return CreateObject<OpenGymGraphSpace> (1, 1, 0, 10);
+}
+
+Ptr<OpenGymDataContainer>
+SharedGraphTestEnv::GetObservation (uint32_t agent_id)
+{
+  if (agent_id == 2 && m_step % 2)
+    {
+      return 0;
+    }
+  return m_graph;
+}
+
+float
+SharedGraphTestEnv::GetReward (uint32_t agent_id)
+{
+  return 0.0;
+}
+
+bool
+SharedGraphTestEnv::GetDone (uint32_t agent_id)
+{
+  return false;
+}
+
+std::string
+SharedGraphTestEnv::GetInfo (uint32_t agent_id)
+{
+  return "";
+}
+
+bool
+SharedGraphTestEnv::ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  return true;
+}
+
+// A graph shared by several agents is filled once per step, an agent that
+// missed a graph message gets a keyframe
+class OpengymSharedGraphTestCase : public TestCase
+{
+public:
+  OpengymSharedGraphTestCase ();
+  virtual ~OpengymSharedGraphTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymSharedGraphTestCase::OpengymSharedGraphTestCase ()
+  : TestCase ("Opengym multi-agent graph shared by agents is filled once per step")
+{
+}
+
+OpengymSharedGraphTestCase::~OpengymSharedGraphTestCase ()
+{
+}
+
+void
+OpengymSharedGraphTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 8) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (7);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  std::string actBytes = ns3opengym::MultiAgentActMsg ().SerializeAsString ();
+
+  Ptr<SharedGraphTestEnv> env = CreateObject<SharedGraphTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  uint32_t size;
+  // per step: seq and keyframe flag of agents 0 and 1, then of agent 2
+  const uint32_t expected[4][4] = {{1, 1, 1, 1}, {2, 0, 0, 0}, {3, 0, 4, 1}, {5, 1, 0, 0}};
+  for (uint32_t step = 0; step < 4; step++)
+    {
+      env->m_step = step;
+      env->m_graph->SetNodeFeature (0, 0, step);
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      if (step == 0)
+        {
+          // init msg
+          agent->Receive (size, 0);
+          agent->Release ();
+        }
+      const uint8_t *data = agent->Receive (size, 0);
+      NS_TEST_ASSERT_MSG_NE (data, 0, "State msg missing");
+      ns3opengym::MultiAgentStateMsg stateMsg;
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse state msg");
+      agent->Release ();
+
+      ns3opengym::GraphDataContainer graphMsg[3];
+      for (int i = 0; i < 3; i++)
+        {
+          stateMsg.agentstatemsg (i).obsdata ().data ().UnpackTo (&graphMsg[i]);
+        }
+      NS_TEST_ASSERT_MSG_EQ (graphMsg[1].SerializeAsString (), graphMsg[0].SerializeAsString (),
+                             "Agents sharing the graph got different messages at step " << step);
+      NS_TEST_ASSERT_MSG_EQ (graphMsg[0].seq (), expected[step][0], "Wrong seq at step " << step);
+      NS_TEST_ASSERT_MSG_EQ (graphMsg[0].keyframe (), expected[step][1], "Wrong keyframe at step " << step);
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.agentstatemsg (2).has_obsdata (), expected[step][2] > 0,
+                             "Wrong observation of agent 2 at step " << step);
+      if (expected[step][2])
+        {
+          NS_TEST_ASSERT_MSG_EQ (graphMsg[2].seq (), expected[step][2], "Wrong seq of agent 2 at step " << step);
+          NS_TEST_ASSERT_MSG_EQ (graphMsg[2].keyframe (), expected[step][3],
+                                 "Agent 2 missed a message and got no keyframe at step " << step);
+        }
+    }
+}
+
+// Discrete space counting its serializations
+class CountingDiscreteSpace : public OpenGymDiscreteSpace
+{
+public:
+  CountingDiscreteSpace (int n)
+    : OpenGymDiscreteSpace (n),
+      m_descriptions (0)
+  {
+  }
+
+  virtual ns3opengym::SpaceDescription
+  GetSpaceDescription ()
+  {
+    m_descriptions++;
+    return OpenGymDiscreteSpace::GetSpaceDescription ();
+  }
+
+  uint32_t m_descriptions;
+};
+
+// Agents 0 and 1 share an action space object, agent 2 has an equal one
+// of its own and agent 3 a different one. The observation spaces of agents
+// 0 to 2 are equal objects, the one of agent 3 differs.
+class InternSpaceTestEnv : public OpenGymMultiEnv
+{
+public:
+  InternSpaceTestEnv (uint32_t port);
+
+  virtual Ptr<OpenGymSpace> GetActionSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymSpace> GetObservationSpace (uint32_t agent_id);
+  virtual Ptr<OpenGymDataContainer> GetObservation (uint32_t agent_id);
+  virtual float GetReward (uint32_t agent_id);
+  virtual bool GetDone (uint32_t agent_id);
+  virtual std::string GetInfo (uint32_t agent_id);
+  virtual bool ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action);
+
+  Ptr<CountingDiscreteSpace> m_sharedActionSpace;
+};
+
+InternSpaceTestEnv::InternSpaceTestEnv (uint32_t port)
+{
+  m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+  SetOpenGymPort (port);
+  for (uint32_t agent_id = 0; agent_id < 4; agent_id++)
+    {
+      AddAgentId (agent_id);
+    }
+  m_sharedActionSpace = CreateObject<CountingDiscreteSpace> (4);
+}
+
+Ptr<OpenGymSpace>
+InternSpaceTestEnv::GetActionSpace (uint32_t agent_id)
+{
+  if (agent_id < 2)
+    {
+      return m_sharedActionSpace;
+    }
+  return CreateObject<OpenGymDiscreteSpace> (agent_id == 2 ? 4 : 5);
+}
+
+Ptr<OpenGymSpace>
+InternSpaceTestEnv::GetObservationSpace (uint32_t agent_id)
+{
+  std::vector<uint32_t> shape = {agent_id < 3 ? 8u : 16u};
+  return CreateObject<OpenGymBoxSpace> (0, 1, shape, TypeNameGet<float> ());
+}
+
+Ptr<OpenGymDataContainer>
+InternSpaceTestEnv::GetObservation (uint32_t agent_id)
+{
+  return 0;
+}
+
+float
+InternSpaceTestEnv::GetReward (uint32_t agent_id)
+{
+  return 0.0;
+}
+
+bool
+InternSpaceTestEnv::GetDone (uint32_t agent_id)
+{
+  return false;
+}
+
+std::string
+InternSpaceTestEnv::GetInfo (uint32_t agent_id)
+{
+  return "";
+}
+
+bool
+InternSpaceTestEnv::ExecuteActions (uint32_t agent_id, Ptr<OpenGymDataContainer> action)
+{
+  return true;
+}
+
+// Spaces in MultiAgentInitMsg are sent once: deduplicated by object, then
+// by fingerprint, which does not change between runs
+class OpengymInternSpaceTestCase : public TestCase
+{
+public:
+  OpengymInternSpaceTestCase ();
+  virtual ~OpengymInternSpaceTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymInternSpaceTestCase::OpengymInternSpaceTestCase ()
+  : TestCase ("Opengym multi-agent init msg interns equal spaces once")
+{
+}
+
+OpengymInternSpaceTestCase::~OpengymInternSpaceTestCase ()
+{
+}
+
+void
+OpengymInternSpaceTestCase::DoRun (void)
+{
+  // the hash of the deterministic serialization, agents cache spaces by it
+  ns3opengym::SpaceDescription discrete = CreateObject<OpenGymDiscreteSpace> (4)->GetSpaceDescription ();
+  uint64_t fingerprint = OpenGymSpace::GetFingerprint (discrete);
+  NS_TEST_ASSERT_MSG_EQ (fingerprint, 623144828231756290ULL, "Fingerprint changed");
+  NS_TEST_ASSERT_MSG_EQ (OpenGymSpace::GetFingerprint (CreateObject<OpenGymDiscreteSpace> (4)->GetSpaceDescription ()),
+                         fingerprint, "Equal spaces with different fingerprints");
+  NS_TEST_ASSERT_MSG_NE (OpenGymSpace::GetFingerprint (CreateObject<OpenGymDiscreteSpace> (5)->GetSpaceDescription ()),
+                         fingerprint, "Different spaces with the same fingerprint");
+
+  uint32_t port = 40000 + (::getpid () + 15) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (1);
+  std::string bytes = simInitAck.SerializeAsString ();
+  agent->Send (bytes.data (), bytes.size ());
+  bytes = ns3opengym::MultiAgentActMsg ().SerializeAsString ();
+  agent->Send (bytes.data (), bytes.size ());
+
+  Ptr<InternSpaceTestEnv> env = CreateObject<InternSpaceTestEnv> (port);
+  env->Step ();
+  uint32_t size;
+  const uint8_t *data = agent->Receive (size, 0);
+  NS_TEST_ASSERT_MSG_NE (data, 0, "Init msg missing");
+  ns3opengym::MultiAgentInitMsg initMsg;
+  NS_TEST_ASSERT_MSG_EQ (initMsg.ParseFromArray (data, size), true, "Cannot parse init msg");
+  agent->Release ();
+
+  NS_TEST_ASSERT_MSG_EQ (env->m_sharedActionSpace->m_descriptions, 1, "Shared space serialized again");
+  NS_TEST_ASSERT_MSG_EQ (initMsg.spaces_size (), 4, "Equal spaces not interned once");
+  uint32_t obsIds[4] = {1, 1, 1, 3};
+  uint32_t actIds[4] = {2, 2, 2, 4};
+  NS_TEST_ASSERT_MSG_EQ (initMsg.agentinitmsg_size (), 4, "Agents missing");
+  for (int i = 0; i < initMsg.agentinitmsg_size (); i++)
+    {
+      const ns3opengym::AgentInitMsg &agentInitMsg = initMsg.agentinitmsg (i);
+      NS_TEST_ASSERT_MSG_EQ (agentInitMsg.obsspaceid (), obsIds[i], "Wrong observation space of agent " << i);
+      NS_TEST_ASSERT_MSG_EQ (agentInitMsg.actspaceid (), actIds[i], "Wrong action space of agent " << i);
+    }
+  for (int i = 0; i < initMsg.spaces_size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (initMsg.spaces (i).fingerprint (), OpenGymSpace::GetFingerprint (initMsg.spaces (i).space ()),
+                             "Fingerprint does not match space " << i + 1);
+    }
+  NS_TEST_ASSERT_MSG_EQ (initMsg.spaces (1).fingerprint (), fingerprint, "Wrong interned space");
+}
+
+// MultiDiscrete in the smallest sufficient width, MultiBinary as bits
+class OpengymMultiDiscreteTestCase : public TestCase
+{
+public:
+  OpengymMultiDiscreteTestCase ();
+  virtual ~OpengymMultiDiscreteTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymMultiDiscreteTestCase::OpengymMultiDiscreteTestCase ()
+  : TestCase ("Opengym MultiDiscrete and MultiBinary")
+{
+}
+
+OpengymMultiDiscreteTestCase::~OpengymMultiDiscreteTestCase ()
+{
+}
+
+void
+OpengymMultiDiscreteTestCase::DoRun (void)
+{
+  std::vector<uint32_t> nvec = {4, 16, 8};
+  Ptr<OpenGymMultiDiscreteContainer> windows = CreateObject<OpenGymMultiDiscreteContainer> (nvec);
+  NS_TEST_ASSERT_MSG_EQ (windows->SetValue (1, 15), true, "Value not set");
+  NS_TEST_ASSERT_MSG_EQ (windows->SetValue (0, 4), false, "Value out of nvec set");
+  ns3opengym::DataContainer msg;
+  windows->FillDataContainerPbMsg (msg, 8);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::MultiDiscrete, "Wrong type");
+  NS_TEST_ASSERT_MSG_EQ (msg.tensor ().dtype (), ns3opengym::UINT8, "Not the smallest width");
+  NS_TEST_ASSERT_MSG_EQ (msg.tensor ().data (), std::string ("\0\17\0", 3), "Wrong data");
+
+  Ptr<OpenGymMultiDiscreteContainer> received =
+      DynamicCast<OpenGymMultiDiscreteContainer> (OpenGymDataContainer::CreateFromDataContainerPbMsg (msg));
+  NS_TEST_ASSERT_MSG_NE (received, 0, "Not decoded");
+  NS_TEST_ASSERT_MSG_EQ (received->GetValue (1), 15, "Wrong decoded value");
+
+  nvec[2] = 1000;
+  windows = CreateObject<OpenGymMultiDiscreteContainer> (nvec);
+  windows->FillDataContainerPbMsg (msg, 8);
+  NS_TEST_ASSERT_MSG_EQ (msg.tensor ().dtype (), ns3opengym::UINT16, "Wrong width");
+  // older agents get a uint32 Box
+  windows->FillDataContainerPbMsg (msg, 7);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::Box, "Wrong legacy type");
+  NS_TEST_ASSERT_MSG_EQ (msg.tensor ().data ().size (), 12, "Wrong legacy size");
+
+  Ptr<OpenGymMultiBinaryContainer> mask = CreateObject<OpenGymMultiBinaryContainer> (10);
+  mask->SetValue (0, true);
+  mask->SetValue (9, true);
+  NS_TEST_ASSERT_MSG_EQ (mask->SetValue (10, true), false, "Bit out of range set");
+  mask->FillDataContainerPbMsg (msg, 8);
+  NS_TEST_ASSERT_MSG_EQ (msg.type (), ns3opengym::MultiBinary, "Wrong type");
+  NS_TEST_ASSERT_MSG_EQ (msg.tensor ().data (), std::string ("\1\2", 2), "Wrong bits");
+  Ptr<OpenGymMultiBinaryContainer> recycled = CreateObject<OpenGymMultiBinaryContainer> ();
+  NS_TEST_ASSERT_MSG_EQ (recycled->UpdateFromDataContainerPbMsg (msg), true, "Not updated");
+  NS_TEST_ASSERT_MSG_EQ (recycled->GetSize (), 10, "Wrong size");
+  NS_TEST_ASSERT_MSG_EQ (recycled->GetValue (9), true, "Wrong bit");
+  NS_TEST_ASSERT_MSG_EQ (recycled->GetValue (8), false, "Wrong bit");
+
+  opengym::Data value;
+  NS_TEST_ASSERT_MSG_EQ (value.Update (msg), true, "Not read as value");
+  NS_TEST_ASSERT_MSG_EQ (value.GetDtype (), ns3opengym::BOOL, "MultiBinary value is no bool Box");
+}
+
+// Agents with one common Box observation space, agent 1 is done
+class BatchedTestEnv : public OpenGymMultiValueEnv
+{
+public:
+  BatchedTestEnv (uint32_t port)
+  {
+    m_openGymMultiInterface->SetAttribute ("Transport", EnumValue (OpenGymMultiInterface::TRANSPORT_SHM));
+    SetOpenGymPort (port);
+    AddAgentId (4);
+    AddAgentId (7);
+    m_box.shape.assign (1, 3);
+  }
+
+  virtual Ptr<OpenGymSpace>
+  GetActionSpace (uint32_t agent_id)
+  {
+    return CreateObject<OpenGymDiscreteSpace> (2);
+  }
+  virtual Ptr<OpenGymSpace>
+  GetObservationSpace (uint32_t agent_id)
+  {
+    std::vector<uint32_t> shape = {3};
+    return CreateObject<OpenGymBoxSpace> (0, 255, shape, TypeNameGet<uint8_t> ());
+  }
+  virtual bool
+  GetObservationData (uint32_t agent_id, opengym::Data &obs)
+  {
+    m_box.data.assign (3, agent_id);
+    obs.Set (m_box);
+    return true;
+  }
+  virtual float
+  GetReward (uint32_t agent_id)
+  {
+    return agent_id * 0.5;
+  }
+  virtual bool
+  GetDone (uint32_t agent_id)
+  {
+    return agent_id == 7;
+  }
+  virtual std::string
+  GetInfo (uint32_t agent_id)
+  {
+    return "";
+  }
+  virtual bool
+  ExecuteActionData (uint32_t agent_id, const opengym::Data &action)
+  {
+    return true;
+  }
+
+private:
+  opengym::Box<uint8_t> m_box;
+};
+
+// Homogeneous Box observations arrive as one BatchedStateMsg
+class OpengymBatchedStateTestCase : public TestCase
+{
+public:
+  OpengymBatchedStateTestCase ();
+  virtual ~OpengymBatchedStateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymBatchedStateTestCase::OpengymBatchedStateTestCase ()
+  : TestCase ("Opengym multi-agent states with a common Box space are batched")
+{
+}
+
+OpengymBatchedStateTestCase::~OpengymBatchedStateTestCase ()
+{
+}
+
+void
+OpengymBatchedStateTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 3) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (4);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  std::string actBytes = ns3opengym::MultiAgentActMsg ().SerializeAsString ();
+
+  Ptr<BatchedTestEnv> env = CreateObject<BatchedTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  uint32_t size;
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  for (int step = 0; step < 10; step++)
+    {
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      if (step == 0)
+        {
+          // init msg
+          agent->Receive (size);
+          agent->Release ();
+        }
+      const uint8_t *data = agent->Receive (size);
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse state msg");
+      agent->Release ();
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.has_batch (), true, "State not batched");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.agentstatemsg_size (), 0, "Per-agent states sent as well");
+  const ns3opengym::BatchedStateMsg &batch = stateMsg.batch ();
+  NS_TEST_ASSERT_MSG_EQ (batch.agentids_size (), 2, "Wrong agent count");
+  NS_TEST_ASSERT_MSG_EQ (batch.agentids (1), 7, "Wrong agent id");
+  NS_TEST_ASSERT_MSG_EQ (batch.obs ().dtype (), ns3opengym::UINT8, "Wrong dtype");
+  NS_TEST_ASSERT_MSG_EQ (batch.obs ().shape_size (), 2, "Wrong rank");
+  NS_TEST_ASSERT_MSG_EQ (batch.obs ().shape (0), 2, "Wrong batch dimension");
+  NS_TEST_ASSERT_MSG_EQ (batch.obs ().data (), std::string ("\4\4\4\7\7\7"), "Wrong observations");
+  float reward;
+  std::memcpy (&reward, batch.reward ().data () + sizeof (float), sizeof (reward));
+  NS_TEST_ASSERT_MSG_EQ (reward, 3.5, "Wrong reward");
+  NS_TEST_ASSERT_MSG_EQ (batch.done (), std::string ("\2"), "Wrong done bitmask");
+}
+
+// BatchedTestEnv that gathers its state and executes its actions in one call per step
+class BatchedCallbackTestEnv : public BatchedTestEnv
+{
+public:
+  BatchedCallbackTestEnv (uint32_t port)
+    : BatchedTestEnv (port),
+      m_calls (0),
+      m_actionCalls (0),
+      m_actionSum (0)
+  {
+    SetBatchedCallbacks (true);
+  }
+
+  virtual void
+  GetObservations (const std::vector<uint32_t> &agentIds, std::vector<opengym::Data> &obs)
+  {
+    m_calls++;
+    m_box.data.assign (3, 0);
+    for (size_t i = 0; i < agentIds.size (); i++)
+      {
+        m_box.data[i] = agentIds[i];
+        obs[i].Set (m_box);
+      }
+  }
+  virtual void
+  GetRewards (const std::vector<uint32_t> &agentIds, std::vector<float> &rewards)
+  {
+    rewards.assign (agentIds.size (), 1);
+  }
+  virtual void
+  ExecuteActionsBatch (const std::vector<uint32_t> &agentIds,
+                       const std::vector<const opengym::Data *> &actions)
+  {
+    m_actionCalls++;
+    for (size_t i = 0; i < agentIds.size (); i++)
+      {
+        m_actionSum += agentIds[i] * actions[i]->GetValue ();
+      }
+  }
+
+  uint32_t m_calls;
+  uint32_t m_actionCalls;
+  uint32_t m_actionSum;
+
+private:
+  opengym::Box<uint8_t> m_box;
+};
+
+// One call of the batched env functions per step, the per-agent ones fill the rest
+class OpengymBatchedCallbackTestCase : public TestCase
+{
+public:
+  OpengymBatchedCallbackTestCase ();
+  virtual ~OpengymBatchedCallbackTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymBatchedCallbackTestCase::OpengymBatchedCallbackTestCase ()
+  : TestCase ("Opengym multi-agent env gathers all agents in one batched call")
+{
+}
+
+OpengymBatchedCallbackTestCase::~OpengymBatchedCallbackTestCase ()
+{
+}
+
+void
+OpengymBatchedCallbackTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 4) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (4);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+
+  // Discrete 2 for both agents
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  discreteContainerPbMsg.set_data (2);
+  for (uint32_t agentId = 4; agentId <= 7; agentId += 3)
+    {
+      ns3opengym::AgentActMsg *agentActMsg = multiAgentActMsg.add_agentactmsg ();
+      agentActMsg->set_agentid (agentId);
+      agentActMsg->mutable_actdata ()->set_type (ns3opengym::Discrete);
+      agentActMsg->mutable_actdata ()->mutable_data ()->PackFrom (discreteContainerPbMsg);
+    }
+  std::string actBytes = multiAgentActMsg.SerializeAsString ();
+
+  Ptr<BatchedCallbackTestEnv> env = CreateObject<BatchedCallbackTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  uint32_t size;
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  for (int step = 0; step < 5; step++)
+    {
+      agent->Send (actBytes.data (), actBytes.size ());
+      env->Step ();
+      if (step == 0)
+        {
+          // init msg
+          agent->Receive (size);
+          agent->Release ();
+        }
+      const uint8_t *data = agent->Receive (size);
+      NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse state msg");
+      agent->Release ();
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (env->m_calls, 5, "GetObservations not called once per step");
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionCalls, 5, "ExecuteActionsBatch not called once per step");
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionSum, 5 * (4 + 7) * 2, "Wrong actions executed");
+  const ns3opengym::BatchedStateMsg &batch = stateMsg.batch ();
+  NS_TEST_ASSERT_MSG_EQ (batch.obs ().data (), std::string ("\4\0\0\4\7\0", 6), "Wrong observations");
+  float reward;
+  std::memcpy (&reward, batch.reward ().data () + sizeof (float), sizeof (reward));
+  NS_TEST_ASSERT_MSG_EQ (reward, 1, "Wrong batched reward");
+  // GetDones default calls GetDone per agent
+  NS_TEST_ASSERT_MSG_EQ (batch.done (), std::string ("\2"), "Wrong done bitmask");
+}
+
+// BatchedCallbackTestEnv whose rewards show the actions executed so far
+class BranchTestEnv : public BatchedCallbackTestEnv
+{
+public:
+  BranchTestEnv (uint32_t port)
+    : BatchedCallbackTestEnv (port)
+  {
+  }
+
+  virtual void
+  GetRewards (const std::vector<uint32_t> &agentIds, std::vector<float> &rewards)
+  {
+    rewards.assign (agentIds.size (), m_actionSum);
+  }
+};
+
+// Branches run in forked copies and leave the state of the simulation as it was
+class OpengymBranchTestCase : public TestCase
+{
+public:
+  OpengymBranchTestCase ();
+  virtual ~OpengymBranchTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymBranchTestCase::OpengymBranchTestCase ()
+  : TestCase ("Opengym multi-agent env evaluates branches in forked copies")
+{
+}
+
+OpengymBranchTestCase::~OpengymBranchTestCase ()
+{
+}
+
+static void
+AddDiscreteActions (ns3opengym::MultiAgentActMsg &multiAgentActMsg, uint32_t value)
+{
+  ns3opengym::DiscreteDataContainer discreteContainerPbMsg;
+  discreteContainerPbMsg.set_data (value);
+  for (uint32_t agentId = 4; agentId <= 7; agentId += 3)
+    {
+      ns3opengym::AgentActMsg *agentActMsg = multiAgentActMsg.add_agentactmsg ();
+      agentActMsg->set_agentid (agentId);
+      agentActMsg->mutable_actdata ()->set_type (ns3opengym::Discrete);
+      agentActMsg->mutable_actdata ()->mutable_data ()->PackFrom (discreteContainerPbMsg);
+    }
+}
+
+void
+OpengymBranchTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 5) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (4);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  AddDiscreteActions (multiAgentActMsg, 2);
+  std::string actBytes = multiAgentActMsg.SerializeAsString ();
+
+  // two candidates for two steps: 1 then 3, and 3 only
+  ns3opengym::MultiAgentActMsg branchMsg;
+  ns3opengym::BranchRequest *request = branchMsg.mutable_branch ();
+  request->set_horizon (2);
+  request->set_maxparallel (1);
+  ns3opengym::BranchPlan *plan = request->add_plans ();
+  AddDiscreteActions (*plan->add_steps (), 1);
+  AddDiscreteActions (*plan->add_steps (), 3);
+  AddDiscreteActions (*request->add_plans ()->add_steps (), 3);
+  std::string branchBytes = branchMsg.SerializeAsString ();
+
+  Ptr<BranchTestEnv> env = CreateObject<BranchTestEnv> (port);
+  pid_t parent = ::getpid ();
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  uint32_t size;
+  ns3opengym::MultiAgentInitMsg initMsg;
+  const uint8_t *data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (initMsg.ParseFromArray (data, size), true, "Cannot parse init msg");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (initMsg.branching (), true, "Branching not offered in lockstep");
+  agent->Receive (size);
+  agent->Release ();
+
+  agent->Send (branchBytes.data (), branchBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  // the copies go on stepping until their horizon and exit
+  while (::getpid () != parent)
+    {
+      env->Step ();
+    }
+  agent->Receive (size);
+  agent->Release ();
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse branch msg");
+  agent->Release ();
+
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.branchresults_size (), 2, "Wrong branch count");
+  // 22 from the step before the branch, 11 per step and action value after it
+  float expected[2][2] = {{33, 66}, {55, 88}};
+  for (int k = 0; k < 2; k++)
+    {
+      const ns3opengym::BranchResult &result = stateMsg.branchresults (k);
+      NS_TEST_ASSERT_MSG_EQ (result.failed (), false, "Branch " << k << " failed");
+      NS_TEST_ASSERT_MSG_EQ (result.steps (), 2, "Wrong branch steps");
+      NS_TEST_ASSERT_MSG_EQ (result.agentids_size (), 2, "Wrong branch agents");
+      NS_TEST_ASSERT_MSG_EQ (result.rewards_size (), 4, "Wrong reward count");
+      NS_TEST_ASSERT_MSG_EQ (result.rewards (1), expected[k][0], "Wrong first step reward");
+      NS_TEST_ASSERT_MSG_EQ (result.rewards (3), expected[k][1], "Wrong second step reward");
+      NS_TEST_ASSERT_MSG_EQ (result.dones (1), true, "Wrong branch done");
+    }
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionSum, 44, "Branches changed the simulation");
+}
+
+// BatchedCallbackTestEnv that starts its episodes over in place
+class SoftResetTestEnv : public BatchedCallbackTestEnv
+{
+public:
+  SoftResetTestEnv (uint32_t port)
+    : BatchedCallbackTestEnv (port),
+      m_resets (0),
+      m_canReset (true)
+  {
+  }
+
+  virtual bool
+  ResetEpisode (void)
+  {
+    if (!m_canReset)
+      {
+        return false;
+      }
+    m_resets++;
+    m_actionSum = 0;
+    return true;
+  }
+
+  uint32_t m_resets;
+  bool m_canReset;
+};
+
+// A resetReq is answered with the first state of the next episode
+class OpengymSoftResetTestCase : public TestCase
+{
+public:
+  OpengymSoftResetTestCase ();
+  virtual ~OpengymSoftResetTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymSoftResetTestCase::OpengymSoftResetTestCase ()
+  : TestCase ("Opengym multi-agent env resets its episode in place")
+{
+}
+
+OpengymSoftResetTestCase::~OpengymSoftResetTestCase ()
+{
+}
+
+void
+OpengymSoftResetTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 6) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (4);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  AddDiscreteActions (multiAgentActMsg, 2);
+  std::string actBytes = multiAgentActMsg.SerializeAsString ();
+  ns3opengym::MultiAgentActMsg resetMsg;
+  resetMsg.set_resetreq (true);
+  std::string resetBytes = resetMsg.SerializeAsString ();
+
+  Ptr<SoftResetTestEnv> env = CreateObject<SoftResetTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  uint32_t size;
+  ns3opengym::MultiAgentInitMsg initMsg;
+  const uint8_t *data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (initMsg.ParseFromArray (data, size), true, "Cannot parse init msg");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (initMsg.softreset (), true, "Soft reset not offered in lockstep");
+  agent->Receive (size);
+  agent->Release ();
+
+  // accepted: a second state starts the next episode, then the actions run
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  agent->Send (resetBytes.data (), resetBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  agent->Receive (size);
+  agent->Release ();
+  data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse reset state");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.episode (), 1, "Episode not counted");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), 2, "Wrong reset state index");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.batch ().agentids_size (), 2, "Not all agents in the reset state");
+  NS_TEST_ASSERT_MSG_EQ (env->m_resets, 1, "ResetEpisode not called");
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionSum, 22, "Actions not executed after the reset");
+
+  // refused: the last state stays the current one, nothing is gathered
+  env->m_canReset = false;
+  uint32_t calls = env->m_calls;
+  agent->Send (resetBytes.data (), resetBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  agent->Receive (size);
+  agent->Release ();
+  data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse refusal");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.resetfailed (), true, "Refusal not flagged");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.episode (), 1, "Refused reset counted");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), 3, "Refusal not for the last state");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.has_batch () || stateMsg.agentstatemsg_size () > 0, false,
+                         "States sent with the refusal");
+  NS_TEST_ASSERT_MSG_EQ (env->m_calls, calls + 1, "State gathered again for the refusal");
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionSum, 44, "Actions not executed after the refused reset");
+}
+
+// A policy pushed by the agent acts in the simulation until the rollout is due
+class OpengymPolicyTestCase : public TestCase
+{
+public:
+  OpengymPolicyTestCase ();
+  virtual ~OpengymPolicyTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymPolicyTestCase::OpengymPolicyTestCase ()
+  : TestCase ("Opengym multi-agent env runs an offloaded policy")
+{
+}
+
+OpengymPolicyTestCase::~OpengymPolicyTestCase ()
+{
+}
+
+static std::string
+PolicyBytes (uint32_t inputs, uint32_t maxStaleness)
+{
+  // output 0 = obs[1], output 1 = obs[0]
+  float weights[2][3] = {{0, 1, 0}, {1, 0, 0}};
+  ns3opengym::MultiAgentActMsg policyMsg;
+  ns3opengym::PolicyMsg *request = policyMsg.mutable_policy ();
+  request->set_maxstaleness (maxStaleness);
+  ns3opengym::DenseLayer *layer = request->add_policies ()->add_layers ();
+  layer->set_inputs (inputs);
+  layer->set_outputs (2);
+  layer->set_weights (std::string (reinterpret_cast<const char *> (weights), 2 * inputs * sizeof (float)));
+  return policyMsg.SerializeAsString ();
+}
+
+void
+OpengymPolicyTestCase::DoRun (void)
+{
+  uint32_t port = 40000 + (::getpid () + 7) % 20000;
+  Ptr<OpenGymShmChannel> agent = Create<OpenGymShmChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (agent->Create (OpenGymShmChannel::GetSegmentName (port), 1 << 16), true,
+                         "Cannot create shm segment");
+  ns3opengym::SimInitAck simInitAck;
+  simInitAck.set_done (true);
+  simInitAck.set_rawtensorversion (4);
+  std::string ackBytes = simInitAck.SerializeAsString ();
+  ns3opengym::MultiAgentActMsg multiAgentActMsg;
+  AddDiscreteActions (multiAgentActMsg, 2);
+  std::string actBytes = multiAgentActMsg.SerializeAsString ();
+  std::string badPolicyBytes = PolicyBytes (2, 3);
+  std::string policyBytes = PolicyBytes (3, 3);
+
+  Ptr<BranchTestEnv> env = CreateObject<BranchTestEnv> (port);
+  agent->Send (ackBytes.data (), ackBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  env->Step ();
+  uint32_t size;
+  ns3opengym::MultiAgentInitMsg initMsg;
+  const uint8_t *data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (initMsg.ParseFromArray (data, size), true, "Cannot parse init msg");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (initMsg.policyoffload (), true, "Policy offload not offered in lockstep");
+  agent->Receive (size);
+  agent->Release ();
+
+  // a policy that does not fit is refused, the next one acts for three
+  // steps, then the actions of the agent run again
+  agent->Send (badPolicyBytes.data (), badPolicyBytes.size ());
+  agent->Send (policyBytes.data (), policyBytes.size ());
+  agent->Send (actBytes.data (), actBytes.size ());
+  for (int i = 0; i < 4; i++)
+    {
+      env->Step ();
+    }
+  agent->Receive (size);
+  agent->Release ();
+  ns3opengym::MultiAgentStateMsg stateMsg;
+  data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse error msg");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.rollout ().error ().empty (), false, "Wrong input size accepted");
+  data = agent->Receive (size);
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.ParseFromArray (data, size), true, "Cannot parse rollout msg");
+  agent->Release ();
+  NS_TEST_ASSERT_MSG_EQ (env->m_actionSum, 56, "Wrong actions executed");
+  // the first row is the state the agent answered, it is not gathered
+  // again: one call per state sent and per policy step
+  NS_TEST_ASSERT_MSG_EQ (env->m_calls, 5, "Observations of the answered state gathered again");
+
+  const ns3opengym::PolicyRollout &rollout = stateMsg.rollout ();
+  NS_TEST_ASSERT_MSG_EQ (rollout.error (), "", "Policy refused");
+  NS_TEST_ASSERT_MSG_EQ (stateMsg.stepidx (), 2, "Wrong rollout index");
+  NS_TEST_ASSERT_MSG_EQ (rollout.agentids_size (), 2, "Wrong rollout agents");
+  NS_TEST_ASSERT_MSG_EQ (rollout.steps (), 4, "Wrong rollout rows");
+  NS_TEST_ASSERT_MSG_EQ (rollout.obssize (), 3, "Wrong rollout obs size");
+  NS_TEST_ASSERT_MSG_EQ (rollout.actionsize (), 1, "Wrong rollout action size");
+  NS_TEST_ASSERT_MSG_EQ (rollout.obs ().size (), 4 * 2 * 3 * sizeof (float), "Wrong obs bytes");
+  NS_TEST_ASSERT_MSG_EQ (rollout.dones ().size (), 4 * 2, "Wrong done bytes");
+  std::vector<float> obs (4 * 2 * 3);
+  std::vector<float> actions (3 * 2);
+  std::vector<float> rewards (4 * 2);
+  NS_TEST_ASSERT_MSG_EQ (rollout.actions ().size (), actions.size () * sizeof (float), "Wrong action bytes");
+  NS_TEST_ASSERT_MSG_EQ (rollout.rewards ().size (), rewards.size () * sizeof (float), "Wrong reward bytes");
+  std::memcpy (obs.data (), rollout.obs ().data (), rollout.obs ().size ());
+  std::memcpy (actions.data (), rollout.actions ().data (), rollout.actions ().size ());
+  std::memcpy (rewards.data (), rollout.rewards ().data (), rollout.rewards ().size ());
+  NS_TEST_ASSERT_MSG_EQ (obs[0], 4, "Wrong observation of agent 4");
+  NS_TEST_ASSERT_MSG_EQ (obs[4], 7, "Wrong observation of agent 7");
+  // agent 4 takes action 1, agent 7 action 0: 4 more per step
+  for (int step = 0; step < 4; step++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (rewards[step * 2], 22 + 4 * step, "Wrong reward in row " << step);
+    }
+  for (int step = 0; step < 3; step++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (actions[step * 2], 1, "Wrong action of agent 4");
+      NS_TEST_ASSERT_MSG_EQ (actions[step * 2 + 1], 0, "Wrong action of agent 7");
+    }
+}
+
+// Offloaded policy outputs out of range of the table or the action dtype
+class OpengymPolicyRangeTestCase : public TestCase
+{
+public:
+  OpengymPolicyRangeTestCase ();
+  virtual ~OpengymPolicyRangeTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+OpengymPolicyRangeTestCase::OpengymPolicyRangeTestCase ()
+  : TestCase ("Opengym offloaded policy clamps table bins and saturates actions")
+{
+}
+
+OpengymPolicyRangeTestCase::~OpengymPolicyRangeTestCase ()
+{
+}
+
+void
+OpengymPolicyRangeTestCase::DoRun (void)
+{
+  // one input of 4 bins, the output is the bin
+  ns3opengym::AgentPolicy msg;
+  msg.add_tabledims (4);
+  float table[4] = {0, 1, 2, 3};
+  msg.set_table (std::string (reinterpret_cast<const char *> (table), sizeof (table)));
+  Ptr<OpenGymPolicy> policy = Create<OpenGymPolicy> ();
+  std::string error;
+  NS_TEST_ASSERT_MSG_EQ (policy->Load (msg, error), true, "Table refused: " << error);
+  float inputs[6] = {2.5, -7, 1e30, std::numeric_limits<float>::infinity (),
+                     -std::numeric_limits<float>::infinity (), std::numeric_limits<float>::quiet_NaN ()};
+  float bins[6] = {2, 0, 3, 3, 0, 0};
+  for (int i = 0; i < 6; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (policy->Evaluate (&inputs[i])[0], bins[i], "Wrong bin of input " << inputs[i]);
+    }
+
+  float values[5] = {300, -300, 1.6, std::numeric_limits<float>::quiet_NaN (), 1e30};
+  std::string bytes;
+  OpenGymPolicy::EncodeFloats (ns3opengym::INT8, values, 5, bytes);
+  NS_TEST_ASSERT_MSG_EQ (bytes, std::string ("\x7f\x80\x02\x00\x7f", 5), "Wrong int8 elements");
+  OpenGymPolicy::EncodeFloats (ns3opengym::UINT8, values, 5, bytes);
+  NS_TEST_ASSERT_MSG_EQ (bytes, std::string ("\xff\x00\x02\x00\xff", 5), "Wrong uint8 elements");
+  OpenGymPolicy::EncodeFloats (ns3opengym::BOOL, values, 5, bytes);
+  NS_TEST_ASSERT_MSG_EQ (bytes, std::string ("\x01\x00\x01\x00\x01", 5), "Wrong bool elements");
+  int64_t wide[5];
+  OpenGymPolicy::EncodeFloats (ns3opengym::INT64, values, 5, bytes);
+  std::memcpy (wide, bytes.data (), sizeof (wide));
+  NS_TEST_ASSERT_MSG_EQ (wide[4], std::numeric_limits<int64_t>::max (), "int64 element not saturated");
+  NS_TEST_ASSERT_MSG_EQ (wide[1], -300, "Wrong int64 element");
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -61,6 +2554,31 @@ OpengymTestSuite::OpengymTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new OpengymTestCase1, TestCase::QUICK);
+  AddTestCase (new OpengymShmChannelTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymSteadyStepTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymAgentIntervalTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymDeltaObservationTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymPipelinedTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymStepDeadlineTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymLateAgentTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymWorkerTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymBoxContainerTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymBoxDtypeTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymContainerPoolTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymValueTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymBatchedStateTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymBatchedCallbackTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymBranchTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymSoftResetTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymPolicyTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymPolicyRangeTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymDictSlotTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymSparseBoxTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymGraphTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymGraphRemoveEdgeTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymSharedGraphTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymMultiDiscreteTestCase, TestCase::QUICK);
+  AddTestCase (new OpengymInternSpaceTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite